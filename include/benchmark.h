@@ -0,0 +1,117 @@
+#ifndef PROJECT_4_BENCHMARK_H
+#define PROJECT_4_BENCHMARK_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../include/drawing_lib.h"
+
+// Camera position and the point it looks at, time seconds of animation after the start of the benchmark.
+struct CameraKeyframe
+{
+    float time{0.0f};
+    glm::vec3 position{0.0f, 1.0f, 10.0f};
+    glm::vec3 target{0.0f};
+};
+
+// Benchmark scenario, read from a text file with one setting per line ('#' starts a comment):
+//   name <text>                       name reported in the results
+//   frames <N>                        frames measured
+//   warmup <N>                        frames rendered before measuring starts
+//   planes <N>                        number of planes
+//   surface day|night                 surface map of the Earth
+//   camera <time> <x y z> [<x y z>]   keyframe of the camera path: position and target (the origin by default)
+// The camera moves linearly between keyframes and stays at the first and last one before and after them.
+struct BenchmarkScenario
+{
+    std::string name{"default"};
+    int frame_count{600};
+    int warmup_frames{60};
+    int plane_count{1};
+    bool night{false};
+    std::vector<CameraKeyframe> camera_path;
+
+    static bool load(const std::string &filepath, BenchmarkScenario &scenario);
+    CameraKeyframe cameraAt(float time) const;
+};
+
+// Summary of a series of times in milliseconds.
+struct FrameTimeStats
+{
+    double mean{0.0};
+    double min{0.0};
+    double max{0.0};
+    double p50{0.0};
+    double p95{0.0};
+    double p99{0.0};
+    double standard_deviation{0.0};
+
+    static FrameTimeStats compute(std::vector<double> samples);
+};
+
+// GPU time of a span of GL commands per frame, measured with GL_TIME_ELAPSED queries. Results are read back once they
+// are available, so measuring only waits for the GPU when it's kQueryCount frames behind.
+class GpuTimer
+{
+public:
+    GpuTimer();
+    ~GpuTimer();
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    void begin();
+    void end();
+    // reads back the results that have arrived, or all of them if wait is set
+    void collect(bool wait);
+    // milliseconds of the spans read back so far, in the order they were measured
+    const std::vector<double>& milliseconds() const { return milliseconds_; }
+
+private:
+    static constexpr int kQueryCount = 4;
+
+    GLuint queries_[kQueryCount]{};
+    int next_query_{0};
+    int pending_count_{0};
+    std::vector<double> milliseconds_;
+};
+
+// Renders a scenario with a fixed frame time and writes its frame times as JSON.
+class Benchmark
+{
+public:
+    explicit Benchmark(const BenchmarkScenario &scenario) : scenario_(scenario) {}
+
+    // present shows the frame (swap buffers, poll events), it's part of the measured CPU frame time
+    void run(DrawingLib &drawing_lib, Plane &plane, Earth &earth, Skybox &skybox, const std::function<void()> &present);
+    bool writeJson(const std::string &filepath) const;
+    void printSummary() const;
+
+private:
+    BenchmarkScenario scenario_;
+
+    // measured frames only: the time from the start of one frame to the start of the next, the time spent in
+    // drawScene, and the GPU time of drawScene
+    std::vector<double> frame_ms_;
+    std::vector<double> render_ms_;
+    std::vector<double> gpu_ms_;
+    // stages of the frame pipeline of the frames drawn while measuring, see FramePipelineStats
+    std::vector<double> prepare_ms_;
+    std::vector<double> prepare_wait_ms_;
+    std::vector<double> gl_wait_ms_;
+    std::vector<double> draw_ms_;
+    int frames_in_flight_{0};
+    // bounding spheres drawn and culled, summed over the measured frames
+    uint64_t visible_{0};
+    uint64_t frustum_culled_{0};
+    uint64_t horizon_culled_{0};
+
+    std::string renderer_;
+    std::string version_;
+};
+
+#endif //PROJECT_4_BENCHMARK_H
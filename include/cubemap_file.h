@@ -0,0 +1,52 @@
+#ifndef PROJECT_4_CUBEMAP_FILE_H
+#define PROJECT_4_CUBEMAP_FILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../include/mapped_file.h"
+#include "../include/texture_codec.h"
+
+struct CubemapHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t size;
+    uint32_t channels;
+    uint64_t faces_offset;
+};
+
+// Six faces of a cube map packed into one file (.cubemap), so that a cube map is read in one pass instead of six image
+// files being opened and decoded. The faces are square and of the same size, stored one after another in the order of
+// GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, uncompressed with rows ordered bottom to top, and are read straight from the
+// memory-mapped file.
+class CubemapFile
+{
+public:
+    static constexpr uint32_t kVersion = 1;
+    static constexpr int kFaceCount = 6;
+
+    // the file next to the directory of the first face, e.g. textures/sky.cubemap for textures/sky/right.jpg; empty if
+    // the face isn't in a directory
+    static std::string pathFor(const std::vector<std::string> &face_filepaths);
+    // checks that there are 6 faces, square and of the same size and number of channels; error describes the first
+    // face that doesn't fit
+    static bool validateFaces(const std::vector<ImageData> &faces, std::string &error);
+    static bool write(const std::string &filepath, const std::vector<ImageData> &faces);
+
+    bool open(const std::string &filepath);
+    void close();
+
+    bool isOpen() const { return file_.isOpen(); }
+    int size() const { return static_cast<int>(header_.size); }
+    int channels() const { return static_cast<int>(header_.channels); }
+    size_t faceBytes() const;
+    const uint8_t* faceData(int face) const;
+
+private:
+    MappedFile file_;
+    CubemapHeader header_{};
+};
+
+#endif //PROJECT_4_CUBEMAP_FILE_H
@@ -0,0 +1,59 @@
+#ifndef PROJECT_4_CULLING_H
+#define PROJECT_4_CULLING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// Bounding spheres tested by a Culler since its last resetStats(), i.e. in the last frame.
+struct CullingStats
+{
+    uint32_t tested{0};
+    uint32_t visible{0};
+    uint32_t frustum_culled{0};     // outside the view frustum
+    uint32_t horizon_culled{0};     // inside the frustum, but hidden behind the occluder
+};
+
+// Visibility of bounding spheres for the camera of a frame. A sphere is culled if it's entirely outside one of the planes
+// of the view frustum, or hidden behind the occluder sphere (the Earth): entirely inside the cone the occluder's silhouette
+// casts away from the camera, and behind the plane of its horizon circle, where every ray from the camera has hit the
+// occluder already. Spheres given as a structure of arrays are tested 4 at a time with SSE2.
+class Culler
+{
+public:
+    // planes are extracted from the view-projection matrix, so the frustum is the one the objects are drawn with
+    void setView(const glm::mat4 &view_projection, const glm::vec3 &camera_position);
+    // a radius of 0 turns horizon culling off; it's off as well while the camera is inside the occluder
+    void setOccluder(const glm::vec3 &center, float radius);
+
+    bool isVisible(const glm::vec3 &center, float radius);
+    // writes the indices of the visible ones of count spheres of the same radius into visible, returns how many there are
+    size_t cullSpheres(const float* x, const float* y, const float* z, float radius, size_t count, uint32_t* visible);
+
+    void resetStats() { stats_ = CullingStats(); }
+    const CullingStats& stats() const { return stats_; }
+
+private:
+    void updateHorizon();
+    // 0 if visible, 1 if outside the frustum, 2 if behind the horizon
+    int classify(float x, float y, float z, float radius) const;
+
+    // (a, b, c, d) of the left, right, bottom, top, near and far plane, with normals of unit length pointing inwards
+    float planes_[6][4]{};
+    glm::vec3 camera_position_{0.0f};
+    glm::vec3 occluder_center_{0.0f};
+    float occluder_radius_{0.0f};
+
+    // horizon test, derived from camera and occluder: unit axis of the silhouette cone from the camera towards the
+    // occluder, sine and cosine of its half angle, and the distance of the horizon plane along the axis
+    bool horizon_enabled_{false};
+    glm::vec3 cone_axis_{0.0f};
+    float cone_sin_{0.0f};
+    float cone_cos_{1.0f};
+    float camera_along_axis_{0.0f};
+    float horizon_along_axis_{0.0f};
+
+    CullingStats stats_;
+};
+
+#endif //PROJECT_4_CULLING_H
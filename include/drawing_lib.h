@@ -2,28 +2,114 @@
 #define PROJECT_4_DRAWING_LIB_H
 #include <GLFW/glfw3.h>
 
+#include <memory>
+
+#include "../include/job_system.h"
 #include "../include/object.h"
+#include "../include/render_queue.h"
+#include "../include/simulation_clock.h"
+#include "../include/uniform_buffer.h"
 
+// Milliseconds the stages of the frame pipeline spent on the last frame drawn, and waiting for each other
+struct FramePipelineStats
+{
+    double prepare_ms{0.0};         // simulation, culling and building the draw packets, on the job system
+    double prepare_wait_ms{0.0};    // from the end of preparing the previous frame to the start of this one
+    double gl_wait_ms{0.0};         // the GL thread waiting for a frame to be prepared
+    double draw_ms{0.0};            // the GL thread drawing the frame
+};
 
+// Draws the scene in a pipeline of frames: while the GL thread draws one frame, the next one is simulated, culled and
+// turned into draw packets on the job system. Each frame in flight has a slot of its own with its render queue, frame
+// constants and the state the renderables keep for it.
 class DrawingLib{
 public:
     DrawingLib() = default;
+    ~DrawingLib();
+    DrawingLib(const DrawingLib&) = delete;
+    DrawingLib& operator=(const DrawingLib&) = delete;
     GLFWwindow* createWindow() const;
     void getWindowSize(GLFWwindow* window);
-    void drawScene(GLFWwindow* window, Plane& plane, Earth& earth, Skybox& skybox);
+    // size of the framebuffer drawn to when there is no window
+    void setViewportSize(int width, int height);
+    // starts preparing the next frame and draws the oldest prepared one into the bound framebuffer, the caller presents it
+    void drawScene(Plane& plane, Earth& earth, Skybox& skybox);
+    // draws the frames that are still in the pipeline; objects may only be destroyed after it
+    void finishFrames();
+    // 1 prepares and draws every frame in the same call to drawScene(), 2 and more let the frame drawn lag behind the
+    // one prepared by one less; at most kMaxFramesInFlight. Finishes the frames in flight.
+    void setFramesInFlight(int count);
+    int framesInFlight() const { return frames_in_flight_; }
+    const FramePipelineStats& pipelineStats() const { return pipeline_stats_; }
     void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
     void defineCallbackFunction(GLFWwindow* window);
+    void shutdown();
+
+    // every frame advances the simulation by exactly this time instead of the measured frame time, if it's positive,
+    // so that the same frames are rendered at any frame rate
+    void setFixedFrameTime(double seconds) { fixed_frame_time_ = seconds; }
+    const SimulationClock& clock() const { return clock_; }
+    void setCamera(const glm::vec3 &position, const glm::vec3 &target)
+    {
+        camera_position_ = position;
+        target_position_ = target;
+    }
+    // bounding spheres tested, drawn and culled in the last frame drawn
+    const CullingStats& cullingStats() const { return frames_[drawn_slot_].queue.culler().stats(); }
 
 private:
+    struct FrameSlot
+    {
+        RenderQueue queue;
+        FrameConstants constants;
+        int viewport_width{0};
+        int viewport_height{0};
+        Earth* earth{nullptr};
+        JobCounter prepared;
+        double prepare_start{0.0};
+        double prepare_end{0.0};
+        double prepare_wait{0.0};
+    };
+
+    // runs on the job system
+    void prepareFrame(FrameSlot &slot, Plane &plane, Earth &earth, Skybox &skybox, int ticks, float alpha, bool switch_time,
+                      const glm::vec3 &camera_position, const glm::vec3 &target_position);
+    void drawFrame(FrameSlot &slot, double gl_wait);
+    // waits for the frame to be prepared, running jobs in the meantime; returns the seconds waited
+    double waitForFrame(const FrameSlot &slot);
+
     int window_width_{1920};
     int window_height_{1080};
 
     bool switch_time_{false};
 
+    SimulationClock clock_;
+    double fixed_frame_time_{0.0};
+    double last_frame_time_{-1.0};
+
     glm::vec3 camera_position_= glm::vec3(0.0f, 1.0f, 10.0);
     glm::vec3 target_position_ = glm::vec3(0.0f, 0.0f, 0.0f);
     glm::vec3 up_direction_ = glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::vec3 light_direction_ = glm::vec3(-1.0f, 0.0f, -1.0f);
+
+    static constexpr float kFarPlane = 100.0f;
+
+    FrameSlot frames_[kMaxFramesInFlight];
+    int frames_in_flight_{2};
+    // frames started and drawn so far; frame n uses slot n % frames_in_flight_
+    long frames_started_{0};
+    long frames_drawn_{0};
+    int drawn_slot_{0};
+    // end of preparing the last frame, only used by the job preparing the next one
+    double last_prepare_end_{-1.0};
+    FramePipelineStats pipeline_stats_;
+
+    // one region per frame the GPU may still be reading
+    static constexpr int kGpuFramesInFlight = 3;
+    std::unique_ptr<UniformBufferRing> frame_constants_;
 
+    // shared with the libraries; the destructor waits for the frames being prepared before the frame slots are destroyed
+    JobSystem &jobs_{JobSystem::instance()};
 };
 
 #endif //PROJECT_4_DRAWING_LIB_H
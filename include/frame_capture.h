@@ -0,0 +1,53 @@
+#ifndef PROJECT_4_FRAME_CAPTURE_H
+#define PROJECT_4_FRAME_CAPTURE_H
+
+#include <glad/glad.h>
+#include <string>
+
+// Offscreen render target whose frames can be saved as RGB PNG images. The colour buffer is copied into one of two pixel
+// pack buffers by the GPU; the copy is only mapped once its fence has signalled, up to two frames later, so capturing
+// doesn't wait for the GPU to finish the frame.
+class FrameCapture
+{
+public:
+    FrameCapture(int width, int height);
+    ~FrameCapture();
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    bool isComplete() const { return complete_; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+    // binds the render target as the framebuffer drawn to
+    void bind() const;
+
+    // starts reading back the frame rendered last, it's written to the file once it has arrived
+    void capture(const std::string &png_filepath);
+    // writes the captures that have arrived in the meantime, without waiting for any; called once per frame
+    void poll();
+    // waits for all captures and writes them
+    void finish();
+
+private:
+    struct Readback
+    {
+        GLuint pack_buffer{0};
+        GLsync fence{nullptr};
+        std::string png_filepath;
+    };
+    static constexpr int kReadbackCount = 2;
+
+    void write(Readback &readback);
+
+    int width_;
+    int height_;
+    GLuint framebuffer_{0};
+    GLuint color_{0};
+    GLuint depth_{0};
+    bool complete_{false};
+
+    Readback readbacks_[kReadbackCount];
+    int next_readback_{0};
+};
+
+#endif //PROJECT_4_FRAME_CAPTURE_H
@@ -0,0 +1,67 @@
+#ifndef PROJECT_4_GL_EXTENSIONS_H
+#define PROJECT_4_GL_EXTENSIONS_H
+
+#include <glad/glad.h>
+
+// Tokens of features above the OpenGL 3.3 core profile the GLAD loader is generated for.
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+typedef void (APIENTRYP GLBufferStorageProc)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+typedef void (APIENTRYP GLGetProgramBinaryProc)(GLuint program, GLsizei buffer_size, GLsizei* length, GLenum* binary_format, void* binary);
+typedef void (APIENTRYP GLProgramBinaryProc)(GLuint program, GLenum binary_format, const void* binary, GLsizei length);
+typedef void (APIENTRYP GLProgramParameteriProc)(GLuint program, GLenum name, GLint value);
+typedef void (APIENTRYP GLMaxShaderCompilerThreadsProc)(GLuint count);
+typedef void (APIENTRYP GLTexStorage2DProc)(GLenum target, GLsizei levels, GLenum internal_format, GLsizei width, GLsizei height);
+
+// Optional entry points, loaded at runtime when the driver supports them. They stay nullptr otherwise.
+class GLExtensions
+{
+public:
+    static void load(GLADloadproc loader);
+    static bool isSupported(const char* extension);
+    static bool hasVersion(int major, int minor);
+
+    static GLBufferStorageProc bufferStorage;
+    // program binaries, all three or none of them
+    static GLGetProgramBinaryProc getProgramBinary;
+    static GLProgramBinaryProc programBinary;
+    static GLProgramParameteriProc programParameteri;
+    // KHR or ARB_parallel_shader_compile, which also make GL_COMPLETION_STATUS_KHR available
+    static GLMaxShaderCompilerThreadsProc maxShaderCompilerThreads;
+    // immutable texture storage, all mip levels allocated at once
+    static GLTexStorage2DProc texStorage2D;
+    static bool textureCompressionS3TC;
+    static bool textureCompressionBPTC;
+
+private:
+    static int major_version_;
+    static int minor_version_;
+};
+
+#endif //PROJECT_4_GL_EXTENSIONS_H
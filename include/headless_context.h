@@ -0,0 +1,30 @@
+#ifndef PROJECT_4_HEADLESS_CONTEXT_H
+#define PROJECT_4_HEADLESS_CONTEXT_H
+
+#include <glad/glad.h>
+
+// OpenGL context without a window, for rendering on machines without a display (build servers, CI). It's created with
+// EGL on a surfaceless display, where Mesa renders with llvmpipe if there is no GPU. Nothing is drawn to a default
+// framebuffer: everything has to be rendered into framebuffer objects. Only available in builds with EGL.
+class HeadlessContext
+{
+public:
+    HeadlessContext() = default;
+    ~HeadlessContext();
+    HeadlessContext(const HeadlessContext&) = delete;
+    HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+    // creates a core profile context of the version and makes it current on the calling thread
+    bool create(int major_version, int minor_version);
+    void destroy();
+
+    // for gladLoadGLLoader and GLExtensions::load
+    static GLADloadproc loader();
+
+private:
+    // EGLDisplay and EGLContext, so that EGL isn't needed to include this header
+    void* display_{nullptr};
+    void* context_{nullptr};
+};
+
+#endif //PROJECT_4_HEADLESS_CONTEXT_H
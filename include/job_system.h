@@ -0,0 +1,96 @@
+#ifndef PROJECT_4_JOB_SYSTEM_H
+#define PROJECT_4_JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of jobs started with it that haven't finished yet.
+class JobCounter
+{
+public:
+    bool isDone() const { return pending_.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class JobSystem;
+    std::atomic<int> pending_{0};
+};
+
+// Short jobs on worker threads with a deque of jobs each. A worker takes the jobs it pushed itself from the back of its
+// deque, newest first while their data is still in its cache, and steals the oldest ones from the front of the others'
+// deques when its own is empty. Jobs pushed from other threads are spread over the deques round-robin. Threads waiting
+// for a counter run jobs in the meantime, so jobs may wait for the jobs they started, and sleep once there are none.
+// Long jobs such as decoding files run in the background: only idle workers take them, at most half of the workers at
+// a time, so that they never hold up the jobs of a frame or a thread waiting for those.
+class JobSystem
+{
+public:
+    // the system shared by the application and its libraries, so that there is one worker per core in the process
+    static JobSystem& instance();
+
+    // by default one worker per hardware thread but one, which is left to the thread that waits
+    explicit JobSystem(unsigned int thread_count = 0);
+    ~JobSystem();
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // counter is incremented now and decremented once the job has run
+    void run(std::function<void()> job, JobCounter &counter);
+    // like run(), for a job that takes long; it's left to an idle worker, threads waiting for a counter never take it
+    void runBackground(std::function<void()> job, JobCounter &counter);
+    // runs jobs until all jobs of the counter have finished
+    void wait(const JobCounter &counter);
+    // calls function(begin, end) for ranges of [0, count) of grain items (the last one may be shorter) in parallel,
+    // and returns once all of them are done
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &function);
+
+    unsigned int size() const { return static_cast<unsigned int>(threads_.size()); }
+
+private:
+    struct Job
+    {
+        std::function<void()> function;
+        JobCounter* counter;
+    };
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    void push(Job job);
+    // runs one job, from the own queue of a worker first; false if all queues are empty
+    bool runOne();
+    // runs the oldest background job; false if there is none or enough workers are running one
+    bool runBackgroundJob();
+    bool canRunBackground() const;
+    // decrements the counter of a job that has run and wakes the threads waiting for it
+    void finish(JobCounter &counter);
+    void workerLoop(size_t index);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+    std::atomic<unsigned int> next_queue_{0};
+
+    // jobs in all queues; workers sleep while it's 0 and there is no background job for them
+    std::atomic<int> queued_{0};
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    // threads waiting for a counter sleep on their own condition, until it's done or jobs are queued
+    std::condition_variable waiting_;
+    int waiting_count_{0};
+    bool stopping_{false};
+
+    // background jobs and the workers running one, under sleep_mutex_
+    std::deque<Job> background_;
+    unsigned int background_running_{0};
+    unsigned int background_limit_{1};
+};
+
+#endif //PROJECT_4_JOB_SYSTEM_H
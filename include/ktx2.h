@@ -0,0 +1,46 @@
+#ifndef PROJECT_4_KTX2_H
+#define PROJECT_4_KTX2_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../include/mapped_file.h"
+#include "../include/texture_codec.h"
+
+struct Ktx2Level
+{
+    int width{0};
+    int height{0};
+    const uint8_t* data{nullptr};
+    size_t size{0};
+};
+
+// Reader and writer of KTX2 files holding a single 2D block-compressed mip chain: no array layers, faces or supercompression.
+// Files are written with rows ordered bottom to top (KTXorientation "ru"), so levels can be uploaded to OpenGL as they are.
+class Ktx2File
+{
+public:
+    static bool write(const std::string &filepath, TextureFormat format, int width, int height,
+                      const std::vector<std::vector<uint8_t>> &levels);
+    static std::string pathFor(const std::string &image_filepath);
+
+    bool open(const std::string &filepath);
+    void close();
+
+    bool isOpen() const { return file_.isOpen(); }
+    TextureFormat format() const { return format_; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+    int levelCount() const { return static_cast<int>(levels_.size()); }
+    const Ktx2Level& level(int index) const { return levels_[static_cast<size_t>(index)]; }
+
+private:
+    MappedFile file_;
+    TextureFormat format_{kTextureFormatBC1};
+    int width_{0};
+    int height_{0};
+    std::vector<Ktx2Level> levels_;
+};
+
+#endif //PROJECT_4_KTX2_H
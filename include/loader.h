@@ -4,15 +4,23 @@
 #include <string>
 #include <vector>
 #include "tiny_obj_loader.h"
+#include "../include/mesh_bounds.h"
+#include "../include/obj_parser.h"
 
 class ObjectLoader
 {
 public:
 
-    static void loadObjFileData(const std::string &filepath,
-                                std::vector<float> &object_vertices,
-                                std::vector<float> &object_normals,
-                                std::vector<float> &object_texture_coordinates);
+    static void loadIndexedObjFileData(const std::string &filepath,
+                                       std::vector<float> &object_vertices,
+                                       std::vector<float> &object_normals,
+                                       std::vector<float> &object_texture_coordinates,
+                                       std::vector<unsigned int> &object_indices,
+                                       std::vector<MeshBounds> &shape_bounds);
+
+private:
+    static void readObjFile(const std::string &filepath, ObjData &data);
+    static void parseObjFile(const std::string &filepath, tinyobj::ObjReader &reader);
 };
 
 #endif //PROJECT_4_LOADER_H
@@ -0,0 +1,27 @@
+#ifndef PROJECT_4_MAPPED_FILE_H
+#define PROJECT_4_MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string &filepath);
+    void close();
+
+    bool isOpen() const { return data_ != nullptr; }
+    const unsigned char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const unsigned char* data_{nullptr};
+    size_t size_{0};
+};
+
+#endif //PROJECT_4_MAPPED_FILE_H
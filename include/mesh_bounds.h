@@ -0,0 +1,69 @@
+#ifndef PROJECT_4_MESH_BOUNDS_H
+#define PROJECT_4_MESH_BOUNDS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+// Axis-aligned bounding box and bounding sphere of a mesh or of one of its shapes, in the coordinates of the mesh.
+// Plain floats, so that it's stored in the mesh cache as it is.
+struct MeshBounds
+{
+    float min[3];
+    float max[3];
+    float center[3];
+    float radius;
+
+    // position_at(i) returns a pointer to the 3 coordinates of the i-th of count positions
+    template<typename PositionAt>
+    static MeshBounds compute(size_t count, PositionAt position_at);
+    static MeshBounds compute(const std::vector<float> &positions)
+    {
+        return compute(positions.size() / 3, [&positions](size_t i) { return &positions[3 * i]; });
+    }
+};
+
+template<typename PositionAt>
+MeshBounds MeshBounds::compute(size_t count, PositionAt position_at)
+/** The sphere is centered in the box, with the radius reaching the farthest position. That's at most sqrt(3) times
+the radius of the smallest sphere, and exact for the boxy and round meshes of the scene. Without positions all
+bounds are zero. */
+{
+    MeshBounds bounds{};
+    if (count == 0)
+    {
+        return bounds;
+    }
+
+    std::fill(bounds.min, bounds.min + 3, std::numeric_limits<float>::max());
+    std::fill(bounds.max, bounds.max + 3, std::numeric_limits<float>::lowest());
+    for (size_t i = 0; i < count; i++)
+    {
+        const float* position = position_at(i);
+        for (size_t k = 0; k < 3; k++)
+        {
+            bounds.min[k] = std::min(bounds.min[k], position[k]);
+            bounds.max[k] = std::max(bounds.max[k], position[k]);
+        }
+    }
+    for (size_t k = 0; k < 3; k++)
+    {
+        bounds.center[k] = 0.5f * (bounds.min[k] + bounds.max[k]);
+    }
+
+    float squared_radius = 0.0f;
+    for (size_t i = 0; i < count; i++)
+    {
+        const float* position = position_at(i);
+        const float dx = position[0] - bounds.center[0];
+        const float dy = position[1] - bounds.center[1];
+        const float dz = position[2] - bounds.center[2];
+        squared_radius = std::max(squared_radius, dx * dx + dy * dy + dz * dz);
+    }
+    bounds.radius = std::sqrt(squared_radius);
+    return bounds;
+}
+
+#endif //PROJECT_4_MESH_BOUNDS_H
@@ -0,0 +1,99 @@
+#ifndef PROJECT_4_MESH_CACHE_H
+#define PROJECT_4_MESH_CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../include/mapped_file.h"
+#include "../include/mesh_bounds.h"
+#include "../include/mesh_simplifier.h"
+#include "../include/vertex_format.h"
+
+// Fixed-size header at the start of every binary mesh cache file, followed by the vertex, index and shape bounds blobs.
+// The vertex blob holds the vertices interleaved and encoded in a VertexLayout, as they're uploaded. The index blob
+// holds all levels of detail one after another, level 0 being the full mesh.
+struct MeshCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t vertex_count;
+    uint32_t index_count;   // of all levels of detail
+    uint32_t index_size;    // 2 or 4 bytes per index
+    uint32_t shape_count;
+    MeshBounds bounds;      // of the whole mesh
+    uint64_t source_hash;   // FNV-1a hash of the source .obj file
+    int64_t source_mtime;
+    uint64_t source_size;
+    uint32_t vertex_encodings[kMeshAttributeCount];  // VertexEncoding of every MeshAttribute
+    uint32_t vertex_stride;
+    uint64_t vertex_offset;
+    uint64_t vertex_data_size;
+    uint64_t index_offset;
+    uint64_t index_data_size;
+    uint64_t shape_offset;  // MeshBounds of every shape of the .obj file
+    uint32_t lod_count;
+    MeshLod lods[MeshSimplifier::kMaxLods];
+};
+
+// Pointers to mesh data ready to be handed to glBufferData, either inside a mapped cache file or in CPU vectors.
+struct MeshView
+{
+    // interleaved vertices in layout
+    const void* vertices{nullptr};
+    size_t vertex_data_size{0};
+    VertexLayout layout;
+    const void* indices{nullptr};
+    size_t index_data_size{0};
+    uint32_t index_size{4};
+    uint32_t vertex_count{0};
+    uint32_t index_count{0};
+};
+
+class MeshCache
+{
+public:
+    static constexpr uint32_t kVersion = 5;
+
+    static std::string cachePathFor(const std::string &obj_filepath);
+    // 16-bit positions relative to the bounding box and octahedral normals, without texture coordinates
+    static VertexLayout defaultLayout();
+    static bool build(const std::string &obj_filepath, const std::string &cache_filepath, const VertexLayout &layout);
+
+    // a cache with vertices in another layout is rebuilt
+    bool load(const std::string &obj_filepath, const VertexLayout &layout);
+    void release();
+
+    bool isLoaded() const { return file_.isOpen() || built_ != nullptr; }
+    const MeshCacheHeader& header() const;
+    MeshView view() const;
+    std::vector<MeshBounds> shapeBounds() const;
+    std::vector<MeshLod> lods() const;
+
+private:
+    // A mesh parsed from an .obj file, simplified and encoded, with the header of its cache file.
+    struct BuiltMesh
+    {
+        MeshCacheHeader header;
+        std::vector<uint8_t> vertices;
+        std::vector<unsigned int> indices;
+        // the indices as 16 bits, if the mesh has up to 65535 vertices
+        std::vector<uint16_t> short_indices;
+        std::vector<MeshBounds> shape_bounds;
+    };
+
+    static void buildMesh(const std::string &obj_filepath, const VertexLayout &layout, BuiltMesh &mesh);
+    static MeshView viewOf(const BuiltMesh &mesh);
+    static bool write(const std::string &cache_filepath, const BuiltMesh &mesh);
+
+    bool map(const std::string &cache_filepath);
+    bool hasLayout(const VertexLayout &layout) const;
+    bool isUpToDate(const std::string &obj_filepath, const std::string &cache_filepath) const;
+
+    MappedFile file_;
+    // the built mesh, in place of the mapping when the cache file couldn't be written
+    std::unique_ptr<BuiltMesh> built_;
+};
+
+#endif //PROJECT_4_MESH_CACHE_H
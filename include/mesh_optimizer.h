@@ -0,0 +1,23 @@
+#ifndef PROJECT_4_MESH_OPTIMIZER_H
+#define PROJECT_4_MESH_OPTIMIZER_H
+
+#include <vector>
+
+class MeshOptimizer
+{
+public:
+    // size of the simulated post-transform vertex cache, used both for reordering and for ACMR reports
+    static constexpr unsigned int kVertexCacheSize = 32;
+
+    static void optimizeVertexCache(std::vector<unsigned int> &indices, size_t vertex_count);
+
+    static void optimizeVertexFetch(std::vector<float> &vertices,
+                                    std::vector<float> &normals,
+                                    std::vector<float> &texture_coordinates,
+                                    std::vector<unsigned int> &indices);
+
+    static float computeACMR(const std::vector<unsigned int> &indices, size_t vertex_count,
+                             unsigned int cache_size = kVertexCacheSize);
+};
+
+#endif //PROJECT_4_MESH_OPTIMIZER_H
@@ -0,0 +1,49 @@
+#ifndef PROJECT_4_MESH_SIMPLIFIER_H
+#define PROJECT_4_MESH_SIMPLIFIER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Level of detail of a mesh: a range of its index buffer, all levels share the vertices. error is the distance by which
+// the level deviates from the full mesh, in the units of the mesh: no vertex of the full mesh is farther from the
+// level's surface, and no vertex of the level farther from the planes of the full mesh. It's 0 for the full mesh and
+// grows from level to level.
+struct MeshLod
+{
+    uint32_t index_offset;
+    uint32_t index_count;
+    float error;
+};
+
+// Quadric error edge collapse (Garland and Heckbert) of indexed triangle lists. A vertex is always collapsed onto one
+// of its neighbours, so a simplified mesh uses a subset of the original vertices and all levels of detail share one
+// vertex buffer. Vertices at the same position with different normals or texture coordinates (seams) are collapsed
+// together, along the seam only, and the change of the attributes adds to the cost of a collapse. Open borders are
+// kept in place by planes perpendicular to the border edges.
+class MeshSimplifier
+{
+public:
+    static constexpr uint32_t kMaxLods = 6;
+
+    // Simplifies until the indices are down to target_index_count, or until the next collapse would move the surface by
+    // more than max_error. Returns the error of the simplified mesh, as defined for MeshLod; normals and texture
+    // coordinates may be empty.
+    static float simplify(const std::vector<float> &vertices,
+                          const std::vector<float> &normals,
+                          const std::vector<float> &texture_coordinates,
+                          const std::vector<unsigned int> &indices,
+                          size_t target_index_count,
+                          float max_error,
+                          std::vector<unsigned int> &simplified);
+
+    // Appends levels of detail with about half the triangles of the previous level to the indices, which hold the full
+    // mesh as level 0, until there are kMaxLods levels or the mesh can't be simplified any further.
+    static void buildLodChain(const std::vector<float> &vertices,
+                              const std::vector<float> &normals,
+                              const std::vector<float> &texture_coordinates,
+                              std::vector<unsigned int> &indices,
+                              std::vector<MeshLod> &lods);
+};
+
+#endif //PROJECT_4_MESH_SIMPLIFIER_H
@@ -0,0 +1,26 @@
+#ifndef PROJECT_4_OBJ_PARSER_H
+#define PROJECT_4_OBJ_PARSER_H
+
+#include <string>
+#include <vector>
+#include "tiny_obj_loader.h"
+
+// Geometry of an .obj file: attribute arrays as in tinyobj::attrib_t and the corners of all triangulated faces in file order.
+// Shapes ('o' and 'g' records) are consecutive ranges of corners, shape_offsets holds the first corner of each non-empty one.
+struct ObjData
+{
+    std::vector<float> vertices;
+    std::vector<float> normals;
+    std::vector<float> texture_coordinates;
+    std::vector<tinyobj::index_t> indices;
+    std::vector<size_t> shape_offsets;
+};
+
+class ObjParser
+{
+public:
+    static bool parse(const std::string &filepath, ObjData &data);
+    static bool parseFloat(const char* begin, const char* end, double &value);
+};
+
+#endif //PROJECT_4_OBJ_PARSER_H
@@ -2,76 +2,232 @@
 #ifndef PROJECT_4_OBJECT_H
 #define PROJECT_4_OBJECT_H
 
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "../include/texture.h"
 #include "../include/shader.h"
+#include "../include/shader_permutations.h"
+#include "../include/job_system.h"
+#include "../include/mesh_cache.h"
+#include "../include/orbit_set.h"
+#include "../include/planet_mesh.h"
+#include "../include/render_queue.h"
+#include "../include/vertex_attributes.h"
+#include "../include/virtual_texture.h"
 
-class Object{
+class Object : public Renderable{
 public:
-    Object(const std::string& obj_filepath, const std::string& shader_vert, const std::string& shader_frag);
+    // the program is compiled with the ShaderFeature bits in shader_features
+    Object(const std::string& obj_filepath, const std::string& shader_vert, const std::string& shader_frag,
+           uint32_t shader_features = 0);
     ~Object();
 
-    virtual void loadObjectBuffers();
-    virtual void draw(glm::mat4& view, glm::mat4& projection);
+    // encoding of the vertex buffer of the mesh loaded by the next loadObjectFile()
+    void setVertexLayout(const VertexLayout &layout) { vertex_layout_ = layout; }
+    void loadObjectBuffers();
+    void submit(RenderQueue &queue) override;
+    // view and projection are read from the FrameConstants uniform block
+    void draw(int frame_slot) override;
     void loadObjectFile(const std::string& filepath);
 
+    // bounds of the whole mesh and of every shape of the .obj file, in the coordinates of the mesh
+    const MeshBounds& bounds() const { return bounds_; }
+    const std::vector<MeshBounds>& shapeBounds() const { return shape_bounds_; }
+
 protected:
-    float scale_{1};
+    virtual void uploadMeshBuffers(const MeshView& mesh);
 
-    std::vector<GLfloat> vertices_{};
-    std::vector<GLfloat> normals_{};
-    std::vector<GLfloat> texture_coordinates_{};
+    float scale_{1};
 
     GLuint VAO_{};
+    // interleaved vertices in vertex_layout_
     GLuint VBO_{};
-    GLuint NBO_{};
+    GLuint EBO_{};
+
+    // by default 16-bit positions relative to the bounding box and octahedral normals, 12 bytes per vertex instead of
+    // the 24 of floats; the meshes of planes have no textures
+    VertexLayout vertex_layout_{MeshCache::defaultLayout()};
+    VertexDequantization dequantization_;
+
+    // meshes with up to 65535 vertices are drawn with 16-bit indices
+    GLenum index_type_{GL_UNSIGNED_INT};
+    GLsizei index_count_{0};
+
+    MeshCache mesh_cache_;
+    MeshBounds bounds_{};
+    std::vector<MeshBounds> shape_bounds_;
+    // levels of detail, ranges of the index buffer; index_count_ is the one of the full mesh
+    std::vector<MeshLod> lods_;
 
     ShaderProgram shaderProgram_;
+    UniformHandle<glm::mat4> model_uniform_;
+    VertexFormatUniforms vertex_format_uniforms_;
 
 };
 
+// Planes flying around the Earth, all of them drawn with a single instanced draw call. Every plane has an orbit of
+// its own; the first one keeps the orbit of the original single plane.
 class Plane : public Object{
 public:
-    Plane(const std::string& obj_filepath, const std::string& shader_vert, const std::string& shader_frag) : Object(obj_filepath, shader_vert, shader_frag){}
-    void draw(glm::mat4 &view, glm::mat4 &projection) override;
+    // features of the plane programs; the normal encoding of the vertex layout adds its own
+    static constexpr uint32_t kShaderFeatures = kShaderFeatureInstancing | kShaderFeatureSpecular;
+
+    Plane(const std::string& obj_filepath, const std::string& shader_vert, const std::string& shader_frag, int instance_count = 1);
+    ~Plane();
+    // advances all orbits by one tick of the simulation clock
+    void tick();
+    // computes the model matrices of the frame, alpha of the way from the previous tick to the last one, in ranges of
+    // planes on the job system
+    void update(float alpha, JobSystem &jobs);
+    // keeps the model matrices of the planes that pass the culler for the frame, and submits them if there are any
+    void submit(RenderQueue &queue) override;
+    // uploads the model matrices of the frame into the instance buffer and draws them
+    void draw(int frame_slot) override;
+
+protected:
+    void uploadMeshBuffers(const MeshView& mesh) override;
 
 private:
-    float angle_{0.5};
+    // handles of the uniforms set by draw(), resolved once for each of the plane programs
+    struct Uniforms
+    {
+        Uniforms() = default;
+        explicit Uniforms(const ShaderProgram &program);
+
+        UniformHandle<glm::vec3> object_color;
+        VertexFormatUniforms vertex_format;
+    };
+
+    // largest error of the level of detail of a plane on the screen, in pixels
+    static constexpr float kMaxLodPixelError = 1.0f;
+    // planes per job of update()
+    static constexpr size_t kUpdateGrain = 4096;
+
+    // what draw() needs of a frame: the rows of the model matrices of the visible planes, grouped by level of detail
+    // and in 3 blocks like in the instance buffer, and the first instance and number of instances of every level
+    struct Frame
+    {
+        std::vector<float> rows;
+        GLsizei visible_count{0};
+        GLsizei lod_first_instance[MeshSimplifier::kMaxLods]{};
+        GLsizei lod_instance_count[MeshSimplifier::kMaxLods]{};
+    };
+
+    glm::mat4 localMatrix() const;
+    void setInstanceOffset(GLsizei first_instance);
+
     float scale_{1};
+
+    OrbitSet orbits_;
+    // upper 3x4 part of the model matrix of every instance, by rows: all first rows, then all second and third rows;
+    // computed for all planes, and copied into the instance buffer for the visible ones only
+    std::vector<float> rows_;
+    GLuint instance_buffer_{};
+
+    // centers of the bounding spheres of all planes by coordinate, the indices of the visible ones and their level of
+    // detail
+    std::vector<float> centers_[3];
+    std::vector<uint32_t> visible_;
+    std::vector<uint8_t> lod_of_;
+    Frame frames_[kMaxFramesInFlight];
+
+    // permutations by the normal encoding of the vertex layout; the program of the Object is the one of the default
+    // layout, and the one of the loaded mesh is picked when its buffers are uploaded
+    ShaderPermutations<Uniforms> programs_;
+    const ShaderPermutations<Uniforms>::Permutation* program_{nullptr};
 };
 
+// Earth surface map shown by day or by night. When a page pyramid (.vtex) exists next to the image,
+// the map is streamed as a virtual texture instead of being loaded as a whole.
+struct SurfaceMap
+{
+    std::unique_ptr<Texture2D> texture;
+    std::unique_ptr<VirtualTexture> virtual_texture;
+    // ShaderFeature bits of the program the map is drawn with
+    uint32_t shader_features{0};
+};
+
+// Earth with the day or night map and clouds. Its surface is a procedural PlanetMesh refined around the camera, so
+// there is no mesh file behind the Object.
 class Earth : public Object{
 public:
-    Earth(const std::string& obj_filepath, const std::string& shader_vert, const std::string& shader_frag);
-    void draw(glm::mat4 &view, glm::mat4 &projection) override;
-    void loadObjectBuffers() override;
+    Earth(const std::string& shader_vert, const std::string& shader_frag);
+    void tick();
+    void update(float alpha);
+    // selects the patches of the planet mesh for the frame
+    void submit(RenderQueue &queue) override;
+    void draw(int frame_slot) override;
+    // draws the frame into the feedback buffer of the virtual texture; called on the GL thread before draw()
+    void drawFeedback(int frame_slot, int viewport_width, int viewport_height);
+    // the clouds are drawn over the day map only, see SurfaceMap::shader_features
     void switchTime()
     {
         main_texture_id_ ^= 1;
         if (main_texture_id_ == 1){
-            clouds_intensity_ = 0.01;
             light_rgb_[0] = 0.98;
             light_rgb_[1] = 0.859;
             light_rgb_[2] = 0.0;
 
         } else {
-            clouds_intensity_ = 0.25;
             light_rgb_[0] = 0.98;
             light_rgb_[1] = 0.945;
             light_rgb_[2] = 0.784;
         }
     }
+    // colour in rgb and intensity in a of the light shining on the scene, which changes between day and night
+    glm::vec4 lightColor() const { return glm::vec4(light_rgb_[0], light_rgb_[1], light_rgb_[2], diffuse_); }
+    // center in xyz and radius in w of a sphere inside the Earth's surface, which hides what is behind it
+    glm::vec4 occluderSphere() const;
+    // see PlanetMesh::setSynchronous()
+    void setSynchronousPatches(bool synchronous) { planet_.setSynchronous(synchronous); }
 
 private:
+    // handles of the uniforms set by draw() and drawFeedback(), resolved once for each of the Earth programs; those
+    // of features a permutation is compiled without are invalid
+    struct Uniforms
+    {
+        Uniforms() = default;
+        explicit Uniforms(const ShaderProgram &program);
+
+        UniformHandle<glm::mat4> model;
+        UniformHandle<int> material_diffuse;
+        UniformHandle<int> clouds_texture;
+        UniformHandle<glm::vec3> light_ambient;
+        UniformHandle<float> clouds_intensity;
+        VirtualTextureUniforms virtual_texture;
+    };
+
+    // what draw() needs of a frame, taken when it's submitted
+    struct Frame
+    {
+        glm::mat4 model{1.0f};
+        int main_texture_id{0};
+        // base vertices of the selected patches
+        std::vector<GLint> patches;
+    };
+
+    glm::mat4 modelMatrix() const;
+
     float scale_{2};
-    GLuint TBO_{};
+    PlanetMesh planet_;
+    Frame frames_[kMaxFramesInFlight];
+    // rotation at the last two ticks, and the one drawn in between them
+    float previous_angle_{0.2};
     float angle_{0.2};
+    float render_angle_{0.2};
 
-    std::vector<Texture2D> textures_ = {Texture2D("../textures/8k_earth_daymap.jpg"),
-                                        Texture2D("../textures/8k_earth_nightmap.jpg"),
-                                        Texture2D("../textures/8k_earth_clouds.jpg")};
+    // day and night maps
+    std::vector<SurfaceMap> surface_maps_;
+    Texture2D clouds_texture_ = Texture2D("../textures/8k_earth_clouds.jpg");
+
+    // permutations for the surface maps, by their CLOUDS and VIRTUAL_TEXTURE features; all of them are compiled by the
+    // constructor, so that submit() can look them up on the job threads
+    ShaderPermutations<Uniforms> surface_programs_;
+    // only created when one of the surface maps is a virtual texture
+    std::unique_ptr<ShaderProgram> feedback_program_;
+    Uniforms feedback_uniforms_;
 
     int main_texture_id_{0};
 
@@ -81,15 +237,23 @@ private:
 
 };
 
-class Skybox {
+// Cubemap behind everything else, drawn as a single triangle that covers the screen. The vertex shader reconstructs the
+// view direction of every corner from the inverse of the view-projection and puts the triangle on the far plane, so
+// early depth tests reject the pixels the Earth and the planes were drawn on before the cubemap is sampled.
+class Skybox : public Renderable {
 public:
     Skybox(const std::string& shader_vert, const std::string& shader_frag);
-    void draw(glm::mat4 &view, glm::mat4 &projection);
+    ~Skybox();
+    void submit(RenderQueue &queue) override;
+    void draw(int frame_slot) override;
+
+    const Texture3D& texture() const { return skybox_texture_; }
 
 private:
+    // without vertex buffers: the vertices are made up from gl_VertexID, but core profiles can't draw without a VAO
     GLuint VAO_{};
-    GLuint VBO_{};
     ShaderProgram shaderProgram_;
+    UniformHandle<int> skybox_sampler_;
 
     Texture3D skybox_texture_ = Texture3D({"../textures/sky/right.jpg",
                                            "../textures/sky/left.jpg",
@@ -97,52 +261,6 @@ private:
                                            "../textures/sky/bottom.jpg",
                                            "../textures/sky/back.jpg",
                                            "../textures/sky/front.jpg"});
-
-    std::vector<GLfloat> vertices_ =
-            {
-            -1.0f,  1.0f, -1.0f,
-            -1.0f, -1.0f, -1.0f,
-            1.0f, -1.0f, -1.0f,
-            1.0f, -1.0f, -1.0f,
-            1.0f,  1.0f, -1.0f,
-            -1.0f,  1.0f, -1.0f,
-
-            -1.0f, -1.0f,  1.0f,
-            -1.0f, -1.0f, -1.0f,
-            -1.0f,  1.0f, -1.0f,
-            -1.0f,  1.0f, -1.0f,
-            -1.0f,  1.0f,  1.0f,
-            -1.0f, -1.0f,  1.0f,
-
-            1.0f, -1.0f, -1.0f,
-            1.0f, -1.0f,  1.0f,
-            1.0f,  1.0f,  1.0f,
-            1.0f,  1.0f,  1.0f,
-            1.0f,  1.0f, -1.0f,
-            1.0f, -1.0f, -1.0f,
-
-            -1.0f, -1.0f,  1.0f,
-            -1.0f,  1.0f,  1.0f,
-            1.0f,  1.0f,  1.0f,
-            1.0f,  1.0f,  1.0f,
-            1.0f, -1.0f,  1.0f,
-            -1.0f, -1.0f,  1.0f,
-
-            -1.0f,  1.0f, -1.0f,
-            1.0f,  1.0f, -1.0f,
-            1.0f,  1.0f,  1.0f,
-            1.0f,  1.0f,  1.0f,
-            -1.0f,  1.0f,  1.0f,
-            -1.0f,  1.0f, -1.0f,
-
-            -1.0f, -1.0f, -1.0f,
-            -1.0f, -1.0f,  1.0f,
-            1.0f, -1.0f, -1.0f,
-            1.0f, -1.0f, -1.0f,
-            -1.0f, -1.0f,  1.0f,
-            1.0f, -1.0f,  1.0f
-    };
-
 };
 
 
@@ -0,0 +1,53 @@
+#ifndef PROJECT_4_ORBIT_SET_H
+#define PROJECT_4_ORBIT_SET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Implementations of OrbitSet::computeTransforms, the SIMD ones process 4 (SSE2) or 8 (AVX2) orbits at a time
+enum OrbitKernel : uint32_t
+{
+    kOrbitKernelScalar,
+    kOrbitKernelSSE2,
+    kOrbitKernelAVX2,
+};
+
+// Circular orbits around the origin. An orbit starts at (0, 0, -radius), turns around the y axis by its phase and is then
+// tilted around the x axis by its inclination; angles are in degrees. Orbits are stored as a structure of arrays, so that
+// all of them are advanced and turned into transforms in one pass over contiguous memory.
+class OrbitSet
+{
+public:
+    void add(float radius, float inclination, float phase, float speed);
+    void clear();
+    size_t size() const { return radius_.size(); }
+
+    void advance(float frames);
+    // uses the best kernel of the CPU
+    void computeTransforms(const glm::mat4 &local, float* rows, float frames = 0.0f) const;
+    void computeTransforms(const glm::mat4 &local, float* rows, float frames, OrbitKernel kernel) const;
+    // only the orbits [begin, end), with the best kernel; rows still holds all orbits, so that ranges can be computed
+    // by several threads at once
+    void computeTransforms(const glm::mat4 &local, float* rows, float frames, size_t begin, size_t end) const;
+
+    static bool isSupported(OrbitKernel kernel);
+    static OrbitKernel bestKernel();
+    static const char* kernelName(OrbitKernel kernel);
+
+    const std::vector<float>& radius() const { return radius_; }
+    const std::vector<float>& inclination() const { return inclination_; }
+    const std::vector<float>& phase() const { return phase_; }
+    const std::vector<float>& speed() const { return speed_; }
+
+private:
+    void computeTransforms(const glm::mat4 &local, float* rows, float frames, size_t begin, size_t end, OrbitKernel kernel) const;
+
+    std::vector<float> radius_;
+    std::vector<float> inclination_;
+    std::vector<float> phase_;
+    std::vector<float> speed_;  // degrees per frame
+};
+
+#endif //PROJECT_4_ORBIT_SET_H
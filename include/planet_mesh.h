@@ -0,0 +1,121 @@
+#ifndef PROJECT_4_PLANET_MESH_H
+#define PROJECT_4_PLANET_MESH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "../include/job_system.h"
+#include "../include/render_queue.h"
+#include "../include/vertex_format.h"
+
+// Procedural mesh of a sphere of radius 1, made of the six faces of a cube pushed out onto the sphere. Every face is a
+// quadtree of square patches with the same grid of vertices, so a patch at level n covers 1/4^n of its face. Patches
+// are refined until their geometric error covers at most kMaxPixelError pixels on the screen, and cracks between
+// patches of different levels are hidden by skirts hanging down from their edges into the sphere.
+// Patch meshes are generated and encoded on worker threads and kept in slots of one vertex buffer, all of them drawn
+// with the same index buffer; the least recently used ones are evicted when the slots run out. Texture coordinates are
+// equirectangular, with the prime meridian on +x and the north pole on +y.
+// Selection runs on a job thread and only assigns slots; the vertices are copied into them by upload() on the GL
+// thread, before the frames that draw them. Patches of frames that may still be drawn are never evicted.
+class PlanetMesh
+{
+public:
+    // quads along the edge of a patch
+    static constexpr int kPatchResolution = 16;
+    static constexpr int kPatchVertexCount = (kPatchResolution + 1) * (kPatchResolution + 1) + 4 * (kPatchResolution + 1);
+    static constexpr int kPatchIndexCount = 6 * kPatchResolution * (kPatchResolution + 4);
+    // position, normal and texture coordinates, as generated
+    static constexpr int kVertexFloats = 8;
+    // the faces start out split into 4 patches, so that no patch crosses the date line, where u wraps around
+    static constexpr int kRootLevel = 1;
+    static constexpr int kMaxLevel = 10;
+    static constexpr int kMaxPatches = 1024;
+    static constexpr int kMaxPendingPatches = 64;
+    static constexpr float kMaxPixelError = 1.0f;
+
+    PlanetMesh();
+    ~PlanetMesh();
+    PlanetMesh(const PlanetMesh&) = delete;
+    PlanetMesh& operator=(const PlanetMesh&) = delete;
+
+    // selects the visible patches of a frame for a sphere moved by model, which scales uniformly by scale, as the
+    // base vertices of their slots
+    void select(RenderQueue &queue, const glm::mat4 &model, float scale, std::vector<GLint> &selection);
+    // copies the vertices of the patches that got a slot since the last call into the vertex buffer
+    void upload();
+    // draws a selection with the program in use; the vertex attributes are those of vertexLayout()
+    void draw(const std::vector<GLint> &selection) const;
+
+    // with synchronous selection, missing patches are generated before select() returns, so that the mesh of a frame
+    // doesn't depend on the speed of the workers (headless captures, benchmarks)
+    void setSynchronous(bool synchronous) { synchronous_ = synchronous; }
+
+    // encoding of the vertex buffer: positions stay floats, since 16 bits across the whole sphere are coarser than the
+    // cells of the finest levels; the normals are left out, they point along the positions on a sphere around the
+    // origin; texture coordinates get 16 bits. 16 bytes per vertex instead of 32.
+    static VertexLayout vertexLayout() { return VertexLayout(kVertexEncodingFloat, kVertexEncodingNone, kVertexEncodingUnorm16); }
+
+    // distance by which the flat cells of a patch at the level deviate from the sphere
+    static float patchError(int level);
+    // interleaved vertices of a patch: its grid, then the skirt of the bottom, top, left and right edge
+    static void generatePatch(int face, int level, int x, int y, std::vector<float> &vertices);
+    // indices of a patch into its kPatchVertexCount vertices, the same for all patches
+    static void generateIndices(std::vector<uint16_t> &indices);
+
+private:
+    struct Patch
+    {
+        // bounding sphere of the patch including its skirts, in the coordinates of the mesh
+        glm::vec3 center{0.0f};
+        float radius{0.0f};
+        // slot of the vertices in the vertex buffer, or -1 while they're being generated
+        int slot{-1};
+        std::future<std::vector<uint8_t>> vertices;
+        // encoded vertices waiting for upload() once the patch has a slot
+        std::vector<uint8_t> generated;
+        bool uploaded{false};
+        uint64_t last_used{0};
+        int level{0};
+    };
+
+    static uint64_t keyOf(int face, int level, int x, int y);
+    Patch& request(int face, int level, int x, int y);
+    // takes the generated vertices of the patch and gives it a slot, unless all slots are in use
+    bool assignSlot(uint64_t key, Patch &patch);
+    int allocateSlot();
+    // adds the patch or its children to the selection; returns false if missing children were requested
+    bool selectPatch(int face, int level, int x, int y, RenderQueue &queue, const glm::mat4 &model, float scale,
+                     std::vector<GLint> &selection);
+
+    // patches are selected on a job thread and uploaded on the GL thread
+    std::mutex mutex_;
+    std::unordered_map<uint64_t, Patch> patches_;
+    std::vector<uint64_t> uploads_;
+    std::vector<int> free_slots_;
+    size_t pending_count_{0};
+    // frames selected so far
+    uint64_t frame_{0};
+    bool synchronous_{false};
+
+    // arguments of the multi-draw besides the base vertices, the same for every patch
+    std::vector<GLsizei> draw_counts_;
+    std::vector<const void*> draw_offsets_;
+
+    GLuint vertex_array_{};
+    GLuint vertex_buffer_{};
+    GLuint index_buffer_{};
+
+    // patches are generated as background jobs of the shared job system, and with synchronous selection as jobs the
+    // selecting thread waits for; the destructor waits for the background ones
+    JobSystem &jobs_{JobSystem::instance()};
+    JobCounter background_patches_;
+    JobCounter synchronous_patches_;
+};
+
+#endif //PROJECT_4_PLANET_MESH_H
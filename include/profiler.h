@@ -0,0 +1,80 @@
+#ifndef PROJECT_4_PROFILER_H
+#define PROJECT_4_PROFILER_H
+
+// Scoped CPU and GPU profiler, compiled in with the CMake option PROJECT_4_PROFILE. Without it the macros expand to
+// nothing and the profiler costs nothing.
+//
+//   PROFILE_SCOPE("name")      CPU time of the enclosing scope, on any thread
+//   PROFILE_GPU_SCOPE("name")  CPU and GPU time of the enclosing scope, on the GL thread only
+//   PROFILE_FRAME()            frame boundary, on the GL thread
+//
+// Names have to be string literals, only their address is stored while recording.
+#ifdef PROJECT_4_PROFILE
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <string>
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_GPU_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name); \
+                                GpuProfileScope PROFILE_CONCAT(gpu_profile_scope_, __LINE__)(name)
+#define PROFILE_FRAME() Profiler::endFrame()
+
+// CPU scopes are written by their thread into a ring buffer of its own, which the GL thread drains once per frame
+// without taking a lock. GPU scopes are pairs of timestamp queries from a pool, read back kGpuFrameLatency frames later,
+// when the GPU has long finished them. Recorded scopes are kept for the trace, and summed up per name for a summary
+// printed every kSummaryInterval frames.
+class Profiler
+{
+public:
+    static constexpr int kGpuFrameLatency = 3;
+    static constexpr int kSummaryInterval = 300;
+
+    static int64_t now();
+    static void recordCpu(const char* name, int64_t start, int64_t end);
+    static int beginGpu(const char* name);
+    static void endGpu(int scope);
+    static void endFrame();
+
+    // writes the recorded scopes as Chrome trace events (chrome://tracing, Perfetto)
+    static bool writeTrace(const std::string &filepath);
+    // reads back the outstanding GPU scopes and releases the queries, while the context still exists
+    static void shutdown();
+};
+
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char* name);
+    ~ProfileScope();
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    const char* name_;
+    int64_t start_;
+};
+
+class GpuProfileScope
+{
+public:
+    explicit GpuProfileScope(const char* name) : scope_(Profiler::beginGpu(name)) {}
+    ~GpuProfileScope() { Profiler::endGpu(scope_); }
+    GpuProfileScope(const GpuProfileScope&) = delete;
+    GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+
+private:
+    int scope_;
+};
+
+#else
+
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_GPU_SCOPE(name) ((void)0)
+#define PROFILE_FRAME() ((void)0)
+
+#endif
+
+#endif //PROJECT_4_PROFILER_H
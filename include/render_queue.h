@@ -0,0 +1,79 @@
+#ifndef PROJECT_4_RENDER_QUEUE_H
+#define PROJECT_4_RENDER_QUEUE_H
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "../include/culling.h"
+
+class RenderQueue;
+
+// Layers are drawn in this order. The skybox goes last: its depth is 1.0 everywhere, so early depth testing
+// rejects it wherever opaque geometry has been drawn already.
+enum RenderLayer : uint32_t
+{
+    kRenderLayerOpaque = 0,
+    kRenderLayerSkybox = 1,
+};
+
+// Frames that can be between simulation and drawing at once, each with a queue and a frame slot of its own
+constexpr int kMaxFramesInFlight = 3;
+
+// Something the render queue can draw. submit() adds draw packets for a frame; it runs on a job thread, while the GL
+// thread may be drawing an earlier frame, so it must not call GL and keeps what it draws in the frame slot of the queue.
+// draw() is called on the GL thread for each packet once the queue is sorted, with the same frame slot.
+class Renderable
+{
+public:
+    virtual ~Renderable() = default;
+    virtual void submit(RenderQueue &queue) = 0;
+    virtual void draw(int frame_slot) = 0;
+};
+
+struct DrawPacket
+{
+    uint64_t key;
+    Renderable* renderable;
+};
+
+// Draw packets of one frame, executed in the order of their sort keys. Keys are made of, from the most significant bits:
+// the layer (4 bits), the program (12 bits), the material, i.e. the set of textures (16 bits), and the depth (32 bits).
+// Packets sharing state end up next to each other, and opaque packets with the same state are drawn front to back.
+class RenderQueue
+{
+public:
+    static uint64_t makeKey(RenderLayer layer, uint32_t program, uint32_t material, float depth);
+
+    // slot of the frame the queue is built for, in [0, kMaxFramesInFlight)
+    void setFrameSlot(int frame_slot) { frame_slot_ = frame_slot; }
+    int frameSlot() const { return frame_slot_; }
+    void setCamera(const glm::mat4 &view, float far_plane);
+    float depthOf(const glm::vec3 &position) const;
+    // distance of the position from the camera along the viewing direction
+    float viewDepthOf(const glm::vec3 &position) const;
+    // pixels covered by a length of 1 at a view depth of 1, which turns errors of levels of detail into screen space
+    void setLodScale(float pixels) { lod_scale_ = pixels; }
+    float lodScale() const { return lod_scale_; }
+    // visibility of bounding volumes for the camera of the frame, tested by renderables before they submit packets
+    Culler& culler() { return culler_; }
+    const Culler& culler() const { return culler_; }
+
+    void submit(uint64_t key, Renderable* renderable) { packets_.push_back(DrawPacket{key, renderable}); }
+    void sort();
+    void execute();
+    void clear() { packets_.clear(); }
+
+    const std::vector<DrawPacket>& packets() const { return packets_; }
+
+private:
+    std::vector<DrawPacket> packets_;
+    std::vector<DrawPacket> sorted_;
+    int frame_slot_{0};
+    glm::mat4 view_{1.0f};
+    float far_plane_{1.0f};
+    float lod_scale_{1.0f};
+    Culler culler_;
+};
+
+#endif //PROJECT_4_RENDER_QUEUE_H
@@ -0,0 +1,66 @@
+#ifndef PROJECT_4_RENDER_STATE_H
+#define PROJECT_4_RENDER_STATE_H
+
+#include <glad/glad.h>
+
+struct RenderStateStats
+{
+    unsigned int changes{0};    // state changes sent to GL
+    unsigned int skipped{0};    // requests for the state GL already had
+};
+
+// Shadow copy of the GL state the renderer changes: bound program, vertex array and textures, depth function and
+// write mask, polygon mode and enable bits. Requests for the state that is already set are dropped. All of these changes have to go
+// through RenderState, otherwise the shadow copy gets out of sync with GL; invalidate() makes it forget everything.
+class RenderState
+{
+public:
+    static constexpr int kTextureUnits = 16;
+
+    static void useProgram(GLuint program);
+    static void bindVertexArray(GLuint vertex_array);
+    static void bindTexture(int unit, GLenum target, GLuint texture);
+    static void bindTexture(GLenum target, GLuint texture);
+    static void setDepthFunc(GLenum function);
+    static void setDepthMask(bool enabled);
+    static void setPolygonMode(GLenum mode);
+    static void setEnabled(GLenum capability, bool enabled);
+
+    // deleted objects are unbound by GL, their names may be handed out again
+    static void forgetVertexArray(GLuint vertex_array);
+    static void forgetTexture(GLuint texture);
+    static void invalidate();
+
+    static void beginFrame();
+    static const RenderStateStats& frameStats() { return frame_stats_; }
+    static const RenderStateStats& lastFrameStats() { return last_frame_stats_; }
+
+private:
+    static constexpr GLuint kUnknown = 0xFFFFFFFF;
+
+    struct TextureUnit
+    {
+        GLuint texture_2d{kUnknown};
+        GLuint cube_map{kUnknown};
+    };
+
+    static int capabilityIndex(GLenum capability);
+    static GLuint* textureBinding(TextureUnit &unit, GLenum target);
+    static void setActiveUnit(int unit);
+    static bool change(GLuint &shadow, GLuint value);
+
+    static GLuint program_;
+    static GLuint vertex_array_;
+    static int active_unit_;
+    static TextureUnit texture_units_[kTextureUnits];
+    static GLuint depth_function_;
+    static GLuint depth_mask_;
+    static GLuint polygon_mode_;
+    // GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND, GL_SCISSOR_TEST and GL_TEXTURE_CUBE_MAP_SEAMLESS
+    static GLuint capabilities_[5];
+
+    static RenderStateStats frame_stats_;
+    static RenderStateStats last_frame_stats_;
+};
+
+#endif //PROJECT_4_RENDER_STATE_H
@@ -2,22 +2,98 @@
 #define PROJECT_4_SHADER_H
 
 #include <glm/glm.hpp>
+#include <cstdint>
 #include <string>
+#include <unordered_map>
+#include <vector>
+
+// Index of an active uniform in the location table of a ShaderProgram, resolved once with ShaderProgram::uniform().
+// Handles of uniforms the linker removed or that were requested with the wrong type are invalid, setting them does nothing.
+template<typename T>
+struct UniformHandle
+{
+    int index{-1};
+    bool isValid() const { return index >= 0; }
+};
+
+struct UniformStats
+{
+    // counted over all programs since the start of the application
+    unsigned long long calls_issued{0};
+    unsigned long long calls_skipped{0};    // the uniform already had the value
+};
+
+// Features a permutation of a program is compiled with, each one a define of both shaders (see
+// ShaderProgram::definesFor()). The code of features that are off is removed by the preprocessor, instead of being
+// skipped at run time by branches on uniforms.
+enum ShaderFeature : uint32_t
+{
+    kShaderFeatureClouds = 1u << 0,            // CLOUDS: the clouds texture is mixed over the surface
+    kShaderFeatureSpecular = 1u << 1,          // SPECULAR: specular highlights on top of ambient and diffuse light
+    kShaderFeatureInstancing = 1u << 2,        // INSTANCING: model matrices are per-instance vertex attributes
+    kShaderFeatureVirtualTexture = 1u << 3,    // VIRTUAL_TEXTURE: the surface map is sampled from a virtual texture
+    kShaderFeatureOctahedralNormals = 1u << 4  // OCTAHEDRAL_NORMALS: the normals are octahedral, see VertexAttributes::shaderFeatures()
+};
+
+constexpr int kShaderFeatureCount = 5;
 
 class ShaderProgram{
 public:
-    explicit ShaderProgram(const char* vertexPath, const char* fragmentPath);
+    explicit ShaderProgram(const char* vertexPath, const char* fragmentPath, uint32_t features = 0);
     void use() const;
+    unsigned int id() const { return id_; }
+    // ShaderFeature bits the program was compiled with
+    uint32_t features() const { return features_; }
+
+    // starts compiling the permutation before it's created, see ShaderCache::prepare()
+    static void prepare(const std::string &vertexPath, const std::string &fragmentPath, uint32_t features = 0);
+    // "#define NAME\n" for every ShaderFeature bit, always in the same order
+    static std::string definesFor(uint32_t features);
 
+    template<typename T>
+    UniformHandle<T> uniform(const std::string &name) const;
+
+    // the program has to be in use, values equal to the last one set are not sent to GL again
+    void set(UniformHandle<int> handle, int value) const;
+    void set(UniformHandle<float> handle, float value) const;
+    void set(UniformHandle<glm::vec2> handle, const glm::vec2 &value) const;
+    void set(UniformHandle<glm::vec3> handle, const glm::vec3 &value) const;
+    void set(UniformHandle<glm::vec4> handle, const glm::vec4 &value) const;
+    void set(UniformHandle<glm::mat4> handle, const glm::mat4 &value) const;
+
+    // look the uniform up by name on every call, meant for code outside of the render loop
     void setInt(const std::string &name, int value) const;
     void setFloat(const std::string &name, float value) const;
+    void setVec2(const std::string &name, float x, float y) const;
     void setVec3(const std::string &name, const glm::vec3 &value) const;
     void setVec3(const std::string &name, float x, float y, float z) const;
     void setVec4(const std::string &name, float x, float y, float z, float w) const;
     void setMat4(const std::string &name, const glm::mat4 &mat) const;
 
+    static const UniformStats& uniformStats() { return uniform_stats_; }
+    // prints the info log if compiling the shader, or linking the program for type "PROGRAM", failed
+    static void checkCompileErrors(unsigned int shader, const std::string& type);
+
 private:
+    struct Uniform
+    {
+        int location{-1};
+        unsigned int type{0};
+        // last value set, large enough for a mat4
+        float value[16]{};
+        bool has_value{false};
+    };
+
+    void introspect();
+    int findUniform(const std::string &name, unsigned int type) const;
+    bool update(int index, const void* value, size_t size) const;
+
     unsigned int id_;
-    static void checkCompileErrors(unsigned int shader, const std::string& type);
+    uint32_t features_;
+    // active uniforms of the linked program, names of arrays are stored with and without the "[0]" suffix
+    mutable std::vector<Uniform> uniforms_;
+    std::unordered_map<std::string, int> uniform_indices_;
+
+    static UniformStats uniform_stats_;
 };
 #endif //PROJECT_4_SHADER_H
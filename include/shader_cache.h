@@ -0,0 +1,70 @@
+#ifndef PROJECT_4_SHADER_CACHE_H
+#define PROJECT_4_SHADER_CACHE_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+struct ShaderCacheStats
+{
+    unsigned int loaded{0};     // programs loaded from binaries
+    unsigned int compiled{0};   // programs compiled from source
+    unsigned int failed{0};     // programs that didn't compile or link
+    double wait_ms{0.0};        // time spent waiting for programs to be linked
+};
+
+// Linked programs, loaded from the binaries of an earlier run or compiled from source. Every binary is a file of its own
+// in the cache directory, named by a hash of the sources, the defines and the driver (vendor, renderer and version),
+// so a change of any of them compiles the program again. The sources are hashed with their #include "name" files put
+// in place, so shared files count as well.
+// Programs are prepared before they are needed: prepare() only starts loading or compiling, and the link status is
+// checked when the program is acquired. Preparing all programs first lets drivers with KHR_parallel_shader_compile
+// compile them at the same time, instead of one after the other.
+class ShaderCache
+{
+public:
+    static ShaderCache& instance();
+
+    // reads the driver strings; without a directory, or without program binaries in the driver, programs are always
+    // compiled. Must be called after the OpenGL context is made current and GLExtensions are loaded.
+    void open(const std::string &directory);
+    // defines are lines like "#define NAME 1\n", inserted after the #version line of both shaders
+    void prepare(const std::string &vertex_path, const std::string &fragment_path, const std::string &defines = "");
+    // returns the linked program, which is prepared first if it isn't yet. Programs that fail to link are returned as
+    // well, with their errors printed, like programs compiled without the cache.
+    GLuint acquire(const std::string &vertex_path, const std::string &fragment_path, const std::string &defines = "");
+    // deletes the programs that were prepared but never acquired
+    void shutdown();
+
+    const ShaderCacheStats& stats() const { return stats_; }
+
+private:
+    struct Program
+    {
+        GLuint id{0};
+        // 0 for programs loaded from a binary
+        GLuint vertex_shader{0};
+        GLuint fragment_shader{0};
+        uint64_t key{0};
+    };
+
+    ShaderCache() = default;
+
+    static bool readSources(const std::string &vertex_path, const std::string &fragment_path, const std::string &defines,
+                            std::string &vertex_source, std::string &fragment_source);
+    std::string binaryPath(uint64_t key) const;
+    bool loadBinary(Program &program) const;
+    void compile(Program &program, const std::string &vertex_source, const std::string &fragment_source) const;
+    void saveBinary(const Program &program) const;
+
+    std::string directory_;
+    std::string driver_;
+    bool binaries_{false};
+    // prepared programs that weren't acquired yet, by paths and defines
+    std::unordered_map<std::string, Program> pending_;
+    ShaderCacheStats stats_;
+};
+
+#endif //PROJECT_4_SHADER_CACHE_H
@@ -0,0 +1,80 @@
+#ifndef PROJECT_4_SHADER_PERMUTATIONS_H
+#define PROJECT_4_SHADER_PERMUTATIONS_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../include/shader.h"
+
+// Permutations of one program: the same sources compiled with different ShaderFeature bits, each one with the
+// handles of its uniforms resolved into a Uniforms (constructed from the ShaderProgram). A permutation is compiled
+// the first time it's asked for. Bits the sources don't use are dropped first, so features that differ only in those
+// share the permutation.
+template<typename Uniforms>
+class ShaderPermutations
+{
+public:
+    struct Permutation
+    {
+        const ShaderProgram* program;
+        Uniforms uniforms;
+    };
+
+    ShaderPermutations(const std::string &vertex_path, const std::string &fragment_path, uint32_t used_features)
+            : vertex_path_(vertex_path), fragment_path_(fragment_path), used_features_(used_features)
+    {
+    }
+
+    // takes a program compiled from the same sources elsewhere as the permutation of its features, instead of
+    // compiling it again; the program has to outlive the permutations
+    void adopt(const ShaderProgram &program)
+    {
+        permutations_.emplace(program.features() & used_features_, Permutation{&program, Uniforms(program)});
+    }
+
+    // starts compiling the permutation, unless it exists already
+    void prepare(uint32_t features) const
+    {
+        features &= used_features_;
+        if (permutations_.count(features) == 0)
+        {
+            ShaderProgram::prepare(vertex_path_, fragment_path_, features);
+        }
+    }
+
+    // returns the permutation, which is compiled if it doesn't exist yet; GL thread only
+    const Permutation& get(uint32_t features)
+    {
+        features &= used_features_;
+        auto found = permutations_.find(features);
+        if (found != permutations_.end())
+        {
+            return found->second;
+        }
+        programs_.emplace_back(new ShaderProgram(vertex_path_.c_str(), fragment_path_.c_str(), features));
+        const ShaderProgram &program = *programs_.back();
+        return permutations_.emplace(features, Permutation{&program, Uniforms(program)}).first->second;
+    }
+
+    // returns the permutation if it exists, or null. Doesn't call GL, so other threads can look permutations up as
+    // long as get() doesn't compile new ones at the same time.
+    const Permutation* find(uint32_t features) const
+    {
+        auto found = permutations_.find(features & used_features_);
+        return found != permutations_.end() ? &found->second : nullptr;
+    }
+
+private:
+    std::string vertex_path_;
+    std::string fragment_path_;
+    uint32_t used_features_;
+    // by the used features; elements of unordered_map keep their address when others are added
+    std::unordered_map<uint32_t, Permutation> permutations_;
+    // the permutations that weren't adopted
+    std::vector<std::unique_ptr<ShaderProgram>> programs_;
+};
+
+#endif //PROJECT_4_SHADER_PERMUTATIONS_H
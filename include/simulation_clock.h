@@ -0,0 +1,42 @@
+#ifndef PROJECT_4_SIMULATION_CLOCK_H
+#define PROJECT_4_SIMULATION_CLOCK_H
+
+#include <cstdint>
+
+// Fixed-timestep clock of the scene animation. Elapsed time (real or fixed per frame), scaled and stopped while paused,
+// is accumulated and consumed in ticks of a fixed length, so the simulation advances the same way at any frame rate.
+// Rendering interpolates between the last two ticks by alpha(). Time is counted in integer nanoseconds, so that the same
+// sequence of frame times always produces the same ticks.
+class SimulationClock
+{
+public:
+    // the animation speeds of the scene are given per tick of 60 Hz
+    static constexpr int kDefaultTickRate = 60;
+
+    explicit SimulationClock(int tick_rate = kDefaultTickRate, int max_ticks_per_frame = 8);
+
+    // returns the number of ticks to simulate for a frame that took elapsed_seconds
+    int advance(double elapsed_seconds);
+
+    // fraction of the next tick that has elapsed, in [0, 1)
+    float alpha() const;
+    uint64_t tickCount() const { return tick_count_; }
+    double tickSeconds() const { return static_cast<double>(tick_nanoseconds_) * 1e-9; }
+    double simulatedSeconds() const { return static_cast<double>(tick_count_) * tickSeconds(); }
+
+    void setPaused(bool paused) { paused_ = paused; }
+    bool isPaused() const { return paused_; }
+    void setScale(double scale);
+    double scale() const { return scale_; }
+
+private:
+    int64_t tick_nanoseconds_;
+    int max_ticks_per_frame_;
+    int64_t accumulator_{0};
+    uint64_t tick_count_{0};
+
+    bool paused_{false};
+    double scale_{1.0};
+};
+
+#endif //PROJECT_4_SIMULATION_CLOCK_H
@@ -3,6 +3,9 @@
 #define PROJECT_4_TEXTURE_H
 
 #include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
 #include <GL/gl.h>
 
 
@@ -18,8 +21,17 @@ public:
     explicit Texture2D(const std::string& filepath);
 };
 
+struct CubemapLoadStats;
+
 class Texture3D: public Texture{
 public:
+    // faces in the order of GL_TEXTURE_CUBE_MAP_POSITIVE_X + i; the packed file of them is read instead when there is
+    // one (see CubemapFile::pathFor())
     explicit Texture3D(const std::vector<std::string>& filepaths);
+
+    const CubemapLoadStats& loadStats() const;
+
+private:
+    std::shared_ptr<CubemapLoadStats> load_stats_;
 };
 #endif //PROJECT_4_TEXTURE_H
@@ -0,0 +1,50 @@
+#ifndef PROJECT_4_TEXTURE_CODEC_H
+#define PROJECT_4_TEXTURE_CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum TextureFormat : uint32_t
+{
+    kTextureFormatBC1 = 0,  // RGB, 8 bytes per 4x4 block
+    kTextureFormatBC3 = 1,  // RGBA, 16 bytes per 4x4 block
+    kTextureFormatBC4 = 2,  // single channel, 8 bytes per 4x4 block
+    kTextureFormatBC7 = 3   // RGBA, 16 bytes per 4x4 block
+};
+
+// Uncompressed 8-bit image with 1 to 4 channels, rows stored one after another.
+struct ImageData
+{
+    int width{0};
+    int height{0};
+    int channels{0};
+    std::vector<uint8_t> pixels;
+};
+
+// CPU reference encoders and decoders for block-compressed formats. They favour simplicity over quality:
+// BC1/BC3/BC4 use principal-axis endpoints with one least-squares refinement, BC7 only uses mode 6.
+class TextureCodec
+{
+public:
+    static size_t blockSize(TextureFormat format);
+    static size_t compressedSize(TextureFormat format, int width, int height);
+    static const char* name(TextureFormat format);
+
+    static std::vector<ImageData> buildMipChain(const ImageData &image);
+    static std::vector<uint8_t> compress(const ImageData &image, TextureFormat format);
+    static ImageData decompress(const uint8_t* data, int width, int height, TextureFormat format);
+    static double psnr(const ImageData &a, const ImageData &b, int channels);
+
+    static void encodeBlockBC1(const uint8_t rgba[64], uint8_t block[8]);
+    static void encodeBlockBC4(const uint8_t values[16], uint8_t block[8]);
+    static void encodeBlockBC3(const uint8_t rgba[64], uint8_t block[16]);
+    static void encodeBlockBC7(const uint8_t rgba[64], uint8_t block[16]);
+
+    static void decodeBlockBC1(const uint8_t block[8], uint8_t rgba[64]);
+    static void decodeBlockBC4(const uint8_t block[8], uint8_t values[16]);
+    static void decodeBlockBC3(const uint8_t block[16], uint8_t rgba[64]);
+    static bool decodeBlockBC7(const uint8_t block[16], uint8_t rgba[64]);
+};
+
+#endif //PROJECT_4_TEXTURE_CODEC_H
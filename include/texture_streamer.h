@@ -0,0 +1,148 @@
+#ifndef PROJECT_4_TEXTURE_STREAMER_H
+#define PROJECT_4_TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../include/job_system.h"
+#include "../include/ktx2.h"
+
+// Decoded image in CPU memory, rows ordered bottom to top as OpenGL expects them.
+// Images loaded from a .ktx2 file keep pixels empty and reference the block-compressed mip chain of the mapped file instead.
+struct TextureImage
+{
+    std::string filepath;
+    int width{0};
+    int height{0};
+    int channels{0};
+    std::unique_ptr<unsigned char, void (*)(void*)> pixels{nullptr, nullptr};
+    std::shared_ptr<Ktx2File> compressed;
+    unsigned char average_color[4]{};
+    double decode_ms{0.0};
+
+    size_t rowSize() const { return static_cast<size_t>(width) * static_cast<size_t>(channels); }
+};
+
+struct TextureStreamingStats
+{
+    unsigned int textures_decoded{0};
+    unsigned int textures_resident{0};
+    double decode_ms_total{0.0};
+    double upload_ms_total{0.0};
+    size_t bytes_uploaded_total{0};
+
+    // values of the last update() call
+    double upload_ms_frame{0.0};
+    size_t bytes_uploaded_frame{0};
+};
+
+// Load times of a cube map, per face in the order of GL_TEXTURE_CUBE_MAP_POSITIVE_X + i
+struct CubemapLoadStats
+{
+    bool resident{false};       // the values below are set once all faces are uploaded
+    bool packed{false};         // read from the packed .cubemap file instead of the face images
+    double decode_ms[6]{};      // on the worker threads, at the same time
+    double upload_ms[6]{};      // on the GL thread, spread over frames
+    double total_ms{0.0};       // from the request until the cube map is resident
+};
+
+class TextureStreamer
+{
+public:
+    static TextureStreamer& instance();
+
+    static bool decode(const std::string &filepath, bool flip_vertically, TextureImage &image);
+    static bool loadCompressed(const std::string &filepath, TextureImage &image);
+    static GLenum formatFor(int channels);
+    static GLenum compressedFormatFor(TextureFormat format);
+
+    void request(GLuint texture_id, const std::string &filepath);
+    void requestCubemap(GLuint texture_id, const std::vector<std::string> &filepaths, std::shared_ptr<CubemapLoadStats> stats);
+    void update();
+    void finish();
+    void shutdown();
+
+    bool isIdle();
+    void setUploadBudget(size_t bytes_per_frame) { upload_budget_ = bytes_per_frame; }
+    TextureStreamingStats stats() const;
+
+private:
+    // size of one slice of the pixel unpack buffer ring, and number of slices in flight
+    static constexpr size_t kSliceSize = 4 << 20;
+    static constexpr int kSliceCount = 3;
+
+    struct Upload
+    {
+        GLuint texture_id{0};
+        GLenum target{GL_TEXTURE_2D};
+        // the image being uploaded; of a cube map that's the face GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, and the faces
+        // after it wait in next_faces
+        TextureImage image;
+        std::deque<TextureImage> next_faces;
+        int face{0};
+        int next_level{0};
+        int next_row{0};
+        int frames{0};
+        double upload_ms{0.0};
+
+        // cube maps only: collected while the faces are decoded and uploaded, and handed to the texture once it's resident
+        std::chrono::steady_clock::time_point requested;
+        CubemapLoadStats cubemap_load;
+        std::shared_ptr<CubemapLoadStats> cubemap_stats;
+
+        // compressed images are uploaded level by level from the smallest one, rows are rows of blocks then
+        bool isComplete() const { return image.compressed ? next_level < 0 : next_row == image.height && next_faces.empty(); }
+    };
+
+    // faces of a cube map being decoded on several worker threads at the same time
+    struct CubemapDecode
+    {
+        Upload upload;
+        std::vector<TextureImage> faces;
+        std::atomic<int> remaining{0};
+    };
+
+    TextureStreamer() = default;
+    ~TextureStreamer();
+
+    static bool loadPackedCubemap(const std::string &filepath, std::vector<TextureImage> &faces);
+    void decodeCubemapFaces(const std::shared_ptr<CubemapDecode> &cubemap, const std::vector<std::string> &filepaths);
+    void finishCubemapDecode(CubemapDecode &cubemap);
+
+    void createUnpackBuffer();
+    void beginUpload(Upload upload);
+    void beginCompressedUpload(Upload &upload);
+    void beginCubemapUpload(Upload &upload);
+    bool stageSlice(const unsigned char* source, size_t bytes, size_t &offset);
+    bool uploadSlice(Upload &upload, size_t &budget);
+    void finishUpload(Upload &upload);
+
+    // decoded images handed over from the worker threads to the GL thread, and the counters the workers update
+    mutable std::mutex mutex_;
+    std::deque<Upload> decoded_;
+    unsigned int pending_decodes_{0};
+
+    // GL thread only
+    std::deque<Upload> uploads_;
+    size_t upload_budget_{16 << 20};
+    GLuint unpack_buffer_{0};
+    unsigned char* persistent_mapping_{nullptr};
+    GLsync slice_fences_[kSliceCount]{};
+    int next_slice_{0};
+
+    // textures_decoded and decode_ms_total are written by the workers under mutex_, all others by the GL thread
+    TextureStreamingStats stats_;
+
+    // images are decoded as background jobs of the shared job system; the destructor waits for them before the members
+    // they use are destroyed
+    JobSystem &jobs_{JobSystem::instance()};
+    JobCounter decoding_;
+};
+
+#endif //PROJECT_4_TEXTURE_STREAMER_H
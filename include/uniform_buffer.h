@@ -0,0 +1,52 @@
+#ifndef PROJECT_4_UNIFORM_BUFFER_H
+#define PROJECT_4_UNIFORM_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Binding point of the FrameConstants block, ShaderProgram binds the block of every program to it after linking.
+constexpr GLuint kFrameConstantsBinding = 0;
+
+// Per-frame state shared by all shaders, laid out as the std140 FrameConstants uniform block declared in
+// shaders/include/frame_constants.glsl.
+// vec3 values are padded to vec4, as std140 aligns them to 16 bytes anyway.
+struct FrameConstants
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 view_projection;
+    glm::vec4 camera_position;   // w unused
+    glm::vec4 light_direction;   // direction the light travels in, w unused
+    glm::vec4 light_color;       // colour in rgb, intensity in a
+};
+static_assert(sizeof(FrameConstants) == 240, "FrameConstants must match the std140 layout of the uniform block");
+
+// Ring of uniform buffer regions, one of which is written per frame. A region is only overwritten once the GPU has
+// finished the frame that read it, so writing never stalls on draws still in flight. With buffer storage support the
+// buffer is mapped persistently once, otherwise every region is mapped unsynchronized right before it's written.
+class UniformBufferRing
+{
+public:
+    UniformBufferRing(size_t block_size, int region_count);
+    ~UniformBufferRing();
+    UniformBufferRing(const UniformBufferRing&) = delete;
+    UniformBufferRing& operator=(const UniformBufferRing&) = delete;
+
+    void write(const void* block, GLuint binding);
+    void endFrame();
+
+private:
+    void waitForRegion(int region);
+
+    GLuint buffer_{0};
+    size_t block_size_;
+    size_t region_stride_;
+    int region_count_;
+    int current_region_{-1};
+    int next_region_{0};
+    unsigned char* persistent_mapping_{nullptr};
+    std::vector<GLsync> region_fences_;
+};
+
+#endif //PROJECT_4_UNIFORM_BUFFER_H
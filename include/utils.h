@@ -5,23 +5,20 @@
 #include <cmath>
 #include <chrono>
 
-double getCurrentTimeInSeconds() {
+// Seconds of a monotonic clock with an arbitrary start, for measuring frame times
+inline double getCurrentTimeInSeconds() {
     using namespace std::chrono;
-    auto now = steady_clock::now();
-    auto now_ms = time_point_cast<milliseconds>(now);
-    auto value = now_ms.time_since_epoch();
-    long duration = value.count();
-    return duration / 1000.0;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
 }
 
 // Function to get the sine value based on the current time
-double getSineWave(double time, double period) {
+inline double getSineWave(double time, double period) {
     double frequency = 1.0 / period;
     return std::sin(2.0 * M_PI * frequency * time);
 }
 
 // Function to get sine with 180 degrees in 3 seconds
-double getSin180In3Seconds() {
+inline double getSin180In3Seconds() {
     double currentTime = getCurrentTimeInSeconds();
     return getSineWave(currentTime, 18.0); // 18 seconds for a full 360 degrees cycle
 }
@@ -0,0 +1,34 @@
+#ifndef PROJECT_4_VERTEX_ATTRIBUTES_H
+#define PROJECT_4_VERTEX_ATTRIBUTES_H
+
+#include <glad/glad.h>
+
+#include "../include/shader.h"
+#include "../include/vertex_format.h"
+
+// Uniforms of the vertex shaders that undo the quantization of the positions of a VertexLayout ("vertexFormat." in the
+// shaders). The decoding of the normals is a feature of the program instead, see VertexAttributes::shaderFeatures().
+struct VertexFormatUniforms
+{
+    VertexFormatUniforms() = default;
+    explicit VertexFormatUniforms(const ShaderProgram &program);
+
+    UniformHandle<glm::vec3> position_offset;
+    UniformHandle<glm::vec3> position_scale;
+};
+
+// Vertex attributes of the mesh vertex arrays, with the attribute locations of MeshAttribute.
+class VertexAttributes
+{
+public:
+    // points the attributes of the bound vertex array at interleaved vertices of the layout in the bound
+    // GL_ARRAY_BUFFER, from offset on; attributes the layout doesn't store are disabled
+    static void setPointers(const VertexLayout &layout, size_t offset = 0);
+    // ShaderFeature bits of the programs that draw vertices of the layout
+    static uint32_t shaderFeatures(const VertexLayout &layout);
+    // the program has to be in use
+    static void setUniforms(const ShaderProgram &program, const VertexFormatUniforms &uniforms, const VertexLayout &layout,
+                            const VertexDequantization &dequantization);
+};
+
+#endif //PROJECT_4_VERTEX_ATTRIBUTES_H
@@ -0,0 +1,99 @@
+#ifndef PROJECT_4_VERTEX_FORMAT_H
+#define PROJECT_4_VERTEX_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../include/mesh_bounds.h"
+
+enum MeshAttribute : uint32_t
+{
+    kMeshAttributePosition = 0,
+    kMeshAttributeNormal   = 1,
+    kMeshAttributeTexcoord = 2,
+    kMeshAttributeCount    = 3
+};
+
+// How a vertex attribute is stored in the vertex buffer.
+enum VertexEncoding : uint32_t
+{
+    kVertexEncodingNone = 0,            // not stored
+    kVertexEncodingFloat = 1,           // 32-bit floats
+    kVertexEncodingUnorm16 = 2,         // 16-bit unsigned normalized: positions relative to the bounding box, texture
+                                        // coordinates in [0, 1]
+    kVertexEncodingHalf = 3,            // 16-bit floats, texture coordinates only
+    kVertexEncodingOctahedral16 = 4,    // unit vectors folded onto an octahedron, 2 16-bit signed normalized coordinates
+    kVertexEncodingInt2101010 = 5       // unit vectors as 3 10-bit signed normalized components (GL_INT_2_10_10_10_REV)
+};
+
+struct VertexAttributeLayout
+{
+    VertexEncoding encoding{kVertexEncodingNone};
+    // components of the attribute as the shader sees it, and its offset in the vertex in bytes
+    uint32_t components{0};
+    uint32_t offset{0};
+};
+
+// Constants that turn the quantized positions back into the coordinates of the mesh: offset + scale * position.
+struct VertexDequantization
+{
+    float position_offset[3]{0.0f, 0.0f, 0.0f};
+    float position_scale[3]{1.0f, 1.0f, 1.0f};
+};
+
+// Interleaved vertex with a position, a normal and texture coordinates (the MeshAttribute order), each one stored in
+// an encoding of its own. Every attribute starts at a multiple of 4 bytes, so 16-bit positions are padded to 8 bytes.
+// Encodings that don't apply to an attribute are replaced by floats.
+class VertexLayout
+{
+public:
+    VertexLayout() = default;
+    VertexLayout(VertexEncoding position, VertexEncoding normal, VertexEncoding texcoord);
+
+    static bool supports(MeshAttribute attribute, VertexEncoding encoding);
+
+    const VertexAttributeLayout& attribute(MeshAttribute attribute) const { return attributes_[attribute]; }
+    uint32_t stride() const { return stride_; }
+    // identity, unless the positions are quantized relative to the bounding box
+    VertexDequantization dequantizationFor(const MeshBounds &bounds) const;
+
+private:
+    VertexAttributeLayout attributes_[kMeshAttributeCount];
+    uint32_t stride_{0};
+};
+
+// One attribute of the vertices to encode: the components of the first one at data, those of the next ones stride
+// floats further. A null stream encodes zeros.
+struct VertexStream
+{
+    const float* data{nullptr};
+    size_t stride{0};
+};
+
+// CPU encoders of the vertex attribute encodings, and decoders that follow the conversions GL applies on the way to
+// the vertex shader (signed normalized values as c / (2^(b-1) - 1), clamped to -1, as in GL 4.2 and later).
+class VertexCodec
+{
+public:
+    static uint16_t encodeUnorm16(float value);
+    static float decodeUnorm16(uint16_t value);
+    static int16_t encodeSnorm16(float value);
+    static float decodeSnorm16(int16_t value);
+    // rounds to nearest even, overflows to infinity
+    static uint16_t encodeHalf(float value);
+    static float decodeHalf(uint16_t value);
+    // of the roundings of the folded coordinates, the one that decodes closest to the normal is taken
+    static void encodeOctahedral(const float normal[3], int16_t encoded[2]);
+    static void decodeOctahedral(const int16_t encoded[2], float normal[3]);
+    static uint32_t encodeInt2101010(const float normal[3]);
+    static void decodeInt2101010(uint32_t encoded, float normal[3]);
+
+    // writes count vertices in the layout into vertices, count * layout.stride() bytes
+    static void encode(const VertexLayout &layout, const VertexDequantization &dequantization,
+                       const VertexStream streams[kMeshAttributeCount], size_t count, uint8_t* vertices);
+    // reads back one vertex as the vertex shader sees it, with the normal normalized
+    static void decode(const VertexLayout &layout, const VertexDequantization &dequantization, const uint8_t* vertex,
+                       float position[3], float normal[3], float texcoord[2]);
+};
+
+#endif //PROJECT_4_VERTEX_FORMAT_H
@@ -0,0 +1,85 @@
+#ifndef PROJECT_4_VIRTUAL_TEXTURE_H
+#define PROJECT_4_VIRTUAL_TEXTURE_H
+
+#include <glad/glad.h>
+#include <memory>
+#include <string>
+
+#include "../include/shader.h"
+#include "../include/virtual_texture_cache.h"
+#include "../include/virtual_texture_file.h"
+
+// Handles of the "vt" uniform struct declared by the shaders that sample a virtual texture
+struct VirtualTextureUniforms
+{
+    VirtualTextureUniforms() = default;
+    explicit VirtualTextureUniforms(const ShaderProgram &program);
+
+    UniformHandle<int> atlas;
+    UniformHandle<int> indirection;
+    UniformHandle<glm::vec2> virtual_size;
+    UniformHandle<glm::vec2> atlas_size;
+    UniformHandle<float> page_size;
+    UniformHandle<float> border;
+    UniformHandle<float> max_level;
+    UniformHandle<float> lod_bias;
+};
+
+// Texture streamed page by page from a .vtex page pyramid. A feedback pass renders the ids of the pages the shader needs
+// into a small integer framebuffer, which is read back asynchronously. Missing pages are copied into a physical atlas
+// texture and an indirection texture maps every page of the virtual texture to its slot in the atlas.
+class VirtualTexture
+{
+public:
+    explicit VirtualTexture(const std::string &filepath);
+    ~VirtualTexture();
+    VirtualTexture(const VirtualTexture&) = delete;
+    VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+    bool isLoaded() const { return atlas_ != 0; }
+    GLuint atlasTexture() const { return atlas_; }
+
+    bool beginFeedback(int viewport_width, int viewport_height);
+    void endFeedback();
+    void update();
+
+    void bind(const ShaderProgram &program, const VirtualTextureUniforms &uniforms, int atlas_unit, int indirection_unit) const;
+    void bindFeedback(const ShaderProgram &program, const VirtualTextureUniforms &uniforms) const;
+    const VirtualTextureStats& stats() const { return cache_->stats(); }
+
+private:
+    // size of the atlas in pages, the indirection texture stores slot coordinates in 8 bits
+    static constexpr int kAtlasColumns = 16;
+    static constexpr int kAtlasRows = 16;
+    // the feedback framebuffer has 1/8 of the size of the viewport in each direction
+    static constexpr int kFeedbackDivisor = 8;
+    static constexpr size_t kPagesPerFrame = 16;
+
+    void createFeedbackBuffer(int width, int height);
+    void deleteFeedbackBuffer();
+    void processFeedback(const GLushort* texels, size_t count);
+    void uploadPage(VirtualPageId page, int slot);
+    void updateIndirection();
+    void setUniforms(const ShaderProgram &program, const VirtualTextureUniforms &uniforms) const;
+
+    VirtualTextureFile file_;
+    std::unique_ptr<VirtualTextureCache> cache_;
+    GLenum format_{GL_RGB};
+
+    GLuint atlas_{0};
+    GLuint indirection_{0};
+
+    GLuint feedback_framebuffer_{0};
+    GLuint feedback_color_{0};
+    GLuint feedback_depth_{0};
+    GLuint feedback_pack_buffer_{0};
+    GLsync feedback_fence_{nullptr};
+    int feedback_width_{0};
+    int feedback_height_{0};
+    GLint saved_framebuffer_{0};
+    GLint saved_viewport_[4]{};
+
+    bool converged_{false};
+};
+
+#endif //PROJECT_4_VIRTUAL_TEXTURE_H
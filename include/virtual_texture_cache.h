@@ -0,0 +1,90 @@
+#ifndef PROJECT_4_VIRTUAL_TEXTURE_CACHE_H
+#define PROJECT_4_VIRTUAL_TEXTURE_CACHE_H
+
+#include <cstdint>
+#include <list>
+#include <vector>
+
+#include "../include/virtual_texture_file.h"
+
+struct VirtualTextureStats
+{
+    // values of the last frame
+    unsigned int pages_requested{0};
+    unsigned int pages_hit{0};
+    unsigned int pages_missed{0};
+    unsigned int pages_uploaded{0};
+    unsigned int pages_evicted{0};
+
+    unsigned int pages_resident{0};
+};
+
+// Maps pages of a virtual texture to slots of the physical page atlas and derives the indirection texture from it.
+class VirtualTexturePageTable
+{
+public:
+    static constexpr int kNotResident = -1;
+
+    VirtualTexturePageTable() = default;
+    VirtualTexturePageTable(const VirtualTextureLayout &layout, int atlas_columns);
+
+    void map(VirtualPageId page, int slot);
+    void unmap(VirtualPageId page);
+    int slotOf(VirtualPageId page) const { return slots_[static_cast<size_t>(layout_.pageIndex(page))]; }
+    bool isResident(VirtualPageId page) const { return slotOf(page) != kNotResident; }
+
+    bool isDirty() const { return dirty_; }
+    std::vector<std::vector<uint8_t>> buildIndirection();
+
+private:
+    VirtualTextureLayout layout_;
+    int atlas_columns_{1};
+    std::vector<int> slots_;
+    bool dirty_{true};
+};
+
+// Residency of virtual texture pages in a fixed number of atlas slots. Pages reported by the feedback pass are either
+// hits, which refresh their slot, or misses, which get a slot of the least recently used page. Slots of pages used
+// in the current frame and of pinned pages are never evicted.
+class VirtualTextureCache
+{
+public:
+    VirtualTextureCache(const VirtualTextureLayout &layout, int atlas_columns, int atlas_rows);
+
+    void beginFrame();
+    void request(VirtualPageId page);
+    std::vector<VirtualPageId> takeMisses(size_t max_count);
+    int allocate(VirtualPageId page);
+    void pin(VirtualPageId page);
+
+    VirtualTexturePageTable& pageTable() { return page_table_; }
+    const VirtualTextureStats& stats() const { return stats_; }
+
+private:
+    struct Slot
+    {
+        VirtualPageId page{0};
+        uint64_t last_used{0};
+        bool listed{false};     // slot is in recently_used_
+        bool pinned{false};
+        std::list<int>::iterator position;
+    };
+
+    void touch(int slot);
+
+    VirtualTextureLayout layout_;
+    VirtualTexturePageTable page_table_;
+
+    std::vector<Slot> slots_;
+    std::vector<int> free_slots_;
+    // slots of unpinned pages, most recently used first
+    std::list<int> recently_used_;
+
+    uint64_t frame_{0};
+    std::vector<uint64_t> requested_in_frame_;
+    std::vector<VirtualPageId> misses_;
+
+    VirtualTextureStats stats_;
+};
+
+#endif //PROJECT_4_VIRTUAL_TEXTURE_CACHE_H
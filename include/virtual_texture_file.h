@@ -0,0 +1,95 @@
+#ifndef PROJECT_4_VIRTUAL_TEXTURE_FILE_H
+#define PROJECT_4_VIRTUAL_TEXTURE_FILE_H
+
+#include <cstdint>
+#include <string>
+
+#include "../include/mapped_file.h"
+#include "../include/texture_codec.h"
+
+// Page of a virtual texture packed into 32 bits: 4 bits mip level, 14 bits row and 14 bits column of the page within its level.
+typedef uint32_t VirtualPageId;
+
+// Division of a virtual texture into a pyramid of square pages. Level 0 has the resolution of the source image,
+// every further level halves it, until the smaller side is covered by a single page.
+class VirtualTextureLayout
+{
+public:
+    static constexpr int kMaxLevels = 16;
+
+    VirtualTextureLayout() = default;
+    VirtualTextureLayout(int width, int height, int page_size);
+
+    static bool isValid(int width, int height, int page_size);
+    static VirtualPageId pageId(int level, int x, int y)
+    {
+        return (static_cast<uint32_t>(level) << 28) | (static_cast<uint32_t>(y) << 14) | static_cast<uint32_t>(x);
+    }
+    static int pageLevel(VirtualPageId page) { return static_cast<int>(page >> 28); }
+    static int pageY(VirtualPageId page) { return static_cast<int>((page >> 14) & 0x3FFF); }
+    static int pageX(VirtualPageId page) { return static_cast<int>(page & 0x3FFF); }
+    static VirtualPageId parentOf(VirtualPageId page) { return pageId(pageLevel(page) + 1, pageX(page) / 2, pageY(page) / 2); }
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    int pageSize() const { return page_size_; }
+    int levelCount() const { return level_count_; }
+    int pagesX(int level) const { return (width_ / page_size_) >> level; }
+    int pagesY(int level) const { return (height_ / page_size_) >> level; }
+    int pageCount() const { return first_page_[level_count_]; }
+    int pageIndex(VirtualPageId page) const
+    {
+        return first_page_[pageLevel(page)] + pageY(page) * pagesX(pageLevel(page)) + pageX(page);
+    }
+
+private:
+    int width_{0};
+    int height_{0};
+    int page_size_{0};
+    int level_count_{0};
+    int first_page_[kMaxLevels + 1]{};
+};
+
+struct VirtualTextureHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t page_size;
+    uint32_t border;
+    uint32_t channels;
+    uint32_t level_count;
+    uint32_t page_count;
+    uint32_t reserved;
+    uint64_t pages_offset;
+};
+
+// Page pyramid of a virtual texture on disk (.vtex). Every page is stored as a square tile with a border of texels
+// copied from its neighbours, so that bilinear filtering in the page atlas doesn't bleed into unrelated pages.
+// Tiles are uncompressed, rows ordered bottom to top, and are read straight from the memory-mapped file.
+class VirtualTextureFile
+{
+public:
+    static constexpr uint32_t kVersion = 1;
+
+    static std::string pathFor(const std::string &image_filepath);
+    static bool write(const std::string &filepath, const ImageData &image, int page_size, int border);
+
+    bool open(const std::string &filepath);
+    void close();
+
+    bool isOpen() const { return file_.isOpen(); }
+    const VirtualTextureHeader& header() const { return header_; }
+    const VirtualTextureLayout& layout() const { return layout_; }
+    int tileSize() const { return static_cast<int>(header_.page_size + 2 * header_.border); }
+    size_t tileBytes() const;
+    const uint8_t* tileData(VirtualPageId page) const;
+
+private:
+    MappedFile file_;
+    VirtualTextureHeader header_{};
+    VirtualTextureLayout layout_;
+};
+
+#endif //PROJECT_4_VIRTUAL_TEXTURE_FILE_H
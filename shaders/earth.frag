@@ -6,25 +6,29 @@ in vec2 TexCoords;
 
 out vec4 FragColor;
 
-uniform sampler2D texture1;
-uniform float clouds_intensity;
-
-struct Material {
-    sampler2D diffuse;
-    vec3 specular;
-    float shininess;
-};
+#include "include/lighting.glsl"
 
 struct Light {
-    vec3 direction;
-    vec3 color;
     vec3 ambient;
-    vec3 diffuse;
 };
 
-uniform Material material;
 uniform Light light;
 
+#ifdef VIRTUAL_TEXTURE
+#include "include/virtual_texture.glsl"
+#else
+struct Material {
+    sampler2D diffuse;
+};
+
+uniform Material material;
+#endif
+
+#ifdef CLOUDS
+uniform sampler2D texture1;
+uniform float clouds_intensity;
+#endif
+
 
 void main()
 {
@@ -32,16 +36,21 @@ void main()
    vec3 ambient = 0.2 * light.ambient;
 
    // diffuse light
-   vec3 norm = normalize(Normal);
-   vec3 lightDir = normalize(-light.direction);
-   float diff = max(dot(norm, lightDir), 0.0);
-   vec3 diffuse = light.diffuse *  diff * light.color;
+   vec3 diffuse = diffuseLight(normalize(Normal));
 
    // The texture image represents all of the object's diffuse colors.
    // The ambient material's color equal to the diffuse material's color as well.
+#ifdef VIRTUAL_TEXTURE
+   vec3 result = (ambient + diffuse) * sampleVirtualTexture(TexCoords).rgb;
+#else
    vec3 result = (ambient + diffuse) * texture(material.diffuse, TexCoords).rgb;
+#endif
 
+#ifdef CLOUDS
    // Mix the resulting color with another texture (e.g., clouds texture) based on the clouds intensity.
    FragColor = mix(vec4(result, 1.0), texture(texture1, TexCoords), clouds_intensity);
+#else
+   FragColor = vec4(result, 1.0);
+#endif
 
 };
\ No newline at end of file
@@ -0,0 +1,19 @@
+#version 330 core
+
+in vec2 TexCoords;
+
+// page column, row and level wanted at this pixel; alpha marks covered pixels
+layout (location = 0) out uvec4 Feedback;
+
+#include "include/virtual_texture.glsl"
+
+
+void main()
+{
+   vec2 uv = clamp(TexCoords, 0.0, 1.0);
+   float level = virtualTextureLevel(uv);
+
+   vec2 pages = vt.virtual_size / (vt.page_size * exp2(level));
+   vec2 page = min(floor(uv * pages), pages - 1.0);
+   Feedback = uvec4(uvec2(page), uint(level), 1u);
+};
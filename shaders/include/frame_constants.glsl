@@ -0,0 +1,10 @@
+// per-frame state shared by all programs, written once per frame (see FrameConstants in uniform_buffer.h)
+layout (std140) uniform FrameConstants
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    vec4 lightDirection;
+    vec4 lightColor;    // colour in rgb, intensity in a
+};
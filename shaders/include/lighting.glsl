@@ -0,0 +1,29 @@
+// Light of the scene, as set in the FrameConstants block. Ambient light is left to the shaders, which weight it
+// differently.
+#include "frame_constants.glsl"
+
+// colour of the light times its intensity
+vec3 lightIntensity()
+{
+    return lightColor.rgb * lightColor.a;
+}
+
+// diffuse light on a surface with the (normalized) normal
+vec3 diffuseLight(vec3 normal)
+{
+    vec3 lightDir = normalize(-lightDirection.xyz);
+    float diff = max(dot(normal, lightDir), 0.0);
+    return diff * lightIntensity();
+}
+
+#ifdef SPECULAR
+// Phong highlight at the position in world coordinates, seen from the camera
+vec3 specularLight(vec3 normal, vec3 position, float strength, float shininess)
+{
+    vec3 lightDir = normalize(-lightDirection.xyz);
+    vec3 viewDir = normalize(cameraPosition.xyz - position);
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    return strength * spec * lightIntensity();
+}
+#endif
@@ -0,0 +1,37 @@
+// Virtual texture: pages are looked up in the indirection texture and sampled from the page atlas.
+struct VirtualTexture {
+    sampler2D atlas;
+    sampler2D indirection;
+    vec2 virtual_size;
+    vec2 atlas_size;
+    float page_size;
+    float border;
+    float max_level;
+    float lod_bias;
+};
+
+uniform VirtualTexture vt;
+
+
+// mip level the texture unit would pick for the virtual texture at full resolution, but in whole levels: pages are
+// stored without filtering between levels
+float virtualTextureLevel(vec2 uv)
+{
+   vec2 texel = uv * vt.virtual_size;
+   float lod = 0.5 * log2(max(dot(dFdx(texel), dFdx(texel)), dot(dFdy(texel), dFdy(texel)))) - vt.lod_bias;
+   return clamp(floor(lod), 0.0, vt.max_level);
+}
+
+vec4 sampleVirtualTexture(vec2 uv)
+{
+   uv = clamp(uv, 0.0, 1.0);
+   float level = virtualTextureLevel(uv);
+
+   // atlas column and row of the page shown in place of the wanted one, and its level (the same or a coarser one)
+   vec3 entry = floor(textureLod(vt.indirection, uv, level).rgb * 255.0 + 0.5);
+
+   vec2 pages = vt.virtual_size / (vt.page_size * exp2(entry.b));
+   vec2 in_page = uv * pages - min(floor(uv * pages), pages - 1.0);
+   vec2 atlas_texel = entry.rg * (vt.page_size + 2.0 * vt.border) + vt.border + in_page * vt.page_size;
+   return textureLod(vt.atlas, atlas_texel / vt.atlas_size, 0.0);
+}
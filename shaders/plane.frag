@@ -4,32 +4,28 @@ out vec4 FragColor;
 in vec3 Normal;
 in vec3 FragPos;
 
-uniform vec3 lightPos;
-uniform vec3 viewPos;
-uniform vec3 lightColor;
+#include "include/lighting.glsl"
+
 uniform vec3 objectColor;
 
 void main()
 {
        // ambient
        float ambientStrength = 0.1;
-       vec3 ambient = ambientStrength * lightColor;
+       vec3 ambient = ambientStrength * lightIntensity();
 
        // diffuse
        vec3 norm = normalize(Normal);
-       vec3 lightDir = normalize(lightPos - FragPos);
-       float diff = max(dot(norm, lightDir), 0.0);
-       vec3 diffuse = diff * lightColor;
+       vec3 light = ambient + diffuseLight(norm);
 
+#ifdef SPECULAR
        // specular
        float specularStrength = 0.5;
-       vec3 viewDir = normalize(viewPos - FragPos);
-       vec3 reflectDir = reflect(-lightDir, norm);
-       float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
-       vec3 specular = specularStrength * spec * lightColor;
+       light += specularLight(norm, FragPos, specularStrength, 32.0);
+#endif
 
         // Combine all lighting components (ambient, diffuse, specular) and multiply by the object's base color
-       vec3 result = (ambient + diffuse + specular) * objectColor;
+       vec3 result = light * objectColor;
 
        FragColor = vec4(result, 1.0);
 };
\ No newline at end of file
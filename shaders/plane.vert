@@ -1,21 +1,55 @@
 #version 330 core
 
+// quantized as set by the vertex layout of the mesh, see vertexFormat
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
+layout (location = 1) in vec4 aNormal;
+#ifdef INSTANCING
+// model matrix of the instance, as the rows of its upper 3x4 part
+layout (location = 3) in vec4 aModelRow0;
+layout (location = 4) in vec4 aModelRow1;
+layout (location = 5) in vec4 aModelRow2;
+#else
+uniform mat4 model;
+#endif
 
 out vec3 FragPos;
 out vec3 Normal;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "include/frame_constants.glsl"
+
+// undoes the quantization of the positions (see VertexLayout in vertex_format.h)
+struct VertexFormat
+{
+    vec3 position_offset;
+    vec3 position_scale;
+};
+uniform VertexFormat vertexFormat;
+
+vec3 decodeNormal(vec4 normal)
+{
+#ifdef OCTAHEDRAL_NORMALS
+    // unfolds the lower half of the octahedron, where |x| + |y| > 1
+    vec3 n = vec3(normal.xy, 1.0 - abs(normal.x) - abs(normal.y));
+    float fold = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -fold : fold;
+    n.y += n.y >= 0.0 ? -fold : fold;
+    return normalize(n);
+#else
+    // floats and GL_INT_2_10_10_10_REV are read as they are
+    return normal.xyz;
+#endif
+}
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
+#ifdef INSTANCING
+    mat4 model = transpose(mat4(aModelRow0, aModelRow1, aModelRow2, vec4(0.0, 0.0, 0.0, 1.0)));
+#endif
+    vec3 position = vertexFormat.position_offset + vertexFormat.position_scale * aPos;
+    FragPos = vec3(model * vec4(position, 1.0));
 
     // Normal matrix is a trick to keep normals perpendicular even if non-uniform scaling is applied
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    Normal = mat3(transpose(inverse(model))) * decodeNormal(aNormal);
 
-    gl_Position = projection * view * vec4(FragPos, 1.0);
+    gl_Position = viewProjection * vec4(FragPos, 1.0);
 };
\ No newline at end of file
@@ -1,17 +1,22 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
 
 out vec3 TexCoords;
 
-uniform mat4 projection;
-uniform mat4 view;
+#include "include/frame_constants.glsl"
 
 void main()
 {
-    TexCoords = aPos;
-    vec4 pos = projection * view * vec4(aPos, 1.0);
+    // a triangle that covers the whole screen, (-1, -1), (3, -1) and (-1, 3); the parts outside it are clipped
+    vec2 position = vec2(float((gl_VertexID & 1) << 2) - 1.0, float((gl_VertexID & 2) << 1) - 1.0);
 
-    // Use pos.xyww to ensure that the w component is the same for both z and w coordinates.
-    // This keeps the depth at the maximum value (far plane) for the entire skybox, making it always appear behind other objects.
-    gl_Position = pos.xyww;
+    // the skybox doesn't move with the viewer: translation is removed from the view matrix, only rotation is kept.
+    // Undoing that view-projection gives the point of the far plane behind the vertex, in the direction of the view
+    // ray through it. The direction is interpolated linearly across the screen like the points of the plane, so
+    // the cubemap is sampled along the exact ray of every pixel.
+    vec4 direction = inverse(projection * mat4(mat3(view))) * vec4(position, 1.0, 1.0);
+    TexCoords = direction.xyz / direction.w;
+
+    // z equal to w puts the triangle at the maximum depth (far plane) for the entire screen, making it always
+    // appear behind other objects
+    gl_Position = vec4(position, 1.0, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,368 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "../include/benchmark.h"
+#include "../include/render_state.h"
+#include "../include/shader.h"
+#include "../include/texture_streamer.h"
+#include "../include/utils.h"
+
+constexpr int GpuTimer::kQueryCount;
+
+bool BenchmarkScenario::load(const std::string &filepath, BenchmarkScenario &scenario)
+/** Reads the scenario file. Settings that are not given keep their defaults, a scenario without camera keyframes
+keeps the camera of the interactive mode. */
+{
+    std::ifstream file(filepath);
+    if (!file)
+    {
+        std::cerr << "Benchmark: failed to open " << filepath << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line))
+    {
+        line_number++;
+        const size_t comment = line.find('#');
+        if (comment != std::string::npos)
+        {
+            line.erase(comment);
+        }
+        std::istringstream fields(line);
+        std::string key;
+        if (!(fields >> key))
+        {
+            continue;
+        }
+
+        bool valid = true;
+        if (key == "name")
+        {
+            std::getline(fields >> std::ws, scenario.name);
+            valid = !scenario.name.empty();
+        }
+        else if (key == "frames")
+        {
+            valid = static_cast<bool>(fields >> scenario.frame_count) && scenario.frame_count > 0;
+        }
+        else if (key == "warmup")
+        {
+            valid = static_cast<bool>(fields >> scenario.warmup_frames) && scenario.warmup_frames >= 0;
+        }
+        else if (key == "planes")
+        {
+            valid = static_cast<bool>(fields >> scenario.plane_count) && scenario.plane_count > 0;
+        }
+        else if (key == "surface")
+        {
+            std::string surface;
+            fields >> surface;
+            valid = surface == "day" || surface == "night";
+            scenario.night = surface == "night";
+        }
+        else if (key == "camera")
+        {
+            CameraKeyframe keyframe;
+            valid = static_cast<bool>(fields >> keyframe.time >> keyframe.position.x >> keyframe.position.y >> keyframe.position.z);
+            glm::vec3 target;
+            if (valid && fields >> target.x >> target.y >> target.z)
+            {
+                keyframe.target = target;
+            }
+            if (valid && !scenario.camera_path.empty() && keyframe.time <= scenario.camera_path.back().time)
+            {
+                std::cerr << "Benchmark: " << filepath << ":" << line_number << ": camera keyframes must be in time order" << std::endl;
+                return false;
+            }
+            scenario.camera_path.push_back(keyframe);
+        }
+        else
+        {
+            std::cerr << "Benchmark: " << filepath << ":" << line_number << ": unknown setting " << key << std::endl;
+            return false;
+        }
+
+        if (!valid)
+        {
+            std::cerr << "Benchmark: " << filepath << ":" << line_number << ": invalid value of " << key << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+CameraKeyframe BenchmarkScenario::cameraAt(float time) const
+{
+    if (camera_path.empty())
+    {
+        return CameraKeyframe();
+    }
+    if (time <= camera_path.front().time)
+    {
+        return camera_path.front();
+    }
+    for (size_t i = 1; i < camera_path.size(); i++)
+    {
+        const CameraKeyframe &next = camera_path[i];
+        if (time < next.time)
+        {
+            const CameraKeyframe &previous = camera_path[i - 1];
+            const float t = (time - previous.time) / (next.time - previous.time);
+            CameraKeyframe keyframe;
+            keyframe.time = time;
+            keyframe.position = previous.position + (next.position - previous.position) * t;
+            keyframe.target = previous.target + (next.target - previous.target) * t;
+            return keyframe;
+        }
+    }
+    return camera_path.back();
+}
+
+FrameTimeStats FrameTimeStats::compute(std::vector<double> samples)
+/** Percentiles are taken by the nearest rank. */
+{
+    FrameTimeStats stats;
+    if (samples.empty())
+    {
+        return stats;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    const size_t count = samples.size();
+    auto percentile = [&](double p) {
+        const size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * static_cast<double>(count)));
+        return samples[std::min(count - 1, rank > 0 ? rank - 1 : 0)];
+    };
+
+    double sum = 0.0;
+    for (double sample : samples)
+    {
+        sum += sample;
+    }
+    stats.mean = sum / static_cast<double>(count);
+    double squares = 0.0;
+    for (double sample : samples)
+    {
+        squares += (sample - stats.mean) * (sample - stats.mean);
+    }
+    stats.standard_deviation = std::sqrt(squares / static_cast<double>(count));
+
+    stats.min = samples.front();
+    stats.max = samples.back();
+    stats.p50 = percentile(50.0);
+    stats.p95 = percentile(95.0);
+    stats.p99 = percentile(99.0);
+    return stats;
+}
+
+GpuTimer::GpuTimer()
+{
+    glGenQueries(kQueryCount, queries_);
+}
+
+GpuTimer::~GpuTimer()
+{
+    glDeleteQueries(kQueryCount, queries_);
+}
+
+void GpuTimer::begin()
+/** Starts measuring with the next query of the ring, after reading back its last result if it's still pending. */
+{
+    if (pending_count_ == kQueryCount)
+    {
+        const int oldest = next_query_;
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(queries_[oldest], GL_QUERY_RESULT, &nanoseconds);
+        milliseconds_.push_back(static_cast<double>(nanoseconds) * 1e-6);
+        pending_count_--;
+    }
+    glBeginQuery(GL_TIME_ELAPSED, queries_[next_query_]);
+}
+
+void GpuTimer::end()
+{
+    glEndQuery(GL_TIME_ELAPSED);
+    next_query_ = (next_query_ + 1) % kQueryCount;
+    pending_count_++;
+}
+
+void GpuTimer::collect(bool wait)
+{
+    while (pending_count_ > 0)
+    {
+        const int oldest = (next_query_ - pending_count_ + kQueryCount) % kQueryCount;
+        if (!wait)
+        {
+            GLint available = 0;
+            glGetQueryObjectiv(queries_[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+            {
+                return;
+            }
+        }
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(queries_[oldest], GL_QUERY_RESULT, &nanoseconds);
+        milliseconds_.push_back(static_cast<double>(nanoseconds) * 1e-6);
+        pending_count_--;
+    }
+}
+
+void Benchmark::run(DrawingLib &drawing_lib, Plane &plane, Earth &earth, Skybox &skybox, const std::function<void()> &present)
+/** Renders the warm-up frames and then the measured ones. The animation and the camera advance by 1/60 s per frame,
+so that every run renders the same frames. All textures are made resident before the first frame, and the Earth's
+patches are generated within the frame that needs them. */
+{
+    renderer_ = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+    version_ = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+
+    if (scenario_.night)
+    {
+        earth.switchTime();
+    }
+    TextureStreamer::instance().finish();
+    earth.setSynchronousPatches(true);
+
+    const double frame_seconds = 1.0 / SimulationClock::kDefaultTickRate;
+    drawing_lib.setFixedFrameTime(frame_seconds);
+
+    GpuTimer gpu_timer;
+    frame_ms_.clear();
+    render_ms_.clear();
+    prepare_ms_.clear();
+    prepare_wait_ms_.clear();
+    gl_wait_ms_.clear();
+    draw_ms_.clear();
+    frames_in_flight_ = drawing_lib.framesInFlight();
+    visible_ = 0;
+    frustum_culled_ = 0;
+    horizon_culled_ = 0;
+    const int total_frames = scenario_.warmup_frames + scenario_.frame_count;
+    double frame_start = getCurrentTimeInSeconds();
+    for (int frame = 0; frame < total_frames; frame++)
+    {
+        const bool measured = frame >= scenario_.warmup_frames;
+        const CameraKeyframe camera = scenario_.cameraAt(static_cast<float>(frame * frame_seconds));
+        drawing_lib.setCamera(camera.position, camera.target);
+
+        if (measured)
+        {
+            gpu_timer.begin();
+        }
+        const double render_start = getCurrentTimeInSeconds();
+        drawing_lib.drawScene(plane, earth, skybox);
+        const double render_end = getCurrentTimeInSeconds();
+        if (measured)
+        {
+            gpu_timer.end();
+        }
+
+        present();
+        gpu_timer.collect(false);
+
+        const double frame_end = getCurrentTimeInSeconds();
+        if (measured)
+        {
+            render_ms_.push_back((render_end - render_start) * 1e3);
+            frame_ms_.push_back((frame_end - frame_start) * 1e3);
+            const CullingStats &culling_stats = drawing_lib.cullingStats();
+            visible_ += culling_stats.visible;
+            frustum_culled_ += culling_stats.frustum_culled;
+            horizon_culled_ += culling_stats.horizon_culled;
+            const FramePipelineStats &pipeline_stats = drawing_lib.pipelineStats();
+            prepare_ms_.push_back(pipeline_stats.prepare_ms);
+            prepare_wait_ms_.push_back(pipeline_stats.prepare_wait_ms);
+            gl_wait_ms_.push_back(pipeline_stats.gl_wait_ms);
+            draw_ms_.push_back(pipeline_stats.draw_ms);
+        }
+        frame_start = frame_end;
+    }
+    gpu_timer.collect(true);
+    gpu_ms_ = gpu_timer.milliseconds();
+}
+
+static void writeStats(std::ostream &out, const char* name, const FrameTimeStats &stats, bool last)
+{
+    out << "    \"" << name << "\": {"
+        << "\"mean\": " << stats.mean << ", \"min\": " << stats.min << ", \"max\": " << stats.max
+        << ", \"p50\": " << stats.p50 << ", \"p95\": " << stats.p95 << ", \"p99\": " << stats.p99
+        << ", \"stddev\": " << stats.standard_deviation << "}" << (last ? "\n" : ",\n");
+}
+
+static std::string escapeJson(const std::string &text)
+{
+    std::string escaped;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped += '\\';
+        }
+        if (static_cast<unsigned char>(c) >= 0x20)
+        {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+bool Benchmark::writeJson(const std::string &filepath) const
+/** Writes the scenario, the GL implementation and the statistics of the measured frames in milliseconds. The state
+change, uniform and culling counts show whether a change of the frame time comes with a change of the work submitted. */
+{
+    std::ofstream out(filepath);
+    if (!out)
+    {
+        std::cerr << "Benchmark: failed to write " << filepath << std::endl;
+        return false;
+    }
+
+    const RenderStateStats &render_state_stats = RenderState::lastFrameStats();
+    const UniformStats &uniform_stats = ShaderProgram::uniformStats();
+    out << std::fixed << std::setprecision(4);
+    out << "{\n";
+    out << "  \"scenario\": \"" << escapeJson(scenario_.name) << "\",\n";
+    out << "  \"renderer\": \"" << escapeJson(renderer_) << "\",\n";
+    out << "  \"version\": \"" << escapeJson(version_) << "\",\n";
+    out << "  \"frames\": " << scenario_.frame_count << ",\n";
+    out << "  \"warmup_frames\": " << scenario_.warmup_frames << ",\n";
+    out << "  \"planes\": " << scenario_.plane_count << ",\n";
+    out << "  \"frames_in_flight\": " << frames_in_flight_ << ",\n";
+    out << "  \"state_changes_per_frame\": " << render_state_stats.changes << ",\n";
+    out << "  \"uniform_calls_issued\": " << uniform_stats.calls_issued << ",\n";
+    out << "  \"uniform_calls_skipped\": " << uniform_stats.calls_skipped << ",\n";
+    const double frames = std::max(1, scenario_.frame_count);
+    out << "  \"culling_per_frame\": {\"visible\": " << static_cast<double>(visible_) / frames
+        << ", \"frustum_culled\": " << static_cast<double>(frustum_culled_) / frames
+        << ", \"horizon_culled\": " << static_cast<double>(horizon_culled_) / frames << "},\n";
+    out << "  \"milliseconds\": {\n";
+    writeStats(out, "cpu_frame", FrameTimeStats::compute(frame_ms_), false);
+    writeStats(out, "cpu_render", FrameTimeStats::compute(render_ms_), false);
+    writeStats(out, "prepare", FrameTimeStats::compute(prepare_ms_), false);
+    writeStats(out, "prepare_wait", FrameTimeStats::compute(prepare_wait_ms_), false);
+    writeStats(out, "gl_wait", FrameTimeStats::compute(gl_wait_ms_), false);
+    writeStats(out, "draw", FrameTimeStats::compute(draw_ms_), false);
+    writeStats(out, "gpu", FrameTimeStats::compute(gpu_ms_), true);
+    out << "  }\n";
+    out << "}\n";
+    return static_cast<bool>(out);
+}
+
+void Benchmark::printSummary() const
+{
+    const FrameTimeStats frame = FrameTimeStats::compute(frame_ms_);
+    const FrameTimeStats gpu = FrameTimeStats::compute(gpu_ms_);
+    const FrameTimeStats prepare = FrameTimeStats::compute(prepare_ms_);
+    const FrameTimeStats gl_wait = FrameTimeStats::compute(gl_wait_ms_);
+    std::cout << std::fixed << std::setprecision(3)
+              << "Benchmark " << scenario_.name << ": " << frame_ms_.size() << " frames, CPU frame "
+              << frame.mean << " ms (p50 " << frame.p50 << ", p95 " << frame.p95 << ", p99 " << frame.p99
+              << ", stddev " << frame.standard_deviation << "), GPU " << gpu.mean << " ms (p99 " << gpu.p99 << ")" << std::endl
+              << "  " << frames_in_flight_ << " frames in flight: prepared in " << prepare.mean << " ms, GL thread waited "
+              << gl_wait.mean << " ms (p99 " << gl_wait.p99 << ")" << std::endl;
+}
@@ -0,0 +1,149 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "../include/cubemap_file.h"
+
+constexpr uint32_t CubemapFile::kVersion;
+constexpr int CubemapFile::kFaceCount;
+
+namespace
+{
+const char kMagic[4] = {'P', '4', 'C', 'M'};
+// faces start at a page boundary of the OS, like the tiles of virtual textures
+const uint64_t kFacesAlignment = 4096;
+}
+
+std::string CubemapFile::pathFor(const std::vector<std::string> &face_filepaths)
+/** Returns the path of the packed file that is stored next to the directory of the faces, or an empty path for faces
+that aren't in a directory of their own. */
+{
+    const size_t separator = face_filepaths.empty() ? std::string::npos : face_filepaths[0].find_last_of("/\\");
+    if (separator == std::string::npos || separator == 0)
+    {
+        return "";
+    }
+    return face_filepaths[0].substr(0, separator) + ".cubemap";
+}
+
+bool CubemapFile::validateFaces(const std::vector<ImageData> &faces, std::string &error)
+/** Only the sizes and channels are read, so it works as well on faces of which only the metadata is known yet. */
+{
+    if (faces.size() != static_cast<size_t>(kFaceCount))
+    {
+        error = std::to_string(faces.size()) + " faces instead of " + std::to_string(kFaceCount);
+        return false;
+    }
+    for (size_t i = 0; i < faces.size(); i++)
+    {
+        const ImageData &face = faces[i];
+        if (face.width <= 0 || face.width != face.height)
+        {
+            error = "face " + std::to_string(i) + " is " + std::to_string(face.width) + "x" + std::to_string(face.height) + ", not square";
+            return false;
+        }
+        if (face.width != faces[0].width || face.channels != faces[0].channels)
+        {
+            error = "face " + std::to_string(i) + " is " + std::to_string(face.width) + "x" + std::to_string(face.height) + " with " +
+                    std::to_string(face.channels) + " channels, face 0 is " + std::to_string(faces[0].width) + "x" +
+                    std::to_string(faces[0].height) + " with " + std::to_string(faces[0].channels);
+            return false;
+        }
+        if (face.channels < 1 || face.channels > 4)
+        {
+            error = "face " + std::to_string(i) + " has " + std::to_string(face.channels) + " channels";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CubemapFile::write(const std::string &filepath, const std::vector<ImageData> &faces)
+{
+    std::string error;
+    if (!validateFaces(faces, error))
+    {
+        std::cerr << "CubemapFile: " << error << std::endl;
+        return false;
+    }
+
+    CubemapHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.size = static_cast<uint32_t>(faces[0].width);
+    header.channels = static_cast<uint32_t>(faces[0].channels);
+    header.faces_offset = (sizeof(CubemapHeader) + kFacesAlignment - 1) / kFacesAlignment * kFacesAlignment;
+
+    const std::string temporary_filepath = filepath + ".tmp";
+    std::ofstream file(temporary_filepath, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        std::cerr << "CubemapFile: unable to write " << filepath << std::endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    const std::vector<char> padding(header.faces_offset - sizeof(header), 0);
+    file.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+    for (const ImageData &face : faces)
+    {
+        file.write(reinterpret_cast<const char*>(face.pixels.data()), static_cast<std::streamsize>(face.pixels.size()));
+    }
+    file.close();
+
+    if (!file || std::rename(temporary_filepath.c_str(), filepath.c_str()) != 0)
+    {
+        std::cerr << "CubemapFile: unable to write " << filepath << std::endl;
+        std::remove(temporary_filepath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool CubemapFile::open(const std::string &filepath)
+/** Maps the file and validates its header. A missing file is not an error: packed cube maps are optional. */
+{
+    close();
+    if (!file_.open(filepath))
+    {
+        return false;
+    }
+
+    if (file_.size() < sizeof(CubemapHeader))
+    {
+        std::cerr << "CubemapFile: " << filepath << " is too small" << std::endl;
+        close();
+        return false;
+    }
+    std::memcpy(&header_, file_.data(), sizeof(header_));
+    if (std::memcmp(header_.magic, kMagic, sizeof(kMagic)) != 0 || header_.version != kVersion || header_.size == 0 ||
+        header_.channels < 1 || header_.channels > 4)
+    {
+        std::cerr << "CubemapFile: " << filepath << " is not a supported cube map" << std::endl;
+        close();
+        return false;
+    }
+    if (header_.faces_offset + faceBytes() * kFaceCount > file_.size())
+    {
+        std::cerr << "CubemapFile: " << filepath << " is truncated" << std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void CubemapFile::close()
+{
+    file_.close();
+    header_ = CubemapHeader{};
+}
+
+size_t CubemapFile::faceBytes() const
+{
+    return static_cast<size_t>(header_.size) * static_cast<size_t>(header_.size) * static_cast<size_t>(header_.channels);
+}
+
+const uint8_t* CubemapFile::faceData(int face) const
+{
+    return file_.data() + header_.faces_offset + faceBytes() * static_cast<size_t>(face);
+}
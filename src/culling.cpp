@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <cmath>
+
+#include "../include/culling.h"
+
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+#define PROJECT_4_CULLING_SIMD 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+enum Visibility
+{
+    kVisible = 0,
+    kOutsideFrustum = 1,
+    kBehindHorizon = 2,
+};
+}
+
+void Culler::setView(const glm::mat4 &view_projection, const glm::vec3 &camera_position)
+/** Extracts the frustum planes from the rows of the matrix (Gribb and Hartmann): a point is inside when
+-w <= x, y, z <= w in clip space, i.e. (row 3 +- row i) . p >= 0. */
+{
+    for (int i = 0; i < 3; i++)
+    {
+        for (int side = 0; side < 2; side++)
+        {
+            const float sign = side == 0 ? 1.0f : -1.0f;
+            float* plane = planes_[2 * i + side];
+            for (int k = 0; k < 4; k++)
+            {
+                plane[k] = view_projection[k][3] + sign * view_projection[k][i];
+            }
+            const float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+            for (int k = 0; k < 4; k++)
+            {
+                plane[k] /= length;
+            }
+        }
+    }
+    camera_position_ = camera_position;
+    updateHorizon();
+}
+
+void Culler::setOccluder(const glm::vec3 &center, float radius)
+{
+    occluder_center_ = center;
+    occluder_radius_ = radius;
+    updateHorizon();
+}
+
+void Culler::updateHorizon()
+/** The silhouette cone has its apex at the camera and touches the occluder along the horizon circle, whose plane is
+R^2 / d in front of the occluder's center, at the distance d of the camera from it. */
+{
+    const glm::vec3 to_occluder = occluder_center_ - camera_position_;
+    const float distance = std::sqrt(to_occluder.x * to_occluder.x + to_occluder.y * to_occluder.y + to_occluder.z * to_occluder.z);
+    horizon_enabled_ = occluder_radius_ > 0.0f && distance > occluder_radius_;
+    if (!horizon_enabled_)
+    {
+        return;
+    }
+
+    cone_axis_ = to_occluder / distance;
+    cone_sin_ = occluder_radius_ / distance;
+    cone_cos_ = std::sqrt(1.0f - cone_sin_ * cone_sin_);
+    camera_along_axis_ = camera_position_.x * cone_axis_.x + camera_position_.y * cone_axis_.y + camera_position_.z * cone_axis_.z;
+    horizon_along_axis_ = camera_along_axis_ + distance - occluder_radius_ * occluder_radius_ / distance;
+}
+
+int Culler::classify(float x, float y, float z, float radius) const
+{
+    for (const float* plane : planes_)
+    {
+        if (plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < -radius)
+        {
+            return kOutsideFrustum;
+        }
+    }
+    if (!horizon_enabled_)
+    {
+        return kVisible;
+    }
+
+    // position along the cone axis, and distance from it
+    const float along_axis = x * cone_axis_.x + y * cone_axis_.y + z * cone_axis_.z;
+    const float dx = x - camera_position_.x;
+    const float dy = y - camera_position_.y;
+    const float dz = z - camera_position_.z;
+    const float from_camera = along_axis - camera_along_axis_;
+    const float from_axis = std::sqrt(std::max(dx * dx + dy * dy + dz * dz - from_camera * from_camera, 0.0f));
+
+    const bool inside_cone = from_camera * cone_sin_ - from_axis * cone_cos_ >= radius;
+    const bool behind_horizon = along_axis - radius >= horizon_along_axis_;
+    return inside_cone && behind_horizon ? kBehindHorizon : kVisible;
+}
+
+bool Culler::isVisible(const glm::vec3 &center, float radius)
+{
+    const int visibility = classify(center.x, center.y, center.z, radius);
+    stats_.tested++;
+    stats_.visible += visibility == kVisible;
+    stats_.frustum_culled += visibility == kOutsideFrustum;
+    stats_.horizon_culled += visibility == kBehindHorizon;
+    return visibility == kVisible;
+}
+
+size_t Culler::cullSpheres(const float* x, const float* y, const float* z, float radius, size_t count, uint32_t* visible)
+/** Tests 4 spheres at a time against all planes and the horizon, without branching on any single sphere,
+and compacts the indices of the visible ones from the lane mask. The rest is tested one by one. */
+{
+    size_t visible_count = 0;
+    size_t frustum_culled = 0;
+    size_t i = 0;
+
+#ifdef PROJECT_4_CULLING_SIMD
+    const __m128 negative_radius = _mm_set1_ps(-radius);
+    __m128 plane_a[6], plane_b[6], plane_c[6], plane_d[6];
+    for (int p = 0; p < 6; p++)
+    {
+        plane_a[p] = _mm_set1_ps(planes_[p][0]);
+        plane_b[p] = _mm_set1_ps(planes_[p][1]);
+        plane_c[p] = _mm_set1_ps(planes_[p][2]);
+        plane_d[p] = _mm_set1_ps(planes_[p][3]);
+    }
+    const __m128 axis_x = _mm_set1_ps(cone_axis_.x);
+    const __m128 axis_y = _mm_set1_ps(cone_axis_.y);
+    const __m128 axis_z = _mm_set1_ps(cone_axis_.z);
+    const __m128 camera_x = _mm_set1_ps(camera_position_.x);
+    const __m128 camera_y = _mm_set1_ps(camera_position_.y);
+    const __m128 camera_z = _mm_set1_ps(camera_position_.z);
+    const __m128 camera_along_axis = _mm_set1_ps(camera_along_axis_);
+    const __m128 horizon_along_axis = _mm_set1_ps(horizon_along_axis_ + radius);
+    const __m128 cone_sin = _mm_set1_ps(cone_sin_);
+    const __m128 cone_cos = _mm_set1_ps(cone_cos_);
+    const __m128 sphere_radius = _mm_set1_ps(radius);
+
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128 px = _mm_loadu_ps(x + i);
+        const __m128 py = _mm_loadu_ps(y + i);
+        const __m128 pz = _mm_loadu_ps(z + i);
+
+        __m128 outside = _mm_setzero_ps();
+        for (int p = 0; p < 6; p++)
+        {
+            const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(plane_a[p], px), _mm_mul_ps(plane_b[p], py)),
+                                               _mm_add_ps(_mm_mul_ps(plane_c[p], pz), plane_d[p]));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negative_radius));
+        }
+        const int outside_mask = _mm_movemask_ps(outside);
+        frustum_culled += static_cast<size_t>(__builtin_popcount(static_cast<unsigned int>(outside_mask)));
+
+        int hidden_mask = 0;
+        if (horizon_enabled_ && outside_mask != 0xF)
+        {
+            const __m128 along_axis = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, axis_x), _mm_mul_ps(py, axis_y)), _mm_mul_ps(pz, axis_z));
+            const __m128 dx = _mm_sub_ps(px, camera_x);
+            const __m128 dy = _mm_sub_ps(py, camera_y);
+            const __m128 dz = _mm_sub_ps(pz, camera_z);
+            const __m128 from_camera = _mm_sub_ps(along_axis, camera_along_axis);
+            const __m128 squared_distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            const __m128 from_axis = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(squared_distance, _mm_mul_ps(from_camera, from_camera)), _mm_setzero_ps()));
+
+            const __m128 inside_cone = _mm_cmpge_ps(_mm_sub_ps(_mm_mul_ps(from_camera, cone_sin), _mm_mul_ps(from_axis, cone_cos)), sphere_radius);
+            const __m128 behind_horizon = _mm_cmpge_ps(along_axis, horizon_along_axis);
+            hidden_mask = _mm_movemask_ps(_mm_andnot_ps(outside, _mm_and_ps(inside_cone, behind_horizon)));
+        }
+
+        int visible_mask = ~(outside_mask | hidden_mask) & 0xF;
+        while (visible_mask != 0)
+        {
+            visible[visible_count++] = static_cast<uint32_t>(i) + static_cast<uint32_t>(__builtin_ctz(static_cast<unsigned int>(visible_mask)));
+            visible_mask &= visible_mask - 1;
+        }
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        const int visibility = classify(x[i], y[i], z[i], radius);
+        frustum_culled += visibility == kOutsideFrustum;
+        if (visibility == kVisible)
+        {
+            visible[visible_count++] = static_cast<uint32_t>(i);
+        }
+    }
+
+    stats_.tested += static_cast<uint32_t>(count);
+    stats_.visible += static_cast<uint32_t>(visible_count);
+    stats_.frustum_culled += static_cast<uint32_t>(frustum_culled);
+    stats_.horizon_culled += static_cast<uint32_t>(count - visible_count - frustum_culled);
+    return visible_count;
+}
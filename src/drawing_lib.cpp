@@ -1,6 +1,23 @@
+#include <glad/glad.h>
+#include <algorithm>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include "../include/drawing_lib.h"
+#include "../include/texture_streamer.h"
+#include "../include/render_state.h"
+#include "../include/profiler.h"
+#include "../include/utils.h"
+
+constexpr int DrawingLib::kGpuFramesInFlight;
+constexpr float DrawingLib::kFarPlane;
+
+DrawingLib::~DrawingLib()
+{
+    for (const FrameSlot &slot : frames_)
+    {
+        jobs_.wait(slot.prepared);
+    }
+}
 
 GLFWwindow *DrawingLib::createWindow() const
 /** Creates and returns a new GLFW window with the specified width, height, and title. */
@@ -17,6 +34,12 @@ void DrawingLib::getWindowSize(GLFWwindow *window)
     window_height_ = h;
 }
 
+void DrawingLib::setViewportSize(int width, int height)
+{
+    window_width_ = width;
+    window_height_ = height;
+}
+
 void DrawingLib::keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
 /** Handles keyboard events in a GLFW window.*/
 {
@@ -27,6 +50,20 @@ void DrawingLib::keyCallback(GLFWwindow* window, int key, int scancode, int acti
             // switches texture for Earth object
             switch_time_ = true;
         }
+        else if (key == GLFW_KEY_P)
+        {
+            // pauses or resumes the animation
+            clock_.setPaused(!clock_.isPaused());
+        }
+        else if (key == GLFW_KEY_EQUAL || key == GLFW_KEY_KP_ADD)
+        {
+            // runs the animation twice as fast, up to 8 times the normal speed
+            clock_.setScale(std::min(8.0, clock_.scale() * 2.0));
+        }
+        else if (key == GLFW_KEY_MINUS || key == GLFW_KEY_KP_SUBTRACT)
+        {
+            clock_.setScale(std::max(0.125, clock_.scale() * 0.5));
+        }
     }
 }
 
@@ -41,31 +78,186 @@ void DrawingLib::defineCallbackFunction(GLFWwindow* window)
     });
 }
 
-void DrawingLib::drawScene(GLFWwindow *window, Plane& plane, Earth& earth, Skybox& skybox)
-/**  Manages the rendering pipeline using OpenGL. */
+void DrawingLib::drawScene(Plane& plane, Earth& earth, Skybox& skybox)
+/** Starts preparing frame n on the job system, once frame n - 1 is prepared, since the simulation goes on from where
+that one left it. Then draws frame n - frames_in_flight_ + 1, which is prepared already, while frame n is. The inputs of
+the frame (time, keys, camera and viewport) are taken on the GL thread when it's started. */
 {
-    if (switch_time_)
+    // the previous frame ends where this one starts, including the time its caller spent presenting it
+    PROFILE_FRAME();
+    PROFILE_GPU_SCOPE("DrawingLib::drawScene");
+
+    // the scene is simulated in fixed ticks and drawn in between the last two of them
+    double frame_time = fixed_frame_time_;
+    if (frame_time <= 0.0)
     {
-        earth.switchTime();
-        switch_time_ = false;
+        const double now = getCurrentTimeInSeconds();
+        frame_time = last_frame_time_ < 0.0 ? 0.0 : now - last_frame_time_;
+        last_frame_time_ = now;
     }
+    const int ticks = clock_.advance(frame_time);
+    const float alpha = clock_.alpha();
 
-    glViewport(0, 0, window_width_, window_height_);
+    double gl_wait = 0.0;
+    if (frames_started_ > frames_drawn_)
+    {
+        gl_wait += waitForFrame(frames_[(frames_started_ - 1) % frames_in_flight_]);
+    }
 
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LEQUAL);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    const int slot_index = static_cast<int>(frames_started_ % frames_in_flight_);
+    FrameSlot &slot = frames_[slot_index];
+    slot.queue.setFrameSlot(slot_index);
+    slot.viewport_width = window_width_;
+    slot.viewport_height = window_height_;
+    slot.earth = &earth;
+    const bool switch_time = switch_time_;
+    switch_time_ = false;
+    const glm::vec3 camera_position = camera_position_;
+    const glm::vec3 target_position = target_position_;
+    jobs_.run([this, &slot, &plane, &earth, &skybox, ticks, alpha, switch_time, camera_position, target_position]() {
+        prepareFrame(slot, plane, earth, skybox, ticks, alpha, switch_time, camera_position, target_position);
+    }, slot.prepared);
+    frames_started_++;
+
+    if (frames_started_ - frames_drawn_ >= frames_in_flight_)
+    {
+        FrameSlot &oldest = frames_[frames_drawn_ % frames_in_flight_];
+        gl_wait += waitForFrame(oldest);
+        drawFrame(oldest, gl_wait);
+    }
+}
+
+void DrawingLib::prepareFrame(FrameSlot &slot, Plane &plane, Earth &earth, Skybox &skybox, int ticks, float alpha, bool switch_time,
+                              const glm::vec3 &camera_position, const glm::vec3 &target_position)
+/** Advances the simulation, computes camera and light of the frame and fills its render queue. Runs on the job system
+without touching GL; the renderables keep what they draw in the frame slot of the queue. */
+{
+    PROFILE_SCOPE("DrawingLib::prepareFrame");
+    slot.prepare_start = getCurrentTimeInSeconds();
+    slot.prepare_wait = last_prepare_end_ < 0.0 ? 0.0 : slot.prepare_start - last_prepare_end_;
+
+    if (switch_time)
+    {
+        earth.switchTime();
+    }
+    for (int i = 0; i < ticks; i++)
+    {
+        plane.tick();
+        earth.tick();
+    }
+    plane.update(alpha, jobs_);
+    earth.update(alpha);
 
     // Constructs the projection matrix using window height, width and field of view (fov = 65 degrees) /that sets how large the viewspace is.
-    glm::mat4 projection_mat = glm::perspective(glm::radians(65.0f), (float)window_width_ / (float)window_height_, 0.1f, 100.0f);
+    glm::mat4 projection_mat = glm::perspective(glm::radians(65.0f), (float)slot.viewport_width / (float)slot.viewport_height, 0.1f, kFarPlane);
     // constructs the view matrix using the camera's position, target position, and up direction
-    glm::mat4 view_mat = glm::lookAt(camera_position_, target_position_, up_direction_);
+    glm::mat4 view_mat = glm::lookAt(camera_position, target_position, up_direction_);
 
-    plane.draw(view_mat, projection_mat);
-    earth.draw(view_mat, projection_mat);
-    skybox.draw(view_mat, projection_mat);
+    // camera and light are written once per frame into the FrameConstants uniform block all programs read them from
+    FrameConstants &constants = slot.constants;
+    constants.view = view_mat;
+    constants.projection = projection_mat;
+    constants.view_projection = projection_mat * view_mat;
+    constants.camera_position = glm::vec4(camera_position, 1.0f);
+    constants.light_direction = glm::vec4(light_direction_, 0.0f);
+    constants.light_color = earth.lightColor();
 
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+    // objects are drawn in the order of their sort keys: grouped by state, opaque geometry front to back, skybox last
+    RenderQueue &queue = slot.queue;
+    queue.clear();
+    queue.setCamera(view_mat, kFarPlane);
+    // projection[1][1] is 1 / tan(fov / 2), half the viewport height spans tan(fov / 2) at a depth of 1
+    queue.setLodScale(0.5f * static_cast<float>(slot.viewport_height) * projection_mat[1][1]);
+    // bounding spheres outside the view or behind the Earth are culled before their packets are submitted
+    Culler &culler = queue.culler();
+    culler.resetStats();
+    culler.setView(constants.view_projection, camera_position);
+    const glm::vec4 occluder = earth.occluderSphere();
+    culler.setOccluder(glm::vec3(occluder), occluder.w);
+    plane.submit(queue);
+    earth.submit(queue);
+    skybox.submit(queue);
+    {
+        PROFILE_SCOPE("RenderQueue::sort");
+        queue.sort();
+    }
+
+    slot.prepare_end = getCurrentTimeInSeconds();
+    last_prepare_end_ = slot.prepare_end;
+}
+
+double DrawingLib::waitForFrame(const FrameSlot &slot)
+{
+    if (slot.prepared.isDone())
+    {
+        return 0.0;
+    }
+    PROFILE_SCOPE("DrawingLib::waitForFrame");
+    const double start = getCurrentTimeInSeconds();
+    jobs_.wait(slot.prepared);
+    return getCurrentTimeInSeconds() - start;
+}
+
+void DrawingLib::drawFrame(FrameSlot &slot, double gl_wait)
+/** Executes the render queue of a prepared frame, after the uploads the frame needs. */
+{
+    const double start = getCurrentTimeInSeconds();
+    RenderState::beginFrame();
+
+    // uploads a bounded slice of textures that finished decoding on worker threads
+    {
+        PROFILE_SCOPE("TextureStreamer::update");
+        TextureStreamer::instance().update();
+    }
+
+    glViewport(0, 0, slot.viewport_width, slot.viewport_height);
+
+    RenderState::setEnabled(GL_DEPTH_TEST, true);
+    RenderState::setDepthFunc(GL_LEQUAL);
+    // the skybox is drawn without depth writes, which would keep glClear from clearing the depth buffer as well
+    RenderState::setDepthMask(true);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    if (!frame_constants_)
+    {
+        frame_constants_.reset(new UniformBufferRing(sizeof(FrameConstants), kGpuFramesInFlight));
+    }
+    frame_constants_->write(&slot.constants, kFrameConstantsBinding);
+
+    // pages of virtual textures needed by the Earth are determined in a low resolution pass of their own
+    slot.earth->drawFeedback(slot.queue.frameSlot(), slot.viewport_width, slot.viewport_height);
+
+    slot.queue.execute();
+    frame_constants_->endFrame();
+
+    drawn_slot_ = slot.queue.frameSlot();
+    frames_drawn_++;
+    pipeline_stats_.prepare_ms = (slot.prepare_end - slot.prepare_start) * 1e3;
+    pipeline_stats_.prepare_wait_ms = slot.prepare_wait * 1e3;
+    pipeline_stats_.gl_wait_ms = gl_wait * 1e3;
+    pipeline_stats_.draw_ms = (getCurrentTimeInSeconds() - start) * 1e3;
+}
+
+void DrawingLib::finishFrames()
+{
+    while (frames_drawn_ < frames_started_)
+    {
+        FrameSlot &oldest = frames_[frames_drawn_ % frames_in_flight_];
+        const double gl_wait = waitForFrame(oldest);
+        drawFrame(oldest, gl_wait);
+    }
+}
+
+void DrawingLib::setFramesInFlight(int count)
+{
+    finishFrames();
+    frames_in_flight_ = std::max(1, std::min(count, kMaxFramesInFlight));
+    frames_started_ = 0;
+    frames_drawn_ = 0;
 }
 
+void DrawingLib::shutdown()
+/** Releases the GL resources of the renderer, while the context still exists. */
+{
+    frame_constants_.reset();
+}
@@ -0,0 +1,134 @@
+#include <iostream>
+
+#include "../include/frame_capture.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+constexpr int FrameCapture::kReadbackCount;
+
+FrameCapture::FrameCapture(int width, int height) : width_(width), height_(height)
+/** Creates the framebuffer with an RGBA8 colour and a 24-bit depth renderbuffer, and the pixel pack buffers. */
+{
+    glGenRenderbuffers(1, &color_);
+    glBindRenderbuffer(GL_RENDERBUFFER, color_);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width_, height_);
+    glGenRenderbuffers(1, &depth_);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth_);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width_, height_);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &framebuffer_);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_);
+    complete_ = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (!complete_)
+    {
+        std::cerr << "FrameCapture: framebuffer of " << width_ << "x" << height_ << " is incomplete" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    const GLsizeiptr image_size = static_cast<GLsizeiptr>(width_) * height_ * 3;
+    for (Readback &readback : readbacks_)
+    {
+        glGenBuffers(1, &readback.pack_buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pack_buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, image_size, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+FrameCapture::~FrameCapture()
+{
+    for (Readback &readback : readbacks_)
+    {
+        if (readback.fence)
+        {
+            glDeleteSync(readback.fence);
+        }
+        glDeleteBuffers(1, &readback.pack_buffer);
+    }
+    glDeleteFramebuffers(1, &framebuffer_);
+    glDeleteRenderbuffers(1, &color_);
+    glDeleteRenderbuffers(1, &depth_);
+}
+
+void FrameCapture::bind() const
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+}
+
+void FrameCapture::capture(const std::string &png_filepath)
+/** Queues the copy of the colour buffer into the next pack buffer. If that buffer still holds an earlier capture,
+it's written first, which only waits if the GPU is two captures behind. */
+{
+    Readback &readback = readbacks_[next_readback_];
+    if (readback.fence)
+    {
+        write(readback);
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer_);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pack_buffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    // alpha isn't read, the scene doesn't keep it meaningful
+    glReadPixels(0, 0, width_, height_, GL_RGB, GL_UNSIGNED_BYTE, (void*)0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readback.png_filepath = png_filepath;
+
+    next_readback_ = (next_readback_ + 1) % kReadbackCount;
+}
+
+void FrameCapture::poll()
+{
+    for (Readback &readback : readbacks_)
+    {
+        if (readback.fence && glClientWaitSync(readback.fence, 0, 0) != GL_TIMEOUT_EXPIRED)
+        {
+            write(readback);
+        }
+    }
+}
+
+void FrameCapture::finish()
+/** Writes the outstanding captures in the order they were made. */
+{
+    for (int i = 0; i < kReadbackCount; i++)
+    {
+        Readback &readback = readbacks_[(next_readback_ + i) % kReadbackCount];
+        if (readback.fence)
+        {
+            write(readback);
+        }
+    }
+}
+
+void FrameCapture::write(Readback &readback)
+/** Waits for the copy of the capture to complete, maps it and writes it as a PNG image. */
+{
+    glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    glDeleteSync(readback.fence);
+    readback.fence = nullptr;
+
+    const GLsizeiptr image_size = static_cast<GLsizeiptr>(width_) * height_ * 3;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pack_buffer);
+    const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, image_size, GL_MAP_READ_BIT);
+    if (pixels != nullptr)
+    {
+        // GL returns the bottom row first
+        stbi_flip_vertically_on_write(1);
+        if (!stbi_write_png(readback.png_filepath.c_str(), width_, height_, 3, pixels, width_ * 3))
+        {
+            std::cerr << "FrameCapture: failed to write " << readback.png_filepath << std::endl;
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    else
+    {
+        std::cerr << "FrameCapture: failed to map the capture of " << readback.png_filepath << std::endl;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
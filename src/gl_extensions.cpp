@@ -0,0 +1,83 @@
+#include <cstring>
+
+#include "../include/gl_extensions.h"
+
+GLBufferStorageProc GLExtensions::bufferStorage = nullptr;
+GLGetProgramBinaryProc GLExtensions::getProgramBinary = nullptr;
+GLProgramBinaryProc GLExtensions::programBinary = nullptr;
+GLProgramParameteriProc GLExtensions::programParameteri = nullptr;
+GLMaxShaderCompilerThreadsProc GLExtensions::maxShaderCompilerThreads = nullptr;
+GLTexStorage2DProc GLExtensions::texStorage2D = nullptr;
+bool GLExtensions::textureCompressionS3TC = false;
+bool GLExtensions::textureCompressionBPTC = false;
+int GLExtensions::major_version_ = 0;
+int GLExtensions::minor_version_ = 0;
+
+void GLExtensions::load(GLADloadproc loader)
+/** Loads entry points of optional features. Must be called after the OpenGL context is made current. */
+{
+    glGetIntegerv(GL_MAJOR_VERSION, &major_version_);
+    glGetIntegerv(GL_MINOR_VERSION, &minor_version_);
+
+    // persistently mapped buffers: core in OpenGL 4.4
+    if (hasVersion(4, 4) || isSupported("GL_ARB_buffer_storage"))
+    {
+        bufferStorage = reinterpret_cast<GLBufferStorageProc>(loader("glBufferStorage"));
+    }
+
+    // program binaries: core in OpenGL 4.1
+    if (hasVersion(4, 1) || isSupported("GL_ARB_get_program_binary"))
+    {
+        getProgramBinary = reinterpret_cast<GLGetProgramBinaryProc>(loader("glGetProgramBinary"));
+        programBinary = reinterpret_cast<GLProgramBinaryProc>(loader("glProgramBinary"));
+        programParameteri = reinterpret_cast<GLProgramParameteriProc>(loader("glProgramParameteri"));
+        if (getProgramBinary == nullptr || programBinary == nullptr || programParameteri == nullptr)
+        {
+            getProgramBinary = nullptr;
+            programBinary = nullptr;
+            programParameteri = nullptr;
+        }
+    }
+
+    // shaders compiled on threads of the driver
+    if (isSupported("GL_KHR_parallel_shader_compile"))
+    {
+        maxShaderCompilerThreads = reinterpret_cast<GLMaxShaderCompilerThreadsProc>(loader("glMaxShaderCompilerThreadsKHR"));
+    }
+    else if (isSupported("GL_ARB_parallel_shader_compile"))
+    {
+        maxShaderCompilerThreads = reinterpret_cast<GLMaxShaderCompilerThreadsProc>(loader("glMaxShaderCompilerThreadsARB"));
+    }
+
+    // immutable texture storage: core in OpenGL 4.2
+    if (hasVersion(4, 2) || isSupported("GL_ARB_texture_storage"))
+    {
+        texStorage2D = reinterpret_cast<GLTexStorage2DProc>(loader("glTexStorage2D"));
+    }
+
+    // block-compressed texture formats: BC1/BC3 are only exposed as an extension, BC7 is core in OpenGL 4.2
+    textureCompressionS3TC = isSupported("GL_EXT_texture_compression_s3tc");
+    textureCompressionBPTC = hasVersion(4, 2) || isSupported("GL_ARB_texture_compression_bptc");
+}
+
+bool GLExtensions::isSupported(const char* extension)
+/** Checks whether the extension is in the list of extensions reported by the driver. */
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+        if (name != nullptr && std::strcmp(name, extension) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool GLExtensions::hasVersion(int major, int minor)
+/** Checks whether the context version is at least major.minor. */
+{
+    return major_version_ > major || (major_version_ == major && minor_version_ >= minor);
+}
@@ -0,0 +1,119 @@
+#include <iostream>
+
+#include "../include/headless_context.h"
+
+#ifdef PROJECT_4_HAS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+HeadlessContext::~HeadlessContext()
+{
+    destroy();
+}
+
+bool HeadlessContext::create(int major_version, int minor_version)
+/** Initializes EGL on the surfaceless platform, falling back to the default display, and makes a new context current
+without any surface. */
+{
+#ifdef PROJECT_4_HAS_EGL
+    EGLDisplay display = EGL_NO_DISPLAY;
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+    // needs neither a window system nor a GPU
+    auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (get_platform_display != nullptr)
+    {
+        display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+#endif
+    if (display == EGL_NO_DISPLAY)
+    {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    EGLint egl_major, egl_minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &egl_major, &egl_minor))
+    {
+        std::cerr << "HeadlessContext: failed to initialize EGL" << std::endl;
+        return false;
+    }
+    display_ = display;
+
+    if (!eglBindAPI(EGL_OPENGL_API))
+    {
+        std::cerr << "HeadlessContext: EGL doesn't support desktop OpenGL" << std::endl;
+        destroy();
+        return false;
+    }
+
+    const EGLint config_attributes[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+    };
+    EGLConfig config;
+    EGLint config_count = 0;
+    if (!eglChooseConfig(display, config_attributes, &config, 1, &config_count) || config_count == 0)
+    {
+        std::cerr << "HeadlessContext: no EGL config for OpenGL" << std::endl;
+        destroy();
+        return false;
+    }
+
+    const EGLint context_attributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, major_version,
+            EGL_CONTEXT_MINOR_VERSION, minor_version,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attributes);
+    if (context == EGL_NO_CONTEXT)
+    {
+        std::cerr << "HeadlessContext: failed to create an OpenGL " << major_version << "." << minor_version
+                  << " core context" << std::endl;
+        destroy();
+        return false;
+    }
+    context_ = context;
+
+    // binding no surface needs EGL_KHR_surfaceless_context, which all Mesa drivers have
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    {
+        std::cerr << "HeadlessContext: failed to make the context current without a surface" << std::endl;
+        destroy();
+        return false;
+    }
+    return true;
+#else
+    std::cerr << "HeadlessContext: project_4 was built without EGL, headless rendering is not available" << std::endl;
+    return false;
+#endif
+}
+
+void HeadlessContext::destroy()
+{
+#ifdef PROJECT_4_HAS_EGL
+    if (display_ == nullptr)
+    {
+        return;
+    }
+    eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (context_ != nullptr)
+    {
+        eglDestroyContext(display_, context_);
+    }
+    eglTerminate(display_);
+#endif
+    display_ = nullptr;
+    context_ = nullptr;
+}
+
+GLADloadproc HeadlessContext::loader()
+{
+#ifdef PROJECT_4_HAS_EGL
+    // Mesa returns core functions as well (EGL_KHR_get_all_proc_addresses)
+    return reinterpret_cast<GLADloadproc>(eglGetProcAddress);
+#else
+    return nullptr;
+#endif
+}
@@ -0,0 +1,246 @@
+#include <algorithm>
+
+#include "../include/job_system.h"
+
+namespace
+{
+// the system and the index of the queue of the worker running on this thread, if it's one
+thread_local const JobSystem* worker_system = nullptr;
+thread_local size_t worker_queue = 0;
+
+// times a thread waiting for a counter looks for jobs before it sleeps, the last jobs of a counter are usually about
+// to end
+const int kWaitSpins = 64;
+}
+
+JobSystem& JobSystem::instance()
+{
+    static JobSystem system;
+    return system;
+}
+
+JobSystem::JobSystem(unsigned int thread_count)
+{
+    if (thread_count == 0)
+    {
+        thread_count = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    }
+
+    background_limit_ = std::max(1u, thread_count / 2);
+    for (unsigned int i = 0; i < thread_count; i++)
+    {
+        queues_.emplace_back(new Queue());
+    }
+    threads_.reserve(thread_count);
+    for (unsigned int i = 0; i < thread_count; i++)
+    {
+        threads_.emplace_back(&JobSystem::workerLoop, this, i);
+    }
+}
+
+JobSystem::~JobSystem()
+/** Runs the queued and background jobs to the end and joins the workers. */
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+
+    for (std::thread &thread : threads_)
+    {
+        thread.join();
+    }
+}
+
+void JobSystem::run(std::function<void()> job, JobCounter &counter)
+{
+    counter.pending_.fetch_add(1, std::memory_order_relaxed);
+    push(Job{std::move(job), &counter});
+}
+
+void JobSystem::runBackground(std::function<void()> job, JobCounter &counter)
+{
+    counter.pending_.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        background_.push_back(Job{std::move(job), &counter});
+    }
+    wake_.notify_one();
+}
+
+void JobSystem::push(Job job)
+/** Pushes the job to the back of the queue of the worker that calls, or of the next queue in turn. The count of queued
+jobs is raised under the mutex the workers sleep on, so that none of them misses it. Threads waiting for a counter are
+woken as well: if the workers are all waiting, they are the ones to run the job. */
+{
+    const size_t index = worker_system == this ? worker_queue : next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+    {
+        std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+        queues_[index]->jobs.push_back(std::move(job));
+    }
+    bool wake_waiting = false;
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        queued_.fetch_add(1, std::memory_order_relaxed);
+        wake_waiting = waiting_count_ > 0;
+    }
+    wake_.notify_one();
+    if (wake_waiting)
+    {
+        waiting_.notify_all();
+    }
+}
+
+bool JobSystem::runOne()
+/** Pops the newest job of the own queue, or steals the oldest one of the next queue that has any. */
+{
+    const bool is_worker = worker_system == this;
+    const size_t home = is_worker ? worker_queue : 0;
+    Job job{nullptr, nullptr};
+    for (size_t k = 0; k < queues_.size() && job.function == nullptr; k++)
+    {
+        Queue &queue = *queues_[(home + k) % queues_.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.jobs.empty())
+        {
+            continue;
+        }
+        if (k == 0 && is_worker)
+        {
+            job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+        }
+        else
+        {
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+        }
+    }
+    if (job.function == nullptr)
+    {
+        return false;
+    }
+
+    queued_.fetch_sub(1, std::memory_order_relaxed);
+    job.function();
+    finish(*job.counter);
+    return true;
+}
+
+bool JobSystem::canRunBackground() const
+/** Once the system is being destroyed, all workers take background jobs. */
+{
+    return !background_.empty() && (stopping_ || background_running_ < background_limit_);
+}
+
+bool JobSystem::runBackgroundJob()
+{
+    Job job{nullptr, nullptr};
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        if (!canRunBackground())
+        {
+            return false;
+        }
+        job = std::move(background_.front());
+        background_.pop_front();
+        background_running_++;
+    }
+
+    job.function();
+    bool more = false;
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        background_running_--;
+        more = !background_.empty();
+    }
+    if (more)
+    {
+        wake_.notify_one();
+    }
+    finish(*job.counter);
+    return true;
+}
+
+void JobSystem::finish(JobCounter &counter)
+/** The counter may be destroyed as soon as it's done, so it isn't touched after the decrement. The mutex the waiting
+threads sleep on is taken before they are notified, so that the notification can't fall between the check of their
+counter and their sleep. */
+{
+    if (counter.pending_.fetch_sub(1, std::memory_order_release) != 1)
+    {
+        return;
+    }
+    bool wake_waiting = false;
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        wake_waiting = waiting_count_ > 0;
+    }
+    if (wake_waiting)
+    {
+        waiting_.notify_all();
+    }
+}
+
+void JobSystem::wait(const JobCounter &counter)
+/** Runs jobs until the counter is done. Without any, it looks for them a few more times and then sleeps until the
+counter is done or jobs are queued, instead of spinning on a core the workers could use. Background jobs are left to
+the workers. */
+{
+    int spins = 0;
+    while (!counter.isDone())
+    {
+        if (runOne())
+        {
+            spins = 0;
+            continue;
+        }
+        if (spins < kWaitSpins)
+        {
+            spins++;
+            std::this_thread::yield();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        waiting_count_++;
+        waiting_.wait(lock, [this, &counter]() { return counter.isDone() || queued_.load(std::memory_order_relaxed) > 0; });
+        waiting_count_--;
+        spins = 0;
+    }
+}
+
+void JobSystem::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &function)
+/** The first range is run by the calling thread, the others are queued for the workers. */
+{
+    grain = std::max<size_t>(grain, 1);
+    JobCounter counter;
+    for (size_t begin = grain; begin < count; begin += grain)
+    {
+        const size_t end = std::min(begin + grain, count);
+        run([&function, begin, end]() { function(begin, end); }, counter);
+    }
+    function(0, std::min(grain, count));
+    wait(counter);
+}
+
+void JobSystem::workerLoop(size_t index)
+/** Runs jobs while there are any, background jobs once there are no others, and sleeps otherwise, until the system is
+destroyed and all queues are empty. */
+{
+    worker_system = this;
+    worker_queue = index;
+    while (true)
+    {
+        if (runOne() || runBackgroundJob())
+        {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        wake_.wait(lock, [this]() { return stopping_ || queued_.load(std::memory_order_relaxed) > 0 || canRunBackground(); });
+        if (stopping_ && queued_.load(std::memory_order_relaxed) == 0 && background_.empty())
+        {
+            return;
+        }
+    }
+}
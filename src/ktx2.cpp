@@ -0,0 +1,271 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "../include/ktx2.h"
+
+namespace
+{
+const uint8_t kIdentifier[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+
+// sizes of the fixed parts of the file: identifier + header, index, and one entry of the level index
+const size_t kHeaderSize = 48;
+const size_t kIndexSize = 32;
+const size_t kLevelIndexEntrySize = 24;
+
+// VkFormat values of the supported formats
+const uint32_t kVkFormatBC1RGBUnorm = 131;
+const uint32_t kVkFormatBC3Unorm = 137;
+const uint32_t kVkFormatBC4Unorm = 139;
+const uint32_t kVkFormatBC7Unorm = 145;
+
+// Khronos data format descriptor: colour models and channel ids of the block-compressed formats
+const uint32_t kDfdModelBC1A = 128;
+const uint32_t kDfdModelBC3 = 130;
+const uint32_t kDfdModelBC4 = 131;
+const uint32_t kDfdModelBC7 = 134;
+const uint32_t kDfdChannelBC3Alpha = 15;
+const uint32_t kDfdPrimariesBT709 = 1;
+const uint32_t kDfdTransferLinear = 1;
+
+uint32_t vkFormatOf(TextureFormat format)
+{
+    switch (format)
+    {
+        case kTextureFormatBC1: return kVkFormatBC1RGBUnorm;
+        case kTextureFormatBC3: return kVkFormatBC3Unorm;
+        case kTextureFormatBC4: return kVkFormatBC4Unorm;
+        case kTextureFormatBC7: return kVkFormatBC7Unorm;
+    }
+    return 0;
+}
+
+bool formatOf(uint32_t vk_format, TextureFormat &format)
+{
+    switch (vk_format)
+    {
+        case kVkFormatBC1RGBUnorm: format = kTextureFormatBC1; return true;
+        case kVkFormatBC3Unorm: format = kTextureFormatBC3; return true;
+        case kVkFormatBC4Unorm: format = kTextureFormatBC4; return true;
+        case kVkFormatBC7Unorm: format = kTextureFormatBC7; return true;
+        default: return false;
+    }
+}
+
+size_t alignOffset(size_t offset, size_t alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+template<typename T>
+void put(std::vector<uint8_t> &bytes, size_t offset, T value)
+{
+    std::memcpy(bytes.data() + offset, &value, sizeof(T));
+}
+
+template<typename T>
+T get(const uint8_t* bytes, size_t offset)
+{
+    T value;
+    std::memcpy(&value, bytes + offset, sizeof(T));
+    return value;
+}
+
+std::vector<uint8_t> dataFormatDescriptor(TextureFormat format)
+/** Builds the basic data format descriptor block of a block-compressed format. */
+{
+    struct Sample
+    {
+        uint32_t bit_offset;
+        uint32_t bit_length;
+        uint32_t channel;
+    };
+    std::vector<Sample> samples;
+    uint32_t model = 0;
+    switch (format)
+    {
+        case kTextureFormatBC1: model = kDfdModelBC1A; samples.push_back({0, 64, 0}); break;
+        case kTextureFormatBC3: model = kDfdModelBC3; samples.push_back({0, 64, kDfdChannelBC3Alpha}); samples.push_back({64, 64, 0}); break;
+        case kTextureFormatBC4: model = kDfdModelBC4; samples.push_back({0, 64, 0}); break;
+        case kTextureFormatBC7: model = kDfdModelBC7; samples.push_back({0, 128, 0}); break;
+    }
+
+    const uint32_t block_size = 24 + 16 * static_cast<uint32_t>(samples.size());
+    std::vector<uint8_t> descriptor(4 + block_size, 0);
+    put<uint32_t>(descriptor, 0, static_cast<uint32_t>(descriptor.size()));
+    put<uint32_t>(descriptor, 4, 0);                                    // vendor id and descriptor type: Khronos basic
+    put<uint32_t>(descriptor, 8, 2u | (block_size << 16));              // version 1.3, block size
+    put<uint32_t>(descriptor, 12, model | (kDfdPrimariesBT709 << 8) | (kDfdTransferLinear << 16));
+    put<uint32_t>(descriptor, 16, 3u | (3u << 8));                      // 4x4x1x1 texel blocks, stored minus one
+    put<uint32_t>(descriptor, 20, static_cast<uint32_t>(TextureCodec::blockSize(format)));
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        const size_t offset = 28 + 16 * i;
+        put<uint32_t>(descriptor, offset, samples[i].bit_offset | ((samples[i].bit_length - 1) << 16) | (samples[i].channel << 24));
+        put<uint32_t>(descriptor, offset + 12, 0xFFFFFFFFu);           // sample upper
+    }
+    return descriptor;
+}
+
+std::vector<uint8_t> keyValueData()
+/** Key/value data with the orientation of the images: rows go right and up. */
+{
+    const char key_value[] = "KTXorientation\0ru";
+    const uint32_t length = sizeof(key_value);
+    std::vector<uint8_t> data(alignOffset(4 + length, 4), 0);
+    put<uint32_t>(data, 0, length);
+    std::memcpy(data.data() + 4, key_value, length);
+    return data;
+}
+}
+
+bool Ktx2File::write(const std::string &filepath, TextureFormat format, int width, int height,
+                     const std::vector<std::vector<uint8_t>> &levels)
+/** Writes the compressed mip chain, level 0 first in the vector. As required by KTX2, level data is stored in the file
+from the smallest to the largest level. */
+{
+    const std::vector<uint8_t> descriptor = dataFormatDescriptor(format);
+    const std::vector<uint8_t> key_values = keyValueData();
+    const size_t level_alignment = TextureCodec::blockSize(format);
+
+    const size_t descriptor_offset = kHeaderSize + kIndexSize + kLevelIndexEntrySize * levels.size();
+    const size_t key_values_offset = descriptor_offset + descriptor.size();
+    std::vector<size_t> level_offsets(levels.size());
+    size_t end = key_values_offset + key_values.size();
+    for (size_t i = levels.size(); i-- > 0;)
+    {
+        level_offsets[i] = alignOffset(end, level_alignment);
+        end = level_offsets[i] + levels[i].size();
+    }
+
+    std::vector<uint8_t> head(key_values_offset + key_values.size(), 0);
+    std::memcpy(head.data(), kIdentifier, sizeof(kIdentifier));
+    put<uint32_t>(head, 12, vkFormatOf(format));
+    put<uint32_t>(head, 16, 1);                                          // type size of block-compressed formats
+    put<uint32_t>(head, 20, static_cast<uint32_t>(width));
+    put<uint32_t>(head, 24, static_cast<uint32_t>(height));
+    put<uint32_t>(head, 28, 0);                                          // depth: 2D texture
+    put<uint32_t>(head, 32, 0);                                          // not an array
+    put<uint32_t>(head, 36, 1);                                          // faces
+    put<uint32_t>(head, 40, static_cast<uint32_t>(levels.size()));
+    put<uint32_t>(head, 44, 0);                                          // no supercompression
+    put<uint32_t>(head, 48, static_cast<uint32_t>(descriptor_offset));
+    put<uint32_t>(head, 52, static_cast<uint32_t>(descriptor.size()));
+    put<uint32_t>(head, 56, static_cast<uint32_t>(key_values_offset));
+    put<uint32_t>(head, 60, static_cast<uint32_t>(key_values.size()));
+    put<uint64_t>(head, 64, 0);
+    put<uint64_t>(head, 72, 0);
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        const size_t entry = kHeaderSize + kIndexSize + kLevelIndexEntrySize * i;
+        put<uint64_t>(head, entry, level_offsets[i]);
+        put<uint64_t>(head, entry + 8, levels[i].size());
+        put<uint64_t>(head, entry + 16, levels[i].size());
+    }
+    std::memcpy(head.data() + descriptor_offset, descriptor.data(), descriptor.size());
+    std::memcpy(head.data() + key_values_offset, key_values.data(), key_values.size());
+
+    const std::string temporary_filepath = filepath + ".tmp";
+    std::ofstream file(temporary_filepath, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        std::cerr << "Ktx2File: unable to write " << filepath << std::endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(head.data()), static_cast<std::streamsize>(head.size()));
+    size_t position = head.size();
+    const char padding[16] = {};
+    for (size_t i = levels.size(); i-- > 0;)
+    {
+        file.write(padding, static_cast<std::streamsize>(level_offsets[i] - position));
+        file.write(reinterpret_cast<const char*>(levels[i].data()), static_cast<std::streamsize>(levels[i].size()));
+        position = level_offsets[i] + levels[i].size();
+    }
+    file.close();
+
+    if (!file || std::rename(temporary_filepath.c_str(), filepath.c_str()) != 0)
+    {
+        std::cerr << "Ktx2File: unable to write " << filepath << std::endl;
+        std::remove(temporary_filepath.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::string Ktx2File::pathFor(const std::string &image_filepath)
+/** Returns the path of the compressed texture that is stored next to the source image. */
+{
+    const size_t extension = image_filepath.rfind('.');
+    const size_t separator = image_filepath.find_last_of("/\\");
+    if (extension == std::string::npos || (separator != std::string::npos && extension < separator))
+    {
+        return image_filepath + ".ktx2";
+    }
+    return image_filepath.substr(0, extension) + ".ktx2";
+}
+
+bool Ktx2File::open(const std::string &filepath)
+/** Maps the file and validates its header and level index. Level data is not copied, it points into the mapping. */
+{
+    close();
+    if (!file_.open(filepath))
+    {
+        return false;
+    }
+
+    const uint8_t* data = file_.data();
+    const size_t size = file_.size();
+    if (size < kHeaderSize + kIndexSize || std::memcmp(data, kIdentifier, sizeof(kIdentifier)) != 0)
+    {
+        std::cerr << "Ktx2File: " << filepath << " is not a KTX2 file" << std::endl;
+        close();
+        return false;
+    }
+
+    const uint32_t vk_format = get<uint32_t>(data, 12);
+    width_ = static_cast<int>(get<uint32_t>(data, 20));
+    height_ = static_cast<int>(get<uint32_t>(data, 24));
+    const uint32_t depth = get<uint32_t>(data, 28);
+    const uint32_t layers = get<uint32_t>(data, 32);
+    const uint32_t faces = get<uint32_t>(data, 36);
+    const uint32_t level_count = get<uint32_t>(data, 40);
+    const uint32_t supercompression = get<uint32_t>(data, 44);
+    if (!formatOf(vk_format, format_) || width_ <= 0 || height_ <= 0 || depth != 0 || layers != 0 || faces != 1 ||
+        level_count == 0 || supercompression != 0 || size < kHeaderSize + kIndexSize + kLevelIndexEntrySize * level_count)
+    {
+        std::cerr << "Ktx2File: " << filepath << " is not a supported 2D block-compressed texture" << std::endl;
+        close();
+        return false;
+    }
+
+    for (uint32_t i = 0; i < level_count; i++)
+    {
+        const size_t entry = kHeaderSize + kIndexSize + kLevelIndexEntrySize * i;
+        const uint64_t offset = get<uint64_t>(data, entry);
+        const uint64_t length = get<uint64_t>(data, entry + 8);
+
+        Ktx2Level level;
+        level.width = std::max(1, width_ >> i);
+        level.height = std::max(1, height_ >> i);
+        level.data = data + offset;
+        level.size = static_cast<size_t>(length);
+        if (offset > size || length > size - offset || level.size != TextureCodec::compressedSize(format_, level.width, level.height))
+        {
+            std::cerr << "Ktx2File: " << filepath << " has a corrupted level " << i << std::endl;
+            close();
+            return false;
+        }
+        levels_.push_back(level);
+    }
+    return true;
+}
+
+void Ktx2File::close()
+{
+    file_.close();
+    levels_.clear();
+    width_ = 0;
+    height_ = 0;
+}
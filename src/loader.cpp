@@ -1,18 +1,37 @@
-
 #include <iostream>
+#include <iomanip>
+#include <unordered_map>
 
 #include "../include/loader.h"
+#include "../include/mesh_optimizer.h"
 
+namespace
+{
+struct IndexTripleHash
+{
+    size_t operator()(const tinyobj::index_t &idx) const
+    {
+        // combine the three OBJ indices into a single hash value
+        size_t hash = std::hash<int>()(idx.vertex_index);
+        hash ^= std::hash<int>()(idx.normal_index) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        hash ^= std::hash<int>()(idx.texcoord_index) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        return hash;
+    }
+};
+
+struct IndexTripleEqual
+{
+    bool operator()(const tinyobj::index_t &a, const tinyobj::index_t &b) const
+    {
+        return a.vertex_index == b.vertex_index && a.normal_index == b.normal_index && a.texcoord_index == b.texcoord_index;
+    }
+};
+}
 
-void ObjectLoader::loadObjFileData(const std::string &filepath,
-                                   std::vector<float> &object_vertices,
-                                   std::vector<float> &object_normals,
-                                   std::vector<float> &object_texture_coordinates)
-/**  Loads vertices, normals and texture coordinates using open-source library tiny-obj-loader.
-Calculates and loads normals per every vertex.*/
+void ObjectLoader::parseObjFile(const std::string &filepath, tinyobj::ObjReader &reader)
+/** Parses an .obj file with tiny-obj-loader and reports parsing errors and warnings. */
 {
     tinyobj::ObjReaderConfig reader_config;
-    tinyobj::ObjReader reader;
 
     if (!reader.ParseFromFile(filepath, reader_config))
     {
@@ -29,51 +48,108 @@ Calculates and loads normals per every vertex.*/
         std::cout << "TinyObjReader: " << reader.Warning();
         throw reader.Warning();
     }
+}
+
+void ObjectLoader::readObjFile(const std::string &filepath, ObjData &data)
+/** Reads geometry of an .obj file with the parallel parser. Files it can't handle exactly like tiny-obj-loader
+(polygons with more than 4 vertices, invalid indices, etc.) are parsed with tiny-obj-loader instead. */
+{
+    if (ObjParser::parse(filepath, data))
+    {
+        return;
+    }
+
+    tinyobj::ObjReader reader;
+    parseObjFile(filepath, reader);
+
+    const tinyobj::attrib_t &attrib = reader.GetAttrib();
+    data.vertices = attrib.vertices;
+    data.normals = attrib.normals;
+    data.texture_coordinates = attrib.texcoords;
+    data.indices.clear();
+    data.shape_offsets.clear();
+    for (const tinyobj::shape_t &shape : reader.GetShapes())
+    {
+        // faces are triangulated by tiny-obj-loader, shapes are concatenated in file order
+        if (!shape.mesh.indices.empty())
+        {
+            data.shape_offsets.push_back(data.indices.size());
+        }
+        data.indices.insert(data.indices.end(), shape.mesh.indices.begin(), shape.mesh.indices.end());
+    }
+}
+
+void ObjectLoader::loadIndexedObjFileData(const std::string &filepath,
+                                          std::vector<float> &object_vertices,
+                                          std::vector<float> &object_normals,
+                                          std::vector<float> &object_texture_coordinates,
+                                          std::vector<unsigned int> &object_indices,
+                                          std::vector<MeshBounds> &shape_bounds)
+/** Loads an .obj file as an indexed triangle list. Every unique (vertex, normal, texcoord) index triple becomes
+one vertex, face corners only reference it. Triangles are then reordered for the post-transform vertex cache
+and vertices for sequential fetch; vertex count and ACMR before and after are printed.
+The bounds of every shape of the file are returned as well; triangles of different shapes get mixed up by the reordering,
+so shapes are not kept as index ranges. */
+{
+    ObjData data;
+    readObjFile(filepath, data);
+
+    const bool has_normals = !data.normals.empty();
+    const bool has_texture_coordinates = !data.texture_coordinates.empty();
+    const size_t corner_count = data.indices.size();
+
+    shape_bounds.clear();
+    for (size_t s = 0; s < data.shape_offsets.size(); s++)
+    {
+        const size_t first = data.shape_offsets[s];
+        const size_t last = s + 1 < data.shape_offsets.size() ? data.shape_offsets[s + 1] : corner_count;
+        shape_bounds.push_back(MeshBounds::compute(last - first, [&data, first](size_t i) {
+            return &data.vertices[3*size_t(data.indices[first + i].vertex_index)];
+        }));
+    }
 
-    tinyobj::attrib_t attrib    = reader.GetAttrib();
-    std::vector<tinyobj::shape_t> shapes    = reader.GetShapes();
+    std::unordered_map<tinyobj::index_t, unsigned int, IndexTripleHash, IndexTripleEqual> unique_vertices;
+    unique_vertices.reserve(corner_count);
+    object_indices.reserve(object_indices.size() + corner_count);
 
-    for (size_t s = 0; s < shapes.size(); s++)
+    for (const tinyobj::index_t &idx : data.indices)
     {
-        // Loop over faces(polygon)
-        size_t index_offset = 0;
-        for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++)
+        auto inserted = unique_vertices.emplace(idx, static_cast<unsigned int>(object_vertices.size() / 3));
+        if (inserted.second)
         {
-            size_t fv = size_t(shapes[s].mesh.num_face_vertices[f]);
+            object_vertices.push_back(data.vertices[3*size_t(idx.vertex_index)+0]);
+            object_vertices.push_back(data.vertices[3*size_t(idx.vertex_index)+1]);
+            object_vertices.push_back(data.vertices[3*size_t(idx.vertex_index)+2]);
 
-            // Loop over vertices in the face.
-            for (size_t v = 0; v < fv; v++)
+            // attribute streams are kept aligned with positions, missing data is filled with zeros
+            if (has_normals)
             {
-                // access to vertex
-                tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-                tinyobj::real_t vx = attrib.vertices[3*size_t(idx.vertex_index)+0];
-                tinyobj::real_t vy = attrib.vertices[3*size_t(idx.vertex_index)+1];
-                tinyobj::real_t vz = attrib.vertices[3*size_t(idx.vertex_index)+2];
-                object_vertices.push_back(vx);
-                object_vertices.push_back(vy);
-                object_vertices.push_back(vz);
-
-                // Check if `normal_index` is zero or positive. negative = no normal data
-                if (idx.normal_index >= 0)
+                for (size_t k = 0; k < 3; k++)
                 {
-                    tinyobj::real_t nx = attrib.normals[3*size_t(idx.normal_index)+0];
-                    tinyobj::real_t ny = attrib.normals[3*size_t(idx.normal_index)+1];
-                    tinyobj::real_t nz = attrib.normals[3*size_t(idx.normal_index)+2];
-                    object_normals.push_back(nx);
-                    object_normals.push_back(ny);
-                    object_normals.push_back(nz);
+                    object_normals.push_back(idx.normal_index >= 0 ? data.normals[3*size_t(idx.normal_index)+k] : 0.0f);
                 }
-
-                // Check if `texcoord_index` is zero or positive. negative = no texcoord data
-                if (idx.texcoord_index >= 0)
+            }
+            if (has_texture_coordinates)
+            {
+                for (size_t k = 0; k < 2; k++)
                 {
-                    tinyobj::real_t tx = attrib.texcoords[2*size_t(idx.texcoord_index)+0];
-                    tinyobj::real_t ty = attrib.texcoords[2*size_t(idx.texcoord_index)+1];
-                    object_texture_coordinates.push_back(tx);
-                    object_texture_coordinates.push_back(ty);
+                    object_texture_coordinates.push_back(idx.texcoord_index >= 0 ? data.texture_coordinates[2*size_t(idx.texcoord_index)+k] : 0.0f);
                 }
             }
-            index_offset += fv;
         }
+        object_indices.push_back(inserted.first->second);
     }
+
+    const size_t vertex_count = object_vertices.size() / 3;
+    const float unoptimized_acmr = MeshOptimizer::computeACMR(object_indices, vertex_count);
+
+    MeshOptimizer::optimizeVertexCache(object_indices, vertex_count);
+    MeshOptimizer::optimizeVertexFetch(object_vertices, object_normals, object_texture_coordinates, object_indices);
+
+    // a non-indexed triangle list transforms every face corner, which is an ACMR of 3.0
+    std::cout << "ObjectLoader: " << filepath << "\n"
+              << "  vertices: " << corner_count << " -> " << object_vertices.size() / 3
+              << std::fixed << std::setprecision(3)
+              << ", ACMR: " << 3.0f << " -> " << unoptimized_acmr << " (indexed) -> "
+              << MeshOptimizer::computeACMR(object_indices, object_vertices.size() / 3) << " (cache optimized)" << std::defaultfloat << std::setprecision(6) << std::endl;
 }
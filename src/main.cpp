@@ -2,52 +2,335 @@
 #include <GLFW/glfw3.h>
 
 
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <string>
 
+#include "../include/benchmark.h"
 #include "../include/drawing_lib.h"
+#include "../include/frame_capture.h"
+#include "../include/gl_extensions.h"
+#include "../include/headless_context.h"
+#include "../include/profiler.h"
+#include "../include/render_state.h"
+#include "../include/shader_cache.h"
+#include "../include/texture_streamer.h"
 
 
-int main() {
+struct HeadlessOptions
+{
+    int width{1920};
+    int height{1080};
+    int frame_count{120};
+    int capture_interval{0};    // 0 captures only the last frame
+    std::string output_directory{"."};
+};
 
-    glfwInit();
+static bool renderHeadless(DrawingLib &drawing_lib, Plane &plane, Earth &earth, Skybox &skybox, const HeadlessOptions &options)
+/** Renders the frames into an offscreen framebuffer and writes the selected ones as frame_NNNNN.png. Rendering starts once
+all textures are resident and the Earth's patches are generated within their frame, so that with the fixed frame time
+the same frames are captured on every run. */
+{
+    FrameCapture capture(options.width, options.height);
+    if (!capture.isComplete())
+    {
+        return false;
+    }
+    drawing_lib.setViewportSize(options.width, options.height);
+    // every frame is drawn in the call that prepares it, so that it's in the framebuffer when it's captured
+    drawing_lib.setFramesInFlight(1);
+
+    TextureStreamer::instance().finish();
+    earth.setSynchronousPatches(true);
+
+    capture.bind();
+    int captured = 0;
+    for (int frame = 0; frame < options.frame_count; frame++)
+    {
+        drawing_lib.drawScene(plane, earth, skybox);
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        const bool last = frame + 1 == options.frame_count;
+        if (last || (options.capture_interval > 0 && (frame + 1) % options.capture_interval == 0))
+        {
+            char name[32];
+            std::snprintf(name, sizeof(name), "/frame_%05d.png", frame);
+            capture.capture(options.output_directory + name);
+            captured++;
+        }
+        capture.poll();
+    }
+    capture.finish();
 
-    DrawingLib drawingLib = DrawingLib();
+    std::cout << "Rendered " << options.frame_count << " frames of " << options.width << "x" << options.height
+              << ", written " << captured << " to " << options.output_directory << std::endl;
+    return true;
+}
 
-    GLFWwindow* window = drawingLib.createWindow();
-    if (window == NULL)
+int main(int argc, char** argv)
+/** Usage: project_4 [--planes N] [--fixed-fps N] [--frames-in-flight N]
+                     [--headless [--frames N] [--capture-every N] [--output DIR] [--width N] [--height N]]
+                     [--benchmark SCENARIO [--results FILE]] [--trace FILE]
+With --fixed-fps every frame advances the animation by 1/N seconds, however long it took to render.
+With --frames-in-flight N (2 by default) the next N - 1 frames are simulated and culled on worker threads while a frame
+is drawn; 1 prepares and draws each frame in turn.
+With --headless no window is opened: the frames are rendered offscreen, 60 per second of animation unless --fixed-fps
+is given, and every Nth one (only the last one by default) is written as a PNG image.
+With --benchmark the scenario file is rendered with vsync off and its frame times are written as JSON
+(benchmark.json by default); together with --headless it's rendered offscreen without writing images.
+With --trace the scopes recorded by the profiler are written as a Chrome trace at exit, in builds with PROJECT_4_PROFILE. */
+{
+    int plane_count = 1;
+    int fixed_fps = 0;
+    int frames_in_flight = 2;
+    bool headless = false;
+    HeadlessOptions headless_options;
+    std::string scenario_filepath;
+    std::string results_filepath = "benchmark.json";
+    std::string trace_filepath;
+    for (int i = 1; i < argc; i++)
     {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+        if (std::strcmp(argv[i], "--planes") == 0 && i + 1 < argc)
+        {
+            plane_count = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--fixed-fps") == 0 && i + 1 < argc)
+        {
+            fixed_fps = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc)
+        {
+            frames_in_flight = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--headless") == 0)
+        {
+            headless = true;
+        }
+        else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            headless_options.frame_count = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--capture-every") == 0 && i + 1 < argc)
+        {
+            headless_options.capture_interval = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+        {
+            headless_options.output_directory = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--width") == 0 && i + 1 < argc)
+        {
+            headless_options.width = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--height") == 0 && i + 1 < argc)
+        {
+            headless_options.height = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc)
+        {
+            scenario_filepath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--results") == 0 && i + 1 < argc)
+        {
+            results_filepath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            trace_filepath = argv[++i];
+        }
+        else
+        {
+            std::cout << "Usage: " << argv[0] << " [--planes N] [--fixed-fps N] [--frames-in-flight N]"
+                      << " [--headless [--frames N] [--capture-every N] [--output DIR] [--width N] [--height N]]"
+                      << " [--benchmark SCENARIO [--results FILE]] [--trace FILE]" << std::endl;
+            return 1;
+        }
+    }
+
+    const bool benchmark = !scenario_filepath.empty();
+    BenchmarkScenario scenario;
+    if (benchmark)
+    {
+        if (!BenchmarkScenario::load(scenario_filepath, scenario))
+        {
+            return 1;
+        }
+        plane_count = scenario.plane_count;
     }
-    glfwMakeContextCurrent(window);
-    drawingLib.defineCallbackFunction(window);
 
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    DrawingLib drawingLib;
+    if (fixed_fps > 0 || headless)
+    {
+        drawingLib.setFixedFrameTime(1.0 / (fixed_fps > 0 ? fixed_fps : SimulationClock::kDefaultTickRate));
+    }
+    drawingLib.setFramesInFlight(frames_in_flight);
+
+    // declared before the scene, so that the context outlives the objects created in it
+    HeadlessContext headless_context;
+    GLFWwindow* window = nullptr;
+    if (headless)
+    {
+        if (!headless_context.create(3, 3))
+        {
+            return -1;
+        }
+        if (!gladLoadGLLoader(HeadlessContext::loader()))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
+        GLExtensions::load(HeadlessContext::loader());
+    }
+    else
     {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+        glfwInit();
+
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        window = drawingLib.createWindow();
+        if (window == NULL)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        drawingLib.defineCallbackFunction(window);
+        if (benchmark)
+        {
+            // frames are measured as fast as they can be rendered
+            glfwSwapInterval(0);
+        }
+
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
+        GLExtensions::load((GLADloadproc)glfwGetProcAddress);
     }
 
-    Earth earth = Earth("../objects/earth.obj", "../shaders/earth.vert", "../shaders/earth.frag");
-    earth.loadObjectBuffers();
-    Plane plane = Plane("../objects/14082_WWII_Plane_Japan_Kawasaki_Ki-61_v1_L2.obj", "../shaders/plane.vert", "../shaders/plane.frag");
+    // the programs of the scene are loaded from the binaries of the last run, or all of them compiled at the same time,
+    // before the objects ask for them
+    ShaderCache &shader_cache = ShaderCache::instance();
+    shader_cache.open("shader_cache");
+    // with the features the objects create them with
+    ShaderProgram::prepare("../shaders/earth.vert", "../shaders/earth.frag", kShaderFeatureClouds);
+    ShaderProgram::prepare("../shaders/plane.vert", "../shaders/plane.frag",
+                           Plane::kShaderFeatures | VertexAttributes::shaderFeatures(MeshCache::defaultLayout()));
+    ShaderProgram::prepare("../shaders/skybox.vert", "../shaders/skybox.frag");
+
+    Earth earth("../shaders/earth.vert", "../shaders/earth.frag");
+    Plane plane("../objects/14082_WWII_Plane_Japan_Kawasaki_Ki-61_v1_L2.obj", "../shaders/plane.vert", "../shaders/plane.frag", plane_count);
     plane.loadObjectBuffers();
-    Skybox skybox = Skybox("../shaders/skybox.vert", "../shaders/skybox.frag");
+    Skybox skybox("../shaders/skybox.vert", "../shaders/skybox.frag");
 
-    while (!glfwWindowShouldClose(window))
+    int result = 0;
+    if (benchmark)
     {
-        drawingLib.getWindowSize(window);
-        drawingLib.drawScene(window, plane, earth, skybox);
+        Benchmark scenario_benchmark(scenario);
+        if (headless)
+        {
+            FrameCapture target(headless_options.width, headless_options.height);
+            if (!target.isComplete())
+            {
+                return -1;
+            }
+            target.bind();
+            drawingLib.setViewportSize(headless_options.width, headless_options.height);
+            scenario_benchmark.run(drawingLib, plane, earth, skybox, []() {});
+        }
+        else
+        {
+            drawingLib.getWindowSize(window);
+            scenario_benchmark.run(drawingLib, plane, earth, skybox, [&]() {
+                {
+                    PROFILE_SCOPE("glfwSwapBuffers");
+                    glfwSwapBuffers(window);
+                }
+                glfwPollEvents();
+                drawingLib.getWindowSize(window);
+            });
+        }
+        scenario_benchmark.printSummary();
+        result = scenario_benchmark.writeJson(results_filepath) ? 0 : -1;
+    }
+    else if (headless)
+    {
+        result = renderHeadless(drawingLib, plane, earth, skybox, headless_options) ? 0 : -1;
+    }
+    else
+    {
+        while (!glfwWindowShouldClose(window))
+        {
+            drawingLib.getWindowSize(window);
+            drawingLib.drawScene(plane, earth, skybox);
+            {
+                PROFILE_SCOPE("glfwSwapBuffers");
+                glfwSwapBuffers(window);
+            }
+            glfwPollEvents();
+        }
     }
 
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    // the objects are destroyed at the end of main, frames still in flight refer to them
+    drawingLib.finishFrames();
 
-    return 0;
-}
+#ifndef NDEBUG
+    const UniformStats &uniform_stats = ShaderProgram::uniformStats();
+    std::cout << "ShaderProgram: " << uniform_stats.calls_issued << " uniform calls issued, "
+              << uniform_stats.calls_skipped << " skipped because the value didn't change" << std::endl;
+    const RenderStateStats &render_state_stats = RenderState::lastFrameStats();
+    std::cout << "RenderState: " << render_state_stats.changes << " state changes in the last frame, "
+              << render_state_stats.skipped << " skipped" << std::endl;
+    const ShaderCacheStats &shader_cache_stats = shader_cache.stats();
+    std::cout << "ShaderCache: " << shader_cache_stats.loaded << " programs loaded from binaries, " << shader_cache_stats.compiled
+              << " compiled, " << shader_cache_stats.failed << " failed, " << shader_cache_stats.wait_ms << " ms waiting for them" << std::endl;
+    const CullingStats &culling_stats = drawingLib.cullingStats();
+    std::cout << "Culler: " << culling_stats.visible << " of " << culling_stats.tested << " bounding spheres visible in the last frame, "
+              << culling_stats.frustum_culled << " outside the view, " << culling_stats.horizon_culled << " behind the Earth" << std::endl;
+    const CubemapLoadStats &cubemap_stats = skybox.texture().loadStats();
+    if (cubemap_stats.resident)
+    {
+        // the time of every face is printed by the TextureStreamer when the cube map becomes resident
+        std::cout << "Skybox: cube map loaded from " << (cubemap_stats.packed ? "the packed file" : "the faces") << " in "
+                  << cubemap_stats.total_ms << " ms" << std::endl;
+    }
+    else
+    {
+        std::cout << "Skybox: cube map wasn't resident yet" << std::endl;
+    }
+    const FramePipelineStats &pipeline_stats = drawingLib.pipelineStats();
+    std::cout << "Frame pipeline: " << drawingLib.framesInFlight() << " frames in flight, last frame prepared in "
+              << pipeline_stats.prepare_ms << " ms after waiting " << pipeline_stats.prepare_wait_ms << " ms, drawn in "
+              << pipeline_stats.draw_ms << " ms after waiting " << pipeline_stats.gl_wait_ms << " ms" << std::endl;
+#endif
 
+#ifdef PROJECT_4_PROFILE
+    Profiler::shutdown();
+    if (!trace_filepath.empty())
+    {
+        Profiler::writeTrace(trace_filepath);
+    }
+#else
+    if (!trace_filepath.empty())
+    {
+        std::cout << "No trace written: project_4 was built without PROJECT_4_PROFILE" << std::endl;
+    }
+#endif
+
+    drawingLib.shutdown();
+    TextureStreamer::instance().shutdown();
+    shader_cache.shutdown();
+    if (window != nullptr)
+    {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
+
+    return result;
+}
@@ -0,0 +1,54 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/mapped_file.h"
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const std::string &filepath)
+/** Maps the whole file read-only into memory. Pages are loaded lazily by the OS on first access,
+so nothing is copied until the data is actually read (e.g. by glBufferData). */
+{
+    close();
+
+    int fd = ::open(filepath.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat file_stat{};
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping stays valid after the file descriptor is closed
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+
+    data_ = static_cast<const unsigned char*>(mapping);
+    size_ = static_cast<size_t>(file_stat.st_size);
+    return true;
+}
+
+void MappedFile::close()
+/** Unmaps the file if it is mapped. */
+{
+    if (data_ != nullptr)
+    {
+        munmap(const_cast<unsigned char*>(data_), size_);
+        data_ = nullptr;
+        size_ = 0;
+    }
+}
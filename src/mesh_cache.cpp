@@ -0,0 +1,364 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sys/stat.h>
+
+#include "../include/mesh_cache.h"
+#include "../include/loader.h"
+
+constexpr uint32_t MeshCache::kVersion;
+
+namespace
+{
+const char kMagic[4] = {'P', '4', 'M', 'C'};
+const uint64_t kBlobAlignment = 16;
+
+uint64_t alignOffset(uint64_t offset)
+{
+    return (offset + kBlobAlignment - 1) & ~(kBlobAlignment - 1);
+}
+
+uint64_t hashBytes(const unsigned char* data, size_t size)
+/** 64-bit FNV-1a hash. */
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+bool statFile(const std::string &filepath, int64_t &mtime, uint64_t &size)
+{
+    struct stat file_stat{};
+    if (stat(filepath.c_str(), &file_stat) != 0)
+    {
+        return false;
+    }
+    // modification time in nanoseconds, so that edits within the same second are noticed as well
+#ifdef __APPLE__
+    mtime = static_cast<int64_t>(file_stat.st_mtimespec.tv_sec) * 1000000000 + file_stat.st_mtimespec.tv_nsec;
+#else
+    mtime = static_cast<int64_t>(file_stat.st_mtim.tv_sec) * 1000000000 + file_stat.st_mtim.tv_nsec;
+#endif
+    size = static_cast<uint64_t>(file_stat.st_size);
+    return true;
+}
+
+VertexLayout layoutOf(const MeshCacheHeader &header)
+{
+    return VertexLayout(static_cast<VertexEncoding>(header.vertex_encodings[kMeshAttributePosition]),
+                        static_cast<VertexEncoding>(header.vertex_encodings[kMeshAttributeNormal]),
+                        static_cast<VertexEncoding>(header.vertex_encodings[kMeshAttributeTexcoord]));
+}
+
+uint64_t hashFile(const std::string &filepath)
+{
+    MappedFile file;
+    if (!file.open(filepath))
+    {
+        return 0;
+    }
+    return hashBytes(file.data(), file.size());
+}
+}
+
+std::string MeshCache::cachePathFor(const std::string &obj_filepath)
+/** Returns the path of the binary cache that is stored next to the .obj file. */
+{
+    const size_t extension = obj_filepath.rfind('.');
+    const size_t separator = obj_filepath.find_last_of("/\\");
+    if (extension == std::string::npos || (separator != std::string::npos && extension < separator))
+    {
+        return obj_filepath + ".meshcache";
+    }
+    return obj_filepath.substr(0, extension) + ".meshcache";
+}
+
+VertexLayout MeshCache::defaultLayout()
+{
+    return VertexLayout(kVertexEncodingUnorm16, kVertexEncodingOctahedral16, kVertexEncodingNone);
+}
+
+bool MeshCache::build(const std::string &obj_filepath, const std::string &cache_filepath, const VertexLayout &layout)
+/** Parses the .obj file into an optimized indexed mesh, simplifies it into levels of detail, encodes its vertices in the
+layout and writes it as a binary cache file. */
+{
+    BuiltMesh mesh;
+    buildMesh(obj_filepath, layout, mesh);
+    return write(cache_filepath, mesh);
+}
+
+void MeshCache::buildMesh(const std::string &obj_filepath, const VertexLayout &layout, BuiltMesh &mesh)
+/** Parses, simplifies and encodes the mesh and lays out the blobs of its cache file in the header. Positions are
+quantized relative to the bounding box of the mesh, which the header stores. */
+{
+    std::vector<float> vertices;
+    std::vector<float> normals;
+    std::vector<float> texture_coordinates;
+    std::vector<MeshLod> lods;
+    ObjectLoader::loadIndexedObjFileData(obj_filepath, vertices, normals, texture_coordinates, mesh.indices, mesh.shape_bounds);
+    MeshSimplifier::buildLodChain(vertices, normals, texture_coordinates, mesh.indices, lods);
+
+    MeshCacheHeader &header = mesh.header;
+    header = MeshCacheHeader{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.vertex_count = static_cast<uint32_t>(vertices.size() / 3);
+    header.index_count = static_cast<uint32_t>(mesh.indices.size());
+    header.shape_count = static_cast<uint32_t>(mesh.shape_bounds.size());
+    header.bounds = MeshBounds::compute(vertices);
+    header.lod_count = static_cast<uint32_t>(std::min<size_t>(lods.size(), MeshSimplifier::kMaxLods));
+    std::copy_n(lods.begin(), header.lod_count, header.lods);
+
+    statFile(obj_filepath, header.source_mtime, header.source_size);
+    header.source_hash = hashFile(obj_filepath);
+
+    // attributes the .obj file doesn't have are encoded as zeros
+    const size_t floats[kMeshAttributeCount] = {3, 3, 2};
+    const std::vector<float>* attributes[kMeshAttributeCount] = {&vertices, &normals, &texture_coordinates};
+    VertexStream streams[kMeshAttributeCount];
+    for (uint32_t a = 0; a < kMeshAttributeCount; a++)
+    {
+        header.vertex_encodings[a] = layout.attribute(static_cast<MeshAttribute>(a)).encoding;
+        if (attributes[a]->size() >= header.vertex_count * floats[a])
+        {
+            streams[a] = VertexStream{attributes[a]->data(), floats[a]};
+        }
+    }
+    header.vertex_stride = layout.stride();
+    mesh.vertices.resize(static_cast<size_t>(header.vertex_count) * layout.stride());
+    VertexCodec::encode(layout, layout.dequantizationFor(header.bounds), streams, header.vertex_count, mesh.vertices.data());
+
+    if (header.vertex_count <= std::numeric_limits<uint16_t>::max())
+    {
+        mesh.short_indices.assign(mesh.indices.begin(), mesh.indices.end());
+    }
+    header.index_size = mesh.short_indices.empty() ? sizeof(uint32_t) : sizeof(uint16_t);
+
+    header.vertex_offset = alignOffset(sizeof(MeshCacheHeader));
+    header.vertex_data_size = mesh.vertices.size();
+    header.index_offset = alignOffset(header.vertex_offset + header.vertex_data_size);
+    header.index_data_size = static_cast<uint64_t>(header.index_size) * header.index_count;
+    header.shape_offset = alignOffset(header.index_offset + header.index_data_size);
+}
+
+MeshView MeshCache::viewOf(const BuiltMesh &mesh)
+/** Describes a built mesh held in CPU vectors. */
+{
+    MeshView view;
+    view.vertices = mesh.vertices.data();
+    view.vertex_data_size = mesh.vertices.size();
+    view.layout = layoutOf(mesh.header);
+    view.indices = mesh.short_indices.empty() ? static_cast<const void*>(mesh.indices.data()) : mesh.short_indices.data();
+    view.index_data_size = mesh.header.index_data_size;
+    view.index_size = mesh.header.index_size;
+    view.vertex_count = mesh.header.vertex_count;
+    view.index_count = mesh.header.index_count;
+    return view;
+}
+
+bool MeshCache::write(const std::string &cache_filepath, const BuiltMesh &mesh)
+/** Writes the mesh in the binary cache format. The file is written under a temporary name and renamed at the end,
+so a reader never maps a partially written cache. */
+{
+    const MeshCacheHeader &header = mesh.header;
+    const MeshView view = viewOf(mesh);
+
+    const std::string temporary_filepath = cache_filepath + ".tmp";
+    std::ofstream file(temporary_filepath, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        std::cerr << "MeshCache: unable to write " << cache_filepath << std::endl;
+        return false;
+    }
+
+    const char padding[kBlobAlignment] = {};
+    auto writeBlob = [&file, &padding](uint64_t blob_offset, const void* data, size_t size)
+    {
+        const uint64_t position = static_cast<uint64_t>(file.tellp());
+        file.write(padding, static_cast<std::streamsize>(blob_offset - position));
+        file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    };
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writeBlob(header.vertex_offset, view.vertices, view.vertex_data_size);
+    writeBlob(header.index_offset, view.indices, view.index_data_size);
+    writeBlob(header.shape_offset, mesh.shape_bounds.data(), sizeof(MeshBounds) * mesh.shape_bounds.size());
+    file.close();
+
+    if (!file || std::rename(temporary_filepath.c_str(), cache_filepath.c_str()) != 0)
+    {
+        std::cerr << "MeshCache: unable to write " << cache_filepath << std::endl;
+        std::remove(temporary_filepath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool MeshCache::load(const std::string &obj_filepath, const VertexLayout &layout)
+/** Maps the binary cache of the .obj file. A missing, outdated or broken cache, or one with vertices in another layout,
+is rebuilt from the .obj first.
+If the new cache can't be written or mapped (e.g. in a read-only directory), the mesh that was built for it is kept
+in memory instead, so the .obj is never parsed twice. */
+{
+    release();
+    const std::string cache_filepath = cachePathFor(obj_filepath);
+    if (map(cache_filepath) && hasLayout(layout) && isUpToDate(obj_filepath, cache_filepath))
+    {
+        return true;
+    }
+    release();
+
+    std::cout << "MeshCache: building " << cache_filepath << std::endl;
+    std::unique_ptr<BuiltMesh> mesh(new BuiltMesh());
+    buildMesh(obj_filepath, layout, *mesh);
+    if (!write(cache_filepath, *mesh) || !map(cache_filepath))
+    {
+        built_ = std::move(mesh);
+    }
+    return true;
+}
+
+void MeshCache::release()
+/** Unmaps the cache file or frees the built mesh, e.g. once its contents have been uploaded to GPU buffers. */
+{
+    file_.close();
+    built_.reset();
+}
+
+const MeshCacheHeader &MeshCache::header() const
+{
+    return built_ ? built_->header : *reinterpret_cast<const MeshCacheHeader*>(file_.data());
+}
+
+MeshView MeshCache::view() const
+/** Describes the mesh data, pointers reference the mapped cache file directly (or the built mesh kept in its place). */
+{
+    if (built_)
+    {
+        return viewOf(*built_);
+    }
+    const MeshCacheHeader &cache_header = header();
+
+    MeshView mesh;
+    mesh.vertices = file_.data() + cache_header.vertex_offset;
+    mesh.vertex_data_size = cache_header.vertex_data_size;
+    mesh.layout = layoutOf(cache_header);
+    mesh.indices = file_.data() + cache_header.index_offset;
+    mesh.index_data_size = cache_header.index_data_size;
+    mesh.index_size = cache_header.index_size;
+    mesh.vertex_count = cache_header.vertex_count;
+    mesh.index_count = cache_header.index_count;
+    return mesh;
+}
+
+std::vector<MeshBounds> MeshCache::shapeBounds() const
+/** Copies the bounds of the shapes out of the mapped cache file or the built mesh, so that they outlive it. */
+{
+    if (built_)
+    {
+        return built_->shape_bounds;
+    }
+    const MeshCacheHeader &cache_header = header();
+    const auto* shapes = reinterpret_cast<const MeshBounds*>(file_.data() + cache_header.shape_offset);
+    return std::vector<MeshBounds>(shapes, shapes + cache_header.shape_count);
+}
+
+std::vector<MeshLod> MeshCache::lods() const
+{
+    const MeshCacheHeader &cache_header = header();
+    return std::vector<MeshLod>(cache_header.lods, cache_header.lods + cache_header.lod_count);
+}
+
+bool MeshCache::map(const std::string &cache_filepath)
+/** Maps the cache file and validates its header and blob ranges. */
+{
+    if (!file_.open(cache_filepath))
+    {
+        return false;
+    }
+
+    if (file_.size() < sizeof(MeshCacheHeader))
+    {
+        release();
+        return false;
+    }
+
+    const MeshCacheHeader &cache_header = header();
+    bool valid = std::memcmp(cache_header.magic, kMagic, sizeof(kMagic)) == 0 && cache_header.version == kVersion;
+    for (uint32_t a = 0; valid && a < kMeshAttributeCount; a++)
+    {
+        valid = cache_header.vertex_encodings[a] <= kVertexEncodingInt2101010;
+    }
+    valid = valid && cache_header.vertex_stride == layoutOf(cache_header).stride();
+    valid = valid && cache_header.vertex_data_size == static_cast<uint64_t>(cache_header.vertex_stride) * cache_header.vertex_count;
+    valid = valid && cache_header.vertex_offset + cache_header.vertex_data_size <= file_.size();
+    valid = valid && cache_header.index_offset + cache_header.index_data_size <= file_.size();
+    valid = valid && cache_header.shape_offset + sizeof(MeshBounds) * cache_header.shape_count <= file_.size();
+    valid = valid && cache_header.lod_count >= 1 && cache_header.lod_count <= MeshSimplifier::kMaxLods;
+    for (uint32_t l = 0; valid && l < cache_header.lod_count; l++)
+    {
+        valid = static_cast<uint64_t>(cache_header.lods[l].index_offset) + cache_header.lods[l].index_count <= cache_header.index_count;
+    }
+
+    if (!valid)
+    {
+        std::cerr << "MeshCache: ignoring invalid or outdated cache " << cache_filepath << std::endl;
+        release();
+    }
+    return valid;
+}
+
+bool MeshCache::hasLayout(const VertexLayout &layout) const
+/** Checks that the vertices of the mapped cache are encoded in the layout. */
+{
+    const MeshCacheHeader &cache_header = header();
+    for (uint32_t a = 0; a < kMeshAttributeCount; a++)
+    {
+        if (cache_header.vertex_encodings[a] != layout.attribute(static_cast<MeshAttribute>(a)).encoding)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MeshCache::isUpToDate(const std::string &obj_filepath, const std::string &cache_filepath) const
+/** Checks that the mapped cache was built from the current .obj file. Size and modification time are compared first;
+if only the modification time differs, the content hash decides and the stored time is refreshed. */
+{
+    int64_t mtime = 0;
+    uint64_t size = 0;
+    if (!statFile(obj_filepath, mtime, size))
+    {
+        // without the source file the cache is the only copy of the mesh
+        return true;
+    }
+
+    const MeshCacheHeader &cache_header = header();
+    if (cache_header.source_size != size)
+    {
+        return false;
+    }
+    if (cache_header.source_mtime == mtime)
+    {
+        return true;
+    }
+    if (cache_header.source_hash != hashFile(obj_filepath))
+    {
+        return false;
+    }
+
+    // the file was touched but not changed: store the new time, so the hash is not computed on every start
+    std::fstream file(cache_filepath, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(offsetof(MeshCacheHeader, source_mtime));
+    file.write(reinterpret_cast<const char*>(&mtime), sizeof(mtime));
+    return true;
+}
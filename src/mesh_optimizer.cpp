@@ -0,0 +1,266 @@
+#include <cmath>
+#include <algorithm>
+
+#include "../include/mesh_optimizer.h"
+
+constexpr unsigned int MeshOptimizer::kVertexCacheSize;
+
+namespace
+{
+// Tuning constants of Tom Forsyth's "Linear-Speed Vertex Cache Optimisation".
+const float kCacheDecayPower   = 1.5f;
+const float kLastTriangleScore = 0.75f;
+const float kValenceBoostScale = 2.0f;
+const float kValenceBoostPower = 0.5f;
+
+float vertexScore(int cache_position, unsigned int live_triangles)
+/** Scores a vertex by its position in the simulated cache and the number of triangles still using it. */
+{
+    if (live_triangles == 0)
+    {
+        // vertex is not used by any remaining triangle
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (cache_position >= 0)
+    {
+        if (cache_position < 3)
+        {
+            // vertices of the last emitted triangle get a fixed score, so that strips are not favoured too much
+            score = kLastTriangleScore;
+        }
+        else
+        {
+            const float scaler = 1.0f / (MeshOptimizer::kVertexCacheSize - 3);
+            score = std::pow(1.0f - static_cast<float>(cache_position - 3) * scaler, kCacheDecayPower);
+        }
+    }
+
+    // boost vertices with few remaining triangles, so that lone triangles are not left behind
+    score += kValenceBoostScale * std::pow(static_cast<float>(live_triangles), -kValenceBoostPower);
+    return score;
+}
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<unsigned int> &indices, size_t vertex_count)
+/** Reorders triangles of an indexed triangle list to maximize post-transform vertex cache hits (Forsyth algorithm).
+The set of triangles and their winding stay the same, only the order in which they are emitted changes. */
+{
+    const size_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0)
+    {
+        return;
+    }
+
+    // build vertex -> triangles adjacency in a single flat array
+    std::vector<unsigned int> live_triangles(vertex_count, 0);
+    for (unsigned int index : indices)
+    {
+        live_triangles[index]++;
+    }
+
+    std::vector<size_t> adjacency_offsets(vertex_count + 1, 0);
+    for (size_t v = 0; v < vertex_count; v++)
+    {
+        adjacency_offsets[v + 1] = adjacency_offsets[v] + live_triangles[v];
+    }
+
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<size_t> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+    for (size_t t = 0; t < triangle_count; t++)
+    {
+        for (size_t k = 0; k < 3; k++)
+        {
+            adjacency[fill[indices[3 * t + k]]++] = static_cast<unsigned int>(t);
+        }
+    }
+
+    std::vector<int> cache_position(vertex_count, -1);
+    std::vector<float> vertex_scores(vertex_count);
+    for (size_t v = 0; v < vertex_count; v++)
+    {
+        vertex_scores[v] = vertexScore(-1, live_triangles[v]);
+    }
+
+    std::vector<float> triangle_scores(triangle_count);
+    std::vector<char> emitted(triangle_count, 0);
+    for (size_t t = 0; t < triangle_count; t++)
+    {
+        triangle_scores[t] = vertex_scores[indices[3 * t]] + vertex_scores[indices[3 * t + 1]] + vertex_scores[indices[3 * t + 2]];
+    }
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+
+    std::vector<unsigned int> cache;
+    std::vector<unsigned int> new_cache;
+    cache.reserve(kVertexCacheSize + 3);
+    new_cache.reserve(kVertexCacheSize + 3);
+
+    long best_triangle = static_cast<long>(std::max_element(triangle_scores.begin(), triangle_scores.end()) - triangle_scores.begin());
+    size_t cursor = 0;
+
+    for (size_t emitted_count = 0; emitted_count < triangle_count; emitted_count++)
+    {
+        if (best_triangle < 0)
+        {
+            // no triangle touches the cache anymore: continue with the next triangle in the original order
+            while (emitted[cursor])
+            {
+                cursor++;
+            }
+            best_triangle = static_cast<long>(cursor);
+        }
+
+        const size_t t = static_cast<size_t>(best_triangle);
+        emitted[t] = 1;
+
+        new_cache.clear();
+        for (size_t k = 0; k < 3; k++)
+        {
+            const unsigned int v = indices[3 * t + k];
+            output.push_back(v);
+            new_cache.push_back(v);
+
+            // remove the emitted triangle from the live adjacency range of the vertex
+            const size_t begin = adjacency_offsets[v];
+            const size_t end = begin + live_triangles[v];
+            for (size_t a = begin; a < end; a++)
+            {
+                if (adjacency[a] == t)
+                {
+                    std::swap(adjacency[a], adjacency[end - 1]);
+                    break;
+                }
+            }
+            live_triangles[v]--;
+        }
+
+        // vertices of the emitted triangle move to the front of the cache, the rest is pushed back
+        for (unsigned int v : cache)
+        {
+            if (v != new_cache[0] && v != new_cache[1] && v != new_cache[2])
+            {
+                new_cache.push_back(v);
+            }
+        }
+
+        for (size_t c = 0; c < new_cache.size(); c++)
+        {
+            const unsigned int v = new_cache[c];
+            cache_position[v] = c < kVertexCacheSize ? static_cast<int>(c) : -1;
+
+            const float score = vertexScore(cache_position[v], live_triangles[v]);
+            const float delta = score - vertex_scores[v];
+            vertex_scores[v] = score;
+
+            const size_t begin = adjacency_offsets[v];
+            for (size_t a = begin; a < begin + live_triangles[v]; a++)
+            {
+                triangle_scores[adjacency[a]] += delta;
+            }
+        }
+
+        if (new_cache.size() > kVertexCacheSize)
+        {
+            new_cache.resize(kVertexCacheSize);
+        }
+        cache.swap(new_cache);
+
+        // the next triangle is the best scored one among those that share a vertex with the cache
+        best_triangle = -1;
+        float best_score = -1.0f;
+        for (unsigned int v : cache)
+        {
+            const size_t begin = adjacency_offsets[v];
+            for (size_t a = begin; a < begin + live_triangles[v]; a++)
+            {
+                const unsigned int candidate = adjacency[a];
+                if (!emitted[candidate] && triangle_scores[candidate] > best_score)
+                {
+                    best_score = triangle_scores[candidate];
+                    best_triangle = candidate;
+                }
+            }
+        }
+    }
+
+    indices.swap(output);
+}
+
+void MeshOptimizer::optimizeVertexFetch(std::vector<float> &vertices,
+                                        std::vector<float> &normals,
+                                        std::vector<float> &texture_coordinates,
+                                        std::vector<unsigned int> &indices)
+/** Reorders vertex attributes in the order they are first referenced by the index buffer,
+so that the vertex fetch reads memory mostly sequentially. Indices are remapped accordingly. */
+{
+    const size_t vertex_count = vertices.size() / 3;
+    const unsigned int unassigned = ~0u;
+    std::vector<unsigned int> remap(vertex_count, unassigned);
+
+    unsigned int next_vertex = 0;
+    for (unsigned int &index : indices)
+    {
+        if (remap[index] == unassigned)
+        {
+            remap[index] = next_vertex++;
+        }
+        index = remap[index];
+    }
+
+    std::vector<float> new_vertices(3 * next_vertex);
+    std::vector<float> new_normals(normals.empty() ? 0 : 3 * next_vertex);
+    std::vector<float> new_texture_coordinates(texture_coordinates.empty() ? 0 : 2 * next_vertex);
+
+    for (size_t v = 0; v < vertex_count; v++)
+    {
+        const unsigned int target = remap[v];
+        if (target == unassigned)
+        {
+            // vertex is not referenced by any triangle
+            continue;
+        }
+        std::copy_n(&vertices[3 * v], 3, &new_vertices[3 * target]);
+        if (!normals.empty())
+        {
+            std::copy_n(&normals[3 * v], 3, &new_normals[3 * target]);
+        }
+        if (!texture_coordinates.empty())
+        {
+            std::copy_n(&texture_coordinates[2 * v], 2, &new_texture_coordinates[2 * target]);
+        }
+    }
+
+    vertices.swap(new_vertices);
+    normals.swap(new_normals);
+    texture_coordinates.swap(new_texture_coordinates);
+}
+
+float MeshOptimizer::computeACMR(const std::vector<unsigned int> &indices, size_t vertex_count, unsigned int cache_size)
+/** Computes average cache miss ratio (transformed vertices per triangle) by simulating a FIFO vertex cache.
+A non-indexed triangle list always has ACMR 3.0, the theoretical minimum for large meshes is about 0.5. */
+{
+    const size_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0)
+    {
+        return 0.0f;
+    }
+
+    // timestamp of the moment each vertex entered the FIFO cache
+    std::vector<size_t> cache_timestamp(vertex_count, 0);
+    size_t timestamp = cache_size + 1;
+    size_t misses = 0;
+
+    for (unsigned int index : indices)
+    {
+        if (timestamp - cache_timestamp[index] > cache_size)
+        {
+            cache_timestamp[index] = timestamp++;
+            misses++;
+        }
+    }
+
+    return static_cast<float>(misses) / static_cast<float>(triangle_count);
+}
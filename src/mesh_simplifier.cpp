@@ -0,0 +1,829 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <unordered_map>
+
+#include "../include/mesh_simplifier.h"
+#include "../include/mesh_optimizer.h"
+
+constexpr uint32_t MeshSimplifier::kMaxLods;
+
+namespace
+{
+// weight of the planes that keep open borders in place, relative to the planes of the triangles
+const double kBorderWeight = 10.0;
+// levels of detail stop when a level doesn't get below this fraction of the previous one, or below this many triangles
+const float kMinLodReduction = 0.8f;
+const size_t kMinLodTriangles = 16;
+// simplification passes stop after this many, even if they still collapse something
+const int kMaxPasses = 256;
+
+const unsigned int kNone = ~0u;
+
+// Symmetric 4x4 matrix of the sum of squared distances to a set of planes, weighted by the areas of their triangles.
+// Divided by the total weight, it's the mean squared distance of a point from the planes.
+struct Quadric
+{
+    double a2{0}, b2{0}, c2{0}, ab{0}, ac{0}, bc{0}, ad{0}, bd{0}, cd{0}, d2{0};
+    double weight{0};
+
+    void addPlane(double a, double b, double c, double d, double plane_weight)
+    {
+        a2 += plane_weight * a * a;
+        b2 += plane_weight * b * b;
+        c2 += plane_weight * c * c;
+        ab += plane_weight * a * b;
+        ac += plane_weight * a * c;
+        bc += plane_weight * b * c;
+        ad += plane_weight * a * d;
+        bd += plane_weight * b * d;
+        cd += plane_weight * c * d;
+        d2 += plane_weight * d * d;
+        weight += plane_weight;
+    }
+
+    void add(const Quadric &other)
+    {
+        a2 += other.a2;
+        b2 += other.b2;
+        c2 += other.c2;
+        ab += other.ab;
+        ac += other.ac;
+        bc += other.bc;
+        ad += other.ad;
+        bd += other.bd;
+        cd += other.cd;
+        d2 += other.d2;
+        weight += other.weight;
+    }
+
+    double squaredDistance(const float* p) const
+    {
+        const double x = p[0], y = p[1], z = p[2];
+        const double error = a2 * x * x + b2 * y * y + c2 * z * z
+                             + 2.0 * (ab * x * y + ac * x * z + bc * y * z + ad * x + bd * y + cd * z) + d2;
+        return weight > 0.0 ? std::max(error, 0.0) / weight : 0.0;
+    }
+};
+
+struct Collapse
+{
+    unsigned int from;  // position that goes away
+    unsigned int to;    // position it's moved to
+    float cost;         // squared distance from the planes, plus the change of attributes
+    float error;        // squared distance from the planes
+};
+
+struct PositionHash
+{
+    const float* vertices;
+    size_t operator()(unsigned int v) const
+    {
+        uint32_t bits[3];
+        std::memcpy(bits, vertices + 3 * size_t(v), sizeof(bits));
+        return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+    }
+};
+
+struct PositionEqual
+{
+    const float* vertices;
+    bool operator()(unsigned int a, unsigned int b) const
+    {
+        return std::memcmp(vertices + 3 * size_t(a), vertices + 3 * size_t(b), 3 * sizeof(float)) == 0;
+    }
+};
+
+void cross(const float* a, const float* b, const float* c, double* normal)
+/** Normal of the triangle abc, with the length of twice its area. */
+{
+    const double e1[3] = {double(b[0]) - a[0], double(b[1]) - a[1], double(b[2]) - a[2]};
+    const double e2[3] = {double(c[0]) - a[0], double(c[1]) - a[1], double(c[2]) - a[2]};
+    normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+float squaredDistance(const float* a, const float* b, size_t components)
+{
+    float sum = 0.0f;
+    for (size_t k = 0; k < components; k++)
+    {
+        sum += (a[k] - b[k]) * (a[k] - b[k]);
+    }
+    return sum;
+}
+
+double squaredDistanceToTriangle(const float* point, const float* a, const float* b, const float* c)
+/** Squared distance of the point from the triangle abc, through the closest point of the triangle: a corner, a point on
+an edge or one inside, depending on the region of the point (Ericson, Real-Time Collision Detection, 5.1.5). */
+{
+    double ab[3], ac[3], ap[3];
+    for (size_t k = 0; k < 3; k++)
+    {
+        ab[k] = double(b[k]) - a[k];
+        ac[k] = double(c[k]) - a[k];
+        ap[k] = double(point[k]) - a[k];
+    }
+    auto dot = [](const double* x, const double* y) { return x[0] * y[0] + x[1] * y[1] + x[2] * y[2]; };
+    const double d1 = dot(ab, ap);
+    const double d2 = dot(ac, ap);
+    const double d3 = d1 - dot(ab, ab);     // ab . (p - b)
+    const double d4 = d2 - dot(ab, ac);     // ac . (p - b)
+    const double d5 = d1 - dot(ab, ac);     // ab . (p - c)
+    const double d6 = d2 - dot(ac, ac);     // ac . (p - c)
+    const double va = d3 * d6 - d5 * d4;
+    const double vb = d5 * d2 - d1 * d6;
+    const double vc = d1 * d4 - d3 * d2;
+
+    double v = 0.0;
+    double w = 0.0;
+    if (d1 <= 0.0 && d2 <= 0.0)
+    {
+        // the corner a
+    }
+    else if (d3 >= 0.0 && d4 <= d3)
+    {
+        // the corner b
+        v = 1.0;
+    }
+    else if (d6 >= 0.0 && d5 <= d6)
+    {
+        // the corner c
+        w = 1.0;
+    }
+    else if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)
+    {
+        // the edge ab
+        v = d1 / (d1 - d3);
+    }
+    else if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)
+    {
+        // the edge ac
+        w = d2 / (d2 - d6);
+    }
+    else if (va <= 0.0 && d4 - d3 >= 0.0 && d5 - d6 >= 0.0)
+    {
+        // the edge bc
+        w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        v = 1.0 - w;
+    }
+    else
+    {
+        // inside
+        const double denominator = 1.0 / (va + vb + vc);
+        v = vb * denominator;
+        w = vc * denominator;
+    }
+
+    double squared_distance = 0.0;
+    for (size_t k = 0; k < 3; k++)
+    {
+        const double difference = ap[k] - v * ab[k] - w * ac[k];
+        squared_distance += difference * difference;
+    }
+    return squared_distance;
+}
+
+// Uniform grid over the bounding box of a triangle list, with every triangle in the cells its bounding box overlaps;
+// finds the closest triangle of a point among those within a given distance.
+class TriangleGrid
+{
+public:
+    TriangleGrid(const std::vector<float> &vertices, const std::vector<unsigned int> &indices);
+
+    // squared distance of the point from the closest triangle, if it's less than max_distance away
+    double squaredDistance(const float* point, double max_distance) const;
+
+private:
+    void cellRange(const float* min, const float* max, int* first, int* last) const;
+    size_t cellIndex(int x, int y, int z) const { return (size_t(z) * cells_[1] + size_t(y)) * cells_[0] + size_t(x); }
+
+    const std::vector<float> &vertices_;
+    const std::vector<unsigned int> &indices_;
+    float origin_[3]{};
+    float cell_size_[3]{};
+    int cells_[3]{1, 1, 1};
+    // triangles of every cell
+    std::vector<unsigned int> cell_offsets_;
+    std::vector<unsigned int> cell_triangles_;
+};
+
+TriangleGrid::TriangleGrid(const std::vector<float> &vertices, const std::vector<unsigned int> &indices)
+        : vertices_(vertices), indices_(indices)
+/** About one cell per triangle: the resolution along the axes the mesh extends along is the cube root of the triangle
+count. */
+{
+    const size_t triangle_count = indices.size() / 3;
+    float min[3] = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+    float max[3] = {std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()};
+    for (unsigned int index : indices)
+    {
+        for (size_t k = 0; k < 3; k++)
+        {
+            min[k] = std::min(min[k], vertices[3 * size_t(index) + k]);
+            max[k] = std::max(max[k], vertices[3 * size_t(index) + k]);
+        }
+    }
+    const int resolution = std::max(1, std::min(128, static_cast<int>(std::ceil(std::cbrt(static_cast<double>(triangle_count))))));
+    for (size_t k = 0; k < 3 && triangle_count > 0; k++)
+    {
+        origin_[k] = min[k];
+        cells_[k] = max[k] > min[k] ? resolution : 1;
+        cell_size_[k] = max[k] > min[k] ? (max[k] - min[k]) / static_cast<float>(resolution) : 1.0f;
+    }
+
+    // counts the triangles of every cell, then fills them in
+    cell_offsets_.assign(size_t(cells_[0]) * cells_[1] * cells_[2] + 1, 0);
+    for (int fill = 0; fill < 2; fill++)
+    {
+        std::vector<unsigned int> next(cell_offsets_.begin(), cell_offsets_.end() - 1);
+        for (size_t t = 0; t < triangle_count; t++)
+        {
+            float triangle_min[3];
+            float triangle_max[3];
+            for (size_t k = 0; k < 3; k++)
+            {
+                triangle_min[k] = std::min({vertices[3 * size_t(indices[3 * t]) + k], vertices[3 * size_t(indices[3 * t + 1]) + k], vertices[3 * size_t(indices[3 * t + 2]) + k]});
+                triangle_max[k] = std::max({vertices[3 * size_t(indices[3 * t]) + k], vertices[3 * size_t(indices[3 * t + 1]) + k], vertices[3 * size_t(indices[3 * t + 2]) + k]});
+            }
+            int first[3];
+            int last[3];
+            cellRange(triangle_min, triangle_max, first, last);
+            for (int z = first[2]; z <= last[2]; z++)
+            {
+                for (int y = first[1]; y <= last[1]; y++)
+                {
+                    for (int x = first[0]; x <= last[0]; x++)
+                    {
+                        if (fill == 0)
+                        {
+                            cell_offsets_[cellIndex(x, y, z) + 1]++;
+                        }
+                        else
+                        {
+                            cell_triangles_[next[cellIndex(x, y, z)]++] = static_cast<unsigned int>(t);
+                        }
+                    }
+                }
+            }
+        }
+        if (fill == 0)
+        {
+            for (size_t c = 1; c < cell_offsets_.size(); c++)
+            {
+                cell_offsets_[c] += cell_offsets_[c - 1];
+            }
+            cell_triangles_.resize(cell_offsets_.back());
+        }
+    }
+}
+
+void TriangleGrid::cellRange(const float* min, const float* max, int* first, int* last) const
+{
+    for (size_t k = 0; k < 3; k++)
+    {
+        first[k] = std::max(0, std::min(cells_[k] - 1, static_cast<int>(std::floor((min[k] - origin_[k]) / cell_size_[k]))));
+        last[k] = std::max(0, std::min(cells_[k] - 1, static_cast<int>(std::floor((max[k] - origin_[k]) / cell_size_[k]))));
+    }
+}
+
+double TriangleGrid::squaredDistance(const float* point, double max_distance) const
+{
+    double squared_distance = std::numeric_limits<double>::max();
+    if (cell_triangles_.empty())
+    {
+        return squared_distance;
+    }
+    const float distance = static_cast<float>(std::min(max_distance, static_cast<double>(std::numeric_limits<float>::max())));
+    const float min[3] = {point[0] - distance, point[1] - distance, point[2] - distance};
+    const float max[3] = {point[0] + distance, point[1] + distance, point[2] + distance};
+    int first[3];
+    int last[3];
+    cellRange(min, max, first, last);
+    for (int z = first[2]; z <= last[2]; z++)
+    {
+        for (int y = first[1]; y <= last[1]; y++)
+        {
+            for (int x = first[0]; x <= last[0]; x++)
+            {
+                const size_t cell = cellIndex(x, y, z);
+                for (unsigned int c = cell_offsets_[cell]; c < cell_offsets_[cell + 1]; c++)
+                {
+                    const unsigned int* triangle = &indices_[3 * size_t(cell_triangles_[c])];
+                    squared_distance = std::min(squared_distance, squaredDistanceToTriangle(point, &vertices_[3 * size_t(triangle[0])],
+                                                                                            &vertices_[3 * size_t(triangle[1])],
+                                                                                            &vertices_[3 * size_t(triangle[2])]));
+                }
+            }
+        }
+    }
+    return squared_distance;
+}
+
+// The mesh during simplification: triangles are kept as vertex indices, the quadrics and the adjacency are kept per
+// position, i.e. for the representative vertex of all vertices at the same position.
+class Simplification
+{
+public:
+    Simplification(const std::vector<float> &vertices,
+                   const std::vector<float> &normals,
+                   const std::vector<float> &texture_coordinates,
+                   const std::vector<unsigned int> &indices);
+
+    // can be called again with a lower target, continuing from the last result
+    float run(size_t target_index_count, float max_error);
+    const std::vector<unsigned int>& indices() const { return indices_; }
+
+private:
+    void buildPositions();
+    void buildQuadrics();
+    void buildAdjacency();
+    bool findCollapse(unsigned int from, unsigned int to, Collapse &collapse) const;
+    bool partnersOf(unsigned int from, unsigned int to, std::vector<std::pair<unsigned int, unsigned int>> &partners) const;
+    bool flipsTriangles(unsigned int from, unsigned int to) const;
+    size_t removeDegenerateTriangles();
+    float measureDeviation();
+
+    const float* position(unsigned int v) const { return &vertices_[3 * size_t(v)]; }
+
+    const std::vector<float> &vertices_;
+    const std::vector<float> &normals_;
+    const std::vector<float> &texture_coordinates_;
+    std::vector<unsigned int> indices_;
+    size_t vertex_count_;
+
+    // representative vertex of the position of every vertex, and the other vertices at the same position in a ring
+    std::vector<unsigned int> position_of_;
+    std::vector<unsigned int> next_wedge_;
+    std::vector<Quadric> quadrics_;
+    float squared_error_{0.0f};
+    // position every position was collapsed onto, or kNone, and the largest deviation measured so far
+    std::vector<unsigned int> collapsed_onto_;
+    float deviation_{0.0f};
+
+    // triangles around every position, rebuilt once per pass
+    std::vector<unsigned int> adjacency_offsets_;
+    std::vector<unsigned int> adjacency_;
+};
+
+Simplification::Simplification(const std::vector<float> &vertices,
+                               const std::vector<float> &normals,
+                               const std::vector<float> &texture_coordinates,
+                               const std::vector<unsigned int> &indices)
+        : vertices_(vertices), normals_(normals), texture_coordinates_(texture_coordinates), indices_(indices),
+          vertex_count_(vertices.size() / 3), collapsed_onto_(vertices.size() / 3, kNone)
+{
+    buildPositions();
+    buildQuadrics();
+}
+
+void Simplification::buildPositions()
+{
+    position_of_.resize(vertex_count_);
+    next_wedge_.resize(vertex_count_);
+    std::unordered_map<unsigned int, unsigned int, PositionHash, PositionEqual> representatives(
+            vertex_count_, PositionHash{vertices_.data()}, PositionEqual{vertices_.data()});
+    for (unsigned int v = 0; v < vertex_count_; v++)
+    {
+        const auto inserted = representatives.emplace(v, v);
+        const unsigned int representative = inserted.first->second;
+        position_of_[v] = representative;
+        // insert into the ring of the representative
+        next_wedge_[v] = inserted.second ? v : next_wedge_[representative];
+        next_wedge_[representative] = v;
+    }
+}
+
+void Simplification::buildQuadrics()
+/** Adds the plane of every triangle to the quadrics of its corners, and a plane perpendicular to the triangle along
+every edge without a twin in the opposite direction, which is an open border. Seams are not borders, since edges are
+matched by positions. */
+{
+    quadrics_.assign(vertex_count_, Quadric());
+    std::unordered_map<uint64_t, unsigned int> edges;
+    edges.reserve(indices_.size());
+    auto edgeKey = [this](unsigned int a, unsigned int b) {
+        return (static_cast<uint64_t>(position_of_[a]) << 32) | position_of_[b];
+    };
+    for (size_t t = 0; t < indices_.size(); t += 3)
+    {
+        for (size_t k = 0; k < 3; k++)
+        {
+            edges[edgeKey(indices_[t + k], indices_[t + (k + 1) % 3])]++;
+        }
+    }
+
+    for (size_t t = 0; t < indices_.size(); t += 3)
+    {
+        const unsigned int corners[3] = {indices_[t], indices_[t + 1], indices_[t + 2]};
+        double normal[3];
+        cross(position(corners[0]), position(corners[1]), position(corners[2]), normal);
+        const double length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (length == 0.0)
+        {
+            continue;
+        }
+        const double area = 0.5 * length;
+        const double n[3] = {normal[0] / length, normal[1] / length, normal[2] / length};
+        const float* p = position(corners[0]);
+        const double d = -(n[0] * p[0] + n[1] * p[1] + n[2] * p[2]);
+        for (unsigned int corner : corners)
+        {
+            quadrics_[position_of_[corner]].addPlane(n[0], n[1], n[2], d, area);
+        }
+
+        for (size_t k = 0; k < 3; k++)
+        {
+            const unsigned int a = corners[k];
+            const unsigned int b = corners[(k + 1) % 3];
+            if (edges.count(edgeKey(b, a)) != 0)
+            {
+                continue;
+            }
+            const float* pa = position(a);
+            const float* pb = position(b);
+            const double edge[3] = {double(pb[0]) - pa[0], double(pb[1]) - pa[1], double(pb[2]) - pa[2]};
+            double border[3] = {edge[1] * n[2] - edge[2] * n[1], edge[2] * n[0] - edge[0] * n[2], edge[0] * n[1] - edge[1] * n[0]};
+            const double edge_length = std::sqrt(edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2]);
+            if (edge_length == 0.0)
+            {
+                continue;
+            }
+            for (double &component : border)
+            {
+                component /= edge_length;
+            }
+            const double border_d = -(border[0] * pa[0] + border[1] * pa[1] + border[2] * pa[2]);
+            const double weight = kBorderWeight * edge_length * edge_length;
+            quadrics_[position_of_[a]].addPlane(border[0], border[1], border[2], border_d, weight);
+            quadrics_[position_of_[b]].addPlane(border[0], border[1], border[2], border_d, weight);
+        }
+    }
+}
+
+void Simplification::buildAdjacency()
+{
+    adjacency_offsets_.assign(vertex_count_ + 1, 0);
+    for (unsigned int index : indices_)
+    {
+        adjacency_offsets_[position_of_[index] + 1]++;
+    }
+    for (size_t v = 0; v < vertex_count_; v++)
+    {
+        adjacency_offsets_[v + 1] += adjacency_offsets_[v];
+    }
+    adjacency_.resize(indices_.size());
+    std::vector<unsigned int> fill(adjacency_offsets_.begin(), adjacency_offsets_.end() - 1);
+    for (size_t i = 0; i < indices_.size(); i++)
+    {
+        adjacency_[fill[position_of_[indices_[i]]]++] = static_cast<unsigned int>(i / 3);
+    }
+}
+
+bool Simplification::partnersOf(unsigned int from, unsigned int to, std::vector<std::pair<unsigned int, unsigned int>> &partners) const
+/** Pairs every vertex at the position from with the vertex at the position to it shares an edge with. A vertex without
+such an edge, or with edges to several vertices there, is on a seam the collapse would cross, which isn't allowed. */
+{
+    partners.clear();
+    unsigned int wedge = from;
+    do
+    {
+        unsigned int partner = kNone;
+        bool referenced = false;
+        for (unsigned int a = adjacency_offsets_[from]; a < adjacency_offsets_[from + 1]; a++)
+        {
+            const unsigned int* triangle = &indices_[3 * size_t(adjacency_[a])];
+            if (triangle[0] != wedge && triangle[1] != wedge && triangle[2] != wedge)
+            {
+                continue;
+            }
+            referenced = true;
+            for (size_t k = 0; k < 3; k++)
+            {
+                if (position_of_[triangle[k]] != to)
+                {
+                    continue;
+                }
+                if (partner != kNone && partner != triangle[k])
+                {
+                    return false;
+                }
+                partner = triangle[k];
+            }
+        }
+        if (referenced)
+        {
+            if (partner == kNone)
+            {
+                return false;
+            }
+            partners.emplace_back(wedge, partner);
+        }
+        wedge = next_wedge_[wedge];
+    }
+    while (wedge != from);
+    return true;
+}
+
+bool Simplification::flipsTriangles(unsigned int from, unsigned int to) const
+/** Checks whether moving the position from onto to turns one of the remaining triangles around it over. */
+{
+    for (unsigned int a = adjacency_offsets_[from]; a < adjacency_offsets_[from + 1]; a++)
+    {
+        const unsigned int* triangle = &indices_[3 * size_t(adjacency_[a])];
+        const float* before[3];
+        const float* after[3];
+        bool removed = false;
+        for (size_t k = 0; k < 3; k++)
+        {
+            const unsigned int p = position_of_[triangle[k]];
+            removed = removed || p == to;
+            before[k] = position(triangle[k]);
+            after[k] = p == from ? position(to) : before[k];
+        }
+        if (removed)
+        {
+            continue;
+        }
+        double normal_before[3];
+        double normal_after[3];
+        cross(before[0], before[1], before[2], normal_before);
+        cross(after[0], after[1], after[2], normal_after);
+        const double dot = normal_before[0] * normal_after[0] + normal_before[1] * normal_after[1] + normal_before[2] * normal_after[2];
+        if (dot <= 0.0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Simplification::findCollapse(unsigned int from, unsigned int to, Collapse &collapse) const
+/** The error of moving from onto to is the distance of to from the planes of both, the cost adds the change of normals
+and texture coordinates of the vertices at from, scaled by the length of the edge to make it a squared distance too. */
+{
+    std::vector<std::pair<unsigned int, unsigned int>> partners;
+    if (!partnersOf(from, to, partners))
+    {
+        return false;
+    }
+
+    Quadric quadric = quadrics_[from];
+    quadric.add(quadrics_[to]);
+    collapse.from = from;
+    collapse.to = to;
+    collapse.error = static_cast<float>(quadric.squaredDistance(position(to)));
+
+    const float edge = squaredDistance(position(from), position(to), 3);
+    float attributes = 0.0f;
+    for (const std::pair<unsigned int, unsigned int> &partner : partners)
+    {
+        if (!normals_.empty())
+        {
+            attributes += squaredDistance(&normals_[3 * size_t(partner.first)], &normals_[3 * size_t(partner.second)], 3);
+        }
+        if (!texture_coordinates_.empty())
+        {
+            attributes += squaredDistance(&texture_coordinates_[2 * size_t(partner.first)], &texture_coordinates_[2 * size_t(partner.second)], 2);
+        }
+    }
+    collapse.cost = collapse.error + edge * attributes;
+    return true;
+}
+
+size_t Simplification::removeDegenerateTriangles()
+{
+    size_t write = 0;
+    for (size_t t = 0; t < indices_.size(); t += 3)
+    {
+        const unsigned int a = position_of_[indices_[t]];
+        const unsigned int b = position_of_[indices_[t + 1]];
+        const unsigned int c = position_of_[indices_[t + 2]];
+        if (a == b || b == c || c == a)
+        {
+            continue;
+        }
+        std::copy_n(&indices_[t], 3, &indices_[write]);
+        write += 3;
+    }
+    const size_t removed = indices_.size() - write;
+    indices_.resize(write);
+    return removed;
+}
+
+float Simplification::run(size_t target_index_count, float max_error)
+/** Collapses edges in passes. Every pass finds the cheapest collapse of every position, and performs them in the order
+of their cost, as long as nothing around the position has changed in the same pass. */
+{
+    const float max_squared_error = max_error * max_error;
+    std::vector<Collapse> collapses;
+    std::vector<unsigned int> remap(vertex_count_);
+    std::vector<char> locked(vertex_count_);
+    std::vector<std::pair<unsigned int, unsigned int>> partners;
+
+    for (int pass = 0; pass < kMaxPasses && indices_.size() > target_index_count; pass++)
+    {
+        buildAdjacency();
+
+        collapses.clear();
+        for (unsigned int from = 0; from < vertex_count_; from++)
+        {
+            if (position_of_[from] != from || adjacency_offsets_[from] == adjacency_offsets_[from + 1])
+            {
+                continue;
+            }
+            Collapse best{kNone, kNone, std::numeric_limits<float>::max(), 0.0f};
+            for (unsigned int a = adjacency_offsets_[from]; a < adjacency_offsets_[from + 1]; a++)
+            {
+                const unsigned int* triangle = &indices_[3 * size_t(adjacency_[a])];
+                for (size_t k = 0; k < 3; k++)
+                {
+                    const unsigned int to = position_of_[triangle[k]];
+                    Collapse collapse{};
+                    if (to != from && findCollapse(from, to, collapse) && collapse.cost < best.cost)
+                    {
+                        best = collapse;
+                    }
+                }
+            }
+            if (best.from != kNone && best.error <= max_squared_error)
+            {
+                collapses.push_back(best);
+            }
+        }
+        if (collapses.empty())
+        {
+            break;
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) { return a.cost < b.cost; });
+        // a collapse removes about 2 triangles: the pass doesn't go much beyond the cost of the ones it needs, and not
+        // beyond the cheapest quarter, so that expensive collapses aren't made while cheaper ones are blocked by the locks
+        const size_t needed = std::min(collapses.size() / 4, (indices_.size() - target_index_count) / 6);
+        const float pass_cost_limit = 1.5f * collapses[needed].cost;
+
+        for (unsigned int v = 0; v < vertex_count_; v++)
+        {
+            remap[v] = v;
+        }
+        std::fill(locked.begin(), locked.end(), 0);
+        size_t removable = indices_.size() - target_index_count;
+        size_t performed = 0;
+        for (const Collapse &collapse : collapses)
+        {
+            if (collapse.cost > pass_cost_limit)
+            {
+                break;
+            }
+            if (locked[collapse.from] || locked[collapse.to] || flipsTriangles(collapse.from, collapse.to))
+            {
+                continue;
+            }
+            partnersOf(collapse.from, collapse.to, partners);
+
+            // the triangles around from are the only ones that change; they are locked for the rest of the pass
+            size_t removed = 0;
+            for (unsigned int a = adjacency_offsets_[collapse.from]; a < adjacency_offsets_[collapse.from + 1]; a++)
+            {
+                const unsigned int* triangle = &indices_[3 * size_t(adjacency_[a])];
+                bool has_to = false;
+                for (size_t k = 0; k < 3; k++)
+                {
+                    locked[position_of_[triangle[k]]] = 1;
+                    has_to = has_to || position_of_[triangle[k]] == collapse.to;
+                }
+                removed += has_to ? 3 : 0;
+            }
+            for (const std::pair<unsigned int, unsigned int> &partner : partners)
+            {
+                remap[partner.first] = partner.second;
+            }
+            quadrics_[collapse.to].add(quadrics_[collapse.from]);
+            collapsed_onto_[collapse.from] = collapse.to;
+            squared_error_ = std::max(squared_error_, collapse.error);
+            performed++;
+
+            if (removed >= removable)
+            {
+                break;
+            }
+            removable -= removed;
+        }
+        if (performed == 0)
+        {
+            break;
+        }
+
+        for (unsigned int &index : indices_)
+        {
+            index = remap[index];
+        }
+        removeDegenerateTriangles();
+    }
+    deviation_ = std::max(deviation_, measureDeviation());
+    return std::max(std::sqrt(squared_error_), deviation_);
+}
+
+float Simplification::measureDeviation()
+/** Measures the distance of every position that was collapsed from the simplified mesh, which the quadric error alone
+doesn't bound: it's the distance from the planes of the original triangles, not from the simplified ones. The
+triangles around the position it ended up at give an upper bound, and the grid finds the closest triangle within it. */
+{
+    buildAdjacency();
+    const TriangleGrid grid(vertices_, indices_);
+    double max_squared_distance = 0.0;
+    for (unsigned int v = 0; v < vertex_count_; v++)
+    {
+        if (collapsed_onto_[v] == kNone)
+        {
+            continue;
+        }
+        unsigned int onto = collapsed_onto_[v];
+        while (collapsed_onto_[onto] != kNone)
+        {
+            onto = collapsed_onto_[onto];
+        }
+        collapsed_onto_[v] = onto;
+        if (adjacency_offsets_[onto] == adjacency_offsets_[onto + 1])
+        {
+            continue;
+        }
+
+        double squared_distance = std::numeric_limits<double>::max();
+        for (unsigned int a = adjacency_offsets_[onto]; a < adjacency_offsets_[onto + 1]; a++)
+        {
+            const unsigned int* triangle = &indices_[3 * size_t(adjacency_[a])];
+            squared_distance = std::min(squared_distance, squaredDistanceToTriangle(position(v), position(triangle[0]),
+                                                                                    position(triangle[1]), position(triangle[2])));
+        }
+        squared_distance = std::min(squared_distance, grid.squaredDistance(position(v), std::sqrt(squared_distance)));
+        max_squared_distance = std::max(max_squared_distance, squared_distance);
+    }
+    // rounded up, so that the error still bounds the distance as a float
+    return std::nextafter(static_cast<float>(std::sqrt(max_squared_distance)), std::numeric_limits<float>::max());
+}
+}
+
+float MeshSimplifier::simplify(const std::vector<float> &vertices,
+                               const std::vector<float> &normals,
+                               const std::vector<float> &texture_coordinates,
+                               const std::vector<unsigned int> &indices,
+                               size_t target_index_count,
+                               float max_error,
+                               std::vector<unsigned int> &simplified)
+/** Simplifies a copy of the indices, the vertices stay as they are. Normals and texture coordinates are used as long as
+they have an entry for every vertex. */
+{
+    const size_t vertex_count = vertices.size() / 3;
+    static const std::vector<float> kNoAttribute;
+    Simplification simplification(vertices,
+                                  normals.size() == 3 * vertex_count ? normals : kNoAttribute,
+                                  texture_coordinates.size() == 2 * vertex_count ? texture_coordinates : kNoAttribute,
+                                  indices);
+    const float error = simplification.run(target_index_count, max_error);
+    simplified = simplification.indices();
+    return error;
+}
+
+void MeshSimplifier::buildLodChain(const std::vector<float> &vertices,
+                                   const std::vector<float> &normals,
+                                   const std::vector<float> &texture_coordinates,
+                                   std::vector<unsigned int> &indices,
+                                   std::vector<MeshLod> &lods)
+/** Levels are taken from one simplification of the full mesh that continues from level to level, so that the quadrics
+and the error of every level are those of the full mesh. Levels are reordered for the post-transform vertex cache.
+Triangle counts and errors of the levels are printed. */
+{
+    const size_t vertex_count = vertices.size() / 3;
+    static const std::vector<float> kNoAttribute;
+    Simplification simplification(vertices,
+                                  normals.size() == 3 * vertex_count ? normals : kNoAttribute,
+                                  texture_coordinates.size() == 2 * vertex_count ? texture_coordinates : kNoAttribute,
+                                  indices);
+    lods.assign(1, MeshLod{0, static_cast<uint32_t>(indices.size()), 0.0f});
+
+    std::vector<unsigned int> simplified;
+    while (lods.size() < kMaxLods && lods.back().index_count / 3 > kMinLodTriangles)
+    {
+        const size_t target = lods.back().index_count / 6 * 3;
+        const float error = simplification.run(target, std::numeric_limits<float>::max());
+        simplified = simplification.indices();
+        if (simplified.empty() || simplified.size() > kMinLodReduction * lods.back().index_count)
+        {
+            break;
+        }
+        MeshOptimizer::optimizeVertexCache(simplified, vertex_count);
+        lods.push_back(MeshLod{static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(simplified.size()), error});
+        indices.insert(indices.end(), simplified.begin(), simplified.end());
+    }
+
+    std::cout << "MeshSimplifier: " << lods.size() << " levels of detail, triangles (error):";
+    for (const MeshLod &lod : lods)
+    {
+        std::cout << " " << lod.index_count / 3 << " (" << std::setprecision(3) << lod.error << ")";
+    }
+    std::cout << std::setprecision(6) << std::endl;
+}
@@ -0,0 +1,519 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "../include/obj_parser.h"
+#include "../include/mapped_file.h"
+#include "../include/job_system.h"
+
+namespace
+{
+// files are split into chunks of at least this size, smaller files are parsed by a single task
+const size_t kMinChunkSize = 1 << 20;
+
+// Face corner as written in the file: 0-based indices of vertex, normal and texture coordinate.
+// Negative OBJ indices are relative to the end of the attribute list; they are stored relative to the chunk start
+// and marked in relative_mask until the number of attributes in all previous chunks is known.
+struct RawCorner
+{
+    int index[3];
+    unsigned char relative_mask;
+};
+
+struct Chunk
+{
+    const char* begin{nullptr};
+    const char* end{nullptr};
+
+    std::vector<float> vertices;
+    std::vector<float> normals;
+    std::vector<float> texture_coordinates;
+    std::vector<RawCorner> corners;
+    std::vector<unsigned char> face_sizes;
+    // faces before which an 'o' or 'g' record starts a new shape, and where these faces are written to in the output
+    std::vector<size_t> shape_faces;
+    std::vector<size_t> shape_offsets;
+
+    // set when the chunk contains something the parser doesn't reproduce exactly like tiny-obj-loader
+    bool supported{true};
+
+    // prefix sums over all previous chunks
+    size_t vertex_offset{0};
+    size_t normal_offset{0};
+    size_t texture_coordinate_offset{0};
+    size_t index_offset{0};
+    size_t index_count{0};
+};
+
+enum CornerAttribute { kCornerVertex = 0, kCornerNormal = 1, kCornerTexcoord = 2 };
+
+inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+inline const char* skipSpaces(const char* p, const char* end)
+{
+    while (p < end && isSpace(*p))
+    {
+        p++;
+    }
+    return p;
+}
+
+inline const char* skipUntil(const char* p, const char* end, const char* delimiters)
+{
+    while (p < end && std::strchr(delimiters, *p) == nullptr)
+    {
+        p++;
+    }
+    return p;
+}
+
+float parseReal(const char* &p, const char* end)
+/** Parses the next whitespace separated number of a line, 0 is returned for a malformed number like tiny-obj-loader does. */
+{
+    p = skipSpaces(p, end);
+    const char* token_end = skipUntil(p, end, " \t\r");
+    double value = 0.0;
+    ObjParser::parseFloat(p, token_end, value);
+    p = token_end;
+    return static_cast<float>(value);
+}
+
+int parseInt(const char* &p, const char* end)
+/** Parses an integer with atoi semantics and moves to the next '/' or whitespace. */
+{
+    bool negative = false;
+    if (p < end && (*p == '+' || *p == '-'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+    int value = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        value = value * 10 + (*p - '0');
+        p++;
+    }
+    p = skipUntil(p, end, "/ \t\r");
+    return negative ? -value : value;
+}
+
+inline bool isEmptyField(const char* p, const char* end)
+{
+    return p >= end || *p == '/' || isSpace(*p) || *p == '\r';
+}
+
+bool resolveCorner(int raw_index, bool present, size_t attribute_count, bool required, int &index, unsigned char &relative_mask,
+                   int attribute)
+/** Converts an OBJ index (1-based, negative = relative) into a 0-based index. An empty field is a missing index, a field
+that reads as 0 is an invalid one. */
+{
+    if (raw_index > 0)
+    {
+        index = raw_index - 1;
+        return true;
+    }
+    if (raw_index == 0)
+    {
+        // an absent normal or texture coordinate is fine; a missing vertex index and a zero index are errors
+        // tiny-obj-loader reports itself
+        index = -1;
+        return !required && !present;
+    }
+    index = static_cast<int>(attribute_count) + raw_index;
+    relative_mask |= static_cast<unsigned char>(1u << attribute);
+    return true;
+}
+
+void parseFace(const char* p, const char* end, Chunk &chunk)
+/** Parses corners of a face in 'v', 'v/t', 'v//n' or 'v/t/n' notation. */
+{
+    unsigned int corner_count = 0;
+    while (true)
+    {
+        while (p < end && (isSpace(*p) || *p == '\r'))
+        {
+            p++;
+        }
+        if (p >= end)
+        {
+            break;
+        }
+
+        int raw[3] = {0, 0, 0};
+        bool present[3] = {true, false, false};
+        raw[kCornerVertex] = parseInt(p, end);
+        if (p < end && *p == '/')
+        {
+            p++;
+            if (p < end && *p == '/')
+            {
+                p++;
+                present[kCornerNormal] = !isEmptyField(p, end);
+                raw[kCornerNormal] = parseInt(p, end);
+            }
+            else
+            {
+                present[kCornerTexcoord] = !isEmptyField(p, end);
+                raw[kCornerTexcoord] = parseInt(p, end);
+                if (p < end && *p == '/')
+                {
+                    p++;
+                    present[kCornerNormal] = !isEmptyField(p, end);
+                    raw[kCornerNormal] = parseInt(p, end);
+                }
+            }
+        }
+
+        RawCorner corner{{-1, -1, -1}, 0};
+        const size_t counts[3] = {chunk.vertices.size() / 3, chunk.normals.size() / 3, chunk.texture_coordinates.size() / 2};
+        for (int a = 0; a < 3; a++)
+        {
+            if (!resolveCorner(raw[a], present[a], counts[a], a == kCornerVertex, corner.index[a], corner.relative_mask, a))
+            {
+                chunk.supported = false;
+            }
+        }
+        chunk.corners.push_back(corner);
+        corner_count++;
+    }
+
+    // triangles and quads are triangulated exactly like tiny-obj-loader does it, bigger polygons are left to it
+    if (corner_count < 3 || corner_count > 4)
+    {
+        chunk.supported = false;
+    }
+    chunk.face_sizes.push_back(static_cast<unsigned char>(std::min(corner_count, 255u)));
+}
+
+void parseChunk(Chunk &chunk)
+/** Parses 'v', 'vn', 'vt', 'f', 'o' and 'g' records of all lines in the chunk, everything else is skipped. */
+{
+    const char* p = chunk.begin;
+    while (p < chunk.end && chunk.supported)
+    {
+        const char* line_end = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(chunk.end - p)));
+        if (line_end == nullptr)
+        {
+            line_end = chunk.end;
+        }
+
+        const char* token = skipSpaces(p, line_end);
+        const size_t length = static_cast<size_t>(line_end - token);
+
+        if (length > 1 && token[0] == 'v' && isSpace(token[1]))
+        {
+            token += 2;
+            for (int k = 0; k < 3; k++)
+            {
+                chunk.vertices.push_back(parseReal(token, line_end));
+            }
+        }
+        else if (length > 2 && token[0] == 'v' && token[1] == 'n' && isSpace(token[2]))
+        {
+            token += 3;
+            for (int k = 0; k < 3; k++)
+            {
+                chunk.normals.push_back(parseReal(token, line_end));
+            }
+        }
+        else if (length > 2 && token[0] == 'v' && token[1] == 't' && isSpace(token[2]))
+        {
+            token += 3;
+            for (int k = 0; k < 2; k++)
+            {
+                chunk.texture_coordinates.push_back(parseReal(token, line_end));
+            }
+        }
+        else if (length > 1 && token[0] == 'f' && isSpace(token[1]))
+        {
+            parseFace(token + 2, line_end, chunk);
+        }
+        else if (length > 1 && (token[0] == 'o' || token[0] == 'g') && isSpace(token[1]))
+        {
+            chunk.shape_faces.push_back(chunk.face_sizes.size());
+        }
+        else if (length > 0 && line_end[-1] == '\\')
+        {
+            // line continuations are not handled
+            chunk.supported = false;
+        }
+
+        p = line_end + 1;
+    }
+}
+
+void copyAttributes(const Chunk &chunk, ObjData &data)
+{
+    std::copy(chunk.vertices.begin(), chunk.vertices.end(), data.vertices.begin() + chunk.vertex_offset);
+    std::copy(chunk.normals.begin(), chunk.normals.end(), data.normals.begin() + chunk.normal_offset);
+    std::copy(chunk.texture_coordinates.begin(), chunk.texture_coordinates.end(),
+              data.texture_coordinates.begin() + chunk.texture_coordinate_offset);
+}
+
+void emitFaces(Chunk &chunk, ObjData &data)
+/** Converts chunk corners into global indices and writes triangulated faces at the chunk's position in the output. */
+{
+    const size_t bases[3] = {chunk.vertex_offset / 3, chunk.normal_offset / 3, chunk.texture_coordinate_offset / 2};
+    const size_t limits[3] = {data.vertices.size() / 3, data.normals.size() / 3, data.texture_coordinates.size() / 2};
+
+    std::vector<tinyobj::index_t> face(4);
+    size_t corner = 0;
+    size_t output = chunk.index_offset;
+    size_t shape = 0;
+
+    for (size_t f = 0; f < chunk.face_sizes.size(); f++)
+    {
+        const unsigned char face_size = chunk.face_sizes[f];
+        for (; shape < chunk.shape_faces.size() && chunk.shape_faces[shape] == f; shape++)
+        {
+            chunk.shape_offsets.push_back(output);
+        }
+        for (unsigned int c = 0; c < face_size; c++, corner++)
+        {
+            const RawCorner &raw = chunk.corners[corner];
+            int resolved[3];
+            for (int a = 0; a < 3; a++)
+            {
+                const long index = raw.index[a] + ((raw.relative_mask >> a) & 1u ? static_cast<long>(bases[a]) : 0);
+                if (index >= static_cast<long>(limits[a]) || (index < 0 && (a == kCornerVertex || ((raw.relative_mask >> a) & 1u))))
+                {
+                    // index out of range: let tiny-obj-loader deal with the file
+                    chunk.supported = false;
+                    return;
+                }
+                resolved[a] = static_cast<int>(index);
+            }
+            face[c].vertex_index = resolved[kCornerVertex];
+            face[c].normal_index = resolved[kCornerNormal];
+            face[c].texcoord_index = resolved[kCornerTexcoord];
+        }
+
+        if (face_size == 3)
+        {
+            std::copy(face.begin(), face.begin() + 3, data.indices.begin() + output);
+            output += 3;
+            continue;
+        }
+
+        // quad is split along the shorter diagonal, computed in single precision as in tiny-obj-loader
+        const float* v0 = &data.vertices[3 * size_t(face[0].vertex_index)];
+        const float* v1 = &data.vertices[3 * size_t(face[1].vertex_index)];
+        const float* v2 = &data.vertices[3 * size_t(face[2].vertex_index)];
+        const float* v3 = &data.vertices[3 * size_t(face[3].vertex_index)];
+
+        const float e02x = v2[0] - v0[0], e02y = v2[1] - v0[1], e02z = v2[2] - v0[2];
+        const float e13x = v3[0] - v1[0], e13y = v3[1] - v1[1], e13z = v3[2] - v1[2];
+        const float sqr02 = e02x * e02x + e02y * e02y + e02z * e02z;
+        const float sqr13 = e13x * e13x + e13y * e13y + e13z * e13z;
+
+        const int order02[6] = {0, 1, 2, 0, 2, 3};
+        const int order13[6] = {0, 1, 3, 1, 2, 3};
+        const int* order = sqr02 < sqr13 ? order02 : order13;
+        for (int k = 0; k < 6; k++)
+        {
+            data.indices[output++] = face[order[k]];
+        }
+    }
+}
+
+template<typename Function>
+void forEachChunk(std::vector<Chunk> &chunks, Function function)
+/** Runs the function for every chunk on the job system and waits for completion. */
+{
+    JobSystem::instance().parallelFor(chunks.size(), 1, [&chunks, &function](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            function(chunks[i]);
+        }
+    });
+}
+}
+
+bool ObjParser::parse(const std::string &filepath, ObjData &data)
+/** Parses geometry of an .obj file on the job system. The file is mapped and split into line-aligned chunks,
+which are parsed independently; prefix sums of per-chunk attribute counts then turn chunk-local indices into global ones.
+Returns false if the file can't be read or contains constructs the parser doesn't handle,
+in which case the caller falls back to tiny-obj-loader. */
+{
+    MappedFile file;
+    if (!file.open(filepath))
+    {
+        return false;
+    }
+
+    const char* begin = reinterpret_cast<const char*>(file.data());
+    const char* end = begin + file.size();
+
+    const size_t chunk_count = std::max<size_t>(1, std::min<size_t>(4 * (JobSystem::instance().size() + 1), file.size() / kMinChunkSize));
+    std::vector<Chunk> chunks(chunk_count);
+
+    const char* chunk_begin = begin;
+    for (size_t i = 0; i < chunk_count; i++)
+    {
+        const char* chunk_end = end;
+        if (i + 1 < chunk_count)
+        {
+            // move the split point to the start of the next line
+            chunk_end = std::max(chunk_begin, begin + file.size() * (i + 1) / chunk_count);
+            const void* newline = std::memchr(chunk_end, '\n', static_cast<size_t>(end - chunk_end));
+            chunk_end = newline != nullptr ? static_cast<const char*>(newline) + 1 : end;
+        }
+        chunks[i].begin = chunk_begin;
+        chunks[i].end = chunk_end;
+        chunk_begin = chunk_end;
+    }
+
+    forEachChunk(chunks, parseChunk);
+
+    size_t vertex_count = 0, normal_count = 0, texture_coordinate_count = 0, index_count = 0;
+    for (Chunk &chunk : chunks)
+    {
+        if (!chunk.supported)
+        {
+            return false;
+        }
+        for (unsigned char face_size : chunk.face_sizes)
+        {
+            chunk.index_count += face_size == 3 ? 3 : 6;
+        }
+
+        chunk.vertex_offset = vertex_count;
+        chunk.normal_offset = normal_count;
+        chunk.texture_coordinate_offset = texture_coordinate_count;
+        chunk.index_offset = index_count;
+        vertex_count += chunk.vertices.size();
+        normal_count += chunk.normals.size();
+        texture_coordinate_count += chunk.texture_coordinates.size();
+        index_count += chunk.index_count;
+    }
+
+    data.vertices.resize(vertex_count);
+    data.normals.resize(normal_count);
+    data.texture_coordinates.resize(texture_coordinate_count);
+    data.indices.resize(index_count);
+
+    // attributes have to be complete before faces are emitted, since quads are split depending on vertex positions
+    forEachChunk(chunks, [&data](Chunk &chunk) { copyAttributes(chunk, data); });
+    forEachChunk(chunks, [&data](Chunk &chunk) { emitFaces(chunk, data); });
+
+    // the first shape starts with the file, shapes without faces are dropped like tiny-obj-loader drops them
+    data.shape_offsets.assign(index_count > 0 ? 1 : 0, 0);
+    for (const Chunk &chunk : chunks)
+    {
+        if (!chunk.supported)
+        {
+            return false;
+        }
+        for (size_t offset : chunk.shape_offsets)
+        {
+            if (offset < index_count && offset > data.shape_offsets.back())
+            {
+                data.shape_offsets.push_back(offset);
+            }
+        }
+    }
+    return true;
+}
+
+bool ObjParser::parseFloat(const char* begin, const char* end, double &value)
+/** Locale-independent number parser. It accumulates digits the same way as tryParseDouble of tiny-obj-loader,
+so parsed values are bit-identical to the ones tiny-obj-loader produces. */
+{
+    if (begin >= end)
+    {
+        return false;
+    }
+
+    double mantissa = 0.0;
+    int exponent = 0;
+    char sign = '+';
+    const char* p = begin;
+    bool leading_decimal_dot = false;
+
+    if (*p == '+' || *p == '-')
+    {
+        sign = *p;
+        p++;
+        leading_decimal_dot = p != end && *p == '.';
+    }
+    else if (*p == '.')
+    {
+        leading_decimal_dot = true;
+    }
+    else if (*p < '0' || *p > '9')
+    {
+        return false;
+    }
+
+    // integer part
+    if (!leading_decimal_dot)
+    {
+        int read = 0;
+        while (p != end && *p >= '0' && *p <= '9')
+        {
+            mantissa *= 10;
+            mantissa += static_cast<int>(*p - '0');
+            p++;
+            read++;
+        }
+        if (read == 0)
+        {
+            return false;
+        }
+    }
+
+    // decimal part
+    if (p != end && *p == '.')
+    {
+        static const double pow_lut[] = {1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001};
+        const int lut_entries = sizeof(pow_lut) / sizeof(pow_lut[0]);
+
+        p++;
+        int read = 1;
+        while (p != end && *p >= '0' && *p <= '9')
+        {
+            mantissa += static_cast<int>(*p - '0') * (read < lut_entries ? pow_lut[read] : std::pow(10.0, -read));
+            read++;
+            p++;
+        }
+    }
+
+    // exponent part
+    if (p != end && (*p == 'e' || *p == 'E'))
+    {
+        p++;
+        char exponent_sign = '+';
+        if (p != end && (*p == '+' || *p == '-'))
+        {
+            exponent_sign = *p;
+            p++;
+        }
+        else if (p == end || *p < '0' || *p > '9')
+        {
+            return false;
+        }
+
+        int read = 0;
+        while (p != end && *p >= '0' && *p <= '9')
+        {
+            if (exponent > 2147483647 / 10)
+            {
+                return false;
+            }
+            exponent = exponent * 10 + static_cast<int>(*p - '0');
+            p++;
+            read++;
+        }
+        if (read == 0)
+        {
+            return false;
+        }
+        exponent *= exponent_sign == '+' ? 1 : -1;
+    }
+
+    value = (sign == '+' ? 1 : -1) * (exponent ? std::ldexp(mantissa * std::pow(5.0, exponent), exponent) : mantissa);
+    return true;
+}
@@ -1,35 +1,51 @@
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <random>
+#include <utility>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glad/glad.h>
 
 #include "../include/object.h"
-#include "../include/loader.h"
+#include "../include/render_state.h"
+#include "../include/profiler.h"
 
+constexpr uint32_t Plane::kShaderFeatures;
+constexpr float Plane::kMaxLodPixelError;
+constexpr size_t Plane::kUpdateGrain;
 
-Object::Object(const std::string& obj_filepath, const std::string& shader_vert, const std::string& shader_frag): shaderProgram_(shader_vert.c_str(), shader_frag.c_str()) {
+Object::Object(const std::string& obj_filepath, const std::string& shader_vert, const std::string& shader_frag,
+               uint32_t shader_features): shaderProgram_(shader_vert.c_str(), shader_frag.c_str(), shader_features),
+        model_uniform_(shaderProgram_.uniform<glm::mat4>("model")), vertex_format_uniforms_(shaderProgram_) {
     loadObjectFile(obj_filepath);
 
     // generates a single Vertex Array Object (VAO)  that stores the state needed to supply vertex data,
     // including information about vertex attribute pointers: position, normals, text.coordinates etc.
     glGenVertexArrays(1, &VAO_);
-    // generates a single Vertex Buffer Object (VBO) that stores the actual vertex data.
+    // generates a single Vertex Buffer Object (VBO) that stores the actual vertex data, all attributes of a vertex next to each other.
     glGenBuffers(1, &VBO_);
-    // buffer for normals
-    glGenBuffers(1, &NBO_);
+    // generates an Element Buffer Object (EBO) that stores indices of unique vertices for every triangle.
+    glGenBuffers(1, &EBO_);
 }
 
 void Object::loadObjectFile(const std::string &filepath)
-/** Loads vertices, normals and texture coodinates from an .obj file using Loader class. */
+/** Loads unique vertices, normals, texture coodinates and triangle indices of an .obj file, encoded in the vertex layout.
+The binary mesh cache next to the file is memory-mapped, the .obj is parsed only when the cache is missing or outdated;
+if the cache can't be written (e.g. read-only directory), the mesh cache keeps the parsed mesh in memory instead. */
 {
     if (filepath.empty()){
         return;
     }
-    vertices_.clear();
-    normals_.clear();
 
     try{
-        ObjectLoader::loadObjFileData(filepath, vertices_, normals_, texture_coordinates_);
+        if (mesh_cache_.load(filepath, vertex_layout_))
+        {
+            lods_ = mesh_cache_.lods();
+            index_count_ = static_cast<GLsizei>(lods_[0].index_count);
+            bounds_ = mesh_cache_.header().bounds;
+            shape_bounds_ = mesh_cache_.shapeBounds();
+        }
     }
     catch(...) {
         std::cerr << "Error: Unable to load file: " << filepath;
@@ -38,35 +54,49 @@ void Object::loadObjectFile(const std::string &filepath)
 }
 
 void Object::loadObjectBuffers()
-/** Loads data into all Object's buffers: vertices, normals. */
+/** Loads data into all Object's buffers, straight from the mapped mesh cache or from the mesh it built. */
 {
-    glBindVertexArray(VAO_);
+    uploadMeshBuffers(mesh_cache_.isLoaded() ? mesh_cache_.view() : MeshView());
 
+    // the mesh is stored in GPU buffers now, the mapping is not needed anymore
+    mesh_cache_.release();
+}
+
+void Object::uploadMeshBuffers(const MeshView &mesh)
+/** Uploads the interleaved vertices and the indices into Object's buffers as they are, they're encoded in the vertex
+layout of the object already. Positions are quantized relative to the bounding box of the mesh, the shader gets it
+through the vertexFormat uniforms. */
+{
+    RenderState::bindVertexArray(VAO_);
+
+    dequantization_ = vertex_layout_.dequantizationFor(bounds_);
     glBindBuffer(GL_ARRAY_BUFFER, VBO_);
-    glBufferData(GL_ARRAY_BUFFER,
-                 sizeof(GLfloat) * vertices_.size(),
-                 vertices_.data(),
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(mesh.vertex_data_size), mesh.vertices, GL_STATIC_DRAW);
+    // Points the vertex attributes (0: positions, 1: normals, 2: texture coordinates) of the currently bound VAO at their place in every vertex.
+    VertexAttributes::setPointers(vertex_layout_);
+
+    // the element buffer binding is stored in the VAO, so it has to be bound while the VAO is active.
+    // Meshes with up to 65535 vertices come with 16-bit indices, which halves the size of the index buffer.
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO_);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                 static_cast<GLsizeiptr>(mesh.index_data_size),
+                 mesh.indices,
                  GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    // Enables the vertex attribute array at the specified index (0 corresponds to the vertex positions) within the currently bound VAO.
-    glEnableVertexAttribArray(0);
-
-    glBindBuffer(GL_ARRAY_BUFFER, NBO_);
-    glBufferData(GL_ARRAY_BUFFER,
-                 sizeof(GLfloat) * normals_.size(),
-                 normals_.data(),
-                 GL_STATIC_DRAW);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    // the specified index 1 corresponds to the vertex normal within the currently bound VAO.
-    glEnableVertexAttribArray(1);
+    index_type_ = mesh.index_size == sizeof(GLushort) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
 
-    glBindVertexArray(0);
+    RenderState::bindVertexArray(0);
 }
 
-void Object::draw(glm::mat4 &view, glm::mat4 &projection)
+void Object::submit(RenderQueue &queue)
+/** Adds the object as opaque geometry, sorted by its distance from the camera. */
+{
+    queue.submit(RenderQueue::makeKey(kRenderLayerOpaque, shaderProgram_.id(), 0, queue.depthOf(glm::vec3(0.0f))), this);
+}
+
+void Object::draw(int frame_slot)
 /** Default drawing function. */
 {
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    RenderState::setPolygonMode(GL_LINE);
 
     shaderProgram_.use();
 
@@ -75,177 +105,498 @@ void Object::draw(glm::mat4 &view, glm::mat4 &projection)
     glm::mat4 model = glm::mat4(1.0f);
     model = glm::scale(model, glm::vec3(scale_, scale_, scale_));
 
-    shaderProgram_.setMat4("projection", projection);
-    shaderProgram_.setMat4("view", view);
-    shaderProgram_.setMat4("model", model);
+    shaderProgram_.set(model_uniform_, model);
+    VertexAttributes::setUniforms(shaderProgram_, vertex_format_uniforms_, vertex_layout_, dequantization_);
 
-    glBindVertexArray(VAO_);
+    RenderState::bindVertexArray(VAO_);
     // draws the specified number of triangles using the vertex data that has been previously bound to the vertex array object (VAO)
-    // The difference from glDrawElements is that it uses an index buffer to specify the order in which vertices should be drawn.
-    // While with glDrawArrays vertices are rendered sequentially from the vertex array without any reuse or indexing.
-    glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(vertices_.size()/3));
+    // The difference from glDrawArrays is that it uses an index buffer to specify the order in which vertices should be drawn,
+    // so a vertex shared by several triangles is stored and (thanks to the post-transform cache) shaded only once.
+    glDrawElements(GL_TRIANGLES, index_count_, index_type_, (void*)0);
 }
 
 Object::~Object()
 {
+    RenderState::forgetVertexArray(VAO_);
     glDeleteVertexArrays(1, &VAO_);
     glDeleteBuffers(1, &VBO_);
-    glDeleteBuffers(1, &NBO_);
+    glDeleteBuffers(1, &EBO_);
 }
 
-void Plane::draw(glm::mat4 &view, glm::mat4 &projection)
-/** Render a model of plane with custom color, rotation and scaling. */
+Plane::Uniforms::Uniforms(const ShaderProgram &program)
+        : object_color(program.uniform<glm::vec3>("objectColor")),
+          vertex_format(program)
 {
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-
-    shaderProgram_.use();
-    // set uniforms to calculate lighting in fragment shader
-    shaderProgram_.setVec3("objectColor", 0.741, 0.741, 0.741);
-    shaderProgram_.setVec3("lightPos", glm::vec3(15.0f, 15.0f, 10.0));
-    shaderProgram_.setVec3("viewPos", glm::vec3(0.0f, 1.0f, 10.0));
+}
 
-    shaderProgram_.setVec3("lightColor", 0.988, 0.945, 0.784);
+Plane::Plane(const std::string &obj_filepath, const std::string &shader_vert, const std::string &shader_frag, int instance_count) : Object(
+        obj_filepath, shader_vert, shader_frag, kShaderFeatures | VertexAttributes::shaderFeatures(MeshCache::defaultLayout())),
+        programs_(shader_vert, shader_frag, kShaderFeatures | kShaderFeatureOctahedralNormals)
+{
+    programs_.adopt(shaderProgram_);
+    program_ = &programs_.get(shaderProgram_.features());
+
+    // the original plane: 6 units away from the Earth's axis, moving by half a degree per frame
+    orbits_.add(6.0f, 0.0f, 0.0f, 0.5f);
+
+    // the others get random orbits around the Earth, with a fixed seed so that every run shows the same traffic
+    std::mt19937 random(4);
+    std::uniform_real_distribution<float> radius(4.0f, 9.0f);
+    std::uniform_real_distribution<float> inclination(-70.0f, 70.0f);
+    std::uniform_real_distribution<float> phase(0.0f, 360.0f);
+    std::uniform_real_distribution<float> speed(0.2f, 0.8f);
+    for (int i = 1; i < instance_count; i++)
+    {
+        orbits_.add(radius(random), inclination(random), phase(random), speed(random));
+    }
 
-    glm::mat4 model = glm::mat4(1.0f);
+    // buffer for the per-instance model matrices
+    glGenBuffers(1, &instance_buffer_);
+}
 
-    model = glm::rotate(model, glm::radians(angle_), glm::vec3(0.0, 1.0, 0.0));
-    model = glm::translate(model, glm::vec3(0.0, 0.0, -6.0));
+Plane::~Plane()
+{
+    glDeleteBuffers(1, &instance_buffer_);
+}
 
+glm::mat4 Plane::localMatrix() const
+/** Returns the transformation from the model's coordinates into those of a plane flying in the direction of its orbit. */
+{
+    glm::mat4 model = glm::mat4(1.0f);
     model = glm::rotate(model, glm::radians(-180.0f), glm::vec3(0.0, 1.0, 0.0));
     model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0, 0.0, 0.0));
     model = glm::scale(model, glm::vec3(scale_, scale_, scale_));
+    return model;
+}
 
-    shaderProgram_.setMat4("projection", projection);
-    shaderProgram_.setMat4("view", view);
-    shaderProgram_.setMat4("model", model);
+void Plane::uploadMeshBuffers(const MeshView &mesh)
+/** Uploads vertices, normals and indices and sets up the per-instance model matrices as vertex attributes 3 to 5. The
+program is the permutation that decodes the normals of the mesh's vertex layout. */
+{
+    program_ = &programs_.get(kShaderFeatures | VertexAttributes::shaderFeatures(vertex_layout_));
+    Object::uploadMeshBuffers(mesh);
+    RenderState::bindVertexArray(VAO_);
+
+    const GLsizeiptr rows_size = static_cast<GLsizeiptr>(orbits_.size() * 12 * sizeof(float));
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer_);
+    glBufferData(GL_ARRAY_BUFFER, rows_size, nullptr, GL_STREAM_DRAW);
+    for (GLuint row = 0; row < 3; row++)
+    {
+        // each row of the matrices is a vec4 attribute of its own, stored after the previous row of all instances
+        const size_t offset = row * orbits_.size() * 4 * sizeof(float);
+        glVertexAttribPointer(3 + row, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)offset);
+        glEnableVertexAttribArray(3 + row);
+        // advance the attribute once per instance instead of once per vertex
+        glVertexAttribDivisor(3 + row, 1);
+    }
 
-    glBindVertexArray(VAO_);
-    glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(vertices_.size()/3));
+    RenderState::bindVertexArray(0);
+}
 
-    // rotation angle changes every frame to make plane 'fly' around Earth model.
-    angle_ += 0.5;
+void Plane::tick()
+{
+    orbits_.advance(1.0f);
 }
 
-Earth::Earth(const std::string &obj_filepath, const std::string &shader_vert, const std::string &shader_frag) : Object(
-        obj_filepath, shader_vert, shader_frag)
+void Plane::update(float alpha, JobSystem &jobs)
+/** Computes the model matrices of all planes with the widest SIMD kernel of the CPU, in ranges of kUpdateGrain planes
+spread over the job system. Planes are drawn between the previous tick and the last one, since they move at constant
+speed, the position at alpha is the one of the last tick moved back by 1 - alpha ticks. */
 {
-    // buffer for texture coordinates
-    glGenBuffers(1, &TBO_);
+    PROFILE_SCOPE("Plane::update");
+    rows_.resize(orbits_.size() * 12);
+    const glm::mat4 local = localMatrix();
+    float* rows = rows_.data();
+    jobs.parallelFor(orbits_.size(), kUpdateGrain, [this, &local, rows, alpha](size_t begin, size_t end) {
+        orbits_.computeTransforms(local, rows, alpha - 1.0f, begin, end);
+    });
 }
 
-void Earth::loadObjectBuffers()
-/** Loads data into all Object's buffers: vertices, normals, texture coordinates. */
+void Plane::submit(RenderQueue &queue)
+/** Culls the planes by the bounding sphere of the mesh moved by their model matrices, and picks the coarsest level of
+detail for each visible one whose error covers at most kMaxLodPixelError pixels at its distance. The model matrices of
+the visible planes are kept for the frame grouped by level, and the planes are added as one packet of opaque geometry,
+sorted by the distance of the center of their orbits from the camera. Planes behind the Earth or outside the view are
+not drawn at all. */
 {
-    // load data into buffers for vertex positions and normals
-    Object::loadObjectBuffers();
-    glBindVertexArray(VAO_);
+    PROFILE_SCOPE("Plane::submit");
+    const size_t count = orbits_.size();
+    Frame &frame = frames_[queue.frameSlot()];
+    frame.visible_count = 0;
+    if (count == 0)
+    {
+        return;
+    }
 
-    // load buffer with texture coordinates
-    glBindBuffer(GL_ARRAY_BUFFER, TBO_);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * texture_coordinates_.size(), texture_coordinates_.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
-    // vertex attributes with indexes 0 and 1 are assigned to vertex position and normal
-    glEnableVertexAttribArray(2);
+    const float* rows[3] = {rows_.data(), rows_.data() + 4 * count, rows_.data() + 8 * count};
+    for (size_t r = 0; r < 3; r++)
+    {
+        centers_[r].resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            const float* row = rows[r] + 4 * i;
+            centers_[r][i] = row[0] * bounds_.center[0] + row[1] * bounds_.center[1] + row[2] * bounds_.center[2] + row[3];
+        }
+    }
+    visible_.resize(count);
+    // the local matrix only rotates and scales uniformly, and the orbits only rotate and move
+    const size_t visible_count = queue.culler().cullSpheres(centers_[0].data(), centers_[1].data(), centers_[2].data(),
+                                                             bounds_.radius * scale_, count, visible_.data());
+    if (visible_count == 0)
+    {
+        return;
+    }
+
+    // errors of the levels grow with the level, the coarsest one that is good enough at the depth of the plane is taken
+    const size_t lod_count = std::max<size_t>(lods_.size(), 1);
+    const float error_scale = queue.lodScale() * scale_ / kMaxLodPixelError;
+    lod_of_.resize(visible_count);
+    size_t lod_counts[MeshSimplifier::kMaxLods] = {};
+    for (size_t j = 0; j < visible_count; j++)
+    {
+        const uint32_t i = visible_[j];
+        const float depth = queue.viewDepthOf(glm::vec3(centers_[0][i], centers_[1][i], centers_[2][i]));
+        size_t lod = lod_count - 1;
+        while (lod > 0 && lods_[lod].error * error_scale > depth)
+        {
+            lod--;
+        }
+        lod_of_[j] = static_cast<uint8_t>(lod);
+        lod_counts[lod]++;
+    }
+    size_t lod_next[MeshSimplifier::kMaxLods];
+    for (size_t lod = 0, first = 0; lod < MeshSimplifier::kMaxLods; first += lod_counts[lod], lod++)
+    {
+        lod_next[lod] = first;
+        frame.lod_first_instance[lod] = static_cast<GLsizei>(first);
+        frame.lod_instance_count[lod] = static_cast<GLsizei>(lod_counts[lod]);
+    }
 
-    glBindVertexArray(0);
+    // the visible planes are packed into blocks of rows as long as their number, ordered by level of detail
+    frame.rows.resize(12 * visible_count);
+    for (size_t j = 0; j < visible_count; j++)
+    {
+        const size_t slot = lod_next[lod_of_[j]]++;
+        for (size_t r = 0; r < 3; r++)
+        {
+            std::memcpy(frame.rows.data() + 4 * (visible_count * r + slot), rows[r] + 4 * size_t(visible_[j]), 4 * sizeof(float));
+        }
+    }
+    frame.visible_count = static_cast<GLsizei>(visible_count);
+
+    queue.submit(RenderQueue::makeKey(kRenderLayerOpaque, program_->program->id(), 0, queue.depthOf(glm::vec3(0.0f))), this);
 }
 
-void Earth::draw(glm::mat4 &view, glm::mat4 &projection)
-/** Render a model of Earth with a combination of 2 textures: Earth texture (day or night) and clouds texture.*/
+void Plane::draw(int frame_slot)
+/** Render all planes with custom color, rotation and scaling. */
 {
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL); // using GL_FILL to see the texture
+    PROFILE_GPU_SCOPE("Plane::draw");
+    const Frame &frame = frames_[frame_slot];
+
+    // invalidating the buffer orphans it, so the driver doesn't have to wait for the previous frame to finish reading it
+    const size_t count = orbits_.size();
+    const size_t visible_count = static_cast<size_t>(frame.visible_count);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer_);
+    auto* instance_rows = static_cast<float*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(count * 12 * sizeof(float)),
+                                                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    if (instance_rows == nullptr)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return;
+    }
+    for (size_t r = 0; r < 3; r++)
+    {
+        std::memcpy(instance_rows + 4 * count * r, frame.rows.data() + 4 * visible_count * r, 4 * visible_count * sizeof(float));
+    }
+    const bool unmapped = glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE;
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (!unmapped)
+    {
+        // the contents were lost, e.g. on a mode switch; they are written again next frame
+        std::cout << "Failed to update the instance buffer of the planes" << std::endl;
+        return;
+    }
 
-    glActiveTexture(GL_TEXTURE0);
-    // bind to main Earth texture (daylight or night)
-    // This texture is used as diffuse map for lighting calculations
-    glBindTexture(GL_TEXTURE_2D, textures_[main_texture_id_].getTexture());
+    RenderState::setPolygonMode(GL_FILL);
+
+    const ShaderProgram &program = *program_->program;
+    program.use();
+    // light and camera come from the FrameConstants uniform block, the colour and the dequantization of the vertices are
+    // only sent to GL in the first frame
+    program.set(program_->uniforms.object_color, glm::vec3(0.741, 0.741, 0.741));
+    VertexAttributes::setUniforms(program, program_->uniforms.vertex_format, vertex_layout_, dequantization_);
+
+    // GL 3.3 has no base instance: the instance attributes are pointed at the first plane of each level instead
+    RenderState::bindVertexArray(VAO_);
+    const size_t index_size = index_type_ == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    for (size_t lod = 0; lod < lods_.size(); lod++)
+    {
+        if (frame.lod_instance_count[lod] == 0)
+        {
+            continue;
+        }
+        setInstanceOffset(frame.lod_first_instance[lod]);
+        glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(lods_[lod].index_count), index_type_,
+                                (void*)(lods_[lod].index_offset * index_size), frame.lod_instance_count[lod]);
+    }
+}
 
-    glActiveTexture(GL_TEXTURE1);
-    // bind to clouds texture
-    glBindTexture(GL_TEXTURE_2D, textures_[2].getTexture());
+void Plane::setInstanceOffset(GLsizei first_instance)
+/** Points the per-instance model matrix attributes of the bound vertex array at the given instance. */
+{
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer_);
+    for (GLuint row = 0; row < 3; row++)
+    {
+        const size_t offset = (row * orbits_.size() + static_cast<size_t>(first_instance)) * 4 * sizeof(float);
+        glVertexAttribPointer(3 + row, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)offset);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-    shaderProgram_.use();
-    // assign Earth texture unit to the Material.diffuse uniform sampler
-    shaderProgram_.setInt("material.diffuse", 0);
+Earth::Uniforms::Uniforms(const ShaderProgram &program)
+        : model(program.uniform<glm::mat4>("model")),
+          material_diffuse(program.uniform<int>("material.diffuse")),
+          clouds_texture(program.uniform<int>("texture1")),
+          light_ambient(program.uniform<glm::vec3>("light.ambient")),
+          clouds_intensity(program.uniform<float>("clouds_intensity")),
+          virtual_texture(program)
+{
+}
 
-    // texture1 with clouds is set with a separate uniform sampler2D,
-    // while main Earth texture is set as sampler2D diffuse map within Material struct
-    shaderProgram_.setInt("texture1", 1);
+Earth::Earth(const std::string &shader_vert, const std::string &shader_frag) : Object(
+        "", shader_vert, shader_frag, kShaderFeatureClouds),
+        surface_programs_(shader_vert, shader_frag, kShaderFeatureClouds | kShaderFeatureVirtualTexture)
+{
+    // the planet mesh is a sphere of radius 1 around the origin
+    bounds_ = MeshBounds{{-1.0f, -1.0f, -1.0f}, {1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f}, 1.0f};
+    // the program of the Object is the one of the day map when it's a regular texture
+    surface_programs_.adopt(shaderProgram_);
+
+    // the clouds are too faint to be seen at night, the night map is drawn without them
+    const std::pair<std::string, uint32_t> maps[] = {{"../textures/8k_earth_daymap.jpg", kShaderFeatureClouds},
+                                                     {"../textures/8k_earth_nightmap.jpg", 0}};
+    bool virtual_textures = false;
+    for (const auto &map : maps)
+    {
+        const std::string &filepath = map.first;
+        SurfaceMap surface_map;
+        surface_map.shader_features = map.second;
+        std::unique_ptr<VirtualTexture> virtual_texture(new VirtualTexture(VirtualTextureFile::pathFor(filepath)));
+        if (virtual_texture->isLoaded())
+        {
+            surface_map.virtual_texture = std::move(virtual_texture);
+            surface_map.shader_features |= kShaderFeatureVirtualTexture;
+            virtual_textures = true;
+        }
+        else
+        {
+            surface_map.texture.reset(new Texture2D(filepath));
+        }
+        surface_programs_.prepare(surface_map.shader_features);
+        surface_maps_.push_back(std::move(surface_map));
+    }
+    if (virtual_textures)
+    {
+        ShaderProgram::prepare(shader_vert, "../shaders/earth_feedback.frag");
+    }
 
+    // the programs prepared above are compiled at the same time
+    for (const SurfaceMap &surface_map : surface_maps_)
+    {
+        surface_programs_.get(surface_map.shader_features);
+    }
+    if (virtual_textures)
+    {
+        feedback_program_.reset(new ShaderProgram(shader_vert.c_str(), "../shaders/earth_feedback.frag"));
+        feedback_uniforms_ = Uniforms(*feedback_program_);
+    }
+}
+
+glm::mat4 Earth::modelMatrix() const
+/** Returns the model matrix of the current frame, shared by the feedback and the main pass. */
+{
     glm::mat4 model = glm::mat4(1.0f);
-    model = glm::rotate(model, glm::radians(angle_), glm::vec3(0.0, 1.0, 0.0));
+    model = glm::rotate(model, glm::radians(render_angle_), glm::vec3(0.0, 1.0, 0.0));
     model = glm::scale(model, glm::vec3(scale_, scale_, scale_));
+    return model;
+}
 
-    // set light parameters for the active shader program
-    shaderProgram_.setVec3("light.color", light_rgb_[0], light_rgb_[1], light_rgb_[2]);
-    shaderProgram_.setVec3("light.direction", glm::vec3(-1.0f, 0.0f, -1.0));
-    shaderProgram_.setVec3("light.ambient", 1.0f, 1.0f, 1.0f);
-    shaderProgram_.setVec3("light.diffuse", diffuse_, diffuse_, diffuse_);
+glm::vec4 Earth::occluderSphere() const
+/** The largest sphere inside the box of the mesh, shrunk by 2% for the flat triangles in between the vertices, which are
+closer to the center than the vertices themselves (by at most PlanetMesh::patchError(PlanetMesh::kRootLevel)). */
+{
+    float half_extent = 0.5f * (bounds_.max[0] - bounds_.min[0]);
+    for (int k = 1; k < 3; k++)
+    {
+        half_extent = std::min(half_extent, 0.5f * (bounds_.max[k] - bounds_.min[k]));
+    }
+    const glm::vec4 center = modelMatrix() * glm::vec4(bounds_.center[0], bounds_.center[1], bounds_.center[2], 1.0f);
+    return glm::vec4(center.x, center.y, center.z, 0.98f * half_extent * scale_);
+}
 
-    shaderProgram_.setFloat("clouds_intensity", clouds_intensity_);
+void Earth::tick()
+/** Turns the Earth by 0.2 degrees. The angle is kept in [0, 360) together with the previous one, so that the rotation
+drawn between them doesn't jump when it wraps around. */
+{
+    previous_angle_ = angle_;
+    angle_ += 0.2f;
+    if (angle_ >= 360.0f)
+    {
+        angle_ -= 360.0f;
+        previous_angle_ -= 360.0f;
+    }
+}
 
-    shaderProgram_.setMat4("projection", projection);
-    shaderProgram_.setMat4("view", view);
-    shaderProgram_.setMat4("model", model);
+void Earth::update(float alpha)
+{
+    render_angle_ = previous_angle_ + (angle_ - previous_angle_) * alpha;
+}
+
+void Earth::submit(RenderQueue &queue)
+/** Keeps the state of the frame, selects the patches of the planet mesh for the view and adds the Earth as opaque
+geometry, unless it's outside the view. Its material is the surface map that is currently shown. */
+{
+    Frame &frame = frames_[queue.frameSlot()];
+    frame.model = modelMatrix();
+    frame.main_texture_id = main_texture_id_;
+    frame.patches.clear();
+
+    const glm::vec4 center = frame.model * glm::vec4(bounds_.center[0], bounds_.center[1], bounds_.center[2], 1.0f);
+    if (!queue.culler().isVisible(glm::vec3(center), bounds_.radius * scale_))
+    {
+        return;
+    }
+    planet_.select(queue, frame.model, scale_, frame.patches);
 
-    glBindVertexArray(VAO_);
-    glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(vertices_.size()/3));
+    const SurfaceMap &surface_map = surface_maps_[main_texture_id_];
+    const ShaderProgram &program = *surface_programs_.find(surface_map.shader_features)->program;
+    const GLuint material = surface_map.virtual_texture ? surface_map.virtual_texture->atlasTexture() : surface_map.texture->getTexture();
+    queue.submit(RenderQueue::makeKey(kRenderLayerOpaque, program.id(), material, queue.depthOf(glm::vec3(0.0f))), this);
+}
+
+void Earth::draw(int frame_slot)
+/** Render a model of Earth with a combination of 2 textures: Earth texture (day or night) and clouds texture.*/
+{
+    PROFILE_GPU_SCOPE("Earth::draw");
+    RenderState::setPolygonMode(GL_FILL); // using GL_FILL to see the texture
+
+    const Frame &frame = frames_[frame_slot];
+    planet_.upload();
+    const SurfaceMap &surface_map = surface_maps_[frame.main_texture_id];
+    const auto &permutation = surface_programs_.get(surface_map.shader_features);
+    const ShaderProgram &program = *permutation.program;
+    const Uniforms &uniforms = permutation.uniforms;
+    const bool clouds = (surface_map.shader_features & kShaderFeatureClouds) != 0;
+
+    {
+        PROFILE_SCOPE("Earth::draw textures");
+        if (clouds)
+        {
+            // bind to clouds texture
+            RenderState::bindTexture(1, GL_TEXTURE_2D, clouds_texture_.getTexture());
+        }
+
+        program.use();
+        if (surface_map.virtual_texture)
+        {
+            // the page atlas and the indirection texture take the place of the diffuse map
+            surface_map.virtual_texture->bind(program, uniforms.virtual_texture, 0, 2);
+        }
+        else
+        {
+            // bind to main Earth texture (daylight or night)
+            // This texture is used as diffuse map for lighting calculations
+            RenderState::bindTexture(0, GL_TEXTURE_2D, surface_map.texture->getTexture());
+            // assign Earth texture unit to the Material.diffuse uniform sampler
+            program.set(uniforms.material_diffuse, 0);
+        }
+    }
 
-    glBindVertexArray(0); // Unbind VAO
-    glBindTexture(GL_TEXTURE_2D, 0); // Unbind texture
+    if (clouds)
+    {
+        // texture1 with clouds is set with a separate uniform sampler2D,
+        // while main Earth texture is set as sampler2D diffuse map within Material struct
+        program.set(uniforms.clouds_texture, 1);
+        program.set(uniforms.clouds_intensity, clouds_intensity_);
+    }
 
-    // rotation angle changes every frame to make Earth rotate around the center.
-    angle_ += 0.2;
+    // direction and colour of the light are set for all programs in the FrameConstants uniform block
+    program.set(uniforms.light_ambient, glm::vec3(1.0f, 1.0f, 1.0f));
+
+    program.set(uniforms.model, frame.model);
+
+    planet_.draw(frame.patches);
 }
 
-Skybox::Skybox(const std::string& shader_vert, const std::string& shader_frag): shaderProgram_(shader_vert.c_str(), shader_frag.c_str()){
-    glGenVertexArrays(1, &VAO_);
-    glGenBuffers(1, &VBO_);
+void Earth::drawFeedback(int frame_slot, int viewport_width, int viewport_height)
+/** Streams in the pages requested by the last feedback pass and renders a new one, if the surface map of the frame is
+a virtual texture. Both passes draw the same patches with the same model matrix. */
+{
+    PROFILE_GPU_SCOPE("Earth::drawFeedback");
+    const Frame &frame = frames_[frame_slot];
+    VirtualTexture* virtual_texture = surface_maps_[frame.main_texture_id].virtual_texture.get();
+    if (virtual_texture == nullptr)
+    {
+        return;
+    }
 
-    glBindVertexArray(VAO_);
-    // consider all vertex positions of the cube to be its texture coordinates when sampling a cubemap.
-    // Therefore, we need only 1 buffer with vertices' coordinates.
-    glBindBuffer(GL_ARRAY_BUFFER, VBO_);
-    glBufferData(GL_ARRAY_BUFFER,
-                 sizeof(GLfloat) * vertices_.size(),
-                 vertices_.data(),
-                 GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+    virtual_texture->update();
+    if (!virtual_texture->beginFeedback(viewport_width, viewport_height))
+    {
+        return;
+    }
+
+    RenderState::setPolygonMode(GL_FILL);
+    feedback_program_->use();
+    virtual_texture->bindFeedback(*feedback_program_, feedback_uniforms_.virtual_texture);
+    feedback_program_->set(feedback_uniforms_.model, frame.model);
 
-    glBindVertexArray(0);
+    planet_.upload();
+    planet_.draw(frame.patches);
 
+    virtual_texture->endFeedback();
 }
 
-void Skybox::draw(glm::mat4 &view, glm::mat4 &projection)
+Skybox::Skybox(const std::string& shader_vert, const std::string& shader_frag): shaderProgram_(shader_vert.c_str(), shader_frag.c_str()),
+        skybox_sampler_(shaderProgram_.uniform<int>("skybox")){
+    glGenVertexArrays(1, &VAO_);
+}
+
+Skybox::~Skybox()
+{
+    RenderState::forgetVertexArray(VAO_);
+    glDeleteVertexArrays(1, &VAO_);
+}
+
+void Skybox::submit(RenderQueue &queue)
+/** Adds the skybox in a layer of its own, after all opaque geometry. */
+{
+    queue.submit(RenderQueue::makeKey(kRenderLayerSkybox, shaderProgram_.id(), skybox_texture_.getTexture(), 1.0f), this);
+}
+
+void Skybox::draw(int frame_slot)
 /** Render a skybox with cubemap texture. */
 {
-    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    PROFILE_GPU_SCOPE("Skybox::draw");
+    RenderState::setPolygonMode(GL_FILL);
 
-    // in vertex shader z-coordinate of skybox is set to w-value, so that depth testing results in 1.0.
-    // The depth buffer is filled with 1.0 for the skybox, so to make sure the skybox passes the depth tests
-    // with values less than or equal to the depth buffer, depth test function is set to  GL_LEQUAL.
-    glDepthFunc(GL_LEQUAL);
+    // in the vertex shader the depth of the triangle is set to 1.0, the far plane, which only passes the depth test
+    // where nothing else was drawn: the depth buffer is cleared to 1.0, and GL_LEQUAL lets equal values pass.
+    // The depth buffer keeps its values, so writing them is skipped.
+    RenderState::setDepthFunc(GL_LEQUAL);
+    RenderState::setDepthMask(false);
 
-    glActiveTexture(GL_TEXTURE0);
-    // bind to generated cubemap texture
-    glBindTexture(GL_TEXTURE_CUBE_MAP, skybox_texture_.getTexture());
+    // bind to generated cubemap texture; mip levels are filtered across the edges of the faces
+    RenderState::setEnabled(GL_TEXTURE_CUBE_MAP_SEAMLESS, true);
+    RenderState::bindTexture(0, GL_TEXTURE_CUBE_MAP, skybox_texture_.getTexture());
 
     shaderProgram_.use();
-    shaderProgram_.setInt("skybox", 0);
+    shaderProgram_.set(skybox_sampler_, 0);
 
     // Cubemap is meant to creat an impression that is large, static and always far away from viewer.
-    // The cube should not move with viewer.
-    // This trick removes any translation, but keeps all rotation transformations so the user can still look around the scene.
-    glm::mat4 new_view = glm::mat4(glm::mat3(view));
-
-    shaderProgram_.setMat4("projection", projection);
-    shaderProgram_.setMat4("view", new_view);
-
-    glBindVertexArray(VAO_);
-    glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(vertices_.size()/3));
+    // It doesn't move with viewer: the vertex shader only undoes the rotation of the view, not its translation,
+    // so the user can still look around the scene.
 
-    glBindVertexArray(0);
-    glDepthFunc(GL_LESS); // set depth testing function back to 'less than'.
-    glBindTexture(GL_TEXTURE_CUBE_MAP, 0); // Unbind texture
+    RenderState::bindVertexArray(VAO_);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
 }
@@ -0,0 +1,335 @@
+#include <cmath>
+
+#include "../include/orbit_set.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define PROJECT_4_ORBIT_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+const float kRadiansPerDegree = 0.01745329251994329577f;
+
+// Orbits and the local transform in the form all kernels read them: the first three rows of every column of the
+// local matrix, and the output rows of the model matrices.
+struct TransformBatch
+{
+    const float* radius;
+    const float* inclination;
+    const float* phase;
+    const float* speed;
+    float frames;
+    float local[4][3];
+    float* rows[3];
+};
+
+void computeTransformsScalar(const TransformBatch &batch, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++)
+    {
+        const float phase = (batch.phase[i] + batch.speed[i] * batch.frames) * kRadiansPerDegree;
+        const float inclination = batch.inclination[i] * kRadiansPerDegree;
+        const float sin_p = std::sin(phase);
+        const float cos_p = std::cos(phase);
+        const float sin_i = std::sin(inclination);
+        const float cos_i = std::cos(inclination);
+
+        // rotateX(inclination) * rotateY(phase), by rows
+        const float r[3][3] = {
+                {cos_p,          0.0f,   sin_p},
+                {sin_i * sin_p,  cos_i, -sin_i * cos_p},
+                {-cos_i * sin_p, sin_i,  cos_i * cos_p},
+        };
+        // the rotation applied to (0, 0, -radius)
+        const float t[3] = {-batch.radius[i] * r[0][2], -batch.radius[i] * r[1][2], -batch.radius[i] * r[2][2]};
+
+        for (int row = 0; row < 3; row++)
+        {
+            float* out = batch.rows[row] + 4 * i;
+            for (int column = 0; column < 4; column++)
+            {
+                out[column] = r[row][0] * batch.local[column][0] + r[row][1] * batch.local[column][1] + r[row][2] * batch.local[column][2];
+            }
+            out[3] += t[row];
+        }
+    }
+}
+
+#ifdef PROJECT_4_ORBIT_SIMD
+// Sine and cosine of 4 angles in radians: the angles are reduced to [-pi/4, pi/4] by multiples of pi/2, where both are
+// approximated by minimax polynomials (from Cephes). The error is about 1e-7 for the angles of orbits.
+void sinCos(__m128 x, __m128 &sin_x, __m128 &cos_x)
+{
+    const __m128 quadrant = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(0.63661977236758134f))));
+    const __m128i quadrant_bits = _mm_cvtps_epi32(quadrant);
+    // pi/2 split into three parts, so that the reduction is exact for the angles of orbits
+    x = _mm_sub_ps(x, _mm_mul_ps(quadrant, _mm_set1_ps(1.5703125f)));
+    x = _mm_sub_ps(x, _mm_mul_ps(quadrant, _mm_set1_ps(4.837512969970703125e-4f)));
+    x = _mm_sub_ps(x, _mm_mul_ps(quadrant, _mm_set1_ps(7.54978995489188216e-8f)));
+
+    const __m128 x2 = _mm_mul_ps(x, x);
+    __m128 s = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-1.9515295891e-4f), x2), _mm_set1_ps(8.3321608736e-3f));
+    s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(-1.6666654611e-1f));
+    s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, x2), x), x);
+    __m128 c = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.443315711809948e-5f), x2), _mm_set1_ps(-1.388731625493765e-3f));
+    c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(4.166664568298827e-2f));
+    c = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(c, x2), x2), _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), x2)));
+
+    // odd quadrants swap sine and cosine, quadrants 1 and 2 negate the sine, quadrants 2 and 3 the cosine
+    const __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant_bits, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+    const __m128 sin_r = _mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s));
+    const __m128 cos_r = _mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c));
+    const __m128 sin_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant_bits, _mm_set1_epi32(2)), 30));
+    const __m128 cos_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant_bits, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+    sin_x = _mm_xor_ps(sin_r, sin_sign);
+    cos_x = _mm_xor_ps(cos_r, cos_sign);
+}
+
+void computeTransformsSSE2(const TransformBatch &batch, size_t begin, size_t end)
+/** Computes the matrices of 4 orbits at a time, one column of one row for all 4 of them per vector. */
+{
+    const __m128 radians_per_degree = _mm_set1_ps(kRadiansPerDegree);
+    const __m128 frames = _mm_set1_ps(batch.frames);
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 sin_p, cos_p, sin_i, cos_i;
+        const __m128 phase = _mm_add_ps(_mm_loadu_ps(batch.phase + i), _mm_mul_ps(_mm_loadu_ps(batch.speed + i), frames));
+        sinCos(_mm_mul_ps(phase, radians_per_degree), sin_p, cos_p);
+        sinCos(_mm_mul_ps(_mm_loadu_ps(batch.inclination + i), radians_per_degree), sin_i, cos_i);
+        const __m128 radius = _mm_loadu_ps(batch.radius + i);
+
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 r[3][3] = {
+                {cos_p,                     zero,  sin_p},
+                {_mm_mul_ps(sin_i, sin_p),  cos_i, _mm_sub_ps(zero, _mm_mul_ps(sin_i, cos_p))},
+                {_mm_sub_ps(zero, _mm_mul_ps(cos_i, sin_p)), sin_i, _mm_mul_ps(cos_i, cos_p)},
+        };
+
+        for (int row = 0; row < 3; row++)
+        {
+            __m128 columns[4];
+            for (int column = 0; column < 4; column++)
+            {
+                columns[column] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r[row][0], _mm_set1_ps(batch.local[column][0])),
+                                                        _mm_mul_ps(r[row][1], _mm_set1_ps(batch.local[column][1]))),
+                                             _mm_mul_ps(r[row][2], _mm_set1_ps(batch.local[column][2])));
+            }
+            columns[3] = _mm_sub_ps(columns[3], _mm_mul_ps(radius, r[row][2]));
+
+            // vectors hold one column of 4 orbits, the output one row of each orbit after the other
+            _MM_TRANSPOSE4_PS(columns[0], columns[1], columns[2], columns[3]);
+            float* out = batch.rows[row] + 4 * i;
+            _mm_storeu_ps(out, columns[0]);
+            _mm_storeu_ps(out + 4, columns[1]);
+            _mm_storeu_ps(out + 8, columns[2]);
+            _mm_storeu_ps(out + 12, columns[3]);
+        }
+    }
+    computeTransformsScalar(batch, i, end);
+}
+
+// The same as sinCos, for 8 angles.
+__attribute__((target("avx2,fma")))
+void sinCos(__m256 x, __m256 &sin_x, __m256 &cos_x)
+{
+    const __m256 quadrant = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(0.63661977236758134f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    const __m256i quadrant_bits = _mm256_cvtps_epi32(quadrant);
+    x = _mm256_fnmadd_ps(quadrant, _mm256_set1_ps(1.5703125f), x);
+    x = _mm256_fnmadd_ps(quadrant, _mm256_set1_ps(4.837512969970703125e-4f), x);
+    x = _mm256_fnmadd_ps(quadrant, _mm256_set1_ps(7.54978995489188216e-8f), x);
+
+    const __m256 x2 = _mm256_mul_ps(x, x);
+    __m256 s = _mm256_fmadd_ps(_mm256_set1_ps(-1.9515295891e-4f), x2, _mm256_set1_ps(8.3321608736e-3f));
+    s = _mm256_fmadd_ps(s, x2, _mm256_set1_ps(-1.6666654611e-1f));
+    s = _mm256_fmadd_ps(_mm256_mul_ps(s, x2), x, x);
+    __m256 c = _mm256_fmadd_ps(_mm256_set1_ps(2.443315711809948e-5f), x2, _mm256_set1_ps(-1.388731625493765e-3f));
+    c = _mm256_fmadd_ps(c, x2, _mm256_set1_ps(4.166664568298827e-2f));
+    c = _mm256_fmadd_ps(_mm256_mul_ps(c, x2), x2, _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), x2, _mm256_set1_ps(1.0f)));
+
+    const __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant_bits, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+    const __m256 sin_r = _mm256_blendv_ps(s, c, swap);
+    const __m256 cos_r = _mm256_blendv_ps(c, s, swap);
+    const __m256 sin_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(quadrant_bits, _mm256_set1_epi32(2)), 30));
+    const __m256 cos_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(quadrant_bits, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30));
+    sin_x = _mm256_xor_ps(sin_r, sin_sign);
+    cos_x = _mm256_xor_ps(cos_r, cos_sign);
+}
+
+__attribute__((target("avx2,fma")))
+void computeTransformsAVX2(const TransformBatch &batch, size_t begin, size_t end)
+/** Computes the matrices of 8 orbits at a time. The transpose works on the two 128-bit halves of the vectors separately,
+each of them holding the rows of 4 orbits. */
+{
+    const __m256 radians_per_degree = _mm256_set1_ps(kRadiansPerDegree);
+    const __m256 frames = _mm256_set1_ps(batch.frames);
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8)
+    {
+        __m256 sin_p, cos_p, sin_i, cos_i;
+        const __m256 phase = _mm256_fmadd_ps(_mm256_loadu_ps(batch.speed + i), frames, _mm256_loadu_ps(batch.phase + i));
+        sinCos(_mm256_mul_ps(phase, radians_per_degree), sin_p, cos_p);
+        sinCos(_mm256_mul_ps(_mm256_loadu_ps(batch.inclination + i), radians_per_degree), sin_i, cos_i);
+        const __m256 radius = _mm256_loadu_ps(batch.radius + i);
+
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 r[3][3] = {
+                {cos_p,                        zero,  sin_p},
+                {_mm256_mul_ps(sin_i, sin_p),  cos_i, _mm256_sub_ps(zero, _mm256_mul_ps(sin_i, cos_p))},
+                {_mm256_sub_ps(zero, _mm256_mul_ps(cos_i, sin_p)), sin_i, _mm256_mul_ps(cos_i, cos_p)},
+        };
+
+        for (int row = 0; row < 3; row++)
+        {
+            __m256 columns[4];
+            for (int column = 0; column < 4; column++)
+            {
+                columns[column] = _mm256_fmadd_ps(r[row][2], _mm256_set1_ps(batch.local[column][2]),
+                                                  _mm256_fmadd_ps(r[row][1], _mm256_set1_ps(batch.local[column][1]),
+                                                                  _mm256_mul_ps(r[row][0], _mm256_set1_ps(batch.local[column][0]))));
+            }
+            columns[3] = _mm256_fnmadd_ps(radius, r[row][2], columns[3]);
+
+            const __m256 t0 = _mm256_unpacklo_ps(columns[0], columns[1]);
+            const __m256 t1 = _mm256_unpackhi_ps(columns[0], columns[1]);
+            const __m256 t2 = _mm256_unpacklo_ps(columns[2], columns[3]);
+            const __m256 t3 = _mm256_unpackhi_ps(columns[2], columns[3]);
+            const __m256 orbit_0 = _mm256_shuffle_ps(t0, t2, 0x44);
+            const __m256 orbit_1 = _mm256_shuffle_ps(t0, t2, 0xEE);
+            const __m256 orbit_2 = _mm256_shuffle_ps(t1, t3, 0x44);
+            const __m256 orbit_3 = _mm256_shuffle_ps(t1, t3, 0xEE);
+            float* out = batch.rows[row] + 4 * i;
+            _mm256_storeu_ps(out, _mm256_permute2f128_ps(orbit_0, orbit_1, 0x20));
+            _mm256_storeu_ps(out + 8, _mm256_permute2f128_ps(orbit_2, orbit_3, 0x20));
+            _mm256_storeu_ps(out + 16, _mm256_permute2f128_ps(orbit_0, orbit_1, 0x31));
+            _mm256_storeu_ps(out + 24, _mm256_permute2f128_ps(orbit_2, orbit_3, 0x31));
+        }
+    }
+    computeTransformsSSE2(batch, i, end);
+}
+#endif
+}
+
+void OrbitSet::add(float radius, float inclination, float phase, float speed)
+{
+    radius_.push_back(radius);
+    inclination_.push_back(inclination);
+    phase_.push_back(phase);
+    speed_.push_back(speed);
+}
+
+void OrbitSet::clear()
+{
+    radius_.clear();
+    inclination_.clear();
+    phase_.clear();
+    speed_.clear();
+}
+
+void OrbitSet::advance(float frames)
+/** Moves every orbit on by its speed. Phases are kept in [0, 360) so that they don't lose precision over time. */
+{
+    const size_t count = size();
+    for (size_t i = 0; i < count; i++)
+    {
+        const float phase = phase_[i] + speed_[i] * frames;
+        phase_[i] = phase - 360.0f * std::floor(phase / 360.0f);
+    }
+}
+
+bool OrbitSet::isSupported(OrbitKernel kernel)
+/** Checks whether the CPU can run the kernel. */
+{
+    switch (kernel)
+    {
+        case kOrbitKernelScalar:
+            return true;
+#ifdef PROJECT_4_ORBIT_SIMD
+        case kOrbitKernelSSE2:
+            return __builtin_cpu_supports("sse2");
+        case kOrbitKernelAVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+        default:
+            return false;
+    }
+}
+
+OrbitKernel OrbitSet::bestKernel()
+/** Returns the widest kernel the CPU supports, detected once. */
+{
+    static const OrbitKernel kernel = isSupported(kOrbitKernelAVX2) ? kOrbitKernelAVX2
+                                    : isSupported(kOrbitKernelSSE2) ? kOrbitKernelSSE2
+                                    : kOrbitKernelScalar;
+    return kernel;
+}
+
+const char* OrbitSet::kernelName(OrbitKernel kernel)
+{
+    switch (kernel)
+    {
+        case kOrbitKernelSSE2:
+            return "SSE2";
+        case kOrbitKernelAVX2:
+            return "AVX2";
+        default:
+            return "scalar";
+    }
+}
+
+void OrbitSet::computeTransforms(const glm::mat4 &local, float* rows, float frames) const
+{
+    computeTransforms(local, rows, frames, bestKernel());
+}
+
+void OrbitSet::computeTransforms(const glm::mat4 &local, float* rows, float frames, OrbitKernel kernel) const
+/** Writes the model matrix of every orbit, i.e. rotateX(inclination) * rotateY(phase) * translate(0, 0, -radius) * local,
+for a local transform without projection. The phase is taken the given number of frames after the current one (before it,
+if negative), without advancing the orbits. Matrices are stored as the rows of their upper 3x4 part, all first rows
+followed by all second rows and all third rows: rows must hold 12 floats per orbit. The kernel must be supported. */
+{
+    computeTransforms(local, rows, frames, 0, size(), kernel);
+}
+
+void OrbitSet::computeTransforms(const glm::mat4 &local, float* rows, float frames, size_t begin, size_t end) const
+{
+    computeTransforms(local, rows, frames, begin, end, bestKernel());
+}
+
+void OrbitSet::computeTransforms(const glm::mat4 &local, float* rows, float frames, size_t begin, size_t end, OrbitKernel kernel) const
+{
+    const size_t count = size();
+    TransformBatch batch;
+    batch.radius = radius_.data();
+    batch.inclination = inclination_.data();
+    batch.phase = phase_.data();
+    batch.speed = speed_.data();
+    batch.frames = frames;
+    for (int column = 0; column < 4; column++)
+    {
+        for (int row = 0; row < 3; row++)
+        {
+            // glm matrices are indexed by column first
+            batch.local[column][row] = local[column][row];
+        }
+    }
+    batch.rows[0] = rows;
+    batch.rows[1] = rows + 4 * count;
+    batch.rows[2] = rows + 8 * count;
+
+    switch (kernel)
+    {
+#ifdef PROJECT_4_ORBIT_SIMD
+        case kOrbitKernelSSE2:
+            computeTransformsSSE2(batch, begin, end);
+            break;
+        case kOrbitKernelAVX2:
+            computeTransformsAVX2(batch, begin, end);
+            break;
+#endif
+        default:
+            computeTransformsScalar(batch, begin, end);
+            break;
+    }
+}
@@ -0,0 +1,455 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <glad/glad.h>
+
+#include "../include/planet_mesh.h"
+#include "../include/render_state.h"
+#include "../include/profiler.h"
+#include "../include/vertex_attributes.h"
+
+constexpr int PlanetMesh::kPatchResolution;
+constexpr int PlanetMesh::kPatchVertexCount;
+constexpr int PlanetMesh::kPatchIndexCount;
+constexpr int PlanetMesh::kVertexFloats;
+constexpr int PlanetMesh::kRootLevel;
+constexpr int PlanetMesh::kMaxLevel;
+constexpr int PlanetMesh::kMaxPatches;
+constexpr int PlanetMesh::kMaxPendingPatches;
+constexpr float PlanetMesh::kMaxPixelError;
+
+namespace
+{
+constexpr float kPi = 3.14159265358979f;
+// skirts reach as deep as the error of a patch this many levels coarser, which covers the cracks to all neighbours
+// that are at most as many levels coarser
+constexpr int kSkirtLevels = 2;
+// distance of a patch that the camera is inside of, so that it's refined as far as possible
+constexpr float kMinDistance = 1e-4f;
+
+// normal, and the directions of a and b of every face of the cube; normal = a x b, so triangles are counter-clockwise
+// seen from outside
+const glm::vec3 kFaces[6][3] = {
+        {{1, 0, 0},  {0, 0, -1}, {0, 1, 0}},
+        {{-1, 0, 0}, {0, 0, 1},  {0, 1, 0}},
+        {{0, 1, 0},  {1, 0, 0},  {0, 0, -1}},
+        {{0, -1, 0}, {1, 0, 0},  {0, 0, 1}},
+        {{0, 0, 1},  {1, 0, 0},  {0, 1, 0}},
+        {{0, 0, -1}, {-1, 0, 0}, {0, 1, 0}},
+};
+
+glm::vec3 directionAt(int face, float a, float b)
+/** Maps a point of a face, a and b in [-1, 1], onto the sphere. The tangents make cells of the same size on the cube
+cover about the same angle on the sphere, instead of shrinking towards the edges of the face. */
+{
+    const glm::vec3 point = kFaces[face][0] + std::tan(a * 0.25f * kPi) * kFaces[face][1] + std::tan(b * 0.25f * kPi) * kFaces[face][2];
+    return point / std::sqrt(point.x * point.x + point.y * point.y + point.z * point.z);
+}
+
+float longitudeU(const glm::vec3 &direction)
+{
+    return 0.5f + std::atan2(-direction.z, direction.x) / (2.0f * kPi);
+}
+
+// index of the k-th vertex of the bottom, top, left or right edge of the grid of a patch
+int edgeVertex(int edge, int k)
+{
+    const int n = PlanetMesh::kPatchResolution;
+    switch (edge)
+    {
+        case 0: return k;
+        case 1: return n * (n + 1) + k;
+        case 2: return k * (n + 1);
+        default: return k * (n + 1) + n;
+    }
+}
+}
+
+PlanetMesh::PlanetMesh()
+/** Creates the vertex buffer for all patch slots and the shared index buffer, and generates the root patches, which are
+always resident. */
+{
+    draw_counts_.assign(kMaxPatches, kPatchIndexCount);
+    draw_offsets_.assign(kMaxPatches, nullptr);
+    for (int slot = kMaxPatches - 1; slot >= 0; slot--)
+    {
+        free_slots_.push_back(slot);
+    }
+
+    glGenVertexArrays(1, &vertex_array_);
+    glGenBuffers(1, &vertex_buffer_);
+    glGenBuffers(1, &index_buffer_);
+
+    RenderState::bindVertexArray(vertex_array_);
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+    const VertexLayout layout = vertexLayout();
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(kMaxPatches) * kPatchVertexCount * layout.stride(), nullptr, GL_DYNAMIC_DRAW);
+    VertexAttributes::setPointers(layout);
+
+    std::vector<uint16_t> indices;
+    generateIndices(indices);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(indices.size() * sizeof(uint16_t)), indices.data(), GL_STATIC_DRAW);
+    RenderState::bindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    const int root_count = 1 << kRootLevel;
+    for (int face = 0; face < 6; face++)
+    {
+        for (int y = 0; y < root_count; y++)
+        {
+            for (int x = 0; x < root_count; x++)
+            {
+                request(face, kRootLevel, x, y);
+            }
+        }
+    }
+    for (auto &entry : patches_)
+    {
+        assignSlot(entry.first, entry.second);
+    }
+    upload();
+}
+
+PlanetMesh::~PlanetMesh()
+{
+    jobs_.wait(background_patches_);
+    RenderState::forgetVertexArray(vertex_array_);
+    glDeleteVertexArrays(1, &vertex_array_);
+    glDeleteBuffers(1, &vertex_buffer_);
+    glDeleteBuffers(1, &index_buffer_);
+}
+
+float PlanetMesh::patchError(int level)
+/** The largest cells span the angle of a face divided by the cells along it; the flat triangles of a cell are farthest
+from the sphere in the middle of its diagonal, by the sagitta of that. */
+{
+    const float cell_angle = 0.5f * kPi / static_cast<float>((1 << level) * kPatchResolution);
+    // 1 - cos(angle / 2), without the cancellation for small angles
+    const float quarter_sine = std::sin(0.25f * std::sqrt(2.0f) * cell_angle);
+    return 2.0f * quarter_sine * quarter_sine;
+}
+
+void PlanetMesh::generatePatch(int face, int level, int x, int y, std::vector<float> &vertices)
+/** Computes the grid of a patch on the sphere and its skirts, which repeat the edge vertices moved into the sphere.
+The longitude is taken relative to the center of the patch, so that the u of the patches on either side of the date
+line is 1 and 0 respectively, and the poles, which have no longitude, get the one of the center. */
+{
+    const int n = kPatchResolution;
+    const float size = 2.0f / static_cast<float>(1 << level);
+    const float a0 = -1.0f + size * static_cast<float>(x);
+    const float b0 = -1.0f + size * static_cast<float>(y);
+    const float center_u = longitudeU(directionAt(face, a0 + 0.5f * size, b0 + 0.5f * size));
+    const float cell_size = size / static_cast<float>(n);
+
+    vertices.resize(static_cast<size_t>(kPatchVertexCount) * kVertexFloats);
+    for (int j = 0; j <= n; j++)
+    {
+        for (int i = 0; i <= n; i++)
+        {
+            // from the index of the vertex among all vertices of the level along the face, so that patches sharing an
+            // edge compute exactly the same positions for it
+            const glm::vec3 direction = directionAt(face, -1.0f + static_cast<float>(x * n + i) * cell_size,
+                                                    -1.0f + static_cast<float>(y * n + j) * cell_size);
+            float u = center_u;
+            if (direction.x * direction.x + direction.z * direction.z > 1e-12f)
+            {
+                u = longitudeU(direction);
+                u += u - center_u > 0.5f ? -1.0f : (center_u - u > 0.5f ? 1.0f : 0.0f);
+            }
+            const float v = 0.5f + std::asin(std::max(-1.0f, std::min(direction.y, 1.0f))) / kPi;
+
+            float* vertex = &vertices[static_cast<size_t>(j * (n + 1) + i) * kVertexFloats];
+            vertex[0] = vertex[3] = direction.x;
+            vertex[1] = vertex[4] = direction.y;
+            vertex[2] = vertex[5] = direction.z;
+            vertex[6] = u;
+            vertex[7] = v;
+        }
+    }
+
+    const float skirt_scale = 1.0f - patchError(std::max(level - kSkirtLevels, 0));
+    for (int edge = 0; edge < 4; edge++)
+    {
+        for (int k = 0; k <= n; k++)
+        {
+            const float* top = &vertices[static_cast<size_t>(edgeVertex(edge, k)) * kVertexFloats];
+            float* vertex = &vertices[static_cast<size_t>((n + 1) * (n + 1 + edge) + k) * kVertexFloats];
+            std::copy(top, top + kVertexFloats, vertex);
+            vertex[0] *= skirt_scale;
+            vertex[1] *= skirt_scale;
+            vertex[2] *= skirt_scale;
+        }
+    }
+}
+
+void PlanetMesh::generateIndices(std::vector<uint16_t> &indices)
+{
+    const int n = kPatchResolution;
+    indices.clear();
+    indices.reserve(kPatchIndexCount);
+    for (int j = 0; j < n; j++)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            const int corner = j * (n + 1) + i;
+            for (int index : {corner, corner + 1, corner + n + 2, corner, corner + n + 2, corner + n + 1})
+            {
+                indices.push_back(static_cast<uint16_t>(index));
+            }
+        }
+    }
+    for (int edge = 0; edge < 4; edge++)
+    {
+        const int skirt = (n + 1) * (n + 1 + edge);
+        for (int k = 0; k < n; k++)
+        {
+            const int top0 = edgeVertex(edge, k);
+            const int top1 = edgeVertex(edge, k + 1);
+            for (int index : {top0, skirt + k, skirt + k + 1, top0, skirt + k + 1, top1})
+            {
+                indices.push_back(static_cast<uint16_t>(index));
+            }
+        }
+    }
+}
+
+uint64_t PlanetMesh::keyOf(int face, int level, int x, int y)
+{
+    return (static_cast<uint64_t>(face) << 56) | (static_cast<uint64_t>(level) << 48) |
+           (static_cast<uint64_t>(x) << 24) | static_cast<uint64_t>(y);
+}
+
+PlanetMesh::Patch& PlanetMesh::request(int face, int level, int x, int y)
+/** Adds a patch with its bounding sphere, and queues the generation of its vertices. The sphere is centered at the
+middle of the patch and reaches its corners and the middles of its edges, plus the depth of the skirts. */
+{
+    Patch &patch = patches_[keyOf(face, level, x, y)];
+    patch.level = level;
+
+    const float size = 2.0f / static_cast<float>(1 << level);
+    const float a0 = -1.0f + size * static_cast<float>(x);
+    const float b0 = -1.0f + size * static_cast<float>(y);
+    patch.center = directionAt(face, a0 + 0.5f * size, b0 + 0.5f * size);
+    float squared_radius = 0.0f;
+    for (int j = 0; j <= 2; j++)
+    {
+        for (int i = 0; i <= 2; i++)
+        {
+            const glm::vec3 offset = directionAt(face, a0 + 0.5f * size * i, b0 + 0.5f * size * j) - patch.center;
+            squared_radius = std::max(squared_radius, offset.x * offset.x + offset.y * offset.y + offset.z * offset.z);
+        }
+    }
+    patch.radius = std::sqrt(squared_radius) + patchError(std::max(level - kSkirtLevels, 0));
+
+    auto generate = std::make_shared<std::packaged_task<std::vector<uint8_t>()>>([face, level, x, y]() {
+        std::vector<float> vertices;
+        generatePatch(face, level, x, y, vertices);
+
+        const VertexLayout layout = vertexLayout();
+        const VertexStream streams[kMeshAttributeCount] = {{vertices.data(), kVertexFloats},
+                                                           {vertices.data() + 3, kVertexFloats},
+                                                           {vertices.data() + 6, kVertexFloats}};
+        std::vector<uint8_t> encoded(static_cast<size_t>(kPatchVertexCount) * layout.stride());
+        VertexCodec::encode(layout, VertexDequantization{}, streams, kPatchVertexCount, encoded.data());
+        return encoded;
+    });
+    patch.vertices = generate->get_future();
+    if (synchronous_)
+    {
+        jobs_.run([generate]() { (*generate)(); }, synchronous_patches_);
+    }
+    else
+    {
+        jobs_.runBackground([generate]() { (*generate)(); }, background_patches_);
+    }
+    pending_count_++;
+    return patch;
+}
+
+int PlanetMesh::allocateSlot()
+/** Takes a free slot, or evicts the least recently used patch, finer levels first. Patches selected for one of the
+frames that may not have been drawn yet are kept, and so are the root patches, so there is always something to draw
+in place of the evicted ones. */
+{
+    if (!free_slots_.empty())
+    {
+        const int slot = free_slots_.back();
+        free_slots_.pop_back();
+        return slot;
+    }
+
+    auto victim = patches_.end();
+    for (auto it = patches_.begin(); it != patches_.end(); ++it)
+    {
+        const Patch &patch = it->second;
+        if (patch.slot < 0 || patch.level == kRootLevel || patch.last_used + kMaxFramesInFlight >= frame_)
+        {
+            continue;
+        }
+        if (victim == patches_.end() || patch.last_used < victim->second.last_used ||
+            (patch.last_used == victim->second.last_used && patch.level > victim->second.level))
+        {
+            victim = it;
+        }
+    }
+    if (victim == patches_.end())
+    {
+        return -1;
+    }
+    const int slot = victim->second.slot;
+    patches_.erase(victim);
+    return slot;
+}
+
+bool PlanetMesh::assignSlot(uint64_t key, Patch &patch)
+/** Waits for the vertices of the patch if necessary. */
+{
+    const int slot = allocateSlot();
+    if (slot < 0)
+    {
+        return false;
+    }
+    patch.generated = patch.vertices.get();
+    pending_count_--;
+    patch.slot = slot;
+    patch.last_used = frame_;
+    uploads_.push_back(key);
+    return true;
+}
+
+void PlanetMesh::upload()
+/** Patches evicted before they were uploaded are skipped. */
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (uploads_.empty())
+    {
+        return;
+    }
+
+    const size_t slot_size = static_cast<size_t>(kPatchVertexCount) * vertexLayout().stride();
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+    for (uint64_t key : uploads_)
+    {
+        auto it = patches_.find(key);
+        if (it == patches_.end() || it->second.slot < 0 || it->second.uploaded)
+        {
+            continue;
+        }
+        Patch &patch = it->second;
+        glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(patch.slot * slot_size), static_cast<GLsizeiptr>(slot_size), patch.generated.data());
+        patch.uploaded = true;
+        std::vector<uint8_t>().swap(patch.generated);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    uploads_.clear();
+}
+
+void PlanetMesh::select(RenderQueue &queue, const glm::mat4 &model, float scale, std::vector<GLint> &selection)
+/** Gives the patches that are generated a slot, and walks down the quadtrees of the faces from the roots.
+Asynchronously a patch is drawn in place of its children until all of them have a slot, synchronously the walk is
+repeated until no patch is missing, with one more level at a time, and the selecting thread helps to generate them. */
+{
+    PROFILE_SCOPE("PlanetMesh::select");
+    std::lock_guard<std::mutex> lock(mutex_);
+    frame_++;
+    const int root_count = 1 << kRootLevel;
+    for (int pass = 0; pass <= kMaxLevel; pass++)
+    {
+        if (synchronous_)
+        {
+            jobs_.wait(synchronous_patches_);
+        }
+        for (auto &entry : patches_)
+        {
+            Patch &patch = entry.second;
+            if (patch.slot < 0 && (synchronous_ || patch.vertices.wait_for(std::chrono::seconds(0)) == std::future_status::ready))
+            {
+                assignSlot(entry.first, patch);
+            }
+        }
+
+        selection.clear();
+        bool complete = true;
+        for (int face = 0; face < 6; face++)
+        {
+            for (int y = 0; y < root_count; y++)
+            {
+                for (int x = 0; x < root_count; x++)
+                {
+                    complete &= selectPatch(face, kRootLevel, x, y, queue, model, scale, selection);
+                }
+            }
+        }
+        if (!synchronous_ || complete)
+        {
+            return;
+        }
+    }
+}
+
+bool PlanetMesh::selectPatch(int face, int level, int x, int y, RenderQueue &queue, const glm::mat4 &model, float scale,
+                             std::vector<GLint> &selection)
+/** Culls the patch, and refines it while the error of its level covers more than kMaxPixelError pixels at the distance
+of the nearest point of its bounding sphere from the camera. */
+{
+    Patch &patch = patches_.at(keyOf(face, level, x, y));
+    patch.last_used = frame_;
+    const glm::vec3 center = glm::vec3(model * glm::vec4(patch.center, 1.0f));
+    const float radius = patch.radius * scale;
+    if (!queue.culler().isVisible(center, radius))
+    {
+        return true;
+    }
+
+    const float distance = std::max(queue.viewDepthOf(center) - radius, kMinDistance);
+    bool complete = true;
+    if (level < kMaxLevel && patchError(level) * scale * queue.lodScale() > kMaxPixelError * distance)
+    {
+        bool children_ready = true;
+        for (int child = 0; child < 4; child++)
+        {
+            const int child_x = 2 * x + (child & 1);
+            const int child_y = 2 * y + (child >> 1);
+            auto it = patches_.find(keyOf(face, level + 1, child_x, child_y));
+            if (it == patches_.end())
+            {
+                if (pending_count_ < kMaxPendingPatches)
+                {
+                    request(face, level + 1, child_x, child_y);
+                }
+                children_ready = false;
+                continue;
+            }
+            // children waiting for a finer level are kept, so that they aren't evicted before their siblings are ready
+            it->second.last_used = frame_;
+            children_ready &= it->second.slot >= 0;
+        }
+
+        if (children_ready)
+        {
+            for (int child = 0; child < 4; child++)
+            {
+                complete &= selectPatch(face, level + 1, 2 * x + (child & 1), 2 * y + (child >> 1), queue, model, scale, selection);
+            }
+            return complete;
+        }
+        complete = false;
+    }
+
+    selection.push_back(patch.slot * kPatchVertexCount);
+    return complete;
+}
+
+void PlanetMesh::draw(const std::vector<GLint> &selection) const
+/** Draws all patches of the selection with one call, each of them with the shared indices offset to its slot. */
+{
+    if (selection.empty())
+    {
+        return;
+    }
+    RenderState::bindVertexArray(vertex_array_);
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, draw_counts_.data(), GL_UNSIGNED_SHORT, draw_offsets_.data(),
+                                  static_cast<GLsizei>(selection.size()), selection.data());
+}
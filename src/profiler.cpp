@@ -0,0 +1,318 @@
+#include "../include/profiler.h"
+
+#ifdef PROJECT_4_PROFILE
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+constexpr int Profiler::kGpuFrameLatency;
+constexpr int Profiler::kSummaryInterval;
+
+namespace
+{
+// CPU scopes a thread can record between two frames before the oldest ones are overwritten
+constexpr size_t kRingSize = 1 << 14;
+// scopes kept for the trace, about 64 MB
+constexpr size_t kMaxTraceEvents = 1 << 21;
+// trace thread of the GPU scopes, CPU threads are numbered from 1 in the order they record their first scope
+constexpr uint32_t kGpuThread = 0;
+
+struct CpuEvent
+{
+    const char* name;
+    int64_t start;
+    int64_t end;
+};
+
+// Single producer (the thread that owns it), single consumer (the GL thread in endFrame) ring of CPU scopes.
+struct ThreadRing
+{
+    uint32_t thread{0};
+    CpuEvent events[kRingSize];
+    std::atomic<uint64_t> written{0};
+    uint64_t read{0};
+};
+
+struct TraceEvent
+{
+    const char* name;
+    int64_t start;
+    int64_t end;
+    uint32_t thread;
+};
+
+struct GpuScope
+{
+    const char* name;
+    GLuint begin_query;
+    GLuint end_query;
+};
+
+struct Totals
+{
+    double cpu_ms{0.0};
+    double gpu_ms{0.0};
+    unsigned int calls{0};
+};
+
+const std::chrono::steady_clock::time_point kEpoch = std::chrono::steady_clock::now();
+
+// rings are only added under the mutex, the recording threads never take it after their first scope
+std::mutex rings_mutex;
+std::vector<std::unique_ptr<ThreadRing>> rings;
+thread_local ThreadRing* thread_ring = nullptr;
+
+// GL thread only
+std::vector<TraceEvent> trace_events;
+uint64_t dropped_events = 0;
+std::vector<GLuint> free_queries;
+std::vector<GpuScope> gpu_frames[Profiler::kGpuFrameLatency];
+int gpu_frame = 0;
+bool gpu_calibrated = false;
+int64_t gpu_offset = 0;     // CPU time minus GPU time, in nanoseconds
+std::map<std::string, Totals> totals;
+int summary_frames = 0;
+
+ThreadRing& threadRing()
+{
+    if (thread_ring == nullptr)
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        rings.emplace_back(new ThreadRing());
+        rings.back()->thread = static_cast<uint32_t>(rings.size());
+        thread_ring = rings.back().get();
+    }
+    return *thread_ring;
+}
+
+void addEvent(const char* name, int64_t start, int64_t end, uint32_t thread)
+{
+    if (trace_events.size() < kMaxTraceEvents)
+    {
+        trace_events.push_back({name, start, end, thread});
+    }
+    else
+    {
+        dropped_events++;
+    }
+
+    Totals &name_totals = totals[name];
+    const double milliseconds = static_cast<double>(end - start) * 1e-6;
+    if (thread == kGpuThread)
+    {
+        name_totals.gpu_ms += milliseconds;
+    }
+    else
+    {
+        name_totals.cpu_ms += milliseconds;
+        name_totals.calls++;
+    }
+}
+
+void drainCpuScopes()
+/** Moves the scopes the threads recorded since the last frame into the trace. Scopes a thread overwrote before they
+were read, or while they were being read, are dropped. */
+{
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    std::vector<CpuEvent> events;
+    for (std::unique_ptr<ThreadRing> &ring : rings)
+    {
+        const uint64_t written = ring->written.load(std::memory_order_acquire);
+        if (written - ring->read > kRingSize)
+        {
+            dropped_events += written - ring->read - kRingSize;
+            ring->read = written - kRingSize;
+        }
+        events.clear();
+        for (uint64_t i = ring->read; i < written; i++)
+        {
+            events.push_back(ring->events[i % kRingSize]);
+        }
+
+        const uint64_t written_after = ring->written.load(std::memory_order_acquire);
+        const uint64_t overwritten = written_after > ring->read + kRingSize ? written_after - kRingSize - ring->read : 0;
+        const size_t skipped = static_cast<size_t>(std::min<uint64_t>(overwritten, events.size()));
+        dropped_events += skipped;
+        for (size_t i = skipped; i < events.size(); i++)
+        {
+            addEvent(events[i].name, events[i].start, events[i].end, ring->thread);
+        }
+        ring->read = written;
+    }
+}
+
+void resolveGpuScopes(std::vector<GpuScope> &scopes)
+/** Reads the timestamps of the scopes of a past frame, moves them onto the CPU timeline and returns the queries to the pool. */
+{
+    if (!scopes.empty() && !gpu_calibrated)
+    {
+        GLint64 gpu_now = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+        gpu_offset = Profiler::now() - gpu_now;
+        gpu_calibrated = true;
+    }
+
+    for (const GpuScope &scope : scopes)
+    {
+        GLuint64 begin = 0;
+        GLuint64 end = 0;
+        glGetQueryObjectui64v(scope.begin_query, GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(scope.end_query, GL_QUERY_RESULT, &end);
+        addEvent(scope.name, static_cast<int64_t>(begin) + gpu_offset, static_cast<int64_t>(end) + gpu_offset, kGpuThread);
+        free_queries.push_back(scope.begin_query);
+        free_queries.push_back(scope.end_query);
+    }
+    scopes.clear();
+}
+
+void printSummary()
+{
+    std::vector<std::pair<std::string, Totals>> sorted(totals.begin(), totals.end());
+    std::sort(sorted.begin(), sorted.end(), [](const std::pair<std::string, Totals> &a, const std::pair<std::string, Totals> &b) {
+        return a.second.cpu_ms > b.second.cpu_ms;
+    });
+
+    const double frames = Profiler::kSummaryInterval;
+    std::cout << "Profiler: per frame over the last " << Profiler::kSummaryInterval << " frames" << std::endl;
+    std::cout << std::fixed << std::setprecision(3);
+    for (const auto &entry : sorted)
+    {
+        std::cout << "  " << std::left << std::setw(32) << entry.first << std::right
+                  << " cpu " << std::setw(8) << entry.second.cpu_ms / frames << " ms";
+        if (entry.second.gpu_ms > 0.0)
+        {
+            std::cout << "  gpu " << std::setw(8) << entry.second.gpu_ms / frames << " ms";
+        }
+        std::cout << "  calls " << entry.second.calls / frames << std::endl;
+    }
+    std::cout << std::defaultfloat;
+}
+}
+
+int64_t Profiler::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - kEpoch).count();
+}
+
+void Profiler::recordCpu(const char* name, int64_t start, int64_t end)
+{
+    ThreadRing &ring = threadRing();
+    const uint64_t written = ring.written.load(std::memory_order_relaxed);
+    ring.events[written % kRingSize] = {name, start, end};
+    ring.written.store(written + 1, std::memory_order_release);
+}
+
+int Profiler::beginGpu(const char* name)
+/** Writes the start timestamp of a GPU scope and returns its index in the current frame. */
+{
+    if (free_queries.size() < 2)
+    {
+        GLuint queries[2];
+        glGenQueries(2, queries);
+        free_queries.push_back(queries[0]);
+        free_queries.push_back(queries[1]);
+    }
+    GpuScope scope;
+    scope.name = name;
+    scope.end_query = free_queries.back();
+    free_queries.pop_back();
+    scope.begin_query = free_queries.back();
+    free_queries.pop_back();
+
+    glQueryCounter(scope.begin_query, GL_TIMESTAMP);
+    gpu_frames[gpu_frame].push_back(scope);
+    return static_cast<int>(gpu_frames[gpu_frame].size()) - 1;
+}
+
+void Profiler::endGpu(int scope)
+{
+    glQueryCounter(gpu_frames[gpu_frame][static_cast<size_t>(scope)].end_query, GL_TIMESTAMP);
+}
+
+void Profiler::endFrame()
+/** Collects the CPU scopes of all threads and the GPU scopes of kGpuFrameLatency frames ago. Scopes still open at the
+frame boundary must not be GPU scopes. */
+{
+    gpu_frame = (gpu_frame + 1) % kGpuFrameLatency;
+    resolveGpuScopes(gpu_frames[gpu_frame]);
+    drainCpuScopes();
+
+    if (++summary_frames == kSummaryInterval)
+    {
+        printSummary();
+        totals.clear();
+        summary_frames = 0;
+    }
+}
+
+bool Profiler::writeTrace(const std::string &filepath)
+/** Writes the scopes recorded so far as complete events in the JSON object format of the trace event format. */
+{
+    drainCpuScopes();
+
+    std::ofstream out(filepath);
+    if (!out)
+    {
+        std::cerr << "Profiler: failed to write " << filepath << std::endl;
+        return false;
+    }
+
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << kGpuThread << ", \"args\": {\"name\": \"GPU\"}}";
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        for (const std::unique_ptr<ThreadRing> &ring : rings)
+        {
+            out << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << ring->thread
+                << ", \"args\": {\"name\": \"Thread " << ring->thread << "\"}}";
+        }
+    }
+    out << std::fixed << std::setprecision(3);
+    for (const TraceEvent &event : trace_events)
+    {
+        out << ",\n{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread
+            << ", \"ts\": " << static_cast<double>(event.start) * 1e-3
+            << ", \"dur\": " << static_cast<double>(event.end - event.start) * 1e-3 << "}";
+    }
+    out << "\n]}\n";
+
+    std::cout << "Profiler: written " << trace_events.size() << " scopes to " << filepath;
+    if (dropped_events > 0)
+    {
+        std::cout << ", " << dropped_events << " dropped";
+    }
+    std::cout << std::endl;
+    return static_cast<bool>(out);
+}
+
+void Profiler::shutdown()
+{
+    for (std::vector<GpuScope> &scopes : gpu_frames)
+    {
+        resolveGpuScopes(scopes);
+    }
+    if (!free_queries.empty())
+    {
+        glDeleteQueries(static_cast<GLsizei>(free_queries.size()), free_queries.data());
+        free_queries.clear();
+    }
+}
+
+ProfileScope::ProfileScope(const char* name) : name_(name), start_(Profiler::now())
+{
+}
+
+ProfileScope::~ProfileScope()
+{
+    Profiler::recordCpu(name_, start_, Profiler::now());
+}
+
+#endif
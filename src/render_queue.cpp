@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <cmath>
+
+#include "../include/render_queue.h"
+
+uint64_t RenderQueue::makeKey(RenderLayer layer, uint32_t program, uint32_t material, float depth)
+/** Packs the state of a draw into a sort key. Depth is expected in [0, 1], values outside are clamped. */
+{
+    const double clamped = std::min(std::max(static_cast<double>(depth), 0.0), 1.0);
+    const uint64_t quantized_depth = static_cast<uint64_t>(clamped * 4294967295.0);
+    return (static_cast<uint64_t>(layer & 0xFu) << 60) |
+           (static_cast<uint64_t>(program & 0xFFFu) << 48) |
+           (static_cast<uint64_t>(material & 0xFFFFu) << 32) |
+           quantized_depth;
+}
+
+void RenderQueue::setCamera(const glm::mat4 &view, float far_plane)
+{
+    view_ = view;
+    far_plane_ = far_plane;
+}
+
+float RenderQueue::depthOf(const glm::vec3 &position) const
+/** Returns the view space distance of the position along the viewing direction, divided by the distance of the far plane. */
+{
+    return viewDepthOf(position) / far_plane_;
+}
+
+float RenderQueue::viewDepthOf(const glm::vec3 &position) const
+{
+    const glm::vec4 view_position = view_ * glm::vec4(position, 1.0f);
+    return -view_position.z;
+}
+
+void RenderQueue::sort()
+/** Sorts the packets by key with a least significant digit radix sort, one byte per pass. The sort is stable, and passes
+over bytes that are the same in all keys (e.g. the layer bits of a scene without skybox) are skipped. */
+{
+    if (packets_.size() < 2)
+    {
+        return;
+    }
+    sorted_.resize(packets_.size());
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        size_t offsets[256] = {};
+        for (const DrawPacket &packet : packets_)
+        {
+            offsets[(packet.key >> shift) & 0xFF]++;
+        }
+        if (offsets[(packets_.front().key >> shift) & 0xFF] == packets_.size())
+        {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (size_t &count : offsets)
+        {
+            const size_t bucket_size = count;
+            count = offset;
+            offset += bucket_size;
+        }
+        for (const DrawPacket &packet : packets_)
+        {
+            sorted_[offsets[(packet.key >> shift) & 0xFF]++] = packet;
+        }
+        packets_.swap(sorted_);
+    }
+}
+
+void RenderQueue::execute()
+/** Draws the packets in their current order. */
+{
+    for (const DrawPacket &packet : packets_)
+    {
+        packet.renderable->draw(frame_slot_);
+    }
+}
@@ -0,0 +1,206 @@
+#include "../include/render_state.h"
+
+constexpr int RenderState::kTextureUnits;
+constexpr GLuint RenderState::kUnknown;
+
+GLuint RenderState::program_ = RenderState::kUnknown;
+GLuint RenderState::vertex_array_ = RenderState::kUnknown;
+int RenderState::active_unit_ = -1;
+RenderState::TextureUnit RenderState::texture_units_[RenderState::kTextureUnits];
+GLuint RenderState::depth_function_ = RenderState::kUnknown;
+GLuint RenderState::depth_mask_ = RenderState::kUnknown;
+GLuint RenderState::polygon_mode_ = RenderState::kUnknown;
+GLuint RenderState::capabilities_[5] = {RenderState::kUnknown, RenderState::kUnknown, RenderState::kUnknown, RenderState::kUnknown,
+                                        RenderState::kUnknown};
+RenderStateStats RenderState::frame_stats_;
+RenderStateStats RenderState::last_frame_stats_;
+
+bool RenderState::change(GLuint &shadow, GLuint value)
+/** Updates the shadow copy of a piece of state. Returns false if it already had the value, the GL call can be skipped then. */
+{
+    if (shadow == value)
+    {
+        frame_stats_.skipped++;
+        return false;
+    }
+    shadow = value;
+    frame_stats_.changes++;
+    return true;
+}
+
+void RenderState::useProgram(GLuint program)
+{
+    if (change(program_, program))
+    {
+        glUseProgram(program);
+    }
+}
+
+void RenderState::bindVertexArray(GLuint vertex_array)
+{
+    if (change(vertex_array_, vertex_array))
+    {
+        glBindVertexArray(vertex_array);
+    }
+}
+
+void RenderState::bindTexture(int unit, GLenum target, GLuint texture)
+/** Binds the texture to the target of the texture unit, for sampling. Only switches the active unit if the binding changes. */
+{
+    GLuint* binding = textureBinding(texture_units_[unit], target);
+    if (binding == nullptr)
+    {
+        setActiveUnit(unit);
+        glBindTexture(target, texture);
+        frame_stats_.changes++;
+        return;
+    }
+    if (change(*binding, texture))
+    {
+        setActiveUnit(unit);
+        glBindTexture(target, texture);
+    }
+}
+
+void RenderState::bindTexture(GLenum target, GLuint texture)
+/** Binds the texture to the target of whatever unit is active, for uploads and parameter changes. */
+{
+    bindTexture(active_unit_ < 0 ? 0 : active_unit_, target, texture);
+}
+
+void RenderState::setDepthFunc(GLenum function)
+{
+    if (change(depth_function_, function))
+    {
+        glDepthFunc(function);
+    }
+}
+
+void RenderState::setDepthMask(bool enabled)
+{
+    if (change(depth_mask_, enabled ? GL_TRUE : GL_FALSE))
+    {
+        glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+    }
+}
+
+void RenderState::setPolygonMode(GLenum mode)
+{
+    if (change(polygon_mode_, mode))
+    {
+        glPolygonMode(GL_FRONT_AND_BACK, mode);
+    }
+}
+
+void RenderState::setEnabled(GLenum capability, bool enabled)
+{
+    const int index = capabilityIndex(capability);
+    if (index >= 0 && !change(capabilities_[index], enabled ? 1 : 0))
+    {
+        return;
+    }
+    if (index < 0)
+    {
+        frame_stats_.changes++;
+    }
+    if (enabled)
+    {
+        glEnable(capability);
+    }
+    else
+    {
+        glDisable(capability);
+    }
+}
+
+void RenderState::forgetVertexArray(GLuint vertex_array)
+{
+    if (vertex_array_ == vertex_array)
+    {
+        vertex_array_ = kUnknown;
+    }
+}
+
+void RenderState::forgetTexture(GLuint texture)
+{
+    for (TextureUnit &unit : texture_units_)
+    {
+        if (unit.texture_2d == texture)
+        {
+            unit.texture_2d = kUnknown;
+        }
+        if (unit.cube_map == texture)
+        {
+            unit.cube_map = kUnknown;
+        }
+    }
+}
+
+void RenderState::invalidate()
+/** Forgets all state, the next request of every piece of state is sent to GL. */
+{
+    program_ = kUnknown;
+    vertex_array_ = kUnknown;
+    active_unit_ = -1;
+    for (TextureUnit &unit : texture_units_)
+    {
+        unit = TextureUnit();
+    }
+    depth_function_ = kUnknown;
+    depth_mask_ = kUnknown;
+    polygon_mode_ = kUnknown;
+    for (GLuint &capability : capabilities_)
+    {
+        capability = kUnknown;
+    }
+}
+
+void RenderState::beginFrame()
+/** Keeps the counters of the frame that just ended and starts counting the next one. */
+{
+    last_frame_stats_ = frame_stats_;
+    frame_stats_ = RenderStateStats();
+}
+
+int RenderState::capabilityIndex(GLenum capability)
+{
+    switch (capability)
+    {
+        case GL_DEPTH_TEST:
+            return 0;
+        case GL_CULL_FACE:
+            return 1;
+        case GL_BLEND:
+            return 2;
+        case GL_SCISSOR_TEST:
+            return 3;
+        case GL_TEXTURE_CUBE_MAP_SEAMLESS:
+            return 4;
+        default:
+            return -1;
+    }
+}
+
+GLuint* RenderState::textureBinding(TextureUnit &unit, GLenum target)
+/** Returns the shadow copy of the binding, or nullptr for targets that aren't tracked. */
+{
+    switch (target)
+    {
+        case GL_TEXTURE_2D:
+            return &unit.texture_2d;
+        case GL_TEXTURE_CUBE_MAP:
+            return &unit.cube_map;
+        default:
+            return nullptr;
+    }
+}
+
+void RenderState::setActiveUnit(int unit)
+{
+    if (active_unit_ != unit)
+    {
+        active_unit_ = unit;
+        frame_stats_.changes++;
+        glActiveTexture(GL_TEXTURE0 + static_cast<GLenum>(unit));
+    }
+}
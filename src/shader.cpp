@@ -1,105 +1,272 @@
+#include <algorithm>
+#include <cstring>
 #include <string>
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <glad/glad.h>
 
 #include "../include/shader.h"
+#include "../include/shader_cache.h"
+#include "../include/profiler.h"
+#include "../include/uniform_buffer.h"
+#include "../include/render_state.h"
 
-ShaderProgram::ShaderProgram(const char *vertexPath, const char *fragmentPath)
-{
-    // 1. retrieve the vertex/fragment source code from filePath
-    std::string vertexCode;
-    std::string fragmentCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
-
-    // ensure ifstream objects can throw exceptions:
-    vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-    try
-    {
-        // open files
-        vShaderFile.open(vertexPath);
-        fShaderFile.open(fragmentPath);
-        std::stringstream vShaderStream, fShaderStream;
-        // read file's buffer contents into streams
-        vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
-        // close file handlers
-        vShaderFile.close();
-        fShaderFile.close();
-        // convert stream into string
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
-    }
-    catch (std::ifstream::failure& e)
-    {
-        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
-    }
-    const char* vShaderCode = vertexCode.c_str();
-    const char * fShaderCode = fragmentCode.c_str();
-
-    // 2. compile shaders
-    unsigned int vertex, fragment;
-
-    // create and define vertex shader
-    vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vShaderCode, NULL);
-    glCompileShader(vertex);
-    checkCompileErrors(vertex, "VERTEX");
-    // create and define fragment Shader
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fShaderCode, NULL);
-    glCompileShader(fragment);
-    checkCompileErrors(fragment, "FRAGMENT");
-
-    // construct shader Program by linking vertex and fragment shaders to Shader Program id.
-    id_ = glCreateProgram();
-    glAttachShader(id_, vertex);
-    glAttachShader(id_, fragment);
-    glLinkProgram(id_);
-    checkCompileErrors(id_, "PROGRAM");
-
-    // delete the shaders as they're linked into our program now and no longer necessary
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
+UniformStats ShaderProgram::uniform_stats_;
+
+namespace
+{
+// names of the ShaderFeature bits, by bit
+const char* const kShaderFeatureNames[kShaderFeatureCount] = {"CLOUDS", "SPECULAR", "INSTANCING", "VIRTUAL_TEXTURE", "OCTAHEDRAL_NORMALS"};
+
+// GL type of the uniforms that can be set with a value of type T
+template<typename T> struct UniformType;
+template<> struct UniformType<int> { static constexpr GLenum value = GL_INT; };
+template<> struct UniformType<float> { static constexpr GLenum value = GL_FLOAT; };
+template<> struct UniformType<glm::vec2> { static constexpr GLenum value = GL_FLOAT_VEC2; };
+template<> struct UniformType<glm::vec3> { static constexpr GLenum value = GL_FLOAT_VEC3; };
+template<> struct UniformType<glm::vec4> { static constexpr GLenum value = GL_FLOAT_VEC4; };
+template<> struct UniformType<glm::mat4> { static constexpr GLenum value = GL_FLOAT_MAT4; };
+
+bool isSampler(GLenum type)
+{
+    switch (type)
+    {
+        case GL_SAMPLER_2D:
+        case GL_SAMPLER_3D:
+        case GL_SAMPLER_CUBE:
+        case GL_SAMPLER_2D_ARRAY:
+        case GL_SAMPLER_2D_SHADOW:
+        case GL_INT_SAMPLER_2D:
+        case GL_UNSIGNED_INT_SAMPLER_2D:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool typeMatches(GLenum active_type, GLenum requested_type)
+/** Booleans and samplers are set with glUniform1i like ints. */
+{
+    if (active_type == requested_type)
+    {
+        return true;
+    }
+    return requested_type == GL_INT && (active_type == GL_BOOL || isSampler(active_type));
+}
+}
+
+ShaderProgram::ShaderProgram(const char *vertexPath, const char *fragmentPath, uint32_t features) : features_(features)
+/** Takes the linked program from the ShaderCache, which loads it from the binary of an earlier run or compiles it. */
+{
+    id_ = ShaderCache::instance().acquire(vertexPath, fragmentPath, definesFor(features));
+    introspect();
+}
+
+void ShaderProgram::prepare(const std::string &vertexPath, const std::string &fragmentPath, uint32_t features)
+{
+    ShaderCache::instance().prepare(vertexPath, fragmentPath, definesFor(features));
+}
+
+std::string ShaderProgram::definesFor(uint32_t features)
+/** The same features always give the same string, so the ShaderCache finds their permutation however the bits were
+put together. */
+{
+    std::string defines;
+    for (int bit = 0; bit < kShaderFeatureCount; bit++)
+    {
+        if ((features & (1u << bit)) != 0)
+        {
+            defines += std::string("#define ") + kShaderFeatureNames[bit] + "\n";
+        }
+    }
+    return defines;
+}
+
+void ShaderProgram::introspect()
+/** Stores the location and type of every active uniform of the linked program, so that uniforms are never looked up
+in the driver by name afterwards. Uniforms of uniform blocks have no location and are left out. */
+{
+    GLint link_status = GL_FALSE;
+    glGetProgramiv(id_, GL_LINK_STATUS, &link_status);
+    if (link_status != GL_TRUE)
+    {
+        return;
+    }
+
+    // the per-frame constants are read from the uniform buffer bound to a fixed binding point
+    const GLuint frame_constants = glGetUniformBlockIndex(id_, "FrameConstants");
+    if (frame_constants != GL_INVALID_INDEX)
+    {
+        glUniformBlockBinding(id_, frame_constants, kFrameConstantsBinding);
+    }
+
+    GLint count = 0;
+    GLint max_length = 0;
+    glGetProgramiv(id_, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(id_, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+    std::vector<GLchar> name_buffer(static_cast<size_t>(std::max(max_length, 1)));
+
+    for (GLint i = 0; i < count; i++)
+    {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(id_, static_cast<GLuint>(i), max_length, &length, &size, &type, name_buffer.data());
+        const std::string name(name_buffer.data(), static_cast<size_t>(length));
+
+        Uniform uniform;
+        uniform.location = glGetUniformLocation(id_, name.c_str());
+        uniform.type = type;
+        if (uniform.location < 0)
+        {
+            continue;
+        }
+        const int index = static_cast<int>(uniforms_.size());
+        uniforms_.push_back(uniform);
+        uniform_indices_[name] = index;
+        // arrays are reported as "name[0]", the first element can be set by the plain name as well
+        const size_t suffix = name.rfind("[0]");
+        if (suffix != std::string::npos && suffix + 3 == name.size())
+        {
+            uniform_indices_[name.substr(0, suffix)] = index;
+        }
+    }
 }
 
 void ShaderProgram::use() const
 /** Returns ShaderProgram id.*/
 {
-    glUseProgram(id_);
+    RenderState::useProgram(id_);
+}
+
+template<typename T>
+UniformHandle<T> ShaderProgram::uniform(const std::string &name) const
+/** Returns the handle of the active uniform with the given name. The handle is invalid if the uniform isn't active,
+which happens when the shader doesn't use it, or if it can't be set with a value of type T. */
+{
+    UniformHandle<T> handle;
+    handle.index = findUniform(name, UniformType<T>::value);
+    return handle;
+}
+
+template UniformHandle<int> ShaderProgram::uniform<int>(const std::string &name) const;
+template UniformHandle<float> ShaderProgram::uniform<float>(const std::string &name) const;
+template UniformHandle<glm::vec2> ShaderProgram::uniform<glm::vec2>(const std::string &name) const;
+template UniformHandle<glm::vec3> ShaderProgram::uniform<glm::vec3>(const std::string &name) const;
+template UniformHandle<glm::vec4> ShaderProgram::uniform<glm::vec4>(const std::string &name) const;
+template UniformHandle<glm::mat4> ShaderProgram::uniform<glm::mat4>(const std::string &name) const;
+
+int ShaderProgram::findUniform(const std::string &name, unsigned int type) const
+{
+    const auto found = uniform_indices_.find(name);
+    if (found == uniform_indices_.end())
+    {
+        return -1;
+    }
+    if (!typeMatches(uniforms_[static_cast<size_t>(found->second)].type, type))
+    {
+        std::cout << "ERROR::SHADER::UNIFORM_TYPE_MISMATCH: " << name << std::endl;
+        return -1;
+    }
+    return found->second;
+}
+
+bool ShaderProgram::update(int index, const void* value, size_t size) const
+/** Stores the new value of the uniform. Returns false if it is equal to the last value, the GL call can be skipped then. */
+{
+    Uniform &uniform = uniforms_[static_cast<size_t>(index)];
+    if (uniform.has_value && std::memcmp(uniform.value, value, size) == 0)
+    {
+        uniform_stats_.calls_skipped++;
+        return false;
+    }
+    std::memcpy(uniform.value, value, size);
+    uniform.has_value = true;
+    uniform_stats_.calls_issued++;
+    return true;
+}
+
+void ShaderProgram::set(UniformHandle<int> handle, int value) const
+/** Sets value to the uniform of the handle, if it is valid and the value changed.*/
+{
+    PROFILE_SCOPE("ShaderProgram::set");
+    if (handle.isValid() && update(handle.index, &value, sizeof(value)))
+    {
+        glUniform1i(uniforms_[static_cast<size_t>(handle.index)].location, value);
+    }
+}
+
+// Following functions have the same functionality as set for int, but for uniforms of different types.
+void ShaderProgram::set(UniformHandle<float> handle, float value) const
+{
+    PROFILE_SCOPE("ShaderProgram::set");
+    if (handle.isValid() && update(handle.index, &value, sizeof(value)))
+    {
+        glUniform1f(uniforms_[static_cast<size_t>(handle.index)].location, value);
+    }
+}
+void ShaderProgram::set(UniformHandle<glm::vec2> handle, const glm::vec2 &value) const
+{
+    PROFILE_SCOPE("ShaderProgram::set");
+    if (handle.isValid() && update(handle.index, &value[0], 2 * sizeof(float)))
+    {
+        glUniform2fv(uniforms_[static_cast<size_t>(handle.index)].location, 1, &value[0]);
+    }
+}
+void ShaderProgram::set(UniformHandle<glm::vec3> handle, const glm::vec3 &value) const
+{
+    PROFILE_SCOPE("ShaderProgram::set");
+    if (handle.isValid() && update(handle.index, &value[0], 3 * sizeof(float)))
+    {
+        glUniform3fv(uniforms_[static_cast<size_t>(handle.index)].location, 1, &value[0]);
+    }
+}
+void ShaderProgram::set(UniformHandle<glm::vec4> handle, const glm::vec4 &value) const
+{
+    PROFILE_SCOPE("ShaderProgram::set");
+    if (handle.isValid() && update(handle.index, &value[0], 4 * sizeof(float)))
+    {
+        glUniform4fv(uniforms_[static_cast<size_t>(handle.index)].location, 1, &value[0]);
+    }
+}
+void ShaderProgram::set(UniformHandle<glm::mat4> handle, const glm::mat4 &value) const
+{
+    PROFILE_SCOPE("ShaderProgram::set");
+    if (handle.isValid() && update(handle.index, &value[0][0], 16 * sizeof(float)))
+    {
+        glUniformMatrix4fv(uniforms_[static_cast<size_t>(handle.index)].location, 1, GL_FALSE, &value[0][0]);
+    }
 }
 
 void ShaderProgram::setInt(const std::string &name, int value) const
 /** Sets value to the Uniform of 1 int type with the given name.*/
 {
-    // glGetUniformLocation retrieves location of the specific uniform of the ShaderProgram.
-    // sets uniform value of 1 int type.
-    glUniform1i(glGetUniformLocation(id_, name.c_str()), value);
+    set(uniform<int>(name), value);
 }
 
 // Following functions have the same functionality as setInt, but for uniforms of different types.
 void ShaderProgram::setFloat(const std::string &name, float value) const
 {
-    glUniform1f(glGetUniformLocation(id_, name.c_str()), value);
+    set(uniform<float>(name), value);
+}
+void ShaderProgram::setVec2(const std::string &name, float x, float y) const
+{
+    set(uniform<glm::vec2>(name), glm::vec2(x, y));
 }
 void ShaderProgram::setVec3(const std::string &name, const glm::vec3 &value) const
 {
-    glUniform3fv(glGetUniformLocation(id_, name.c_str()), 1, &value[0]);
+    set(uniform<glm::vec3>(name), value);
 }
 void ShaderProgram::setVec3(const std::string &name, float x, float y, float z) const
 {
-    glUniform3f(glGetUniformLocation(id_, name.c_str()), x, y, z);
+    set(uniform<glm::vec3>(name), glm::vec3(x, y, z));
 }
 void ShaderProgram::setVec4(const std::string &name, float x, float y, float z, float w) const
 {
-    glUniform4f(glGetUniformLocation(id_, name.c_str()), x, y, z, w);
+    set(uniform<glm::vec4>(name), glm::vec4(x, y, z, w));
 }
 void ShaderProgram::setMat4(const std::string &name, const glm::mat4 &mat) const
 {
-    glUniformMatrix4fv(glGetUniformLocation(id_, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    set(uniform<glm::mat4>(name), mat);
 }
 
 void ShaderProgram::checkCompileErrors(unsigned int shader, const std::string& type)
@@ -0,0 +1,355 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <sys/stat.h>
+
+#include "../include/shader_cache.h"
+#include "../include/gl_extensions.h"
+#include "../include/shader.h"
+#include "../include/utils.h"
+
+namespace
+{
+constexpr char kBinaryMagic[4] = {'P', '4', 'S', 'B'};
+constexpr uint32_t kBinaryVersion = 1;
+
+// Header of a binary file, followed by size bytes of the program binary.
+struct BinaryHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t format;
+    uint32_t size;
+    uint64_t key;
+};
+
+uint64_t hashString(uint64_t hash, const std::string &text)
+/** 64-bit FNV-1a hash, continued from hash; the terminating zero is hashed as well, so that the strings of a key
+can't be shifted into each other. */
+{
+    for (size_t i = 0; i <= text.size(); i++)
+    {
+        hash ^= static_cast<unsigned char>(i < text.size() ? text[i] : '\0');
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string glString(GLenum name)
+{
+    const GLubyte* value = glGetString(name);
+    return value != nullptr ? reinterpret_cast<const char*>(value) : "";
+}
+
+std::string withDefines(const std::string &source, const std::string &defines)
+/** Inserts the defines after the #version line, which has to stay the first one. A #line directive after them keeps
+the line numbers of compiler errors those of the file. */
+{
+    if (defines.empty())
+    {
+        return source;
+    }
+    const size_t version = source.find("#version");
+    const size_t line_end = version == std::string::npos ? std::string::npos : source.find('\n', version);
+    if (line_end == std::string::npos)
+    {
+        return defines + source;
+    }
+    return source.substr(0, line_end + 1) + defines + "#line 2 0\n" + source.substr(line_end + 1);
+}
+
+bool includedName(const std::string &line, std::string &name)
+/** Returns whether the line is an #include "name" directive, and the name if so. */
+{
+    size_t position = line.find_first_not_of(" \t");
+    if (position == std::string::npos || line[position] != '#')
+    {
+        return false;
+    }
+    position = line.find_first_not_of(" \t", position + 1);
+    if (position == std::string::npos || line.compare(position, 7, "include") != 0)
+    {
+        return false;
+    }
+    const size_t open = line.find('"', position + 7);
+    const size_t close = open == std::string::npos ? std::string::npos : line.find('"', open + 1);
+    if (close == std::string::npos)
+    {
+        return false;
+    }
+    name = line.substr(open + 1, close - open - 1);
+    return true;
+}
+
+bool readSource(const std::string &path, std::vector<std::string> &files, std::string &source)
+/** Appends the file to source, with the files of its #include "name" lines in their place. Names are relative to the
+directory of the including file. Every file is included once only, like with #pragma once: files holds the ones read
+so far, and the index of a file there is its source string number in the #line directives around it, so compiler
+errors point into the right file. */
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+        return false;
+    }
+    const size_t file_index = files.size();
+    files.push_back(path);
+    const size_t slash = path.find_last_of('/');
+    const std::string directory = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line))
+    {
+        line_number++;
+        std::string name;
+        if (!includedName(line, name))
+        {
+            source += line;
+            source += '\n';
+            continue;
+        }
+        const std::string included_path = directory + name;
+        if (std::find(files.begin(), files.end(), included_path) != files.end())
+        {
+            // the line is kept as an empty one, so the numbers of the following ones stay the same
+            source += '\n';
+            continue;
+        }
+        source += "#line 1 " + std::to_string(files.size()) + "\n";
+        if (!readSource(included_path, files, source))
+        {
+            return false;
+        }
+        source += "#line " + std::to_string(line_number + 1) + " " + std::to_string(file_index) + "\n";
+    }
+    return true;
+}
+}
+
+ShaderCache &ShaderCache::instance()
+/** Returns the cache shared by all programs. */
+{
+    static ShaderCache cache;
+    return cache;
+}
+
+void ShaderCache::open(const std::string &directory)
+{
+    driver_ = glString(GL_VENDOR) + "\n" + glString(GL_RENDERER) + "\n" + glString(GL_VERSION);
+
+    // drivers without binary formats can't load the binaries they return
+    GLint format_count = 0;
+    if (GLExtensions::programBinary != nullptr)
+    {
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+    }
+    binaries_ = !directory.empty() && format_count > 0;
+    if (binaries_)
+    {
+        directory_ = directory;
+        mkdir(directory_.c_str(), 0755);
+    }
+
+    // let the driver pick the number of compiler threads
+    if (GLExtensions::maxShaderCompilerThreads != nullptr)
+    {
+        GLExtensions::maxShaderCompilerThreads(0xFFFFFFFFu);
+    }
+}
+
+bool ShaderCache::readSources(const std::string &vertex_path, const std::string &fragment_path, const std::string &defines,
+                              std::string &vertex_source, std::string &fragment_source)
+/** The sources are read with their included files, which is what the key of the program is computed from: a change
+in a shared file compiles all programs that include it again. */
+{
+    std::vector<std::string> vertex_files;
+    std::vector<std::string> fragment_files;
+    vertex_source.clear();
+    fragment_source.clear();
+    if (!readSource(vertex_path, vertex_files, vertex_source) || !readSource(fragment_path, fragment_files, fragment_source))
+    {
+        return false;
+    }
+    vertex_source = withDefines(vertex_source, defines);
+    fragment_source = withDefines(fragment_source, defines);
+    return true;
+}
+
+void ShaderCache::prepare(const std::string &vertex_path, const std::string &fragment_path, const std::string &defines)
+/** Loads the binary of the program if there is one, or starts compiling and linking it. Nothing here waits for the
+driver. */
+{
+    const std::string name = vertex_path + "\n" + fragment_path + "\n" + defines;
+    if (pending_.count(name) != 0)
+    {
+        return;
+    }
+
+    std::string vertex_source;
+    std::string fragment_source;
+    readSources(vertex_path, fragment_path, defines, vertex_source, fragment_source);
+
+    Program program;
+    program.key = hashString(hashString(hashString(hashString(14695981039346656037ull, vertex_source), fragment_source), defines), driver_);
+    if (!loadBinary(program))
+    {
+        compile(program, vertex_source, fragment_source);
+    }
+    pending_[name] = program;
+}
+
+GLuint ShaderCache::acquire(const std::string &vertex_path, const std::string &fragment_path, const std::string &defines)
+/** Waits for the program to be linked. A binary the driver doesn't accept anymore (e.g. after an update that kept
+the version string) is deleted and the program compiled from source; newly compiled programs are stored. */
+{
+    const std::string name = vertex_path + "\n" + fragment_path + "\n" + defines;
+    if (pending_.count(name) == 0)
+    {
+        prepare(vertex_path, fragment_path, defines);
+    }
+    Program program = pending_[name];
+    pending_.erase(name);
+
+    const double start = getCurrentTimeInSeconds();
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program.id, GL_LINK_STATUS, &linked);
+    if (program.vertex_shader == 0)
+    {
+        if (linked == GL_TRUE)
+        {
+            stats_.loaded++;
+            stats_.wait_ms += (getCurrentTimeInSeconds() - start) * 1e3;
+            return program.id;
+        }
+        glDeleteProgram(program.id);
+        std::remove(binaryPath(program.key).c_str());
+
+        std::string vertex_source;
+        std::string fragment_source;
+        readSources(vertex_path, fragment_path, defines, vertex_source, fragment_source);
+        compile(program, vertex_source, fragment_source);
+        glGetProgramiv(program.id, GL_LINK_STATUS, &linked);
+    }
+
+    ShaderProgram::checkCompileErrors(program.vertex_shader, "VERTEX");
+    ShaderProgram::checkCompileErrors(program.fragment_shader, "FRAGMENT");
+    ShaderProgram::checkCompileErrors(program.id, "PROGRAM");
+    // the shaders are linked into the program now and no longer necessary
+    glDeleteShader(program.vertex_shader);
+    glDeleteShader(program.fragment_shader);
+    stats_.wait_ms += (getCurrentTimeInSeconds() - start) * 1e3;
+
+    if (linked == GL_TRUE)
+    {
+        stats_.compiled++;
+        saveBinary(program);
+    }
+    else
+    {
+        stats_.failed++;
+    }
+    return program.id;
+}
+
+void ShaderCache::shutdown()
+{
+    for (auto &entry : pending_)
+    {
+        glDeleteShader(entry.second.vertex_shader);
+        glDeleteShader(entry.second.fragment_shader);
+        glDeleteProgram(entry.second.id);
+    }
+    pending_.clear();
+}
+
+std::string ShaderCache::binaryPath(uint64_t key) const
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "/%016llx.bin", static_cast<unsigned long long>(key));
+    return directory_ + name;
+}
+
+bool ShaderCache::loadBinary(Program &program) const
+/** Hands the binary to the driver; whether it accepts it shows in the link status. */
+{
+    if (!binaries_)
+    {
+        return false;
+    }
+    std::ifstream file(binaryPath(program.key), std::ios::binary);
+    BinaryHeader header{};
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, kBinaryMagic, 4) != 0 ||
+        header.version != kBinaryVersion || header.key != program.key)
+    {
+        return false;
+    }
+    std::vector<char> binary(header.size);
+    if (!file.read(binary.data(), static_cast<std::streamsize>(binary.size())))
+    {
+        return false;
+    }
+
+    program.id = glCreateProgram();
+    GLExtensions::programBinary(program.id, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+    return true;
+}
+
+void ShaderCache::compile(Program &program, const std::string &vertex_source, const std::string &fragment_source) const
+/** Starts compiling and linking without asking for the results, which would wait for the compiler. */
+{
+    const char* vertex_code = vertex_source.c_str();
+    const char* fragment_code = fragment_source.c_str();
+
+    program.vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(program.vertex_shader, 1, &vertex_code, NULL);
+    glCompileShader(program.vertex_shader);
+    program.fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(program.fragment_shader, 1, &fragment_code, NULL);
+    glCompileShader(program.fragment_shader);
+
+    program.id = glCreateProgram();
+    if (binaries_)
+    {
+        GLExtensions::programParameteri(program.id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glAttachShader(program.id, program.vertex_shader);
+    glAttachShader(program.id, program.fragment_shader);
+    glLinkProgram(program.id);
+}
+
+void ShaderCache::saveBinary(const Program &program) const
+{
+    if (!binaries_)
+    {
+        return;
+    }
+    GLint length = 0;
+    glGetProgramiv(program.id, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+    {
+        return;
+    }
+    std::vector<char> binary(static_cast<size_t>(length));
+    GLenum format = 0;
+    GLsizei written = 0;
+    GLExtensions::getProgramBinary(program.id, length, &written, &format, binary.data());
+
+    BinaryHeader header{};
+    std::memcpy(header.magic, kBinaryMagic, 4);
+    header.version = kBinaryVersion;
+    header.format = format;
+    header.size = static_cast<uint32_t>(written);
+    header.key = program.key;
+    std::ofstream file(binaryPath(program.key), std::ios::binary);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(binary.data(), written);
+    if (!file)
+    {
+        std::cout << "ShaderCache: failed to write " << binaryPath(program.key) << std::endl;
+    }
+}
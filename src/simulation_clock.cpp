@@ -0,0 +1,42 @@
+#include <algorithm>
+#include <cmath>
+
+#include "../include/simulation_clock.h"
+
+constexpr int SimulationClock::kDefaultTickRate;
+
+SimulationClock::SimulationClock(int tick_rate, int max_ticks_per_frame)
+        : tick_nanoseconds_(1000000000 / std::max(1, tick_rate)),
+          max_ticks_per_frame_(std::max(1, max_ticks_per_frame))
+{
+}
+
+int SimulationClock::advance(double elapsed_seconds)
+/** Adds the scaled frame time to the time not yet simulated and takes as many whole ticks out of it as fit. After a
+long stall (loading, a breakpoint) at most max_ticks_per_frame ticks are run and the rest of the time is dropped, so
+that the simulation doesn't fall further behind with every frame. */
+{
+    if (paused_ || elapsed_seconds <= 0.0)
+    {
+        return 0;
+    }
+
+    accumulator_ += static_cast<int64_t>(std::llround(elapsed_seconds * scale_ * 1e9));
+    int64_t ticks = accumulator_ / tick_nanoseconds_;
+    accumulator_ -= ticks * tick_nanoseconds_;
+    ticks = std::min<int64_t>(ticks, max_ticks_per_frame_);
+
+    tick_count_ += static_cast<uint64_t>(ticks);
+    return static_cast<int>(ticks);
+}
+
+float SimulationClock::alpha() const
+{
+    return static_cast<float>(static_cast<double>(accumulator_) / static_cast<double>(tick_nanoseconds_));
+}
+
+void SimulationClock::setScale(double scale)
+/** Sets how fast simulated time runs compared to the frame time, e.g. 0.5 for slow motion. */
+{
+    scale_ = std::max(0.0, scale);
+}
@@ -2,20 +2,24 @@
 #include <vector>
 
 #include "../include/texture.h"
+#include "../include/cubemap_file.h"
+#include "../include/texture_streamer.h"
+#include "../include/render_state.h"
 #define STB_IMAGE_IMPLEMENTATION
 
 #include "stb_image.h"
 
 
 Texture2D::Texture2D(const std::string& filepath)
-/** Generates an OpenGL texture object, sets its wrapping and filtering parameters,
- loads the texture data from the specified file, and applies it to the texture object. */
+/** Generates an OpenGL texture object, sets its wrapping and filtering parameters and fills it with a placeholder texel.
+The image itself (or its precompressed .ktx2 version) is loaded on a worker thread and streamed into the texture object
+by TextureStreamer. */
 {
     // Generate a texture object and store its ID
     glGenTextures(1, &texture_id_);
 
     // Bind the generated texture object to the 2D texture target
-    glBindTexture(GL_TEXTURE_2D, texture_id_);
+    RenderState::bindTexture(GL_TEXTURE_2D, texture_id_);
 
     // Set texture wrapping parameters:
     // GL_CLAMP_TO_EDGE ensures texture coordinates outside the 0.0 to 1.0 range  will be clamped to the edge of the texture.
@@ -25,37 +29,16 @@ Texture2D::Texture2D(const std::string& filepath)
 
     // Set texture filtering parameters:
     // GL_LINEAR_MIPMAP_LINEAR uses linear filtering for both the texture and mipmaps, which provides smooth transitions between mipmap levels.
+    // Magnification always samples the base level, so mipmap filters are not valid for it.
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    // Variables to store the dimensions and number of color channels in the texture image
-    int width, height, nrChannels;
+    // A single grey texel keeps the texture complete and drawable until the image is streamed in.
+    const unsigned char placeholder[4] = {128, 128, 128, 255};
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
 
-    // Flip the texture vertically when loading
-    stbi_set_flip_vertically_on_load(true);
-
-    // Load the image data from the specified file
-    unsigned char *data = stbi_load(filepath.c_str(), &width, &height, &nrChannels, 0);
-
-    if (data)
-    {
-        // Create the texture image in OpenGL using the loaded data
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-
-        // Generate mipmaps for the texture for better scaling and rendering at different distances.
-        // Mipmaps is a collection of texture images where each subsequent texture is twice as small compared to the previous one.
-        glGenerateMipmap(GL_TEXTURE_2D);
-    }
-    else
-    {
-        std::cout << "Failed to load texture" << std::endl;
-    }
-
-    // Free the image memory as it's now loaded into OpenGL
-    stbi_image_free(data);
-
-    // Unbind the texture to prevent unintended modifications
-    glBindTexture(GL_TEXTURE_2D, 0);
+    // Decoding an 8k image takes seconds, so it's done asynchronously instead of blocking the first frame
+    TextureStreamer::instance().request(texture_id_, filepath);
 }
 
 GLuint Texture::getTexture() const
@@ -65,48 +48,43 @@ GLuint Texture::getTexture() const
 }
 
 Texture3D::Texture3D(const std::vector<std::string>& filepaths)
-/** Sets up a 3D texture (cube map) in OpenGL, loading six individual images to represent the six faces of a cube,
-and configures the necessary filtering and wrapping options.*/
+/** Sets up a 3D texture (cube map) in OpenGL from six individual images representing the six faces of a cube, or from
+the packed file of them, and configures the necessary filtering and wrapping options once for the whole cube map.
+The faces get mip levels, so the skybox is sampled from prefiltered levels where it's minified instead of aliasing.
+Like 2D textures, the faces are decoded on worker threads and streamed in by TextureStreamer; until then every face is
+a single black texel, the colour of space.*/
+        : load_stats_(std::make_shared<CubemapLoadStats>())
 {
     glGenTextures(1, &texture_id_);
     // Bind the generated texture object to the cube map target
-    glBindTexture(GL_TEXTURE_CUBE_MAP, texture_id_);
-
-    int width, height, nrChannels;
-    for (unsigned int i = 0; i < filepaths.size(); i++)
+    RenderState::bindTexture(GL_TEXTURE_CUBE_MAP, texture_id_);
+
+    // Set texture filtering parameters for the cube map
+    // GL_LINEAR takes an interpolated value from the texture coordinate's neighboring texels, approximating a color between the texels.
+    // GL_LINEAR_MIPMAP_LINEAR blends the two closest mip levels as well when the cube map is minified.
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // Set texture wrapping parameters for the cube map
+    // Cube maps require wrapping along three axes: S, T, and R
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    const unsigned char placeholder[4] = {0, 0, 0, 255};
+    for (int face = 0; face < CubemapFile::kFaceCount; face++)
     {
-        unsigned char *data = stbi_load(filepaths[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            // Determine the image format based on the number of channels
-            GLenum format = 0;
-            if (nrChannels == 1)
-                format = GL_RED;
-            else if (nrChannels == 3)
-                format = GL_RGB;
-            else if (nrChannels == 4)
-                format = GL_RGBA;
-
-            // Create the texture image for the current face of the cube map
-            // GL_TEXTURE_CUBE_MAP_POSITIVE_X + i selects the appropriate face of the cube map
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-            // Set texture filtering parameters for the cube map
-            // GL_LINEAR takes an interpolated value from the texture coordinate's neighboring texels, approximating a color between the texels.
-            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-            // Set texture wrapping parameters for the cube map
-            // Cube maps require wrapping along three axes: S, T, and R
-            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Cubemap texture failed to load at path: " << filepaths[i] << std::endl;
-            stbi_image_free(data);
-        }
+        // GL_TEXTURE_CUBE_MAP_POSITIVE_X + face selects the appropriate face of the cube map
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
     }
-}
\ No newline at end of file
+    RenderState::bindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+    // Decoding the faces doesn't block the first frame, the skybox is drawn with the placeholder until they are resident
+    TextureStreamer::instance().requestCubemap(texture_id_, filepaths, load_stats_);
+}
+
+const CubemapLoadStats& Texture3D::loadStats() const
+/** Returns the load times of the cube map, set once it's resident. */
+{
+    return *load_stats_;
+}
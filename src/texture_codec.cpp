@@ -0,0 +1,811 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "../include/job_system.h"
+#include "../include/texture_codec.h"
+
+namespace
+{
+// interpolation weights of 4-bit BC7 indices, in 1/64
+const int kBC7Weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+int clampByte(float value)
+{
+    return std::min(255, std::max(0, static_cast<int>(std::lround(value))));
+}
+
+void fetchBlock(const ImageData &image, int block_x, int block_y, uint8_t rgba[64])
+/** Copies a 4x4 block of texels expanded to RGBA. Texels outside of the image repeat the last row and column. */
+{
+    for (int y = 0; y < 4; y++)
+    {
+        const int source_y = std::min(block_y * 4 + y, image.height - 1);
+        for (int x = 0; x < 4; x++)
+        {
+            const int source_x = std::min(block_x * 4 + x, image.width - 1);
+            const uint8_t* texel = image.pixels.data() +
+                    (static_cast<size_t>(source_y) * static_cast<size_t>(image.width) + static_cast<size_t>(source_x)) * static_cast<size_t>(image.channels);
+            uint8_t* out = rgba + (y * 4 + x) * 4;
+            switch (image.channels)
+            {
+                case 1: out[0] = out[1] = out[2] = texel[0]; out[3] = 255; break;
+                case 2: out[0] = texel[0]; out[1] = texel[1]; out[2] = 0; out[3] = 255; break;
+                case 3: out[0] = texel[0]; out[1] = texel[1]; out[2] = texel[2]; out[3] = 255; break;
+                default: std::memcpy(out, texel, 4); break;
+            }
+        }
+    }
+}
+
+template<int N>
+void principalAxisEndpoints(const float points[16][4], float low[4], float high[4])
+/** Finds the extremes of the points along their principal axis (covariance eigenvector found by power iteration). */
+{
+    float mean[4] = {0, 0, 0, 0};
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < N; c++)
+        {
+            mean[c] += points[i][c] / 16.0f;
+        }
+    }
+
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; i++)
+    {
+        for (int a = 0; a < N; a++)
+        {
+            for (int b = 0; b < N; b++)
+            {
+                covariance[a][b] += (points[i][a] - mean[a]) * (points[i][b] - mean[b]);
+            }
+        }
+    }
+
+    // starts from the column of the channel that varies most: a fixed start such as (1, 1, 1) is orthogonal to some
+    // axes, e.g. to a gradient that gets brighter in red as much as darker in green and blue, and never leaves zero
+    int widest = 0;
+    for (int c = 1; c < N; c++)
+    {
+        widest = covariance[c][c] > covariance[widest][widest] ? c : widest;
+    }
+    float axis[4] = {1, 1, 1, 1};
+    if (covariance[widest][widest] > 0.0f)
+    {
+        for (int c = 0; c < N; c++)
+        {
+            axis[c] = covariance[c][widest];
+        }
+    }
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        float next[4] = {0, 0, 0, 0};
+        float length = 0.0f;
+        for (int a = 0; a < N; a++)
+        {
+            for (int b = 0; b < N; b++)
+            {
+                next[a] += covariance[a][b] * axis[b];
+            }
+            length = std::max(length, std::fabs(next[a]));
+        }
+        if (length < 1e-6f)
+        {
+            break;
+        }
+        for (int a = 0; a < N; a++)
+        {
+            axis[a] = next[a] / length;
+        }
+    }
+
+    float t_min = std::numeric_limits<float>::max();
+    float t_max = -std::numeric_limits<float>::max();
+    float axis_length = 0.0f;
+    for (int c = 0; c < N; c++)
+    {
+        axis_length += axis[c] * axis[c];
+    }
+    for (int i = 0; i < 16; i++)
+    {
+        float t = 0.0f;
+        for (int c = 0; c < N; c++)
+        {
+            t += (points[i][c] - mean[c]) * axis[c];
+        }
+        t /= std::max(axis_length, 1e-6f);
+        t_min = std::min(t_min, t);
+        t_max = std::max(t_max, t);
+    }
+    for (int c = 0; c < N; c++)
+    {
+        low[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * t_min));
+        high[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * t_max));
+    }
+}
+
+template<int N>
+bool leastSquaresEndpoints(const float points[16][4], const float weights[16], float first[4], float second[4])
+/** Solves for the two endpoints that minimize the error of points reconstructed as w * first + (1 - w) * second. */
+{
+    float aa = 0, bb = 0, ab = 0;
+    float ap[4] = {0, 0, 0, 0};
+    float bp[4] = {0, 0, 0, 0};
+    for (int i = 0; i < 16; i++)
+    {
+        const float a = weights[i];
+        const float b = 1.0f - a;
+        aa += a * a;
+        bb += b * b;
+        ab += a * b;
+        for (int c = 0; c < N; c++)
+        {
+            ap[c] += a * points[i][c];
+            bp[c] += b * points[i][c];
+        }
+    }
+    const float determinant = aa * bb - ab * ab;
+    if (std::fabs(determinant) < 1e-6f)
+    {
+        return false;
+    }
+    for (int c = 0; c < N; c++)
+    {
+        first[c] = std::min(255.0f, std::max(0.0f, (ap[c] * bb - bp[c] * ab) / determinant));
+        second[c] = std::min(255.0f, std::max(0.0f, (bp[c] * aa - ap[c] * ab) / determinant));
+    }
+    return true;
+}
+
+uint16_t packRGB565(const float color[4])
+{
+    const int r = std::min(31, std::max(0, static_cast<int>(std::lround(color[0] * 31.0f / 255.0f))));
+    const int g = std::min(63, std::max(0, static_cast<int>(std::lround(color[1] * 63.0f / 255.0f))));
+    const int b = std::min(31, std::max(0, static_cast<int>(std::lround(color[2] * 31.0f / 255.0f))));
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+void unpackRGB565(uint16_t packed, int color[3])
+{
+    const int r = (packed >> 11) & 31;
+    const int g = (packed >> 5) & 63;
+    const int b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+void colorPalette(uint16_t c0, uint16_t c1, bool four_color, int palette[4][4])
+/** Expands the two endpoints of a BC1 colour block into its four palette entries. */
+{
+    unpackRGB565(c0, palette[0]);
+    unpackRGB565(c1, palette[1]);
+    palette[0][3] = palette[1][3] = 255;
+    for (int c = 0; c < 3; c++)
+    {
+        if (four_color)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        else
+        {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    palette[2][3] = 255;
+    palette[3][3] = four_color ? 255 : 0;
+}
+
+int selectColorIndices(const float points[16][4], uint16_t c0, uint16_t c1, uint8_t indices[16])
+/** Picks the closest palette entry for every texel and returns the total squared error. */
+{
+    int palette[4][4];
+    colorPalette(c0, c1, true, palette);
+    int error = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        int best = std::numeric_limits<int>::max();
+        for (int p = 0; p < 4; p++)
+        {
+            int distance = 0;
+            for (int c = 0; c < 3; c++)
+            {
+                const int d = palette[p][c] - static_cast<int>(points[i][c]);
+                distance += d * d;
+            }
+            if (distance < best)
+            {
+                best = distance;
+                indices[i] = static_cast<uint8_t>(p);
+            }
+        }
+        error += best;
+    }
+    return error;
+}
+
+void encodeColorBlock(const uint8_t rgba[64], uint8_t block[8])
+/** Encodes the colour part of a BC1/BC3 block in four colour mode. */
+{
+    float points[16][4];
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            points[i][c] = rgba[i * 4 + c];
+        }
+    }
+
+    float low[4], high[4];
+    principalAxisEndpoints<3>(points, low, high);
+    uint16_t c0 = packRGB565(high);
+    uint16_t c1 = packRGB565(low);
+    uint8_t indices[16];
+    int error = selectColorIndices(points, c0, c1, indices);
+
+    // one refinement step: fit the endpoints to the chosen indices
+    const float palette_weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+    float weights[16];
+    for (int i = 0; i < 16; i++)
+    {
+        weights[i] = palette_weights[indices[i]];
+    }
+    float first[4], second[4];
+    if (leastSquaresEndpoints<3>(points, weights, first, second))
+    {
+        const uint16_t refined_c0 = packRGB565(first);
+        const uint16_t refined_c1 = packRGB565(second);
+        uint8_t refined_indices[16];
+        const int refined_error = selectColorIndices(points, refined_c0, refined_c1, refined_indices);
+        if (refined_error < error)
+        {
+            c0 = refined_c0;
+            c1 = refined_c1;
+            std::memcpy(indices, refined_indices, sizeof(indices));
+            error = refined_error;
+        }
+    }
+
+    // c0 > c1 selects the four colour mode; swapping the endpoints swaps the palette entries 0<->1 and 2<->3
+    if (c0 < c1)
+    {
+        std::swap(c0, c1);
+        for (uint8_t &index : indices)
+        {
+            index ^= 1;
+        }
+    }
+    else if (c0 == c1)
+    {
+        std::memset(indices, 0, sizeof(indices));
+    }
+
+    uint32_t bits = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        bits |= static_cast<uint32_t>(indices[i]) << (2 * i);
+    }
+    block[0] = static_cast<uint8_t>(c0 & 0xFF);
+    block[1] = static_cast<uint8_t>(c0 >> 8);
+    block[2] = static_cast<uint8_t>(c1 & 0xFF);
+    block[3] = static_cast<uint8_t>(c1 >> 8);
+    for (int i = 0; i < 4; i++)
+    {
+        block[4 + i] = static_cast<uint8_t>(bits >> (8 * i));
+    }
+}
+
+void decodeColorBlock(const uint8_t block[8], bool force_four_color, uint8_t rgba[64])
+{
+    const uint16_t c0 = static_cast<uint16_t>(block[0] | (block[1] << 8));
+    const uint16_t c1 = static_cast<uint16_t>(block[2] | (block[3] << 8));
+    int palette[4][4];
+    colorPalette(c0, c1, force_four_color || c0 > c1, palette);
+
+    const uint32_t bits = static_cast<uint32_t>(block[4]) | (static_cast<uint32_t>(block[5]) << 8) |
+                          (static_cast<uint32_t>(block[6]) << 16) | (static_cast<uint32_t>(block[7]) << 24);
+    for (int i = 0; i < 16; i++)
+    {
+        const int index = (bits >> (2 * i)) & 3;
+        for (int c = 0; c < 4; c++)
+        {
+            rgba[i * 4 + c] = static_cast<uint8_t>(palette[index][c]);
+        }
+    }
+}
+
+// Little-endian bit stream over a 128-bit BC7 block.
+class BlockBits
+{
+public:
+    explicit BlockBits(uint8_t* block) : block_(block) {}
+
+    void write(uint32_t value, int count)
+    {
+        for (int i = 0; i < count; i++, position_++)
+        {
+            if ((value >> i) & 1u)
+            {
+                block_[position_ >> 3] |= static_cast<uint8_t>(1u << (position_ & 7));
+            }
+        }
+    }
+
+    uint32_t read(int count)
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < count; i++, position_++)
+        {
+            value |= static_cast<uint32_t>((block_[position_ >> 3] >> (position_ & 7)) & 1u) << i;
+        }
+        return value;
+    }
+
+private:
+    uint8_t* block_;
+    int position_{0};
+};
+
+void quantizeBC7Endpoint(const float endpoint[4], int quantized[4], int &p_bit)
+/** Mode 6 endpoints have 7 bits per channel plus one shared bit; tries both shared bit values. */
+{
+    int best_error = std::numeric_limits<int>::max();
+    for (int p = 0; p < 2; p++)
+    {
+        int candidate[4];
+        int error = 0;
+        for (int c = 0; c < 4; c++)
+        {
+            candidate[c] = std::min(127, std::max(0, static_cast<int>(std::lround((endpoint[c] - static_cast<float>(p)) / 2.0f))));
+            const int d = ((candidate[c] << 1) | p) - clampByte(endpoint[c]);
+            error += d * d;
+        }
+        if (error < best_error)
+        {
+            best_error = error;
+            p_bit = p;
+            std::memcpy(quantized, candidate, sizeof(candidate));
+        }
+    }
+}
+
+int selectBC7Indices(const float points[16][4], const int e0[4], int p0, const int e1[4], int p1, uint8_t indices[16])
+{
+    int palette[16][4];
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            const int a = (e0[c] << 1) | p0;
+            const int b = (e1[c] << 1) | p1;
+            palette[i][c] = ((64 - kBC7Weights[i]) * a + kBC7Weights[i] * b + 32) >> 6;
+        }
+    }
+    int error = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        int best = std::numeric_limits<int>::max();
+        for (int p = 0; p < 16; p++)
+        {
+            int distance = 0;
+            for (int c = 0; c < 4; c++)
+            {
+                const int d = palette[p][c] - static_cast<int>(points[i][c]);
+                distance += d * d;
+            }
+            if (distance < best)
+            {
+                best = distance;
+                indices[i] = static_cast<uint8_t>(p);
+            }
+        }
+        error += best;
+    }
+    return error;
+}
+}
+
+size_t TextureCodec::blockSize(TextureFormat format)
+/** Returns the number of bytes of one 4x4 block. */
+{
+    return format == kTextureFormatBC1 || format == kTextureFormatBC4 ? 8 : 16;
+}
+
+size_t TextureCodec::compressedSize(TextureFormat format, int width, int height)
+/** Returns the size of a compressed image; partial blocks at the edges take a full block. */
+{
+    return static_cast<size_t>((width + 3) / 4) * static_cast<size_t>((height + 3) / 4) * blockSize(format);
+}
+
+const char* TextureCodec::name(TextureFormat format)
+{
+    switch (format)
+    {
+        case kTextureFormatBC1: return "BC1";
+        case kTextureFormatBC3: return "BC3";
+        case kTextureFormatBC4: return "BC4";
+        case kTextureFormatBC7: return "BC7";
+    }
+    return "unknown";
+}
+
+std::vector<ImageData> TextureCodec::buildMipChain(const ImageData &image)
+/** Returns the image followed by all of its mip levels down to 1x1, each level a 2x2 box filter of the previous one. */
+{
+    std::vector<ImageData> levels;
+    levels.push_back(image);
+    while (levels.back().width > 1 || levels.back().height > 1)
+    {
+        const ImageData &source = levels.back();
+        ImageData level;
+        level.width = std::max(1, source.width / 2);
+        level.height = std::max(1, source.height / 2);
+        level.channels = source.channels;
+        level.pixels.resize(static_cast<size_t>(level.width) * static_cast<size_t>(level.height) * static_cast<size_t>(level.channels));
+
+        const size_t channels = static_cast<size_t>(source.channels);
+        for (int y = 0; y < level.height; y++)
+        {
+            const size_t y0 = static_cast<size_t>(std::min(2 * y, source.height - 1));
+            const size_t y1 = static_cast<size_t>(std::min(2 * y + 1, source.height - 1));
+            for (int x = 0; x < level.width; x++)
+            {
+                const size_t x0 = static_cast<size_t>(std::min(2 * x, source.width - 1));
+                const size_t x1 = static_cast<size_t>(std::min(2 * x + 1, source.width - 1));
+                const size_t row = static_cast<size_t>(source.width);
+                for (size_t c = 0; c < channels; c++)
+                {
+                    const int sum = source.pixels[(y0 * row + x0) * channels + c] + source.pixels[(y0 * row + x1) * channels + c] +
+                                    source.pixels[(y1 * row + x0) * channels + c] + source.pixels[(y1 * row + x1) * channels + c];
+                    level.pixels[(static_cast<size_t>(y) * static_cast<size_t>(level.width) + static_cast<size_t>(x)) * channels + c] =
+                            static_cast<uint8_t>((sum + 2) / 4);
+                }
+            }
+        }
+        levels.push_back(std::move(level));
+    }
+    return levels;
+}
+
+std::vector<uint8_t> TextureCodec::compress(const ImageData &image, TextureFormat format)
+/** Compresses the image block by block. Rows of blocks are distributed over the job system. */
+{
+    const int blocks_x = (image.width + 3) / 4;
+    const int blocks_y = (image.height + 3) / 4;
+    const size_t block_size = blockSize(format);
+    std::vector<uint8_t> output(compressedSize(format, image.width, image.height));
+
+    auto compressRows = [&](int first_row, int last_row)
+    {
+        uint8_t rgba[64];
+        uint8_t values[16];
+        for (int by = first_row; by < last_row; by++)
+        {
+            for (int bx = 0; bx < blocks_x; bx++)
+            {
+                uint8_t* block = output.data() + (static_cast<size_t>(by) * static_cast<size_t>(blocks_x) + static_cast<size_t>(bx)) * block_size;
+                fetchBlock(image, bx, by, rgba);
+                switch (format)
+                {
+                    case kTextureFormatBC1:
+                        encodeBlockBC1(rgba, block);
+                        break;
+                    case kTextureFormatBC3:
+                        encodeBlockBC3(rgba, block);
+                        break;
+                    case kTextureFormatBC4:
+                        for (int i = 0; i < 16; i++)
+                        {
+                            values[i] = rgba[i * 4];
+                        }
+                        encodeBlockBC4(values, block);
+                        break;
+                    case kTextureFormatBC7:
+                        encodeBlockBC7(rgba, block);
+                        break;
+                }
+            }
+        }
+    };
+
+    // small mip levels are not worth the scheduling overhead, they fit into the first range, which runs on this thread
+    const size_t rows_per_job = 16;
+    JobSystem::instance().parallelFor(static_cast<size_t>(blocks_y), rows_per_job, [&compressRows](size_t first_row, size_t last_row) {
+        compressRows(static_cast<int>(first_row), static_cast<int>(last_row));
+    });
+    return output;
+}
+
+ImageData TextureCodec::decompress(const uint8_t* data, int width, int height, TextureFormat format)
+/** Decodes a compressed image; BC4 decodes to a single channel image, all other formats to RGBA. */
+{
+    ImageData image;
+    image.width = width;
+    image.height = height;
+    image.channels = format == kTextureFormatBC4 ? 1 : 4;
+    image.pixels.resize(static_cast<size_t>(width) * static_cast<size_t>(height) * static_cast<size_t>(image.channels));
+
+    const int blocks_x = (width + 3) / 4;
+    const int blocks_y = (height + 3) / 4;
+    const size_t block_size = blockSize(format);
+    uint8_t rgba[64];
+    for (int by = 0; by < blocks_y; by++)
+    {
+        for (int bx = 0; bx < blocks_x; bx++)
+        {
+            const uint8_t* block = data + (static_cast<size_t>(by) * static_cast<size_t>(blocks_x) + static_cast<size_t>(bx)) * block_size;
+            switch (format)
+            {
+                case kTextureFormatBC1: decodeBlockBC1(block, rgba); break;
+                case kTextureFormatBC3: decodeBlockBC3(block, rgba); break;
+                case kTextureFormatBC4: decodeBlockBC4(block, rgba); break;
+                case kTextureFormatBC7: decodeBlockBC7(block, rgba); break;
+            }
+
+            for (int y = 0; y < 4 && by * 4 + y < height; y++)
+            {
+                for (int x = 0; x < 4 && bx * 4 + x < width; x++)
+                {
+                    const size_t texel = static_cast<size_t>(by * 4 + y) * static_cast<size_t>(width) + static_cast<size_t>(bx * 4 + x);
+                    const size_t channels = static_cast<size_t>(image.channels);
+                    std::memcpy(image.pixels.data() + texel * channels, rgba + (y * 4 + x) * static_cast<int>(channels), channels);
+                }
+            }
+        }
+    }
+    return image;
+}
+
+double TextureCodec::psnr(const ImageData &a, const ImageData &b, int channels)
+/** Peak signal-to-noise ratio in dB over the first channels of two images of the same size. */
+{
+    const size_t texels = static_cast<size_t>(a.width) * static_cast<size_t>(a.height);
+    double squared_error = 0.0;
+    for (size_t i = 0; i < texels; i++)
+    {
+        for (int c = 0; c < channels; c++)
+        {
+            const double d = static_cast<double>(a.pixels[i * static_cast<size_t>(a.channels) + static_cast<size_t>(c)]) -
+                             static_cast<double>(b.pixels[i * static_cast<size_t>(b.channels) + static_cast<size_t>(c)]);
+            squared_error += d * d;
+        }
+    }
+    const double mean_squared_error = squared_error / static_cast<double>(texels * static_cast<size_t>(channels));
+    if (mean_squared_error == 0.0)
+    {
+        return std::numeric_limits<double>::infinity();
+    }
+    return 10.0 * std::log10(255.0 * 255.0 / mean_squared_error);
+}
+
+void TextureCodec::encodeBlockBC1(const uint8_t rgba[64], uint8_t block[8])
+/** Encodes a block of 16 RGBA texels (alpha is ignored) into an opaque BC1 block. */
+{
+    encodeColorBlock(rgba, block);
+}
+
+void TextureCodec::encodeBlockBC4(const uint8_t values[16], uint8_t block[8])
+/** Encodes 16 single channel values into a BC4 block using the eight value mode. */
+{
+    int low = 255, high = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        low = std::min<int>(low, values[i]);
+        high = std::max<int>(high, values[i]);
+    }
+
+    // index 0 and 1 are the endpoints, 2..7 interpolate from high to low
+    int palette[8];
+    palette[0] = high;
+    palette[1] = low;
+    for (int i = 1; i < 7; i++)
+    {
+        palette[i + 1] = ((7 - i) * high + i * low + 3) / 7;
+    }
+
+    uint64_t bits = 0;
+    if (high != low)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            int best = std::numeric_limits<int>::max();
+            uint64_t best_index = 0;
+            for (int p = 0; p < 8; p++)
+            {
+                const int distance = std::abs(palette[p] - values[i]);
+                if (distance < best)
+                {
+                    best = distance;
+                    best_index = static_cast<uint64_t>(p);
+                }
+            }
+            bits |= best_index << (3 * i);
+        }
+    }
+
+    block[0] = static_cast<uint8_t>(high);
+    block[1] = static_cast<uint8_t>(low);
+    for (int i = 0; i < 6; i++)
+    {
+        block[2 + i] = static_cast<uint8_t>(bits >> (8 * i));
+    }
+}
+
+void TextureCodec::encodeBlockBC3(const uint8_t rgba[64], uint8_t block[16])
+/** Encodes a block of 16 RGBA texels into a BC3 block: a BC4 alpha block followed by a BC1 colour block. */
+{
+    uint8_t alpha[16];
+    for (int i = 0; i < 16; i++)
+    {
+        alpha[i] = rgba[i * 4 + 3];
+    }
+    encodeBlockBC4(alpha, block);
+    encodeColorBlock(rgba, block + 8);
+}
+
+void TextureCodec::encodeBlockBC7(const uint8_t rgba[64], uint8_t block[16])
+/** Encodes a block of 16 RGBA texels into a BC7 mode 6 block: one subset, 7.7.7.7 endpoints with a shared bit each
+and 4-bit indices. */
+{
+    float points[16][4];
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            points[i][c] = rgba[i * 4 + c];
+        }
+    }
+
+    float low[4], high[4];
+    principalAxisEndpoints<4>(points, low, high);
+    int e0[4], e1[4], p0 = 0, p1 = 0;
+    quantizeBC7Endpoint(low, e0, p0);
+    quantizeBC7Endpoint(high, e1, p1);
+    uint8_t indices[16];
+    int error = selectBC7Indices(points, e0, p0, e1, p1, indices);
+
+    float weights[16];
+    for (int i = 0; i < 16; i++)
+    {
+        weights[i] = 1.0f - static_cast<float>(kBC7Weights[indices[i]]) / 64.0f;
+    }
+    float first[4], second[4];
+    if (leastSquaresEndpoints<4>(points, weights, first, second))
+    {
+        int refined_e0[4], refined_e1[4], refined_p0 = 0, refined_p1 = 0;
+        uint8_t refined_indices[16];
+        quantizeBC7Endpoint(first, refined_e0, refined_p0);
+        quantizeBC7Endpoint(second, refined_e1, refined_p1);
+        const int refined_error = selectBC7Indices(points, refined_e0, refined_p0, refined_e1, refined_p1, refined_indices);
+        if (refined_error < error)
+        {
+            std::memcpy(e0, refined_e0, sizeof(e0));
+            std::memcpy(e1, refined_e1, sizeof(e1));
+            p0 = refined_p0;
+            p1 = refined_p1;
+            std::memcpy(indices, refined_indices, sizeof(indices));
+        }
+    }
+
+    // the most significant bit of the first index is implicitly 0: swap the endpoints if it would be set
+    if (indices[0] >= 8)
+    {
+        std::swap(e0, e1);
+        std::swap(p0, p1);
+        for (uint8_t &index : indices)
+        {
+            index = static_cast<uint8_t>(15 - index);
+        }
+    }
+
+    std::memset(block, 0, 16);
+    BlockBits bits(block);
+    bits.write(1u << 6, 7);
+    for (int c = 0; c < 4; c++)
+    {
+        bits.write(static_cast<uint32_t>(e0[c]), 7);
+        bits.write(static_cast<uint32_t>(e1[c]), 7);
+    }
+    bits.write(static_cast<uint32_t>(p0), 1);
+    bits.write(static_cast<uint32_t>(p1), 1);
+    bits.write(indices[0], 3);
+    for (int i = 1; i < 16; i++)
+    {
+        bits.write(indices[i], 4);
+    }
+}
+
+void TextureCodec::decodeBlockBC1(const uint8_t block[8], uint8_t rgba[64])
+{
+    decodeColorBlock(block, false, rgba);
+}
+
+void TextureCodec::decodeBlockBC4(const uint8_t block[8], uint8_t values[16])
+{
+    const int a0 = block[0];
+    const int a1 = block[1];
+    int palette[8];
+    palette[0] = a0;
+    palette[1] = a1;
+    if (a0 > a1)
+    {
+        for (int i = 1; i < 7; i++)
+        {
+            palette[i + 1] = ((7 - i) * a0 + i * a1 + 3) / 7;
+        }
+    }
+    else
+    {
+        for (int i = 1; i < 5; i++)
+        {
+            palette[i + 1] = ((5 - i) * a0 + i * a1 + 2) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    uint64_t bits = 0;
+    for (int i = 0; i < 6; i++)
+    {
+        bits |= static_cast<uint64_t>(block[2 + i]) << (8 * i);
+    }
+    for (int i = 0; i < 16; i++)
+    {
+        values[i] = static_cast<uint8_t>(palette[(bits >> (3 * i)) & 7]);
+    }
+}
+
+void TextureCodec::decodeBlockBC3(const uint8_t block[16], uint8_t rgba[64])
+{
+    uint8_t alpha[16];
+    decodeBlockBC4(block, alpha);
+    decodeColorBlock(block + 8, true, rgba);
+    for (int i = 0; i < 16; i++)
+    {
+        rgba[i * 4 + 3] = alpha[i];
+    }
+}
+
+bool TextureCodec::decodeBlockBC7(const uint8_t block[16], uint8_t rgba[64])
+/** Decodes a BC7 mode 6 block. Other modes are not produced by the encoder and decode to opaque magenta. */
+{
+    if ((block[0] & 0x7F) != 0x40)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            rgba[i * 4] = 255;
+            rgba[i * 4 + 1] = 0;
+            rgba[i * 4 + 2] = 255;
+            rgba[i * 4 + 3] = 255;
+        }
+        return false;
+    }
+
+    uint8_t copy[16];
+    std::memcpy(copy, block, sizeof(copy));
+    BlockBits bits(copy);
+    bits.read(7);
+    int e0[4], e1[4];
+    for (int c = 0; c < 4; c++)
+    {
+        e0[c] = static_cast<int>(bits.read(7));
+        e1[c] = static_cast<int>(bits.read(7));
+    }
+    const int p0 = static_cast<int>(bits.read(1));
+    const int p1 = static_cast<int>(bits.read(1));
+    for (int i = 0; i < 16; i++)
+    {
+        const int weight = kBC7Weights[bits.read(i == 0 ? 3 : 4)];
+        for (int c = 0; c < 4; c++)
+        {
+            const int a = (e0[c] << 1) | p0;
+            const int b = (e1[c] << 1) | p1;
+            rgba[i * 4 + c] = static_cast<uint8_t>(((64 - weight) * a + weight * b + 32) >> 6);
+        }
+    }
+    return true;
+}
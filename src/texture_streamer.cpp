@@ -0,0 +1,790 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "../include/texture_streamer.h"
+#include "../include/cubemap_file.h"
+#include "../include/render_state.h"
+#include "../include/gl_extensions.h"
+#include "../include/profiler.h"
+
+#include "stb_image.h"
+
+constexpr size_t TextureStreamer::kSliceSize;
+constexpr int TextureStreamer::kSliceCount;
+
+namespace
+{
+double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int mipLevelCount(int width, int height)
+{
+    return 1 + static_cast<int>(std::floor(std::log2(static_cast<double>(std::max(width, height)))));
+}
+
+bool fillSolidImage(TextureImage &image, int size, int channels)
+/** Replaces the image with an opaque black one of the given size. */
+{
+    const size_t texels = static_cast<size_t>(size) * static_cast<size_t>(size);
+    image.pixels = std::unique_ptr<unsigned char, void (*)(void*)>(
+            static_cast<unsigned char*>(std::calloc(texels, static_cast<size_t>(channels))), std::free);
+    if (!image.pixels)
+    {
+        return false;
+    }
+    image.width = size;
+    image.height = size;
+    image.channels = channels;
+    std::fill(image.average_color, image.average_color + 4, 0);
+    if (channels == 4)
+    {
+        image.average_color[3] = 255;
+        for (size_t texel = 0; texel < texels; texel++)
+        {
+            image.pixels.get()[texel * 4 + 3] = 255;
+        }
+    }
+    return true;
+}
+
+void computeAverageColor(TextureImage &image)
+/** The average colour is estimated from a sparse grid of texels, it's only used as a placeholder. */
+{
+    const int samples = 64;
+    const size_t row_size = image.rowSize();
+    unsigned long sums[4] = {0, 0, 0, 0};
+    for (int sy = 0; sy < samples; sy++)
+    {
+        for (int sx = 0; sx < samples; sx++)
+        {
+            const size_t x = static_cast<size_t>(sx) * static_cast<size_t>(image.width) / samples;
+            const size_t y = static_cast<size_t>(sy) * static_cast<size_t>(image.height) / samples;
+            const unsigned char* texel = image.pixels.get() + y * row_size + x * static_cast<size_t>(image.channels);
+            for (int c = 0; c < image.channels; c++)
+            {
+                sums[c] += texel[c];
+            }
+        }
+    }
+    for (int c = 0; c < image.channels; c++)
+    {
+        image.average_color[c] = static_cast<unsigned char>(sums[c] / (samples * samples));
+    }
+}
+}
+
+TextureStreamer &TextureStreamer::instance()
+/** Returns the streamer shared by all textures. */
+{
+    static TextureStreamer streamer;
+    return streamer;
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    jobs_.wait(decoding_);
+}
+
+bool TextureStreamer::decode(const std::string &filepath, bool flip_vertically, TextureImage &image)
+/** Decodes an image file into CPU memory and computes its average colour. Safe to call from worker threads:
+the global flip flag of stb_image is not thread-safe, so rows are flipped here instead. */
+{
+    PROFILE_SCOPE("TextureStreamer::decode");
+    const auto start = std::chrono::steady_clock::now();
+
+    int width, height, channels;
+    unsigned char *data = stbi_load(filepath.c_str(), &width, &height, &channels, 0);
+    if (!data)
+    {
+        return false;
+    }
+
+    image.filepath = filepath;
+    image.width = width;
+    image.height = height;
+    image.channels = channels;
+    image.pixels = std::unique_ptr<unsigned char, void (*)(void*)>(data, stbi_image_free);
+
+    const size_t row_size = image.rowSize();
+    if (flip_vertically)
+    {
+        std::vector<unsigned char> row(row_size);
+        for (int y = 0; y < height / 2; y++)
+        {
+            unsigned char* top = data + row_size * static_cast<size_t>(y);
+            unsigned char* bottom = data + row_size * static_cast<size_t>(height - 1 - y);
+            std::memcpy(row.data(), top, row_size);
+            std::memcpy(top, bottom, row_size);
+            std::memcpy(bottom, row.data(), row_size);
+        }
+    }
+
+    computeAverageColor(image);
+    image.decode_ms = millisecondsSince(start);
+    return true;
+}
+
+bool TextureStreamer::loadCompressed(const std::string &filepath, TextureImage &image)
+/** Opens the .ktx2 file that texture_compressor stores next to the image, if there is one and the driver supports its format.
+Level data isn't read here: it's paged in from the mapped file while it's uploaded. */
+{
+    const auto start = std::chrono::steady_clock::now();
+
+    const std::string ktx2_filepath = Ktx2File::pathFor(filepath);
+    auto file = std::make_shared<Ktx2File>();
+    if (!file->open(ktx2_filepath))
+    {
+        return false;
+    }
+    if (compressedFormatFor(file->format()) == 0)
+    {
+        std::cout << "TextureStreamer: " << TextureCodec::name(file->format()) << " textures are not supported by the driver, loading "
+                  << filepath << " instead" << std::endl;
+        return false;
+    }
+
+    image.filepath = ktx2_filepath;
+    image.width = file->width();
+    image.height = file->height();
+    image.channels = file->format() == kTextureFormatBC4 ? 1 : 4;
+    image.compressed = std::move(file);
+    image.decode_ms = millisecondsSince(start);
+    return true;
+}
+
+GLenum TextureStreamer::formatFor(int channels)
+/** Returns the pixel format matching the number of colour channels of an image. */
+{
+    switch (channels)
+    {
+        case 1: return GL_RED;
+        case 2: return GL_RG;
+        case 4: return GL_RGBA;
+        default: return GL_RGB;
+    }
+}
+
+GLenum TextureStreamer::compressedFormatFor(TextureFormat format)
+/** Returns the internal format of a block-compressed format, or 0 if the driver doesn't support it. */
+{
+    switch (format)
+    {
+        case kTextureFormatBC1: return GLExtensions::textureCompressionS3TC ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : 0;
+        case kTextureFormatBC3: return GLExtensions::textureCompressionS3TC ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : 0;
+        case kTextureFormatBC4: return GL_COMPRESSED_RED_RGTC1;
+        case kTextureFormatBC7: return GLExtensions::textureCompressionBPTC ? GL_COMPRESSED_RGBA_BPTC_UNORM : 0;
+    }
+    return 0;
+}
+
+bool TextureStreamer::loadPackedCubemap(const std::string &filepath, std::vector<TextureImage> &faces)
+/** Copies the faces out of the packed file of a cube map, if there is one (see CubemapFile::pathFor()). They are copied on
+the worker thread, so that the GL thread doesn't take the page faults of reading the file while it uploads them. */
+{
+    CubemapFile file;
+    if (filepath.empty() || !file.open(filepath))
+    {
+        return false;
+    }
+
+    faces.clear();
+    faces.resize(CubemapFile::kFaceCount);
+    for (int face = 0; face < CubemapFile::kFaceCount; face++)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        TextureImage &image = faces[static_cast<size_t>(face)];
+        image.filepath = filepath;
+        image.width = file.size();
+        image.height = file.size();
+        image.channels = file.channels();
+        image.pixels = std::unique_ptr<unsigned char, void (*)(void*)>(static_cast<unsigned char*>(std::malloc(file.faceBytes())), std::free);
+        if (!image.pixels)
+        {
+            return false;
+        }
+        std::memcpy(image.pixels.get(), file.faceData(face), file.faceBytes());
+        computeAverageColor(image);
+        image.decode_ms = millisecondsSince(start);
+    }
+    return true;
+}
+
+void TextureStreamer::request(GLuint texture_id, const std::string &filepath)
+/** Schedules an image to be decoded on a worker thread and streamed into the texture afterwards. A precompressed .ktx2 file
+next to the image is preferred over the image itself. The texture keeps showing its current contents (a placeholder)
+until the image is fully uploaded. */
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_decodes_++;
+    }
+
+    jobs_.runBackground([this, texture_id, filepath]()
+    {
+        Upload upload;
+        upload.texture_id = texture_id;
+        const bool decoded = loadCompressed(filepath, upload.image) || decode(filepath, true, upload.image);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_decodes_--;
+        if (decoded)
+        {
+            stats_.textures_decoded++;
+            stats_.decode_ms_total += upload.image.decode_ms;
+            decoded_.push_back(std::move(upload));
+        }
+        else
+        {
+            std::cout << "Failed to load texture: " << filepath << std::endl;
+        }
+    }, decoding_);
+}
+
+void TextureStreamer::requestCubemap(GLuint texture_id, const std::vector<std::string> &filepaths, std::shared_ptr<CubemapLoadStats> stats)
+/** Schedules the faces of a cube map, in the order of GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, to be decoded on the worker
+threads and streamed into the texture one after another like 2D images. The packed file of the faces is read instead when
+there is one. The texture keeps showing its current contents (a placeholder) until all faces are uploaded; stats are
+written when they are. */
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_decodes_++;
+    }
+
+    auto cubemap = std::make_shared<CubemapDecode>();
+    cubemap->upload.texture_id = texture_id;
+    cubemap->upload.target = GL_TEXTURE_CUBE_MAP;
+    cubemap->upload.requested = std::chrono::steady_clock::now();
+    cubemap->upload.cubemap_stats = std::move(stats);
+    jobs_.runBackground([this, cubemap, filepaths]()
+    {
+        if (loadPackedCubemap(CubemapFile::pathFor(filepaths), cubemap->faces))
+        {
+            cubemap->upload.cubemap_load.packed = true;
+            finishCubemapDecode(*cubemap);
+            return;
+        }
+        decodeCubemapFaces(cubemap, filepaths);
+    }, decoding_);
+}
+
+void TextureStreamer::decodeCubemapFaces(const std::shared_ptr<CubemapDecode> &cubemap, const std::vector<std::string> &filepaths)
+/** Checks the sizes of all faces in the headers of the images before anything is decoded, then decodes every face as a
+job of its own, so that they are decoded at the same time on the workers. The last face to be decoded hands them over. */
+{
+    std::vector<ImageData> faces(filepaths.size());
+    for (size_t i = 0; i < filepaths.size(); i++)
+    {
+        if (!stbi_info(filepaths[i].c_str(), &faces[i].width, &faces[i].height, &faces[i].channels))
+        {
+            std::cout << "Cubemap texture failed to load at path: " << filepaths[i] << std::endl;
+            finishCubemapDecode(*cubemap);
+            return;
+        }
+    }
+    std::string error;
+    if (!CubemapFile::validateFaces(faces, error))
+    {
+        std::cout << "Cubemap faces don't fit together: " << error << std::endl;
+        finishCubemapDecode(*cubemap);
+        return;
+    }
+
+    cubemap->faces.resize(filepaths.size());
+    cubemap->remaining = static_cast<int>(filepaths.size());
+    for (size_t i = 0; i < filepaths.size(); i++)
+    {
+        const std::string filepath = filepaths[i];
+        jobs_.runBackground([this, cubemap, filepath, i]()
+        {
+            // faces are flipped vertically like 2D textures
+            if (!decode(filepath, true, cubemap->faces[i]))
+            {
+                std::cout << "Cubemap texture failed to load at path: " << filepath << std::endl;
+            }
+            if (--cubemap->remaining == 0)
+            {
+                finishCubemapDecode(*cubemap);
+            }
+        }, decoding_);
+    }
+}
+
+void TextureStreamer::finishCubemapDecode(CubemapDecode &cubemap)
+/** Hands the decoded faces over to the GL thread. A face that fails to decode is filled with black, the colour of space,
+instead of leaving its texels undefined. If no face is decoded, or the faces failed the checks of their headers, the
+texture keeps its placeholder. */
+{
+    const TextureImage* decoded_face = nullptr;
+    for (const TextureImage &image : cubemap.faces)
+    {
+        if (image.pixels)
+        {
+            decoded_face = &image;
+            break;
+        }
+    }
+    bool complete = decoded_face != nullptr && cubemap.faces.size() == static_cast<size_t>(CubemapFile::kFaceCount);
+    double decode_ms = 0.0;
+    for (size_t face = 0; face < cubemap.faces.size() && complete; face++)
+    {
+        TextureImage &image = cubemap.faces[face];
+        // the headers were checked to match before decoding, so a face that decoded to another size failed as well
+        if (image.pixels && image.width == decoded_face->width && image.height == decoded_face->height &&
+            image.channels == decoded_face->channels)
+        {
+            cubemap.upload.cubemap_load.decode_ms[face] = image.decode_ms;
+            decode_ms += image.decode_ms;
+            continue;
+        }
+        std::cout << "Cubemap face " << face << " is filled with black" << std::endl;
+        complete = fillSolidImage(image, decoded_face->width, decoded_face->channels);
+    }
+
+    Upload &upload = cubemap.upload;
+    if (complete)
+    {
+        upload.image = std::move(cubemap.faces[0]);
+        for (size_t face = 1; face < cubemap.faces.size(); face++)
+        {
+            upload.next_faces.push_back(std::move(cubemap.faces[face]));
+        }
+    }
+    cubemap.faces.clear();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_decodes_--;
+    if (complete)
+    {
+        stats_.textures_decoded++;
+        stats_.decode_ms_total += decode_ms;
+        decoded_.push_back(std::move(upload));
+    }
+}
+
+void TextureStreamer::update()
+/** Called on the GL thread once per frame. Allocates storage for newly decoded images and uploads pending images
+in slices through the pixel unpack buffer ring, until the per-frame byte budget is used up. */
+{
+    const auto start = std::chrono::steady_clock::now();
+    stats_.bytes_uploaded_frame = 0;
+    stats_.upload_ms_frame = 0.0;
+
+    std::deque<Upload> decoded;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        decoded.swap(decoded_);
+    }
+    if (uploads_.empty() && decoded.empty())
+    {
+        return;
+    }
+
+    if (unpack_buffer_ == 0)
+    {
+        createUnpackBuffer();
+    }
+    for (Upload &upload : decoded)
+    {
+        beginUpload(std::move(upload));
+    }
+
+    size_t budget = upload_budget_;
+    while (!uploads_.empty() && budget > 0)
+    {
+        Upload &upload = uploads_.front();
+        if (!upload.isComplete())
+        {
+            const auto slice_start = std::chrono::steady_clock::now();
+            const int face = upload.face;
+            const bool uploaded = uploadSlice(upload, budget);
+            const double slice_ms = millisecondsSince(slice_start);
+            upload.upload_ms += slice_ms;
+            if (upload.target == GL_TEXTURE_CUBE_MAP)
+            {
+                upload.cubemap_load.upload_ms[face] += slice_ms;
+            }
+            if (!uploaded)
+            {
+                // all slices of the ring are still in use by the GPU: continue next frame instead of stalling
+                break;
+            }
+        }
+
+        if (upload.isComplete())
+        {
+            finishUpload(upload);
+            uploads_.pop_front();
+        }
+    }
+    if (!uploads_.empty())
+    {
+        uploads_.front().frames++;
+    }
+
+    stats_.upload_ms_frame = millisecondsSince(start);
+    stats_.upload_ms_total += stats_.upload_ms_frame;
+
+    if (isIdle())
+    {
+        const TextureStreamingStats totals = stats();
+        std::cout << "TextureStreamer: " << totals.textures_resident << " textures resident, decode "
+                  << totals.decode_ms_total << " ms (worker time), upload " << totals.upload_ms_total << " ms, "
+                  << (totals.bytes_uploaded_total >> 20) << " MB" << std::endl;
+    }
+}
+
+TextureStreamingStats TextureStreamer::stats() const
+/** Returns a copy of the statistics: the decode counters are updated by the worker threads. */
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void TextureStreamer::shutdown()
+/** Releases GL resources of the streamer, must be called before the OpenGL context is destroyed. */
+{
+    uploads_.clear();
+    for (GLsync &fence : slice_fences_)
+    {
+        if (fence)
+        {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+    if (unpack_buffer_ != 0)
+    {
+        if (persistent_mapping_ != nullptr)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpack_buffer_);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            persistent_mapping_ = nullptr;
+        }
+        glDeleteBuffers(1, &unpack_buffer_);
+        unpack_buffer_ = 0;
+    }
+}
+
+void TextureStreamer::finish()
+/** Uploads all requested textures, waiting for the ones that are still being decoded. For runs that need every
+texture resident from the first frame on, such as headless captures and benchmarks. */
+{
+    while (!isIdle())
+    {
+        update();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+bool TextureStreamer::isIdle()
+/** Returns true when all requested textures are resident. */
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_decodes_ == 0 && decoded_.empty() && uploads_.empty();
+}
+
+void TextureStreamer::createUnpackBuffer()
+/** Creates the pixel unpack buffer ring. With buffer storage support it's mapped persistently once,
+otherwise every slice is mapped unsynchronized right before it's written. */
+{
+    const GLsizeiptr size = static_cast<GLsizeiptr>(kSliceSize * kSliceCount);
+
+    glGenBuffers(1, &unpack_buffer_);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpack_buffer_);
+    if (GLExtensions::bufferStorage != nullptr)
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        GLExtensions::bufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+        persistent_mapping_ = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags));
+    }
+    else
+    {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void TextureStreamer::beginUpload(Upload upload)
+/** Allocates the full mip chain of the texture. The smallest mip level is filled with the average colour of the image
+and made the only visible level, so the texture shows a plausible colour until level 0 is streamed in. */
+{
+    if (upload.target == GL_TEXTURE_CUBE_MAP)
+    {
+        beginCubemapUpload(upload);
+        uploads_.push_back(std::move(upload));
+        return;
+    }
+    if (upload.image.compressed)
+    {
+        beginCompressedUpload(upload);
+        uploads_.push_back(std::move(upload));
+        return;
+    }
+
+    const TextureImage &image = upload.image;
+    const GLenum format = formatFor(image.channels);
+    const int levels = mipLevelCount(image.width, image.height);
+
+    RenderState::bindTexture(GL_TEXTURE_2D, upload.texture_id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int level = 0; level < levels; level++)
+    {
+        glTexImage2D(GL_TEXTURE_2D, level, format,
+                     std::max(1, image.width >> level), std::max(1, image.height >> level),
+                     0, format, GL_UNSIGNED_BYTE, level == levels - 1 ? image.average_color : nullptr);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, levels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    if (image.channels == 1)
+    {
+        // single channel images are sampled as grey
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+    }
+    uploads_.push_back(std::move(upload));
+}
+
+void TextureStreamer::beginCompressedUpload(Upload &upload)
+/** Allocates all levels of a compressed texture and uploads the smallest level right away. It's only a few bytes and already
+shows the right colour; larger levels become visible one after another as soon as each of them is streamed in. */
+{
+    const Ktx2File &file = *upload.image.compressed;
+    const GLenum format = compressedFormatFor(file.format());
+    const int levels = file.levelCount();
+
+    RenderState::bindTexture(GL_TEXTURE_2D, upload.texture_id);
+    for (int level = 0; level < levels; level++)
+    {
+        const Ktx2Level &data = file.level(level);
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, format, data.width, data.height, 0, static_cast<GLsizei>(data.size),
+                               level == levels - 1 ? data.data : nullptr);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, levels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    if (upload.image.channels == 1)
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+    }
+
+    const size_t bytes = file.level(levels - 1).size;
+    stats_.bytes_uploaded_frame += bytes;
+    stats_.bytes_uploaded_total += bytes;
+    upload.next_level = levels - 2;
+}
+
+void TextureStreamer::beginCubemapUpload(Upload &upload)
+/** Allocates all faces and mip levels of a cube map, in immutable storage where it's supported: then the driver never has
+to check the cube map for completeness again. The smallest level of every face is filled with the average colour of the
+face and made the only visible level until all faces are streamed in. */
+{
+    const int size = upload.image.width;
+    const int channels = upload.image.channels;
+    const GLenum format = formatFor(channels);
+    const GLenum internal_format = channels == 1 ? GL_R8 : (channels == 2 ? GL_RG8 : (channels == 4 ? GL_RGBA8 : GL_RGB8));
+    const int levels = mipLevelCount(size, size);
+
+    RenderState::bindTexture(GL_TEXTURE_CUBE_MAP, upload.texture_id);
+    if (GLExtensions::texStorage2D != nullptr)
+    {
+        GLExtensions::texStorage2D(GL_TEXTURE_CUBE_MAP, levels, internal_format, size, size);
+    }
+    else
+    {
+        for (int face = 0; face < CubemapFile::kFaceCount; face++)
+        {
+            for (int level = 0; level < levels; level++)
+            {
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, internal_format, std::max(1, size >> level),
+                             std::max(1, size >> level), 0, format, GL_UNSIGNED_BYTE, nullptr);
+            }
+        }
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int face = 0; face < CubemapFile::kFaceCount; face++)
+    {
+        const TextureImage &image = face == 0 ? upload.image : upload.next_faces[static_cast<size_t>(face - 1)];
+        glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, levels - 1, 0, 0, 1, 1, format, GL_UNSIGNED_BYTE, image.average_color);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, levels - 1);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    if (channels == 1)
+    {
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_SWIZZLE_G, GL_RED);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_SWIZZLE_B, GL_RED);
+    }
+}
+
+bool TextureStreamer::stageSlice(const unsigned char* source, size_t bytes, size_t &offset)
+/** Copies data into the next slice of the unpack buffer ring and leaves the buffer bound.
+Returns false if the slice is still being read by the GPU. */
+{
+    GLsync &fence = slice_fences_[next_slice_];
+    if (fence)
+    {
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+        {
+            return false;
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    offset = kSliceSize * static_cast<size_t>(next_slice_);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpack_buffer_);
+    if (persistent_mapping_ != nullptr)
+    {
+        std::memcpy(persistent_mapping_ + offset, source, bytes);
+    }
+    else
+    {
+        // the fence guarantees the GPU is done with this slice, so no implicit synchronization is needed
+        void* destination = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(bytes),
+                                             GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        std::memcpy(destination, source, bytes);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+    return true;
+}
+
+bool TextureStreamer::uploadSlice(Upload &upload, size_t &budget)
+/** Copies the next rows of the level being streamed into a slice of the unpack buffer ring and starts the transfer
+into the texture. That's always level 0 for uncompressed images, whose smaller levels are generated at the end;
+the faces of a cube map are streamed one after another. Returns false if the next slice is still being read by the GPU. */
+{
+    const TextureImage &image = upload.image;
+    const int level = image.compressed ? upload.next_level : 0;
+
+    // compressed data is copied in rows of 4x4 blocks
+    size_t row_size;
+    int row_count;
+    const unsigned char* level_data;
+    if (image.compressed)
+    {
+        const Ktx2Level &data = image.compressed->level(level);
+        row_count = (data.height + 3) / 4;
+        row_size = data.size / static_cast<size_t>(row_count);
+        level_data = data.data;
+    }
+    else
+    {
+        row_size = image.rowSize();
+        row_count = image.height;
+        level_data = image.pixels.get();
+    }
+
+    int rows = static_cast<int>(std::max<size_t>(1, std::min(budget, kSliceSize) / row_size));
+    rows = std::min(rows, row_count - upload.next_row);
+    const size_t bytes = row_size * static_cast<size_t>(rows);
+    const unsigned char* source = level_data + row_size * static_cast<size_t>(upload.next_row);
+
+    // a single row that doesn't fit into a slice is uploaded straight from client memory
+    const bool staged = bytes <= kSliceSize;
+    size_t offset = 0;
+    if (staged && !stageSlice(source, bytes, offset))
+    {
+        return false;
+    }
+    // with a pixel unpack buffer bound, the data argument is an offset into the buffer
+    const void* pixels = staged ? reinterpret_cast<const void*>(offset) : source;
+
+    RenderState::bindTexture(upload.target, upload.texture_id);
+    if (image.compressed)
+    {
+        const Ktx2Level &data = image.compressed->level(level);
+        const int y = upload.next_row * 4;
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, y, data.width, std::min(rows * 4, data.height - y),
+                                  compressedFormatFor(image.compressed->format()), static_cast<GLsizei>(bytes), pixels);
+    }
+    else
+    {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        const GLenum target = upload.target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + static_cast<GLenum>(upload.face) : GL_TEXTURE_2D;
+        glTexSubImage2D(target, 0, 0, upload.next_row, image.width, rows, formatFor(image.channels), GL_UNSIGNED_BYTE, pixels);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+    if (staged)
+    {
+        slice_fences_[next_slice_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        next_slice_ = (next_slice_ + 1) % kSliceCount;
+    }
+
+    upload.next_row += rows;
+    if (image.compressed && upload.next_row == row_count)
+    {
+        // the level is complete: show it and continue with the next larger one
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+        upload.next_level--;
+        upload.next_row = 0;
+    }
+
+    budget -= std::min(budget, bytes);
+    stats_.bytes_uploaded_frame += bytes;
+    stats_.bytes_uploaded_total += bytes;
+
+    if (!upload.image.compressed && upload.next_row == row_count && !upload.next_faces.empty())
+    {
+        // the face is complete, continue with the next one
+        upload.image = std::move(upload.next_faces.front());
+        upload.next_faces.pop_front();
+        upload.face++;
+        upload.next_row = 0;
+    }
+    return true;
+}
+
+void TextureStreamer::finishUpload(Upload &upload)
+/** Switches the texture from the placeholder mip to the uploaded level 0 and generates the remaining mip levels, of all
+faces of a cube map. Compressed textures come with all of their levels and are already complete at this point. */
+{
+    if (!upload.image.compressed)
+    {
+        const int levels = mipLevelCount(upload.image.width, upload.image.height);
+
+        RenderState::bindTexture(upload.target, upload.texture_id);
+        glTexParameteri(upload.target, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(upload.target, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glGenerateMipmap(upload.target);
+    }
+
+    stats_.textures_resident++;
+    if (upload.target == GL_TEXTURE_CUBE_MAP)
+    {
+        upload.cubemap_load.resident = true;
+        upload.cubemap_load.total_ms = millisecondsSince(upload.requested);
+        *upload.cubemap_stats = upload.cubemap_load;
+        std::cout << "TextureStreamer: cube map (" << upload.image.width << "x" << upload.image.height << " faces) resident "
+                  << upload.cubemap_load.total_ms << " ms after it was requested, uploaded in " << upload.upload_ms
+                  << " ms over " << upload.frames + 1 << " frames; per face decoded in";
+        for (double decode_ms : upload.cubemap_load.decode_ms)
+        {
+            std::cout << " " << decode_ms;
+        }
+        std::cout << " ms, uploaded in";
+        for (double upload_ms : upload.cubemap_load.upload_ms)
+        {
+            std::cout << " " << upload_ms;
+        }
+        std::cout << " ms" << std::endl;
+        return;
+    }
+    std::cout << "TextureStreamer: " << upload.image.filepath << " (" << upload.image.width << "x" << upload.image.height
+              << ") decoded in " << upload.image.decode_ms << " ms, uploaded in " << upload.upload_ms
+              << " ms over " << upload.frames + 1 << " frames" << std::endl;
+}
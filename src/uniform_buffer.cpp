@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "../include/uniform_buffer.h"
+#include "../include/gl_extensions.h"
+
+UniformBufferRing::UniformBufferRing(size_t block_size, int region_count)
+        : block_size_(block_size), region_count_(region_count), region_fences_(static_cast<size_t>(region_count), nullptr)
+/** Creates the buffer with one region per frame in flight. Regions start at multiples of the offset alignment
+the driver requires for glBindBufferRange. */
+{
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    const size_t align = static_cast<size_t>(std::max(alignment, 1));
+    region_stride_ = (block_size_ + align - 1) / align * align;
+    const GLsizeiptr size = static_cast<GLsizeiptr>(region_stride_ * static_cast<size_t>(region_count_));
+
+    glGenBuffers(1, &buffer_);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+    if (GLExtensions::bufferStorage != nullptr)
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        GLExtensions::bufferStorage(GL_UNIFORM_BUFFER, size, nullptr, flags);
+        persistent_mapping_ = static_cast<unsigned char*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags));
+    }
+    else
+    {
+        glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+UniformBufferRing::~UniformBufferRing()
+{
+    for (GLsync &fence : region_fences_)
+    {
+        if (fence)
+        {
+            glDeleteSync(fence);
+        }
+    }
+    if (persistent_mapping_ != nullptr)
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &buffer_);
+}
+
+void UniformBufferRing::write(const void* block, GLuint binding)
+/** Copies the block into the next region of the ring and binds that region to the binding point,
+where every program that declares the block reads it from. */
+{
+    const int region = next_region_;
+    waitForRegion(region);
+
+    const size_t offset = region_stride_ * static_cast<size_t>(region);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer_);
+    if (persistent_mapping_ != nullptr)
+    {
+        std::memcpy(persistent_mapping_ + offset, block, block_size_);
+    }
+    else
+    {
+        // the fence guarantees the GPU is done with this region, so no implicit synchronization is needed
+        void* destination = glMapBufferRange(GL_UNIFORM_BUFFER, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(block_size_),
+                                             GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        std::memcpy(destination, block, block_size_);
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer_, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(block_size_));
+
+    current_region_ = region;
+    next_region_ = (next_region_ + 1) % region_count_;
+}
+
+void UniformBufferRing::endFrame()
+/** Marks the region written last as in use by the draws issued since. Must be called after the last draw of the frame. */
+{
+    if (current_region_ < 0)
+    {
+        return;
+    }
+    GLsync &fence = region_fences_[static_cast<size_t>(current_region_)];
+    if (fence)
+    {
+        glDeleteSync(fence);
+    }
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void UniformBufferRing::waitForRegion(int region)
+/** Blocks until the GPU has finished the frame that read the region. With a region per frame in flight this only
+happens when the CPU runs more frames ahead than the driver queues anyway. */
+{
+    GLsync &fence = region_fences_[static_cast<size_t>(region)];
+    if (!fence)
+    {
+        return;
+    }
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while (true)
+    {
+        const GLenum result = glClientWaitSync(fence, flags, 1000000000);
+        if (result != GL_TIMEOUT_EXPIRED)
+        {
+            if (result == GL_WAIT_FAILED)
+            {
+                std::cerr << "UniformBufferRing: waiting for the GPU failed" << std::endl;
+            }
+            break;
+        }
+        flags = 0;
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+}
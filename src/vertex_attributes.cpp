@@ -0,0 +1,56 @@
+#include "../include/vertex_attributes.h"
+
+VertexFormatUniforms::VertexFormatUniforms(const ShaderProgram &program)
+        : position_offset(program.uniform<glm::vec3>("vertexFormat.position_offset")),
+          position_scale(program.uniform<glm::vec3>("vertexFormat.position_scale"))
+{
+}
+
+void VertexAttributes::setPointers(const VertexLayout &layout, size_t offset)
+{
+    for (GLuint location = 0; location < kMeshAttributeCount; location++)
+    {
+        const VertexAttributeLayout &attribute = layout.attribute(static_cast<MeshAttribute>(location));
+        GLenum type = GL_FLOAT;
+        GLboolean normalized = GL_FALSE;
+        switch (attribute.encoding)
+        {
+            case kVertexEncodingNone:
+                glDisableVertexAttribArray(location);
+                continue;
+            case kVertexEncodingUnorm16:
+                type = GL_UNSIGNED_SHORT;
+                normalized = GL_TRUE;
+                break;
+            case kVertexEncodingHalf:
+                type = GL_HALF_FLOAT;
+                break;
+            case kVertexEncodingOctahedral16:
+                type = GL_SHORT;
+                normalized = GL_TRUE;
+                break;
+            case kVertexEncodingInt2101010:
+                type = GL_INT_2_10_10_10_REV;
+                normalized = GL_TRUE;
+                break;
+            default:
+                break;
+        }
+        glVertexAttribPointer(location, static_cast<GLint>(attribute.components), type, normalized,
+                              static_cast<GLsizei>(layout.stride()), (void*)(offset + attribute.offset));
+        glEnableVertexAttribArray(location);
+    }
+}
+
+uint32_t VertexAttributes::shaderFeatures(const VertexLayout &layout)
+/** Octahedral normals are unfolded by the vertex shader, all other encodings are read as they are. */
+{
+    return layout.attribute(kMeshAttributeNormal).encoding == kVertexEncodingOctahedral16 ? kShaderFeatureOctahedralNormals : 0u;
+}
+
+void VertexAttributes::setUniforms(const ShaderProgram &program, const VertexFormatUniforms &uniforms, const VertexLayout &layout,
+                                   const VertexDequantization &dequantization)
+{
+    program.set(uniforms.position_offset, glm::vec3(dequantization.position_offset[0], dequantization.position_offset[1], dequantization.position_offset[2]));
+    program.set(uniforms.position_scale, glm::vec3(dequantization.position_scale[0], dequantization.position_scale[1], dequantization.position_scale[2]));
+}
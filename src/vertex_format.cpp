@@ -0,0 +1,387 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "../include/vertex_format.h"
+
+namespace
+{
+// components of every attribute in the coordinates of the mesh
+constexpr uint32_t kAttributeComponents[kMeshAttributeCount] = {3, 3, 2};
+
+uint32_t encodedSize(MeshAttribute attribute, VertexEncoding encoding)
+{
+    switch (encoding)
+    {
+        case kVertexEncodingFloat: return kAttributeComponents[attribute] * sizeof(float);
+        // 3 16-bit coordinates are padded to 8 bytes, so that the next attribute is aligned
+        case kVertexEncodingUnorm16: return (kAttributeComponents[attribute] + 1) / 2 * 2 * sizeof(uint16_t);
+        case kVertexEncodingHalf: return kAttributeComponents[attribute] * sizeof(uint16_t);
+        case kVertexEncodingOctahedral16: return 2 * sizeof(int16_t);
+        case kVertexEncodingInt2101010: return sizeof(uint32_t);
+        default: return 0;
+    }
+}
+
+void normalize(float vector[3])
+{
+    const float length = std::sqrt(vector[0] * vector[0] + vector[1] * vector[1] + vector[2] * vector[2]);
+    if (length > 0.0f)
+    {
+        vector[0] /= length;
+        vector[1] /= length;
+        vector[2] /= length;
+    }
+}
+
+float signOf(float value)
+{
+    return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+uint32_t encodeSnorm10(float value)
+{
+    const int component = static_cast<int>(std::lround(std::max(-1.0f, std::min(value, 1.0f)) * 511.0f));
+    return static_cast<uint32_t>(component) & 0x3FF;
+}
+
+float decodeSnorm10(uint32_t bits)
+{
+    int component = static_cast<int>(bits & 0x3FF);
+    if (component & 0x200)
+    {
+        component -= 0x400;
+    }
+    return std::max(static_cast<float>(component) / 511.0f, -1.0f);
+}
+}
+
+VertexLayout::VertexLayout(VertexEncoding position, VertexEncoding normal, VertexEncoding texcoord)
+{
+    const VertexEncoding encodings[kMeshAttributeCount] = {position, normal, texcoord};
+    for (uint32_t i = 0; i < kMeshAttributeCount; i++)
+    {
+        const MeshAttribute attribute = static_cast<MeshAttribute>(i);
+        VertexAttributeLayout &layout = attributes_[i];
+        layout.encoding = supports(attribute, encodings[i]) ? encodings[i] : kVertexEncodingFloat;
+        layout.offset = stride_;
+        switch (layout.encoding)
+        {
+            case kVertexEncodingNone: layout.components = 0; break;
+            case kVertexEncodingOctahedral16: layout.components = 2; break;
+            case kVertexEncodingInt2101010: layout.components = 4; break;
+            default: layout.components = kAttributeComponents[i]; break;
+        }
+        stride_ += encodedSize(attribute, layout.encoding);
+    }
+}
+
+bool VertexLayout::supports(MeshAttribute attribute, VertexEncoding encoding)
+{
+    switch (encoding)
+    {
+        case kVertexEncodingNone:
+        case kVertexEncodingFloat:
+            return true;
+        case kVertexEncodingUnorm16:
+            return attribute == kMeshAttributePosition || attribute == kMeshAttributeTexcoord;
+        case kVertexEncodingHalf:
+            return attribute == kMeshAttributeTexcoord;
+        case kVertexEncodingOctahedral16:
+        case kVertexEncodingInt2101010:
+            return attribute == kMeshAttributeNormal;
+        default:
+            return false;
+    }
+}
+
+VertexDequantization VertexLayout::dequantizationFor(const MeshBounds &bounds) const
+{
+    VertexDequantization dequantization;
+    if (attributes_[kMeshAttributePosition].encoding == kVertexEncodingUnorm16)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            dequantization.position_offset[k] = bounds.min[k];
+            dequantization.position_scale[k] = bounds.max[k] - bounds.min[k];
+        }
+    }
+    return dequantization;
+}
+
+uint16_t VertexCodec::encodeUnorm16(float value)
+{
+    return static_cast<uint16_t>(std::lround(std::max(0.0f, std::min(value, 1.0f)) * 65535.0f));
+}
+
+float VertexCodec::decodeUnorm16(uint16_t value)
+{
+    return static_cast<float>(value) / 65535.0f;
+}
+
+int16_t VertexCodec::encodeSnorm16(float value)
+{
+    return static_cast<int16_t>(std::lround(std::max(-1.0f, std::min(value, 1.0f)) * 32767.0f));
+}
+
+float VertexCodec::decodeSnorm16(int16_t value)
+{
+    return std::max(static_cast<float>(value) / 32767.0f, -1.0f);
+}
+
+uint16_t VertexCodec::encodeHalf(float value)
+/** Rebiases the exponent from 127 to 15 and rounds the mantissa from 23 to 10 bits; a carry out of the mantissa
+correctly moves on into the exponent. Values below the smallest normal half become subnormals. */
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    const int exponent = static_cast<int>((bits >> 23) & 0xFF);
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    if (exponent == 0xFF)
+    {
+        // infinity, or a quiet NaN
+        return static_cast<uint16_t>(sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0));
+    }
+    const int half_exponent = exponent - 127 + 15;
+    if (half_exponent >= 31)
+    {
+        return static_cast<uint16_t>(sign | 0x7C00);
+    }
+    if (half_exponent <= 0)
+    {
+        if (half_exponent < -10)
+        {
+            return sign;
+        }
+        mantissa |= 0x800000;
+        const int shift = 14 - half_exponent;
+        uint32_t half = mantissa >> shift;
+        const uint32_t remainder = mantissa & ((1u << shift) - 1);
+        const uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1)))
+        {
+            half++;
+        }
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    uint32_t half = (static_cast<uint32_t>(half_exponent) << 10) | (mantissa >> 13);
+    const uint32_t remainder = mantissa & 0x1FFF;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+    {
+        half++;
+    }
+    return static_cast<uint16_t>(sign | half);
+}
+
+float VertexCodec::decodeHalf(uint16_t value)
+{
+    const uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+    const uint32_t exponent = (value >> 10) & 0x1F;
+    const uint32_t mantissa = value & 0x3FF;
+
+    if (exponent == 0)
+    {
+        const float magnitude = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign != 0 ? -magnitude : magnitude;
+    }
+    const uint32_t bits = exponent == 0x1F ? sign | 0x7F800000 | (mantissa << 13)
+                                           : sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+void VertexCodec::encodeOctahedral(const float normal[3], int16_t encoded[2])
+/** Projects the normal onto the octahedron |x| + |y| + |z| = 1 and folds its lower half over the upper one, so that it
+covers the square [-1, 1]^2. Rounding both coordinates to nearest isn't always closest on the sphere, so all four
+combinations of rounding down and up are decoded and the best one is kept. */
+{
+    const float sum = std::abs(normal[0]) + std::abs(normal[1]) + std::abs(normal[2]);
+    if (sum <= 0.0f)
+    {
+        encoded[0] = encoded[1] = 0;
+        return;
+    }
+    float x = normal[0] / sum;
+    float y = normal[1] / sum;
+    if (normal[2] < 0.0f)
+    {
+        const float folded_x = (1.0f - std::abs(y)) * signOf(x);
+        y = (1.0f - std::abs(x)) * signOf(y);
+        x = folded_x;
+    }
+
+    float unit[3] = {normal[0], normal[1], normal[2]};
+    normalize(unit);
+    const float scaled_x = std::max(-1.0f, std::min(x, 1.0f)) * 32767.0f;
+    const float scaled_y = std::max(-1.0f, std::min(y, 1.0f)) * 32767.0f;
+    // compared by the distance, the cosine of angles this small is 1 in floats
+    float best = 5.0f;
+    for (float candidate_x : {std::floor(scaled_x), std::ceil(scaled_x)})
+    {
+        for (float candidate_y : {std::floor(scaled_y), std::ceil(scaled_y)})
+        {
+            const int16_t candidate[2] = {static_cast<int16_t>(candidate_x), static_cast<int16_t>(candidate_y)};
+            float decoded[3];
+            decodeOctahedral(candidate, decoded);
+            float distance = 0.0f;
+            for (int k = 0; k < 3; k++)
+            {
+                distance += (decoded[k] - unit[k]) * (decoded[k] - unit[k]);
+            }
+            if (distance < best)
+            {
+                best = distance;
+                encoded[0] = candidate[0];
+                encoded[1] = candidate[1];
+            }
+        }
+    }
+}
+
+void VertexCodec::decodeOctahedral(const int16_t encoded[2], float normal[3])
+/** Unfolds the lower half of the octahedron, which is where |x| + |y| > 1, and normalizes; the same as decodeNormal()
+of the vertex shaders. */
+{
+    normal[0] = decodeSnorm16(encoded[0]);
+    normal[1] = decodeSnorm16(encoded[1]);
+    normal[2] = 1.0f - std::abs(normal[0]) - std::abs(normal[1]);
+    const float fold = std::max(-normal[2], 0.0f);
+    normal[0] += normal[0] >= 0.0f ? -fold : fold;
+    normal[1] += normal[1] >= 0.0f ? -fold : fold;
+    normalize(normal);
+}
+
+uint32_t VertexCodec::encodeInt2101010(const float normal[3])
+{
+    return encodeSnorm10(normal[0]) | (encodeSnorm10(normal[1]) << 10) | (encodeSnorm10(normal[2]) << 20);
+}
+
+void VertexCodec::decodeInt2101010(uint32_t encoded, float normal[3])
+{
+    normal[0] = decodeSnorm10(encoded);
+    normal[1] = decodeSnorm10(encoded >> 10);
+    normal[2] = decodeSnorm10(encoded >> 20);
+}
+
+void VertexCodec::encode(const VertexLayout &layout, const VertexDequantization &dequantization,
+                         const VertexStream streams[kMeshAttributeCount], size_t count, uint8_t* vertices)
+{
+    const uint32_t stride = layout.stride();
+    std::memset(vertices, 0, count * stride);
+    for (uint32_t i = 0; i < kMeshAttributeCount; i++)
+    {
+        const VertexAttributeLayout &attribute = layout.attribute(static_cast<MeshAttribute>(i));
+        const VertexStream &stream = streams[i];
+        if (attribute.encoding == kVertexEncodingNone || stream.data == nullptr)
+        {
+            continue;
+        }
+        const uint32_t components = kAttributeComponents[i];
+        for (size_t v = 0; v < count; v++)
+        {
+            const float* source = stream.data + v * stream.stride;
+            uint8_t* target = vertices + v * stride + attribute.offset;
+            switch (attribute.encoding)
+            {
+                case kVertexEncodingFloat:
+                    std::memcpy(target, source, components * sizeof(float));
+                    break;
+                case kVertexEncodingUnorm16:
+                    for (uint32_t k = 0; k < components; k++)
+                    {
+                        float value = source[k];
+                        if (i == kMeshAttributePosition)
+                        {
+                            const float scale = dequantization.position_scale[k];
+                            value = scale > 0.0f ? (value - dequantization.position_offset[k]) / scale : 0.0f;
+                        }
+                        const uint16_t encoded = encodeUnorm16(value);
+                        std::memcpy(target + k * sizeof(uint16_t), &encoded, sizeof(encoded));
+                    }
+                    break;
+                case kVertexEncodingHalf:
+                    for (uint32_t k = 0; k < components; k++)
+                    {
+                        const uint16_t encoded = encodeHalf(source[k]);
+                        std::memcpy(target + k * sizeof(uint16_t), &encoded, sizeof(encoded));
+                    }
+                    break;
+                case kVertexEncodingOctahedral16:
+                {
+                    int16_t encoded[2];
+                    encodeOctahedral(source, encoded);
+                    std::memcpy(target, encoded, sizeof(encoded));
+                    break;
+                }
+                case kVertexEncodingInt2101010:
+                {
+                    const uint32_t encoded = encodeInt2101010(source);
+                    std::memcpy(target, &encoded, sizeof(encoded));
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+void VertexCodec::decode(const VertexLayout &layout, const VertexDequantization &dequantization, const uint8_t* vertex,
+                         float position[3], float normal[3], float texcoord[2])
+{
+    float* outputs[kMeshAttributeCount] = {position, normal, texcoord};
+    for (uint32_t i = 0; i < kMeshAttributeCount; i++)
+    {
+        const VertexAttributeLayout &attribute = layout.attribute(static_cast<MeshAttribute>(i));
+        const uint8_t* source = vertex + attribute.offset;
+        float* output = outputs[i];
+        const uint32_t components = kAttributeComponents[i];
+        std::fill(output, output + components, 0.0f);
+        switch (attribute.encoding)
+        {
+            case kVertexEncodingFloat:
+                std::memcpy(output, source, components * sizeof(float));
+                break;
+            case kVertexEncodingUnorm16:
+            case kVertexEncodingHalf:
+                for (uint32_t k = 0; k < components; k++)
+                {
+                    uint16_t encoded;
+                    std::memcpy(&encoded, source + k * sizeof(uint16_t), sizeof(encoded));
+                    output[k] = attribute.encoding == kVertexEncodingHalf ? decodeHalf(encoded) : decodeUnorm16(encoded);
+                }
+                break;
+            case kVertexEncodingOctahedral16:
+            {
+                int16_t encoded[2];
+                std::memcpy(encoded, source, sizeof(encoded));
+                decodeOctahedral(encoded, output);
+                break;
+            }
+            case kVertexEncodingInt2101010:
+            {
+                uint32_t encoded;
+                std::memcpy(&encoded, source, sizeof(encoded));
+                decodeInt2101010(encoded, output);
+                break;
+            }
+            default:
+                break;
+        }
+        if (i == kMeshAttributePosition)
+        {
+            for (uint32_t k = 0; k < components; k++)
+            {
+                output[k] = dequantization.position_offset[k] + dequantization.position_scale[k] * output[k];
+            }
+        }
+        else if (i == kMeshAttributeNormal && attribute.encoding != kVertexEncodingNone)
+        {
+            normalize(output);
+        }
+    }
+}
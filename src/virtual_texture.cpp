@@ -0,0 +1,311 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "../include/virtual_texture.h"
+#include "../include/render_state.h"
+#include "../include/texture_streamer.h"
+
+constexpr int VirtualTexture::kAtlasColumns;
+constexpr int VirtualTexture::kAtlasRows;
+constexpr int VirtualTexture::kFeedbackDivisor;
+constexpr size_t VirtualTexture::kPagesPerFrame;
+
+VirtualTextureUniforms::VirtualTextureUniforms(const ShaderProgram &program)
+        : atlas(program.uniform<int>("vt.atlas")),
+          indirection(program.uniform<int>("vt.indirection")),
+          virtual_size(program.uniform<glm::vec2>("vt.virtual_size")),
+          atlas_size(program.uniform<glm::vec2>("vt.atlas_size")),
+          page_size(program.uniform<float>("vt.page_size")),
+          border(program.uniform<float>("vt.border")),
+          max_level(program.uniform<float>("vt.max_level")),
+          lod_bias(program.uniform<float>("vt.lod_bias"))
+{
+}
+
+VirtualTexture::VirtualTexture(const std::string &filepath)
+/** Opens the page pyramid and creates the atlas and indirection textures. The pages of the coarsest level are loaded
+right away and never evicted, so that every part of the texture has something to show. Without a valid file
+the virtual texture stays unloaded. */
+{
+    if (!file_.open(filepath))
+    {
+        return;
+    }
+    const VirtualTextureLayout &layout = file_.layout();
+    const int top_level = layout.levelCount() - 1;
+    if (layout.pagesX(top_level) * layout.pagesY(top_level) > kAtlasColumns * kAtlasRows)
+    {
+        std::cerr << "VirtualTexture: the coarsest level of " << filepath << " doesn't fit into the page atlas" << std::endl;
+        file_.close();
+        return;
+    }
+    cache_.reset(new VirtualTextureCache(layout, kAtlasColumns, kAtlasRows));
+    format_ = TextureStreamer::formatFor(static_cast<int>(file_.header().channels));
+
+    // physical page atlas: no mip levels, pages of different levels are stored side by side
+    glGenTextures(1, &atlas_);
+    RenderState::bindTexture(GL_TEXTURE_2D, atlas_);
+    glTexImage2D(GL_TEXTURE_2D, 0, format_, kAtlasColumns * file_.tileSize(), kAtlasRows * file_.tileSize(), 0, format_, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if (format_ == GL_RED)
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+    }
+
+    // indirection texture: one texel per page, one mip level per level of the page pyramid, sampled without filtering
+    glGenTextures(1, &indirection_);
+    RenderState::bindTexture(GL_TEXTURE_2D, indirection_);
+    for (int level = 0; level < layout.levelCount(); level++)
+    {
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, layout.pagesX(level), layout.pagesY(level), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, top_level);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    for (int y = 0; y < layout.pagesY(top_level); y++)
+    {
+        for (int x = 0; x < layout.pagesX(top_level); x++)
+        {
+            const VirtualPageId page = VirtualTextureLayout::pageId(top_level, x, y);
+            uploadPage(page, cache_->allocate(page));
+            cache_->pin(page);
+        }
+    }
+    updateIndirection();
+
+    std::cout << "VirtualTexture: " << filepath << " (" << layout.width() << "x" << layout.height() << ", "
+              << layout.levelCount() << " levels, " << layout.pageCount() << " pages)" << std::endl;
+}
+
+VirtualTexture::~VirtualTexture()
+{
+    deleteFeedbackBuffer();
+    RenderState::forgetTexture(atlas_);
+    RenderState::forgetTexture(indirection_);
+    glDeleteTextures(1, &atlas_);
+    glDeleteTextures(1, &indirection_);
+}
+
+bool VirtualTexture::beginFeedback(int viewport_width, int viewport_height)
+/** Binds and clears the feedback framebuffer. Returns false while the previous feedback is still being read back,
+the feedback pass is skipped then. */
+{
+    if (!isLoaded() || feedback_fence_ != nullptr)
+    {
+        return false;
+    }
+
+    // the scene may be rendered into a framebuffer object instead of the window, e.g. in headless mode
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &saved_framebuffer_);
+    glGetIntegerv(GL_VIEWPORT, saved_viewport_);
+
+    const int width = std::max(1, viewport_width / kFeedbackDivisor);
+    const int height = std::max(1, viewport_height / kFeedbackDivisor);
+    if (width != feedback_width_ || height != feedback_height_)
+    {
+        createFeedbackBuffer(width, height);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, feedback_framebuffer_);
+    glViewport(0, 0, feedback_width_, feedback_height_);
+    // texels that no page is rendered to keep alpha 0
+    const GLuint clear_color[4] = {0, 0, 0, 0};
+    glClearBufferuiv(GL_COLOR, 0, clear_color);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    return true;
+}
+
+void VirtualTexture::endFeedback()
+/** Starts the asynchronous read back of the feedback framebuffer into a pixel pack buffer and restores the framebuffer
+the scene is rendered into. */
+{
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, feedback_pack_buffer_);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glReadPixels(0, 0, feedback_width_, feedback_height_, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, (void*)0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    feedback_fence_ = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(saved_framebuffer_));
+    glViewport(saved_viewport_[0], saved_viewport_[1], saved_viewport_[2], saved_viewport_[3]);
+}
+
+void VirtualTexture::update()
+/** Called once per frame on the GL thread. As soon as the read back of the last feedback is complete, the requested
+pages are handed to the cache and up to kPagesPerFrame missing pages are uploaded into the atlas. */
+{
+    if (!isLoaded() || feedback_fence_ == nullptr || glClientWaitSync(feedback_fence_, 0, 0) == GL_TIMEOUT_EXPIRED)
+    {
+        return;
+    }
+    glDeleteSync(feedback_fence_);
+    feedback_fence_ = nullptr;
+
+    cache_->beginFrame();
+    const size_t count = static_cast<size_t>(feedback_width_) * static_cast<size_t>(feedback_height_);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, feedback_pack_buffer_);
+    const void* texels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(count * 4 * sizeof(GLushort)), GL_MAP_READ_BIT);
+    if (texels != nullptr)
+    {
+        processFeedback(static_cast<const GLushort*>(texels), count);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    for (VirtualPageId page : cache_->takeMisses(kPagesPerFrame))
+    {
+        const int slot = cache_->allocate(page);
+        if (slot < 0)
+        {
+            // the atlas is too small for the pages visible in this frame
+            break;
+        }
+        uploadPage(page, slot);
+    }
+    if (cache_->pageTable().isDirty())
+    {
+        updateIndirection();
+    }
+
+    const VirtualTextureStats &stats = cache_->stats();
+    const bool converged = stats.pages_missed == stats.pages_uploaded;
+    if (converged && !converged_ && stats.pages_requested > 0)
+    {
+        std::cout << "VirtualTexture: " << stats.pages_requested << " pages requested, " << stats.pages_resident
+                  << " resident, all requested pages are loaded" << std::endl;
+    }
+    converged_ = converged;
+}
+
+void VirtualTexture::bind(const ShaderProgram &program, const VirtualTextureUniforms &uniforms, int atlas_unit, int indirection_unit) const
+/** Binds the atlas and indirection textures to the texture units and sets the uniforms of the sampling shader. */
+{
+    RenderState::bindTexture(atlas_unit, GL_TEXTURE_2D, atlas_);
+    RenderState::bindTexture(indirection_unit, GL_TEXTURE_2D, indirection_);
+
+    program.set(uniforms.atlas, atlas_unit);
+    program.set(uniforms.indirection, indirection_unit);
+    setUniforms(program, uniforms);
+    program.set(uniforms.lod_bias, 0.0f);
+}
+
+void VirtualTexture::bindFeedback(const ShaderProgram &program, const VirtualTextureUniforms &uniforms) const
+/** Sets the uniforms of the feedback shader. Screen-space derivatives in the feedback framebuffer are kFeedbackDivisor
+times larger than in the viewport, which the lod bias compensates. */
+{
+    setUniforms(program, uniforms);
+    program.set(uniforms.lod_bias, std::log2(static_cast<float>(kFeedbackDivisor)));
+}
+
+void VirtualTexture::setUniforms(const ShaderProgram &program, const VirtualTextureUniforms &uniforms) const
+{
+    const VirtualTextureLayout &layout = file_.layout();
+    program.set(uniforms.virtual_size, glm::vec2(static_cast<float>(layout.width()), static_cast<float>(layout.height())));
+    program.set(uniforms.atlas_size, glm::vec2(static_cast<float>(kAtlasColumns * file_.tileSize()), static_cast<float>(kAtlasRows * file_.tileSize())));
+    program.set(uniforms.page_size, static_cast<float>(layout.pageSize()));
+    program.set(uniforms.border, static_cast<float>(file_.header().border));
+    program.set(uniforms.max_level, static_cast<float>(layout.levelCount() - 1));
+}
+
+void VirtualTexture::createFeedbackBuffer(int width, int height)
+{
+    deleteFeedbackBuffer();
+    feedback_width_ = width;
+    feedback_height_ = height;
+
+    // page column, row, level and a coverage flag per texel
+    glGenTextures(1, &feedback_color_);
+    RenderState::bindTexture(GL_TEXTURE_2D, feedback_color_);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16UI, width, height, 0, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    // the texture is rendered to, it must not stay bound for sampling
+    RenderState::bindTexture(GL_TEXTURE_2D, 0);
+
+    glGenRenderbuffers(1, &feedback_depth_);
+    glBindRenderbuffer(GL_RENDERBUFFER, feedback_depth_);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &feedback_framebuffer_);
+    glBindFramebuffer(GL_FRAMEBUFFER, feedback_framebuffer_);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, feedback_color_, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedback_depth_);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cerr << "VirtualTexture: feedback framebuffer is incomplete" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    glGenBuffers(1, &feedback_pack_buffer_);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, feedback_pack_buffer_);
+    glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(width) * height * 4 * static_cast<GLsizeiptr>(sizeof(GLushort)), nullptr, GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void VirtualTexture::deleteFeedbackBuffer()
+{
+    if (feedback_fence_ != nullptr)
+    {
+        glDeleteSync(feedback_fence_);
+        feedback_fence_ = nullptr;
+    }
+    glDeleteFramebuffers(1, &feedback_framebuffer_);
+    RenderState::forgetTexture(feedback_color_);
+    glDeleteTextures(1, &feedback_color_);
+    glDeleteRenderbuffers(1, &feedback_depth_);
+    glDeleteBuffers(1, &feedback_pack_buffer_);
+    feedback_framebuffer_ = feedback_color_ = feedback_depth_ = feedback_pack_buffer_ = 0;
+    feedback_width_ = feedback_height_ = 0;
+}
+
+void VirtualTexture::processFeedback(const GLushort* texels, size_t count)
+/** Requests every page found in the feedback framebuffer. */
+{
+    const VirtualTextureLayout &layout = file_.layout();
+    for (size_t i = 0; i < count; i++)
+    {
+        const GLushort* texel = texels + i * 4;
+        if (texel[3] == 0)
+        {
+            continue;
+        }
+        const int level = std::min<int>(texel[2], layout.levelCount() - 1);
+        const int x = std::min<int>(texel[0], layout.pagesX(level) - 1);
+        const int y = std::min<int>(texel[1], layout.pagesY(level) - 1);
+        cache_->request(VirtualTextureLayout::pageId(level, x, y));
+    }
+}
+
+void VirtualTexture::uploadPage(VirtualPageId page, int slot)
+/** Copies the tile of the page, including its border, from the mapped file into its atlas slot. */
+{
+    const int tile_size = file_.tileSize();
+    RenderState::bindTexture(GL_TEXTURE_2D, atlas_);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % kAtlasColumns) * tile_size, (slot / kAtlasColumns) * tile_size, tile_size, tile_size,
+                    format_, GL_UNSIGNED_BYTE, file_.tileData(page));
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+void VirtualTexture::updateIndirection()
+/** Uploads all levels of the indirection texture. It's small: one texel per page. */
+{
+    const std::vector<std::vector<uint8_t>> levels = cache_->pageTable().buildIndirection();
+    const VirtualTextureLayout &layout = file_.layout();
+    RenderState::bindTexture(GL_TEXTURE_2D, indirection_);
+    for (int level = 0; level < layout.levelCount(); level++)
+    {
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, layout.pagesX(level), layout.pagesY(level), GL_RGBA, GL_UNSIGNED_BYTE,
+                        levels[static_cast<size_t>(level)].data());
+    }
+}
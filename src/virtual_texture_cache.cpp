@@ -0,0 +1,202 @@
+#include <algorithm>
+
+#include "../include/virtual_texture_cache.h"
+
+constexpr int VirtualTexturePageTable::kNotResident;
+
+VirtualTexturePageTable::VirtualTexturePageTable(const VirtualTextureLayout &layout, int atlas_columns)
+        : layout_(layout), atlas_columns_(atlas_columns), slots_(static_cast<size_t>(layout.pageCount()), kNotResident)
+{
+}
+
+void VirtualTexturePageTable::map(VirtualPageId page, int slot)
+{
+    slots_[static_cast<size_t>(layout_.pageIndex(page))] = slot;
+    dirty_ = true;
+}
+
+void VirtualTexturePageTable::unmap(VirtualPageId page)
+{
+    slots_[static_cast<size_t>(layout_.pageIndex(page))] = kNotResident;
+    dirty_ = true;
+}
+
+std::vector<std::vector<uint8_t>> VirtualTexturePageTable::buildIndirection()
+/** Returns one RGBA8 image per level with one texel per page: column and row of the atlas slot and the level of the page
+that is sampled in its place. Pages that aren't resident fall back to the closest resident page of a coarser level. */
+{
+    const int levels = layout_.levelCount();
+    std::vector<std::vector<uint8_t>> indirection(static_cast<size_t>(levels));
+    for (int level = levels - 1; level >= 0; level--)
+    {
+        const int pages_x = layout_.pagesX(level);
+        const int pages_y = layout_.pagesY(level);
+        std::vector<uint8_t> &entries = indirection[static_cast<size_t>(level)];
+        entries.assign(static_cast<size_t>(pages_x) * static_cast<size_t>(pages_y) * 4, 0);
+
+        for (int y = 0; y < pages_y; y++)
+        {
+            for (int x = 0; x < pages_x; x++)
+            {
+                uint8_t* entry = entries.data() + (static_cast<size_t>(y) * static_cast<size_t>(pages_x) + static_cast<size_t>(x)) * 4;
+                const int slot = slotOf(VirtualTextureLayout::pageId(level, x, y));
+                if (slot != kNotResident)
+                {
+                    entry[0] = static_cast<uint8_t>(slot % atlas_columns_);
+                    entry[1] = static_cast<uint8_t>(slot / atlas_columns_);
+                    entry[2] = static_cast<uint8_t>(level);
+                    entry[3] = 255;
+                }
+                else if (level + 1 < levels)
+                {
+                    const std::vector<uint8_t> &parents = indirection[static_cast<size_t>(level + 1)];
+                    const size_t parent = static_cast<size_t>(y / 2) * static_cast<size_t>(layout_.pagesX(level + 1)) + static_cast<size_t>(x / 2);
+                    std::copy(parents.begin() + static_cast<long>(parent * 4), parents.begin() + static_cast<long>(parent * 4 + 4), entry);
+                }
+            }
+        }
+    }
+    dirty_ = false;
+    return indirection;
+}
+
+VirtualTextureCache::VirtualTextureCache(const VirtualTextureLayout &layout, int atlas_columns, int atlas_rows)
+        : layout_(layout),
+          page_table_(layout, atlas_columns),
+          slots_(static_cast<size_t>(atlas_columns * atlas_rows)),
+          requested_in_frame_(static_cast<size_t>(layout.pageCount()), 0)
+{
+    // the slot with the lowest number is handed out first
+    for (int slot = atlas_columns * atlas_rows - 1; slot >= 0; slot--)
+    {
+        free_slots_.push_back(slot);
+    }
+}
+
+void VirtualTextureCache::beginFrame()
+/** Starts a new frame: resets the per-frame counters, pages requested from now on are protected from eviction. */
+{
+    frame_++;
+    misses_.clear();
+    const unsigned int resident = stats_.pages_resident;
+    stats_ = VirtualTextureStats();
+    stats_.pages_resident = resident;
+}
+
+void VirtualTextureCache::request(VirtualPageId page)
+/** Records that the page is needed for the current frame. Resident coarser pages covering it are kept alive as well,
+they are what's sampled while a missing page is being loaded. */
+{
+    const size_t index = static_cast<size_t>(layout_.pageIndex(page));
+    if (requested_in_frame_[index] == frame_)
+    {
+        return;
+    }
+    requested_in_frame_[index] = frame_;
+    stats_.pages_requested++;
+
+    if (page_table_.isResident(page))
+    {
+        stats_.pages_hit++;
+        touch(page_table_.slotOf(page));
+    }
+    else
+    {
+        stats_.pages_missed++;
+        misses_.push_back(page);
+    }
+
+    for (int level = VirtualTextureLayout::pageLevel(page) + 1; level < layout_.levelCount(); level++)
+    {
+        page = VirtualTextureLayout::parentOf(page);
+        if (page_table_.isResident(page))
+        {
+            touch(page_table_.slotOf(page));
+        }
+    }
+}
+
+std::vector<VirtualPageId> VirtualTextureCache::takeMisses(size_t max_count)
+/** Returns up to max_count missing pages of the current frame, coarse levels first: they cover more of the screen
+and are the fallback of the finer ones. Misses that are left out are reported again by the next feedback pass. */
+{
+    std::stable_sort(misses_.begin(), misses_.end(), [](VirtualPageId a, VirtualPageId b)
+    {
+        return VirtualTextureLayout::pageLevel(a) > VirtualTextureLayout::pageLevel(b);
+    });
+    if (misses_.size() > max_count)
+    {
+        misses_.resize(max_count);
+    }
+    std::vector<VirtualPageId> misses;
+    misses.swap(misses_);
+    return misses;
+}
+
+int VirtualTextureCache::allocate(VirtualPageId page)
+/** Assigns an atlas slot to the page, evicting the least recently used page if there is no free slot.
+Returns -1 when every slot is pinned or used in the current frame. */
+{
+    if (page_table_.isResident(page))
+    {
+        return page_table_.slotOf(page);
+    }
+
+    int slot;
+    if (!free_slots_.empty())
+    {
+        slot = free_slots_.back();
+        free_slots_.pop_back();
+        stats_.pages_resident++;
+    }
+    else
+    {
+        if (recently_used_.empty() || slots_[static_cast<size_t>(recently_used_.back())].last_used == frame_)
+        {
+            return -1;
+        }
+        slot = recently_used_.back();
+        recently_used_.pop_back();
+        slots_[static_cast<size_t>(slot)].listed = false;
+        page_table_.unmap(slots_[static_cast<size_t>(slot)].page);
+        stats_.pages_evicted++;
+    }
+
+    slots_[static_cast<size_t>(slot)].page = page;
+    page_table_.map(page, slot);
+    touch(slot);
+    stats_.pages_uploaded++;
+    return slot;
+}
+
+void VirtualTextureCache::pin(VirtualPageId page)
+/** Keeps a resident page in the atlas for good. */
+{
+    Slot &slot = slots_[static_cast<size_t>(page_table_.slotOf(page))];
+    if (slot.listed)
+    {
+        recently_used_.erase(slot.position);
+        slot.listed = false;
+    }
+    slot.pinned = true;
+}
+
+void VirtualTextureCache::touch(int slot)
+{
+    Slot &entry = slots_[static_cast<size_t>(slot)];
+    entry.last_used = frame_;
+    if (entry.pinned)
+    {
+        return;
+    }
+    if (entry.listed)
+    {
+        recently_used_.splice(recently_used_.begin(), recently_used_, entry.position);
+    }
+    else
+    {
+        recently_used_.push_front(slot);
+        entry.listed = true;
+    }
+    entry.position = recently_used_.begin();
+}
@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "../include/virtual_texture_file.h"
+
+constexpr int VirtualTextureLayout::kMaxLevels;
+constexpr uint32_t VirtualTextureFile::kVersion;
+
+namespace
+{
+const char kMagic[4] = {'P', '4', 'V', 'T'};
+// tiles start at a page boundary of the OS, so that reading one tile touches as few pages of the mapping as possible
+const uint64_t kPagesAlignment = 4096;
+
+bool isPowerOfTwo(int value)
+{
+    return value > 0 && (value & (value - 1)) == 0;
+}
+
+int log2Floor(int value)
+{
+    int log = 0;
+    while (value > 1)
+    {
+        value >>= 1;
+        log++;
+    }
+    return log;
+}
+}
+
+VirtualTextureLayout::VirtualTextureLayout(int width, int height, int page_size)
+        : width_(width), height_(height), page_size_(page_size)
+{
+    level_count_ = std::min(kMaxLevels, 1 + std::min(log2Floor(width / page_size), log2Floor(height / page_size)));
+    for (int level = 0; level < level_count_; level++)
+    {
+        first_page_[level + 1] = first_page_[level] + pagesX(level) * pagesY(level);
+    }
+}
+
+bool VirtualTextureLayout::isValid(int width, int height, int page_size)
+/** Checks that the image is split into a power-of-two number of pages in both directions, so that the pages of every
+level line up with the mip levels of the indirection texture. */
+{
+    if (page_size <= 0 || width % page_size != 0 || height % page_size != 0)
+    {
+        return false;
+    }
+    const int pages_x = width / page_size;
+    const int pages_y = height / page_size;
+    return isPowerOfTwo(pages_x) && isPowerOfTwo(pages_y) && pages_x <= 0x3FFF && pages_y <= 0x3FFF;
+}
+
+std::string VirtualTextureFile::pathFor(const std::string &image_filepath)
+/** Returns the path of the page pyramid that is stored next to the source image. */
+{
+    const size_t extension = image_filepath.rfind('.');
+    const size_t separator = image_filepath.find_last_of("/\\");
+    if (extension == std::string::npos || (separator != std::string::npos && extension < separator))
+    {
+        return image_filepath + ".vtex";
+    }
+    return image_filepath.substr(0, extension) + ".vtex";
+}
+
+bool VirtualTextureFile::write(const std::string &filepath, const ImageData &image, int page_size, int border)
+/** Splits the image and its mip levels into tiles and writes them level by level, row by row.
+Images are treated as equirectangular maps: borders wrap around horizontally and are clamped vertically. */
+{
+    if (!VirtualTextureLayout::isValid(image.width, image.height, page_size))
+    {
+        std::cerr << "VirtualTextureFile: " << image.width << "x" << image.height << " can't be split into a power-of-two number of "
+                  << page_size << "x" << page_size << " pages" << std::endl;
+        return false;
+    }
+    const VirtualTextureLayout layout(image.width, image.height, page_size);
+
+    VirtualTextureHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.width = static_cast<uint32_t>(image.width);
+    header.height = static_cast<uint32_t>(image.height);
+    header.page_size = static_cast<uint32_t>(page_size);
+    header.border = static_cast<uint32_t>(border);
+    header.channels = static_cast<uint32_t>(image.channels);
+    header.level_count = static_cast<uint32_t>(layout.levelCount());
+    header.page_count = static_cast<uint32_t>(layout.pageCount());
+    header.pages_offset = (sizeof(VirtualTextureHeader) + kPagesAlignment - 1) / kPagesAlignment * kPagesAlignment;
+
+    const std::string temporary_filepath = filepath + ".tmp";
+    std::ofstream file(temporary_filepath, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+        std::cerr << "VirtualTextureFile: unable to write " << filepath << std::endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    const std::vector<char> padding(header.pages_offset - sizeof(header), 0);
+    file.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+
+    const std::vector<ImageData> levels = TextureCodec::buildMipChain(image);
+    const int tile_size = page_size + 2 * border;
+    const size_t channels = static_cast<size_t>(image.channels);
+    std::vector<uint8_t> tile(static_cast<size_t>(tile_size) * static_cast<size_t>(tile_size) * channels);
+    for (int level = 0; level < layout.levelCount(); level++)
+    {
+        const ImageData &source = levels[static_cast<size_t>(level)];
+        for (int page_y = 0; page_y < layout.pagesY(level); page_y++)
+        {
+            for (int page_x = 0; page_x < layout.pagesX(level); page_x++)
+            {
+                for (int y = 0; y < tile_size; y++)
+                {
+                    const int source_y = std::min(std::max(page_y * page_size + y - border, 0), source.height - 1);
+                    for (int x = 0; x < tile_size; x++)
+                    {
+                        const int source_x = (page_x * page_size + x - border + source.width) % source.width;
+                        const uint8_t* texel = source.pixels.data() +
+                                (static_cast<size_t>(source_y) * static_cast<size_t>(source.width) + static_cast<size_t>(source_x)) * channels;
+                        std::memcpy(tile.data() + (static_cast<size_t>(y) * static_cast<size_t>(tile_size) + static_cast<size_t>(x)) * channels,
+                                    texel, channels);
+                    }
+                }
+                file.write(reinterpret_cast<const char*>(tile.data()), static_cast<std::streamsize>(tile.size()));
+            }
+        }
+    }
+    file.close();
+
+    if (!file || std::rename(temporary_filepath.c_str(), filepath.c_str()) != 0)
+    {
+        std::cerr << "VirtualTextureFile: unable to write " << filepath << std::endl;
+        std::remove(temporary_filepath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool VirtualTextureFile::open(const std::string &filepath)
+/** Maps the file and validates its header. Tiles are paged in by the OS when they are read. */
+{
+    close();
+    if (!file_.open(filepath))
+    {
+        return false;
+    }
+
+    if (file_.size() < sizeof(VirtualTextureHeader))
+    {
+        std::cerr << "VirtualTextureFile: " << filepath << " is too small" << std::endl;
+        close();
+        return false;
+    }
+    std::memcpy(&header_, file_.data(), sizeof(header_));
+    if (std::memcmp(header_.magic, kMagic, sizeof(kMagic)) != 0 || header_.version != kVersion ||
+        !VirtualTextureLayout::isValid(static_cast<int>(header_.width), static_cast<int>(header_.height), static_cast<int>(header_.page_size)) ||
+        header_.channels < 1 || header_.channels > 4)
+    {
+        std::cerr << "VirtualTextureFile: " << filepath << " is not a supported virtual texture" << std::endl;
+        close();
+        return false;
+    }
+
+    layout_ = VirtualTextureLayout(static_cast<int>(header_.width), static_cast<int>(header_.height), static_cast<int>(header_.page_size));
+    if (header_.level_count != static_cast<uint32_t>(layout_.levelCount()) || header_.page_count != static_cast<uint32_t>(layout_.pageCount()) ||
+        header_.pages_offset + tileBytes() * header_.page_count > file_.size())
+    {
+        std::cerr << "VirtualTextureFile: " << filepath << " is truncated" << std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void VirtualTextureFile::close()
+{
+    file_.close();
+    header_ = VirtualTextureHeader{};
+    layout_ = VirtualTextureLayout();
+}
+
+size_t VirtualTextureFile::tileBytes() const
+{
+    const size_t tile_size = static_cast<size_t>(tileSize());
+    return tile_size * tile_size * header_.channels;
+}
+
+const uint8_t* VirtualTextureFile::tileData(VirtualPageId page) const
+/** Returns the texels of a page with its border, rows ordered bottom to top. */
+{
+    return file_.data() + header_.pages_offset + tileBytes() * static_cast<size_t>(layout_.pageIndex(page));
+}
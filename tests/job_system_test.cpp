@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <thread>
+#include <vector>
+
+#include "../include/job_system.h"
+#include "test_check.h"
+
+namespace
+{
+void testParallelFor()
+/** Every item is visited exactly once, with ranges of any grain, including ranges run on the calling thread only. */
+{
+    JobSystem jobs(3);
+    for (size_t grain : {1, 7, 1000, 5000})
+    {
+        std::vector<std::atomic<int>> visits(1000);
+        jobs.parallelFor(visits.size(), grain, [&visits](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                visits[i]++;
+            }
+        });
+        CHECK(std::all_of(visits.begin(), visits.end(), [](const std::atomic<int> &count) { return count == 1; }));
+    }
+}
+
+void testNestedJobs()
+/** Jobs that wait for the jobs they started finish even with a single worker. */
+{
+    JobSystem jobs(1);
+    std::atomic<int> leaves{0};
+    JobCounter counter;
+    for (int i = 0; i < 8; i++)
+    {
+        jobs.run([&jobs, &leaves]() {
+            JobCounter children;
+            for (int k = 0; k < 8; k++)
+            {
+                jobs.run([&leaves]() { leaves++; }, children);
+            }
+            jobs.wait(children);
+        }, counter);
+    }
+    jobs.wait(counter);
+    CHECK(leaves == 64);
+}
+
+void testWaitSleeps()
+/** A thread waiting for a job that takes long sleeps instead of spinning: the process hardly uses the CPU meanwhile. */
+{
+    JobSystem jobs(2);
+    JobCounter counter;
+    std::atomic<bool> started{false};
+    jobs.run([&started]() {
+        started = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    }, counter);
+    // the job is left to a worker, so that there is nothing to run while waiting
+    while (!started)
+    {
+        std::this_thread::yield();
+    }
+    const std::clock_t start = std::clock();
+    jobs.wait(counter);
+    const double cpu_seconds = static_cast<double>(std::clock() - start) / CLOCKS_PER_SEC;
+    CHECK(counter.isDone());
+    CHECK(cpu_seconds < 0.1);
+}
+
+void testBackgroundJobs()
+/** Background jobs run on at most half of the workers and never on the waiting thread, and jobs queued behind them
+still run. */
+{
+    JobSystem jobs(4);
+    std::atomic<int> running{0};
+    std::atomic<int> most_running{0};
+    std::atomic<bool> on_waiting_thread{false};
+    std::atomic<bool> release{false};
+    const std::thread::id waiting_thread = std::this_thread::get_id();
+    JobCounter background;
+    for (int i = 0; i < 8; i++)
+    {
+        jobs.runBackground([&]() {
+            const int now = ++running;
+            int most = most_running.load();
+            while (now > most && !most_running.compare_exchange_weak(most, now))
+            {
+            }
+            on_waiting_thread = on_waiting_thread || std::this_thread::get_id() == waiting_thread;
+            while (!release)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            running--;
+        }, background);
+    }
+
+    std::atomic<int> frame_jobs{0};
+    JobCounter frame;
+    for (int i = 0; i < 16; i++)
+    {
+        jobs.run([&frame_jobs]() { frame_jobs++; }, frame);
+    }
+    jobs.wait(frame);
+    CHECK(frame_jobs == 16);
+    CHECK(!background.isDone());
+
+    // time for the idle workers to take more background jobs than they may
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    CHECK(running == 2);
+    release = true;
+    jobs.wait(background);
+    CHECK(most_running == 2);
+    CHECK(!on_waiting_thread);
+}
+
+void testDestructorFinishesBackgroundJobs()
+{
+    std::atomic<int> finished{0};
+    JobCounter counter;
+    {
+        JobSystem jobs(2);
+        for (int i = 0; i < 6; i++)
+        {
+            jobs.runBackground([&finished]() {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                finished++;
+            }, counter);
+        }
+    }
+    CHECK(finished == 6);
+    CHECK(counter.isDone());
+}
+}
+
+int main()
+/** Scheduling of the job system: parallel loops, nested jobs, sleeping waits and background jobs. */
+{
+    testParallelFor();
+    testNestedJobs();
+    testWaitSleeps();
+    testBackgroundJobs();
+    testDestructorFinishesBackgroundJobs();
+    return test::testResult();
+}
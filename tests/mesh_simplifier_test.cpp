@@ -0,0 +1,260 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "../include/mesh_simplifier.h"
+#include "test_check.h"
+
+namespace
+{
+const float kPi = 3.14159265358979f;
+
+struct Mesh
+{
+    std::vector<float> vertices;
+    std::vector<float> normals;
+    std::vector<float> texture_coordinates;
+    std::vector<unsigned int> indices;
+};
+
+Mesh uvSphere(int segments, int rings)
+/** Unit sphere with normals and texture coordinates. The first column of vertices is repeated with u = 1, which makes
+a seam, and the poles are single triangle fans. */
+{
+    Mesh mesh;
+    for (int r = 0; r <= rings; r++)
+    {
+        for (int s = 0; s <= segments; s++)
+        {
+            const float theta = kPi * static_cast<float>(r) / static_cast<float>(rings);
+            const float phi = 2.0f * kPi * static_cast<float>(s % segments) / static_cast<float>(segments);
+            const bool pole = r == 0 || r == rings;
+            const float x = pole ? 0.0f : std::sin(theta) * std::cos(phi);
+            const float y = std::cos(theta);
+            const float z = pole ? 0.0f : std::sin(theta) * std::sin(phi);
+            mesh.vertices.insert(mesh.vertices.end(), {x, y, z});
+            mesh.normals.insert(mesh.normals.end(), {x, y, z});
+            mesh.texture_coordinates.insert(mesh.texture_coordinates.end(),
+                                            {static_cast<float>(s) / static_cast<float>(segments), static_cast<float>(r) / static_cast<float>(rings)});
+        }
+    }
+    for (int r = 0; r < rings; r++)
+    {
+        for (int s = 0; s < segments; s++)
+        {
+            const unsigned int a = static_cast<unsigned int>(r * (segments + 1) + s);
+            const unsigned int b = a + 1;
+            const unsigned int c = a + static_cast<unsigned int>(segments) + 1;
+            const unsigned int d = c + 1;
+            if (r > 0)
+            {
+                mesh.indices.insert(mesh.indices.end(), {a, b, c});
+            }
+            if (r < rings - 1)
+            {
+                mesh.indices.insert(mesh.indices.end(), {b, d, c});
+            }
+        }
+    }
+    return mesh;
+}
+
+Mesh flatGrid(int size)
+/** Square of size x size units in the plane z = 0, with an open border. */
+{
+    Mesh mesh;
+    for (int y = 0; y <= size; y++)
+    {
+        for (int x = 0; x <= size; x++)
+        {
+            mesh.vertices.insert(mesh.vertices.end(), {static_cast<float>(x), static_cast<float>(y), 0.0f});
+            mesh.normals.insert(mesh.normals.end(), {0.0f, 0.0f, 1.0f});
+        }
+    }
+    for (int y = 0; y < size; y++)
+    {
+        for (int x = 0; x < size; x++)
+        {
+            const unsigned int a = static_cast<unsigned int>(y * (size + 1) + x);
+            const unsigned int c = a + static_cast<unsigned int>(size) + 1;
+            mesh.indices.insert(mesh.indices.end(), {a, a + 1, c + 1, a, c + 1, c});
+        }
+    }
+    return mesh;
+}
+
+double distanceToSegment(const double* p, const double* a, const double* b)
+{
+    double ab[3];
+    double ap[3];
+    double length = 0.0;
+    double along = 0.0;
+    for (int k = 0; k < 3; k++)
+    {
+        ab[k] = b[k] - a[k];
+        ap[k] = p[k] - a[k];
+        length += ab[k] * ab[k];
+        along += ab[k] * ap[k];
+    }
+    const double t = length > 0.0 ? std::max(0.0, std::min(1.0, along / length)) : 0.0;
+    double squared_distance = 0.0;
+    for (int k = 0; k < 3; k++)
+    {
+        squared_distance += (ap[k] - t * ab[k]) * (ap[k] - t * ab[k]);
+    }
+    return std::sqrt(squared_distance);
+}
+
+double distanceToTriangle(const float* point, const float* a, const float* b, const float* c)
+/** Distance from the plane of the triangle if the point projects inside it, from the closest edge otherwise. */
+{
+    const double p[3] = {point[0], point[1], point[2]};
+    const double corners[3][3] = {{a[0], a[1], a[2]}, {b[0], b[1], b[2]}, {c[0], c[1], c[2]}};
+    const double e1[3] = {corners[1][0] - corners[0][0], corners[1][1] - corners[0][1], corners[1][2] - corners[0][2]};
+    const double e2[3] = {corners[2][0] - corners[0][0], corners[2][1] - corners[0][1], corners[2][2] - corners[0][2]};
+    const double normal[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+    const double area2 = normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2];
+    if (area2 > 0.0)
+    {
+        // the point projects inside if it's on the inner side of all three edges
+        bool inside = true;
+        for (int k = 0; k < 3 && inside; k++)
+        {
+            const double* from = corners[k];
+            const double* to = corners[(k + 1) % 3];
+            const double edge[3] = {to[0] - from[0], to[1] - from[1], to[2] - from[2]};
+            const double offset[3] = {p[0] - from[0], p[1] - from[1], p[2] - from[2]};
+            const double side[3] = {edge[1] * offset[2] - edge[2] * offset[1], edge[2] * offset[0] - edge[0] * offset[2], edge[0] * offset[1] - edge[1] * offset[0]};
+            inside = side[0] * normal[0] + side[1] * normal[1] + side[2] * normal[2] >= 0.0;
+        }
+        if (inside)
+        {
+            const double offset[3] = {p[0] - corners[0][0], p[1] - corners[0][1], p[2] - corners[0][2]};
+            return std::abs(offset[0] * normal[0] + offset[1] * normal[1] + offset[2] * normal[2]) / std::sqrt(area2);
+        }
+    }
+    return std::min({distanceToSegment(p, corners[0], corners[1]), distanceToSegment(p, corners[1], corners[2]),
+                     distanceToSegment(p, corners[2], corners[0])});
+}
+
+double measureDeviation(const Mesh &mesh, const MeshLod &lod)
+/** Largest distance of a vertex of the full mesh from the surface of the level of detail, by brute force. */
+{
+    double deviation = 0.0;
+    for (size_t v = 0; v < mesh.vertices.size() / 3; v++)
+    {
+        double distance = 1e30;
+        for (size_t i = lod.index_offset; i < lod.index_offset + lod.index_count; i += 3)
+        {
+            distance = std::min(distance, distanceToTriangle(&mesh.vertices[3 * v], &mesh.vertices[3 * size_t(mesh.indices[i])],
+                                                             &mesh.vertices[3 * size_t(mesh.indices[i + 1])],
+                                                             &mesh.vertices[3 * size_t(mesh.indices[i + 2])]));
+        }
+        deviation = std::max(deviation, distance);
+    }
+    return deviation;
+}
+
+double areaOf(const Mesh &mesh, const MeshLod &lod)
+{
+    double area = 0.0;
+    for (size_t i = lod.index_offset; i < lod.index_offset + lod.index_count; i += 3)
+    {
+        const float* a = &mesh.vertices[3 * size_t(mesh.indices[i])];
+        const float* b = &mesh.vertices[3 * size_t(mesh.indices[i + 1])];
+        const float* c = &mesh.vertices[3 * size_t(mesh.indices[i + 2])];
+        area += 0.5 * ((b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]));
+    }
+    return area;
+}
+
+void checkLodChain(const Mesh &mesh, const std::vector<MeshLod> &lods, size_t full_index_count)
+/** Levels are consecutive ranges of valid indices, each with at most half the triangles of the previous one (the
+ratio buildLodChain asks for) and not far fewer, with an error that never decreases and bounds the deviation. */
+{
+    CHECK(!lods.empty());
+    CHECK(lods[0].index_offset == 0 && lods[0].index_count == full_index_count && lods[0].error == 0.0f);
+    const size_t vertex_count = mesh.vertices.size() / 3;
+    CHECK(std::all_of(mesh.indices.begin(), mesh.indices.end(), [vertex_count](unsigned int index) { return index < vertex_count; }));
+    for (size_t l = 1; l < lods.size(); l++)
+    {
+        const size_t triangles = lods[l].index_count / 3;
+        const size_t previous_triangles = lods[l - 1].index_count / 3;
+        CHECK(lods[l].index_offset == lods[l - 1].index_offset + lods[l - 1].index_count);
+        CHECK(lods[l].index_count % 3 == 0);
+        CHECK(triangles <= previous_triangles / 2);
+        CHECK(triangles >= previous_triangles * 2 / 5);
+        CHECK(lods[l].error >= lods[l - 1].error);
+
+        const double deviation = measureDeviation(mesh, lods[l]);
+        CHECK(deviation <= lods[l].error * (1.0 + 1e-5) + 1e-7);
+    }
+    CHECK(lods.back().index_offset + lods.back().index_count == mesh.indices.size());
+}
+
+void testSphere()
+/** A curved mesh simplifies into all levels, with a growing error that isn't far from the deviation it bounds. */
+{
+    Mesh mesh = uvSphere(64, 32);
+    const size_t full_index_count = mesh.indices.size();
+    std::vector<MeshLod> lods;
+    MeshSimplifier::buildLodChain(mesh.vertices, mesh.normals, mesh.texture_coordinates, mesh.indices, lods);
+    CHECK(lods.size() == MeshSimplifier::kMaxLods);
+    checkLodChain(mesh, lods, full_index_count);
+    for (size_t l = 1; l < lods.size(); l++)
+    {
+        CHECK(lods[l].error > 0.0f);
+        CHECK(lods[l].error <= 2.0 * measureDeviation(mesh, lods[l]));
+    }
+    // the coarsest level of a unit sphere is still a closed ball, not much smaller
+    CHECK(lods.back().error < 0.25f);
+}
+
+void testFlatGrid()
+/** A flat grid simplifies without any error, and its open border keeps the area of the square. */
+{
+    Mesh mesh = flatGrid(20);
+    const size_t full_index_count = mesh.indices.size();
+    std::vector<MeshLod> lods;
+    MeshSimplifier::buildLodChain(mesh.vertices, mesh.normals, mesh.texture_coordinates, mesh.indices, lods);
+    CHECK(lods.size() == MeshSimplifier::kMaxLods);
+    checkLodChain(mesh, lods, full_index_count);
+    for (const MeshLod &lod : lods)
+    {
+        CHECK(lod.error < 1e-4f);
+        CHECK(std::abs(areaOf(mesh, lod) - 400.0) < 1e-3);
+    }
+}
+
+void testSimplifyTarget()
+/** simplify() gets down to the target, or stops at max_error with an error that still bounds the deviation. */
+{
+    const Mesh mesh = uvSphere(32, 16);
+    for (size_t target : {mesh.indices.size() / 2 / 3 * 3, mesh.indices.size() / 8 / 3 * 3})
+    {
+        std::vector<unsigned int> simplified;
+        const float error = MeshSimplifier::simplify(mesh.vertices, mesh.normals, mesh.texture_coordinates, mesh.indices,
+                                                     target, 1e9f, simplified);
+        CHECK(simplified.size() <= target);
+        CHECK(simplified.size() % 3 == 0);
+
+        Mesh simplified_mesh = mesh;
+        simplified_mesh.indices = simplified;
+        const MeshLod lod{0, static_cast<uint32_t>(simplified.size()), error};
+        CHECK(measureDeviation(simplified_mesh, lod) <= error * (1.0 + 1e-5));
+    }
+
+    std::vector<unsigned int> unchanged;
+    MeshSimplifier::simplify(mesh.vertices, mesh.normals, mesh.texture_coordinates, mesh.indices, 0, 0.0f, unchanged);
+    CHECK(unchanged.size() == mesh.indices.size());
+}
+}
+
+int main()
+/** Triangle reduction and error bounds of the levels of detail of MeshSimplifier. */
+{
+    testSphere();
+    testFlatGrid();
+    testSimplifyTarget();
+    return test::testResult();
+}
@@ -0,0 +1,39 @@
+#ifndef PROJECT_4_TEST_CHECK_H
+#define PROJECT_4_TEST_CHECK_H
+
+#include <iostream>
+
+// Minimal checks for the CPU tests run by ctest. A failed CHECK prints its file, line and condition and the test goes
+// on; the test returns testResult() from main, which is 1 if any check failed.
+namespace test
+{
+inline int& failures()
+{
+    static int count = 0;
+    return count;
+}
+
+inline bool check(bool passed, const char* condition, const char* file, int line)
+{
+    if (!passed)
+    {
+        std::cerr << file << ":" << line << ": check failed: " << condition << std::endl;
+        failures()++;
+    }
+    return passed;
+}
+
+inline int testResult()
+{
+    if (failures() > 0)
+    {
+        std::cerr << failures() << " check(s) failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+}
+
+#define CHECK(condition) test::check((condition), #condition, __FILE__, __LINE__)
+
+#endif //PROJECT_4_TEST_CHECK_H
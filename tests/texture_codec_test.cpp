@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "../include/ktx2.h"
+#include "../include/texture_codec.h"
+#include "test_check.h"
+
+namespace
+{
+const char* kTestFile = "texture_codec_test.ktx2";
+
+void solidBlock(const uint8_t colour[4], uint8_t rgba[64])
+{
+    for (int i = 0; i < 16; i++)
+    {
+        std::copy(colour, colour + 4, rgba + i * 4);
+    }
+}
+
+void gradientBlock(const uint8_t from[4], const uint8_t to[4], bool diagonal, uint8_t rgba[64])
+/** Texels on the line from one colour to the other: 4 steps along x, or 7 steps along x + y. */
+{
+    for (int y = 0; y < 4; y++)
+    {
+        for (int x = 0; x < 4; x++)
+        {
+            const float t = diagonal ? static_cast<float>(x + y) / 6.0f : static_cast<float>(x) / 3.0f;
+            for (int c = 0; c < 4; c++)
+            {
+                rgba[(y * 4 + x) * 4 + c] = static_cast<uint8_t>(std::lround(from[c] + t * (to[c] - from[c])));
+            }
+        }
+    }
+}
+
+bool withinBound(const uint8_t* original, const uint8_t* decoded, int stride, int first_channel, int channel_count,
+                 float palette_steps, int quantization)
+/** Every channel of every texel is at most half a palette step from the original, plus the quantization of the
+endpoints. On a block whose texels lie on a line the palette spans their range, so a step is range / palette_steps. */
+{
+    bool passed = true;
+    for (int c = first_channel; c < first_channel + channel_count; c++)
+    {
+        int low = 255;
+        int high = 0;
+        int error = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            low = std::min(low, static_cast<int>(original[i * stride + c]));
+            high = std::max(high, static_cast<int>(original[i * stride + c]));
+            error = std::max(error, std::abs(original[i * stride + c] - decoded[i * stride + c]));
+        }
+        const float bound = static_cast<float>(high - low) / (2.0f * palette_steps) + static_cast<float>(quantization);
+        if (static_cast<float>(error) > bound)
+        {
+            std::fprintf(stderr, "channel %d: error %d over the bound %.1f\n", c, error, bound);
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+std::vector<std::vector<uint8_t>> testBlocks()
+/** Solid blocks and gradients along and across the block, including one whose axis is orthogonal to grey. */
+{
+    const uint8_t colours[][4] = {{0, 0, 0, 255}, {255, 255, 255, 0}, {200, 40, 90, 128}, {17, 130, 250, 30}, {128, 128, 128, 255}};
+    const uint8_t gradients[][2][4] = {{{0, 0, 0, 0}, {255, 255, 255, 255}},
+                                       {{255, 0, 0, 255}, {0, 0, 255, 0}},
+                                       {{0, 255, 255, 40}, {255, 0, 0, 220}},
+                                       {{100, 110, 120, 130}, {140, 130, 120, 110}},
+                                       {{30, 200, 60, 0}, {90, 20, 240, 90}}};
+    std::vector<std::vector<uint8_t>> blocks;
+    std::vector<uint8_t> rgba(64);
+    for (const auto &colour : colours)
+    {
+        solidBlock(colour, rgba.data());
+        blocks.push_back(rgba);
+    }
+    for (const auto &gradient : gradients)
+    {
+        for (bool diagonal : {false, true})
+        {
+            gradientBlock(gradient[0], gradient[1], diagonal, rgba.data());
+            blocks.push_back(rgba);
+        }
+    }
+    return blocks;
+}
+
+void testBlockRoundTrips()
+/** Encoding then decoding a block keeps every channel within half a step of the format's palette, plus the
+quantization of its endpoints: 4 colours of 5:6:5 bits (BC1, the colour of BC3), 8 values of 8 bits (BC4, the alpha of
+BC3) and 16 colours of 7 bits with a shared bit (BC7 mode 6). */
+{
+    uint8_t block[16];
+    uint8_t decoded[64];
+    for (const std::vector<uint8_t> &rgba : testBlocks())
+    {
+        TextureCodec::encodeBlockBC1(rgba.data(), block);
+        TextureCodec::decodeBlockBC1(block, decoded);
+        CHECK(withinBound(rgba.data(), decoded, 4, 0, 3, 3.0f, 5));
+        bool opaque = true;
+        for (int i = 0; i < 16; i++)
+        {
+            opaque = opaque && decoded[i * 4 + 3] == 255;
+        }
+        CHECK(opaque);
+
+        TextureCodec::encodeBlockBC3(rgba.data(), block);
+        TextureCodec::decodeBlockBC3(block, decoded);
+        CHECK(withinBound(rgba.data(), decoded, 4, 0, 3, 3.0f, 5));
+        CHECK(withinBound(rgba.data(), decoded, 4, 3, 1, 7.0f, 1));
+
+        uint8_t values[16];
+        uint8_t decoded_values[16];
+        for (int i = 0; i < 16; i++)
+        {
+            values[i] = rgba[static_cast<size_t>(i) * 4 + 1];
+        }
+        TextureCodec::encodeBlockBC4(values, block);
+        TextureCodec::decodeBlockBC4(block, decoded_values);
+        CHECK(withinBound(values, decoded_values, 1, 0, 1, 7.0f, 1));
+
+        TextureCodec::encodeBlockBC7(rgba.data(), block);
+        CHECK(TextureCodec::decodeBlockBC7(block, decoded));
+        CHECK(withinBound(rgba.data(), decoded, 4, 0, 4, 15.0f, 2));
+    }
+}
+
+void testSolidBlocksAreExact()
+/** Single values of BC4 and grey levels of BC7 are reproduced exactly. The shared bit of a BC7 endpoint is the lowest bit
+of all four channels, so the alpha of the grey level is the level itself. */
+{
+    uint8_t block[16];
+    uint8_t decoded[64];
+    for (int value = 0; value < 256; value++)
+    {
+        uint8_t values[16];
+        std::fill(values, values + 16, static_cast<uint8_t>(value));
+        TextureCodec::encodeBlockBC4(values, block);
+        TextureCodec::decodeBlockBC4(block, decoded);
+        CHECK(std::all_of(decoded, decoded + 16, [value](uint8_t decoded_value) { return decoded_value == value; }));
+
+        const uint8_t colour[4] = {static_cast<uint8_t>(value), static_cast<uint8_t>(value), static_cast<uint8_t>(value), static_cast<uint8_t>(value)};
+        uint8_t rgba[64];
+        solidBlock(colour, rgba);
+        TextureCodec::encodeBlockBC7(rgba, block);
+        TextureCodec::decodeBlockBC7(block, decoded);
+        CHECK(std::equal(rgba, rgba + 64, decoded));
+    }
+}
+
+ImageData smoothImage(int width, int height, int channels)
+{
+    ImageData image;
+    image.width = width;
+    image.height = height;
+    image.channels = channels;
+    image.pixels.resize(static_cast<size_t>(width) * static_cast<size_t>(height) * static_cast<size_t>(channels));
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            for (int c = 0; c < channels; c++)
+            {
+                image.pixels[(static_cast<size_t>(y) * static_cast<size_t>(width) + static_cast<size_t>(x)) * static_cast<size_t>(channels) + static_cast<size_t>(c)] =
+                        static_cast<uint8_t>(127.5 + 127.5 * std::sin(0.07 * x * (c + 1) + 0.05 * y));
+            }
+        }
+    }
+    return image;
+}
+
+void testImageRoundTrips()
+/** Whole images, with partial blocks along the edges, compress to the expected size and keep their quality. */
+{
+    const ImageData image = smoothImage(66, 50, 4);
+    const struct
+    {
+        TextureFormat format;
+        int channels;
+        double min_psnr;
+    } cases[] = {{kTextureFormatBC1, 3, 32.0}, {kTextureFormatBC3, 4, 32.0}, {kTextureFormatBC4, 1, 44.0}, {kTextureFormatBC7, 4, 36.0}};
+    for (const auto &test_case : cases)
+    {
+        const std::vector<uint8_t> compressed = TextureCodec::compress(image, test_case.format);
+        CHECK(compressed.size() == TextureCodec::compressedSize(test_case.format, 66, 50));
+        CHECK(compressed.size() == TextureCodec::blockSize(test_case.format) * 17 * 13);
+
+        const ImageData decoded = TextureCodec::decompress(compressed.data(), 66, 50, test_case.format);
+        CHECK(decoded.width == 66 && decoded.height == 50);
+        CHECK(TextureCodec::psnr(image, decoded, test_case.channels) >= test_case.min_psnr);
+    }
+}
+
+std::vector<uint8_t> readFile(const std::string &filepath)
+{
+    std::ifstream file(filepath, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void writeFile(const std::string &filepath, const std::vector<uint8_t> &bytes)
+{
+    std::ofstream file(filepath, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+}
+
+void testKtx2RoundTrip()
+/** A mip chain written to a KTX2 file is read back with the same format, sizes and data. */
+{
+    const std::vector<ImageData> mips = TextureCodec::buildMipChain(smoothImage(40, 24, 4));
+    CHECK(mips.size() == 6);
+    for (TextureFormat format : {kTextureFormatBC1, kTextureFormatBC3, kTextureFormatBC4, kTextureFormatBC7})
+    {
+        std::vector<std::vector<uint8_t>> levels;
+        for (const ImageData &mip : mips)
+        {
+            levels.push_back(TextureCodec::compress(mip, format));
+        }
+        CHECK(Ktx2File::write(kTestFile, format, 40, 24, levels));
+
+        Ktx2File file;
+        CHECK(file.open(kTestFile));
+        CHECK(file.format() == format);
+        CHECK(file.width() == 40 && file.height() == 24);
+        CHECK(file.levelCount() == static_cast<int>(levels.size()));
+        for (int i = 0; i < file.levelCount() && i < static_cast<int>(levels.size()); i++)
+        {
+            const Ktx2Level &level = file.level(i);
+            const std::vector<uint8_t> &expected = levels[static_cast<size_t>(i)];
+            CHECK(level.width == mips[static_cast<size_t>(i)].width && level.height == mips[static_cast<size_t>(i)].height);
+            CHECK(level.size == expected.size() && std::equal(expected.begin(), expected.end(), level.data));
+        }
+        file.close();
+        CHECK(!file.isOpen());
+    }
+    std::remove(kTestFile);
+}
+
+void testKtx2Rejects()
+/** Missing files, other files, truncated files and level indices that don't match the texture are rejected. */
+{
+    Ktx2File file;
+    CHECK(!file.open("texture_codec_test_missing.ktx2"));
+
+    const ImageData image = smoothImage(16, 16, 4);
+    CHECK(Ktx2File::write(kTestFile, kTextureFormatBC1, 16, 16, {TextureCodec::compress(image, kTextureFormatBC1)}));
+    const std::vector<uint8_t> valid = readFile(kTestFile);
+    CHECK(file.open(kTestFile));
+    file.close();
+
+    std::vector<uint8_t> bad_magic = valid;
+    bad_magic[1] = 'X';
+    writeFile(kTestFile, bad_magic);
+    CHECK(!file.open(kTestFile));
+    CHECK(!file.isOpen());
+
+    // the level data is the end of the file
+    writeFile(kTestFile, std::vector<uint8_t>(valid.begin(), valid.end() - 1));
+    CHECK(!file.open(kTestFile));
+    writeFile(kTestFile, std::vector<uint8_t>(valid.begin(), valid.begin() + 60));
+    CHECK(!file.open(kTestFile));
+
+    // the byte length of level 0 follows its offset in the level index, which starts at byte 80
+    std::vector<uint8_t> wrong_length = valid;
+    wrong_length[88] = static_cast<uint8_t>(wrong_length[88] - 8);
+    writeFile(kTestFile, wrong_length);
+    CHECK(!file.open(kTestFile));
+
+    std::vector<uint8_t> wrong_size = valid;
+    wrong_size[20] = 32;
+    writeFile(kTestFile, wrong_size);
+    CHECK(!file.open(kTestFile));
+    std::remove(kTestFile);
+}
+}
+
+int main()
+/** Headless round trips of the CPU reference encoder of the block-compressed formats and of the KTX2 reader and writer. */
+{
+    testBlockRoundTrips();
+    testSolidBlocksAreExact();
+    testImageRoundTrips();
+    testKtx2RoundTrip();
+    testKtx2Rejects();
+    return test::testResult();
+}
@@ -0,0 +1,306 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "../include/vertex_format.h"
+#include "test_check.h"
+
+namespace
+{
+// round-trip error bounds of the encodings: half a step of the normalized integers, half a unit in the last place of
+// half floats (2^-11 relative, 2^-25 absolute among subnormals), and the angles the README states for normals
+const double kUnorm16Bound = 0.5 / 65535.0 + 1e-7;
+const double kSnorm16Bound = 0.5 / 32767.0 + 1e-7;
+const double kHalfRelativeBound = std::ldexp(1.0, -11);
+const double kHalfSubnormalBound = std::ldexp(1.0, -25);
+const double kOctahedralAngleBound = 5e-5;
+const double kInt2101010AngleBound = 2e-3;
+
+double angleBetween(const float a[3], const float b[3])
+/** Angle between two unit vectors, from the cross product, which is accurate for small angles. */
+{
+    const double x = static_cast<double>(a[1]) * b[2] - static_cast<double>(a[2]) * b[1];
+    const double y = static_cast<double>(a[2]) * b[0] - static_cast<double>(a[0]) * b[2];
+    const double z = static_cast<double>(a[0]) * b[1] - static_cast<double>(a[1]) * b[0];
+    const double dot = static_cast<double>(a[0]) * b[0] + static_cast<double>(a[1]) * b[1] + static_cast<double>(a[2]) * b[2];
+    return std::atan2(std::sqrt(x * x + y * y + z * z), dot);
+}
+
+void randomUnitVector(std::mt19937 &random, float normal[3])
+{
+    std::normal_distribution<float> gaussian;
+    float length = 0.0f;
+    while (length < 1e-3f)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            normal[k] = gaussian(random);
+        }
+        length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    }
+    for (int k = 0; k < 3; k++)
+    {
+        normal[k] /= length;
+    }
+}
+
+// unit vectors on the axes, the diagonals and the edges of the octahedron, where the folding changes sides
+std::vector<std::vector<float>> specialNormals()
+{
+    std::vector<std::vector<float>> normals;
+    const float s = 1.0f / std::sqrt(2.0f);
+    const float t = 1.0f / std::sqrt(3.0f);
+    for (float x : {-1.0f, 0.0f, 1.0f})
+    {
+        for (float y : {-1.0f, 0.0f, 1.0f})
+        {
+            for (float z : {-1.0f, 0.0f, 1.0f})
+            {
+                const int nonzero = (x != 0.0f) + (y != 0.0f) + (z != 0.0f);
+                if (nonzero > 0)
+                {
+                    const float scale = nonzero == 1 ? 1.0f : nonzero == 2 ? s : t;
+                    normals.push_back({x * scale, y * scale, z * scale});
+                }
+            }
+        }
+    }
+    return normals;
+}
+
+void testUnorm16()
+{
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    double max_error = 0.0;
+    for (int i = 0; i < 200000; i++)
+    {
+        const float value = unit(random);
+        max_error = std::max(max_error, std::abs(static_cast<double>(VertexCodec::decodeUnorm16(VertexCodec::encodeUnorm16(value))) - value));
+    }
+    CHECK(max_error <= kUnorm16Bound);
+
+    // the ends are exact, values outside [0, 1] are clamped, and a value halfway between two steps rounds away from 0
+    CHECK(VertexCodec::encodeUnorm16(0.0f) == 0);
+    CHECK(VertexCodec::encodeUnorm16(1.0f) == 65535);
+    CHECK(VertexCodec::encodeUnorm16(-0.5f) == 0);
+    CHECK(VertexCodec::encodeUnorm16(2.0f) == 65535);
+    CHECK(VertexCodec::encodeUnorm16(0.5f / 65535.0f) == 1);
+    CHECK(VertexCodec::decodeUnorm16(65535) == 1.0f);
+}
+
+void testSnorm16()
+{
+    std::mt19937 random(2);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    double max_error = 0.0;
+    for (int i = 0; i < 200000; i++)
+    {
+        const float value = unit(random);
+        max_error = std::max(max_error, std::abs(static_cast<double>(VertexCodec::decodeSnorm16(VertexCodec::encodeSnorm16(value))) - value));
+    }
+    CHECK(max_error <= kSnorm16Bound);
+
+    CHECK(VertexCodec::encodeSnorm16(0.0f) == 0);
+    CHECK(VertexCodec::encodeSnorm16(1.0f) == 32767);
+    CHECK(VertexCodec::encodeSnorm16(-1.0f) == -32767);
+    CHECK(VertexCodec::encodeSnorm16(-3.0f) == -32767);
+    // -32768 is the one code below -1, GL clamps it
+    CHECK(VertexCodec::decodeSnorm16(-32768) == -1.0f);
+    CHECK(VertexCodec::decodeSnorm16(32767) == 1.0f);
+}
+
+void testHalf()
+{
+    // every half other than NaN decodes and encodes back to itself
+    int mismatches = 0;
+    for (uint32_t bits = 0; bits <= 0xFFFF; bits++)
+    {
+        const float value = VertexCodec::decodeHalf(static_cast<uint16_t>(bits));
+        if (!std::isnan(value) && VertexCodec::encodeHalf(value) != bits)
+        {
+            mismatches++;
+        }
+    }
+    CHECK(mismatches == 0);
+    CHECK(std::isnan(VertexCodec::decodeHalf(VertexCodec::encodeHalf(std::numeric_limits<float>::quiet_NaN()))));
+
+    // normal halves are off by at most half a unit in the last place
+    std::mt19937 random(3);
+    std::uniform_real_distribution<float> mantissa(1.0f, 2.0f);
+    std::uniform_int_distribution<int> exponent(-14, 15);
+    double max_relative_error = 0.0;
+    for (int i = 0; i < 200000; i++)
+    {
+        const float value = std::ldexp(mantissa(random), exponent(random));
+        if (value >= 65504.0f)
+        {
+            continue;
+        }
+        const double decoded = VertexCodec::decodeHalf(VertexCodec::encodeHalf(value));
+        max_relative_error = std::max(max_relative_error, std::abs(decoded - value) / value);
+    }
+    CHECK(max_relative_error <= kHalfRelativeBound);
+
+    // subnormal halves, steps of 2^-24 below 2^-14, are off by at most half a step
+    std::uniform_real_distribution<float> subnormal(0.0f, std::ldexp(1.0f, -14));
+    double max_subnormal_error = 0.0;
+    for (int i = 0; i < 200000; i++)
+    {
+        const float value = subnormal(random);
+        const double decoded = VertexCodec::decodeHalf(VertexCodec::encodeHalf(value));
+        max_subnormal_error = std::max(max_subnormal_error, std::abs(decoded - value));
+    }
+    CHECK(max_subnormal_error <= kHalfSubnormalBound);
+    CHECK(VertexCodec::encodeHalf(std::ldexp(1.0f, -24)) == 0x0001);
+    CHECK(VertexCodec::encodeHalf(std::ldexp(1.0f, -14)) == 0x0400);
+    CHECK(VertexCodec::encodeHalf(-std::ldexp(1.0f, -24)) == 0x8001);
+    CHECK(VertexCodec::encodeHalf(std::ldexp(1.0f, -26)) == 0x0000);
+
+    // values halfway between two halves round to the even one, in the normal and in the subnormal range
+    CHECK(VertexCodec::encodeHalf(1.0f + std::ldexp(1.0f, -11)) == 0x3C00);
+    CHECK(VertexCodec::encodeHalf(1.0f + 3.0f * std::ldexp(1.0f, -11)) == 0x3C02);
+    CHECK(VertexCodec::encodeHalf(1.0f + std::ldexp(1.0f, -11) + std::ldexp(1.0f, -20)) == 0x3C01);
+    CHECK(VertexCodec::encodeHalf(std::ldexp(1.0f, -25)) == 0x0000);
+    CHECK(VertexCodec::encodeHalf(3.0f * std::ldexp(1.0f, -25)) == 0x0002);
+    CHECK(VertexCodec::encodeHalf(5.0f * std::ldexp(1.0f, -25)) == 0x0002);
+    // the largest subnormal rounded up carries into the exponent, the largest half rounded up overflows
+    CHECK(VertexCodec::encodeHalf(std::ldexp(1.0f, -14) - std::ldexp(1.0f, -25)) == 0x0400);
+    CHECK(VertexCodec::encodeHalf(2.0f - std::ldexp(1.0f, -12)) == 0x4000);
+    CHECK(VertexCodec::encodeHalf(65504.0f) == 0x7BFF);
+    CHECK(VertexCodec::encodeHalf(65519.0f) == 0x7BFF);
+    CHECK(VertexCodec::encodeHalf(65520.0f) == 0x7C00);
+    CHECK(VertexCodec::encodeHalf(-1e10f) == 0xFC00);
+}
+
+void testNormals()
+{
+    std::vector<std::vector<float>> normals = specialNormals();
+    std::mt19937 random(4);
+    for (int i = 0; i < 200000; i++)
+    {
+        float normal[3];
+        randomUnitVector(random, normal);
+        normals.push_back({normal[0], normal[1], normal[2]});
+    }
+
+    double max_octahedral_angle = 0.0;
+    double max_int2101010_angle = 0.0;
+    for (const std::vector<float> &normal : normals)
+    {
+        int16_t octahedral[2];
+        VertexCodec::encodeOctahedral(normal.data(), octahedral);
+        float decoded[3];
+        VertexCodec::decodeOctahedral(octahedral, decoded);
+        max_octahedral_angle = std::max(max_octahedral_angle, angleBetween(decoded, normal.data()));
+
+        VertexCodec::decodeInt2101010(VertexCodec::encodeInt2101010(normal.data()), decoded);
+        const float length = std::sqrt(decoded[0] * decoded[0] + decoded[1] * decoded[1] + decoded[2] * decoded[2]);
+        for (float &component : decoded)
+        {
+            component /= length;
+        }
+        max_int2101010_angle = std::max(max_int2101010_angle, angleBetween(decoded, normal.data()));
+    }
+    CHECK(max_octahedral_angle <= kOctahedralAngleBound);
+    CHECK(max_int2101010_angle <= kInt2101010AngleBound);
+
+    // the axes are exact in both encodings
+    for (const std::vector<float> &normal : specialNormals())
+    {
+        if (std::abs(normal[0]) + std::abs(normal[1]) + std::abs(normal[2]) == 1.0f)
+        {
+            int16_t octahedral[2];
+            VertexCodec::encodeOctahedral(normal.data(), octahedral);
+            float decoded[3];
+            VertexCodec::decodeOctahedral(octahedral, decoded);
+            CHECK(std::equal(decoded, decoded + 3, normal.begin()));
+            VertexCodec::decodeInt2101010(VertexCodec::encodeInt2101010(normal.data()), decoded);
+            CHECK(std::equal(decoded, decoded + 3, normal.begin()));
+        }
+    }
+    // -512 is the one 10-bit code below -1, GL clamps it
+    float decoded[3];
+    VertexCodec::decodeInt2101010(0x200u | (0x200u << 10) | (0x200u << 20), decoded);
+    CHECK(decoded[0] == -1.0f && decoded[1] == -1.0f && decoded[2] == -1.0f);
+}
+
+void testInterleavedMesh()
+/** Encodes a mesh in the plane layout and in one with every other encoding, and decodes it the way GL does: positions
+relative to the bounding box are off by half a step of it at most. */
+{
+    std::mt19937 random(5);
+    std::uniform_real_distribution<float> coordinate(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const size_t count = 10000;
+    std::vector<float> positions(3 * count);
+    std::vector<float> normals(3 * count);
+    std::vector<float> texture_coordinates(2 * count);
+    for (size_t v = 0; v < count; v++)
+    {
+        positions[3 * v + 0] = 5.0f * coordinate(random);
+        positions[3 * v + 1] = 2.0f + 0.3f * coordinate(random);
+        positions[3 * v + 2] = 20.0f * coordinate(random);
+        randomUnitVector(random, &normals[3 * v]);
+        texture_coordinates[2 * v + 0] = unit(random);
+        texture_coordinates[2 * v + 1] = unit(random);
+    }
+    const MeshBounds bounds = MeshBounds::compute(positions);
+    const VertexStream streams[kMeshAttributeCount] = {{positions.data(), 3}, {normals.data(), 3}, {texture_coordinates.data(), 2}};
+
+    const VertexLayout layouts[] = {
+            VertexLayout(kVertexEncodingUnorm16, kVertexEncodingOctahedral16, kVertexEncodingNone),
+            VertexLayout(kVertexEncodingFloat, kVertexEncodingInt2101010, kVertexEncodingHalf),
+            VertexLayout(kVertexEncodingUnorm16, kVertexEncodingFloat, kVertexEncodingUnorm16)};
+    for (const VertexLayout &layout : layouts)
+    {
+        const VertexDequantization dequantization = layout.dequantizationFor(bounds);
+        std::vector<uint8_t> vertices(count * layout.stride());
+        VertexCodec::encode(layout, dequantization, streams, count, vertices.data());
+
+        const bool quantized = layout.attribute(kMeshAttributePosition).encoding == kVertexEncodingUnorm16;
+        const bool has_texture_coordinates = layout.attribute(kMeshAttributeTexcoord).encoding != kVertexEncodingNone;
+        double max_position_error = 0.0;
+        double max_normal_angle = 0.0;
+        double max_texcoord_error = 0.0;
+        for (size_t v = 0; v < count; v++)
+        {
+            float position[3];
+            float normal[3];
+            float texcoord[2];
+            VertexCodec::decode(layout, dequantization, &vertices[v * layout.stride()], position, normal, texcoord);
+            for (int k = 0; k < 3; k++)
+            {
+                const double extent = quantized ? bounds.max[k] - bounds.min[k] : 1.0;
+                max_position_error = std::max(max_position_error, std::abs(position[k] - positions[3 * v + k]) / extent);
+            }
+            max_normal_angle = std::max(max_normal_angle, angleBetween(normal, &normals[3 * v]));
+            for (int k = 0; k < 2 && has_texture_coordinates; k++)
+            {
+                max_texcoord_error = std::max(max_texcoord_error, std::abs(static_cast<double>(texcoord[k]) - texture_coordinates[2 * v + k]));
+            }
+        }
+        // float positions are exact; quantized ones get float rounding of offset + scale * position on top of the step
+        CHECK(max_position_error <= (quantized ? kUnorm16Bound + 1e-6 : 0.0));
+        CHECK(max_normal_angle <= kInt2101010AngleBound);
+        CHECK(max_texcoord_error <= kHalfRelativeBound);
+        CHECK(layout.stride() % 4 == 0);
+    }
+    CHECK(layouts[0].stride() == 12);
+}
+}
+
+int main()
+/** Round-trip error bounds of the vertex encodings of VertexCodec. */
+{
+    testUnorm16();
+    testSnorm16();
+    testHalf();
+    testNormals();
+    testInterleavedMesh();
+    return test::testResult();
+}
@@ -0,0 +1,299 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "../include/virtual_texture_cache.h"
+#include "../include/virtual_texture_file.h"
+#include "test_check.h"
+
+namespace
+{
+const char* kTestFile = "virtual_texture_test.vtex";
+
+void testLayout()
+/** Pages of all levels are numbered densely, level by level, until the smaller side is a single page. */
+{
+    CHECK(VirtualTextureLayout::isValid(1024, 512, 128));
+    CHECK(!VirtualTextureLayout::isValid(384, 128, 128));
+    CHECK(!VirtualTextureLayout::isValid(1000, 512, 128));
+    CHECK(!VirtualTextureLayout::isValid(1024, 512, 0));
+
+    const VirtualTextureLayout layout(1024, 512, 128);
+    CHECK(layout.levelCount() == 3);
+    CHECK(layout.pagesX(0) == 8 && layout.pagesY(0) == 4);
+    CHECK(layout.pagesX(2) == 2 && layout.pagesY(2) == 1);
+    CHECK(layout.pageCount() == 32 + 8 + 2);
+
+    std::vector<int> indices;
+    for (int level = 0; level < layout.levelCount(); level++)
+    {
+        for (int y = 0; y < layout.pagesY(level); y++)
+        {
+            for (int x = 0; x < layout.pagesX(level); x++)
+            {
+                const VirtualPageId page = VirtualTextureLayout::pageId(level, x, y);
+                CHECK(VirtualTextureLayout::pageLevel(page) == level && VirtualTextureLayout::pageX(page) == x &&
+                      VirtualTextureLayout::pageY(page) == y);
+                indices.push_back(layout.pageIndex(page));
+            }
+        }
+    }
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        CHECK(indices[i] == static_cast<int>(i));
+    }
+    CHECK(VirtualTextureLayout::parentOf(VirtualTextureLayout::pageId(0, 5, 3)) == VirtualTextureLayout::pageId(1, 2, 1));
+}
+
+void testPageTable()
+/** The indirection of a resident page points to its atlas slot, the other pages fall back to their closest resident
+ancestor, and pages without one stay empty. */
+{
+    const VirtualTextureLayout layout(1024, 512, 128);
+    VirtualTexturePageTable table(layout, 4);
+    CHECK(table.isDirty());
+    std::vector<std::vector<uint8_t>> indirection = table.buildIndirection();
+    CHECK(!table.isDirty());
+    CHECK(indirection.size() == 3);
+    CHECK(indirection[0].size() == 8 * 4 * 4 && indirection[2].size() == 2 * 1 * 4);
+    for (const std::vector<uint8_t> &level : indirection)
+    {
+        CHECK(std::all_of(level.begin(), level.end(), [](uint8_t value) { return value == 0; }));
+    }
+
+    table.map(VirtualTextureLayout::pageId(2, 1, 0), 1);
+    table.map(VirtualTextureLayout::pageId(0, 5, 3), 6);
+    CHECK(table.isDirty());
+    CHECK(table.slotOf(VirtualTextureLayout::pageId(0, 5, 3)) == 6);
+    CHECK(!table.isResident(VirtualTextureLayout::pageId(0, 4, 3)));
+    indirection = table.buildIndirection();
+
+    auto entry = [&indirection, &layout](int level, int x, int y)
+    {
+        const size_t offset = (static_cast<size_t>(y) * static_cast<size_t>(layout.pagesX(level)) + static_cast<size_t>(x)) * 4;
+        return std::vector<uint8_t>(indirection[static_cast<size_t>(level)].begin() + static_cast<long>(offset),
+                                    indirection[static_cast<size_t>(level)].begin() + static_cast<long>(offset + 4));
+    };
+    // slot 6 is column 2, row 1 of an atlas 4 slots wide
+    CHECK(entry(0, 5, 3) == std::vector<uint8_t>({2, 1, 0, 255}));
+    CHECK(entry(2, 1, 0) == std::vector<uint8_t>({1, 0, 2, 255}));
+    CHECK(entry(1, 2, 1) == std::vector<uint8_t>({1, 0, 2, 255}));
+    CHECK(entry(0, 4, 3) == std::vector<uint8_t>({1, 0, 2, 255}));
+    CHECK(entry(0, 7, 0) == std::vector<uint8_t>({1, 0, 2, 255}));
+    CHECK(entry(2, 0, 0) == std::vector<uint8_t>({0, 0, 0, 0}));
+    CHECK(entry(0, 0, 0) == std::vector<uint8_t>({0, 0, 0, 0}));
+
+    table.unmap(VirtualTextureLayout::pageId(0, 5, 3));
+    CHECK(!table.isResident(VirtualTextureLayout::pageId(0, 5, 3)));
+    indirection = table.buildIndirection();
+    CHECK(entry(0, 5, 3) == std::vector<uint8_t>({1, 0, 2, 255}));
+}
+
+void testEviction()
+/** With every slot taken, a miss evicts the least recently used page. Pinned pages and pages used in the current frame
+are never evicted, and requesting a page keeps its resident ancestors alive. */
+{
+    const VirtualTextureLayout layout(1024, 512, 128);
+    VirtualTextureCache cache(layout, 2, 3);
+    VirtualTexturePageTable &table = cache.pageTable();
+    const VirtualPageId coarsest[2] = {VirtualTextureLayout::pageId(2, 0, 0), VirtualTextureLayout::pageId(2, 1, 0)};
+    const VirtualPageId a = VirtualTextureLayout::pageId(0, 0, 0);
+    const VirtualPageId b = VirtualTextureLayout::pageId(0, 1, 0);
+    const VirtualPageId c = VirtualTextureLayout::pageId(0, 2, 0);
+    const VirtualPageId d = VirtualTextureLayout::pageId(0, 3, 0);
+    const VirtualPageId e = VirtualTextureLayout::pageId(1, 3, 1);
+    const VirtualPageId f = VirtualTextureLayout::pageId(0, 6, 3);
+    const VirtualPageId g = VirtualTextureLayout::pageId(0, 7, 3);
+
+    cache.beginFrame();
+    for (VirtualPageId page : coarsest)
+    {
+        CHECK(cache.allocate(page) >= 0);
+        cache.pin(page);
+    }
+    CHECK(cache.allocate(a) == 2);
+    CHECK(cache.allocate(e) == 3);
+    CHECK(cache.allocate(coarsest[0]) == 0);
+
+    cache.beginFrame();
+    CHECK(cache.allocate(b) == 4);
+    cache.beginFrame();
+    CHECK(cache.allocate(c) == 5);
+    CHECK(cache.stats().pages_resident == 6);
+
+    // a and then e are the least recently used pages; the missing f is a page under e, so requesting it refreshes e
+    cache.beginFrame();
+    cache.request(a);
+    cache.request(f);
+    cache.request(b);
+    CHECK(cache.stats().pages_requested == 3 && cache.stats().pages_hit == 2 && cache.stats().pages_missed == 1);
+    CHECK(cache.takeMisses(8) == std::vector<VirtualPageId>({f}));
+
+    // c is the least recently used page now
+    CHECK(cache.allocate(d) == 5);
+    CHECK(!table.isResident(c));
+    CHECK(cache.stats().pages_evicted == 1);
+
+    // every unpinned page has been used in this frame
+    CHECK(cache.allocate(g) == -1);
+    CHECK(!table.isResident(g));
+
+    // pinned pages outlive frames in which they aren't requested, while all unpinned pages are replaced
+    for (int frame = 0; frame < 3; frame++)
+    {
+        cache.beginFrame();
+        for (int x = 0; x < 4; x++)
+        {
+            const VirtualPageId page = VirtualTextureLayout::pageId(0, x, 1);
+            cache.request(page);
+        }
+        for (VirtualPageId page : cache.takeMisses(2))
+        {
+            CHECK(cache.allocate(page) >= 0);
+        }
+    }
+    for (int x = 0; x < 4; x++)
+    {
+        CHECK(table.isResident(VirtualTextureLayout::pageId(0, x, 1)));
+    }
+    CHECK(table.slotOf(coarsest[0]) == 0 && table.slotOf(coarsest[1]) == 1);
+    CHECK(cache.stats().pages_resident == 6);
+}
+
+void testMissOrder()
+/** Misses are handed out coarse levels first, at most the number asked for. */
+{
+    const VirtualTextureLayout layout(1024, 512, 128);
+    VirtualTextureCache cache(layout, 4, 4);
+    cache.beginFrame();
+    const VirtualPageId fine = VirtualTextureLayout::pageId(0, 1, 1);
+    const VirtualPageId middle = VirtualTextureLayout::pageId(1, 1, 1);
+    const VirtualPageId coarse = VirtualTextureLayout::pageId(2, 1, 0);
+    cache.request(fine);
+    cache.request(middle);
+    cache.request(fine);
+    cache.request(coarse);
+    CHECK(cache.stats().pages_requested == 3);
+    CHECK(cache.takeMisses(2) == std::vector<VirtualPageId>({coarse, middle}));
+    CHECK(cache.takeMisses(2).empty());
+}
+
+ImageData testImage(int width, int height, int channels)
+{
+    ImageData image;
+    image.width = width;
+    image.height = height;
+    image.channels = channels;
+    image.pixels.resize(static_cast<size_t>(width) * static_cast<size_t>(height) * static_cast<size_t>(channels));
+    for (size_t i = 0; i < image.pixels.size(); i++)
+    {
+        image.pixels[i] = static_cast<uint8_t>((i * 7 + i / 97) & 0xFF);
+    }
+    return image;
+}
+
+void testFileRoundTrip()
+/** Every tile read back from a .vtex file holds its page of the mip level with a border that wraps around horizontally
+and is clamped vertically. */
+{
+    const int page_size = 32;
+    const int border = 4;
+    const ImageData image = testImage(256, 64, 3);
+    CHECK(VirtualTextureFile::write(kTestFile, image, page_size, border));
+
+    VirtualTextureFile file;
+    CHECK(file.open(kTestFile));
+    CHECK(file.header().width == 256 && file.header().height == 64 && file.header().channels == 3);
+    CHECK(file.layout().levelCount() == 2 && file.layout().pageCount() == 16 + 4);
+    CHECK(file.tileSize() == 40 && file.tileBytes() == 40 * 40 * 3);
+
+    const std::vector<ImageData> levels = TextureCodec::buildMipChain(image);
+    bool tiles_match = true;
+    for (int level = 0; level < file.layout().levelCount() && file.isOpen(); level++)
+    {
+        const ImageData &source = levels[static_cast<size_t>(level)];
+        for (int page_y = 0; page_y < file.layout().pagesY(level); page_y++)
+        {
+            for (int page_x = 0; page_x < file.layout().pagesX(level); page_x++)
+            {
+                const uint8_t* tile = file.tileData(VirtualTextureLayout::pageId(level, page_x, page_y));
+                for (int y = 0; y < file.tileSize(); y++)
+                {
+                    for (int x = 0; x < file.tileSize(); x++)
+                    {
+                        const int source_x = (page_x * page_size + x - border + source.width) % source.width;
+                        const int source_y = std::min(std::max(page_y * page_size + y - border, 0), source.height - 1);
+                        const size_t texel = (static_cast<size_t>(source_y) * static_cast<size_t>(source.width) + static_cast<size_t>(source_x)) * 3;
+                        const size_t tile_texel = (static_cast<size_t>(y) * static_cast<size_t>(file.tileSize()) + static_cast<size_t>(x)) * 3;
+                        tiles_match = tiles_match && std::equal(tile + tile_texel, tile + tile_texel + 3, source.pixels.begin() + static_cast<long>(texel));
+                    }
+                }
+            }
+        }
+    }
+    CHECK(tiles_match);
+    file.close();
+    CHECK(!file.isOpen());
+    std::remove(kTestFile);
+
+    CHECK(!VirtualTextureFile::write(kTestFile, testImage(96, 32, 3), page_size, border));
+    CHECK(!std::ifstream(kTestFile));
+}
+
+std::vector<uint8_t> readFile(const std::string &filepath)
+{
+    std::ifstream file(filepath, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void writeFile(const std::string &filepath, const std::vector<uint8_t> &bytes)
+{
+    std::ofstream file(filepath, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+}
+
+void testFileRejects()
+/** Missing files, other files, other versions and files cut short anywhere are rejected. */
+{
+    VirtualTextureFile file;
+    CHECK(!file.open("virtual_texture_test_missing.vtex"));
+
+    CHECK(VirtualTextureFile::write(kTestFile, testImage(64, 64, 1), 32, 2));
+    const std::vector<uint8_t> valid = readFile(kTestFile);
+    CHECK(file.open(kTestFile));
+    file.close();
+
+    for (size_t size : {valid.size() - 1, valid.size() / 2, sizeof(VirtualTextureHeader), sizeof(VirtualTextureHeader) - 1, size_t(8)})
+    {
+        writeFile(kTestFile, std::vector<uint8_t>(valid.begin(), valid.begin() + static_cast<long>(size)));
+        CHECK(!file.open(kTestFile));
+        CHECK(!file.isOpen());
+    }
+
+    std::vector<uint8_t> bad_magic = valid;
+    bad_magic[0] = 'X';
+    writeFile(kTestFile, bad_magic);
+    CHECK(!file.open(kTestFile));
+
+    std::vector<uint8_t> other_version = valid;
+    other_version[4] = static_cast<uint8_t>(VirtualTextureFile::kVersion + 1);
+    writeFile(kTestFile, other_version);
+    CHECK(!file.open(kTestFile));
+    std::remove(kTestFile);
+}
+}
+
+int main()
+/** Headless tests of the virtual texture page table, the residency of pages in the atlas and the .vtex page pyramids. */
+{
+    testLayout();
+    testPageTable();
+    testEviction();
+    testMissOrder();
+    testFileRoundTrip();
+    testFileRejects();
+    return test::testResult();
+}
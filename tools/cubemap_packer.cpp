@@ -0,0 +1,61 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../include/cubemap_file.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+int main(int argc, char** argv)
+/** Offline packer of the six faces of a cube map into one .cubemap file, loaded by project_4 instead of the faces.
+Usage: cubemap_packer <+x> <-x> <+y> <-y> <+z> <-z> [output.cubemap]
+Without an output path the file is written next to the directory of the faces (see CubemapFile::pathFor()). */
+{
+    if (argc != 1 + CubemapFile::kFaceCount && argc != 2 + CubemapFile::kFaceCount)
+    {
+        std::cout << "Usage: " << argv[0] << " <+x> <-x> <+y> <-y> <+z> <-z> [output.cubemap]" << std::endl;
+        return 1;
+    }
+    const std::vector<std::string> face_filepaths(argv + 1, argv + 1 + CubemapFile::kFaceCount);
+    const std::string cubemap_filepath = argc == 2 + CubemapFile::kFaceCount ? argv[1 + CubemapFile::kFaceCount]
+                                                                             : CubemapFile::pathFor(face_filepaths);
+    if (cubemap_filepath.empty())
+    {
+        std::cerr << "The faces aren't in a directory of their own, an output path is needed" << std::endl;
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    // OpenGL expects the first row at the bottom, the same flip the application applies to decoded images
+    stbi_set_flip_vertically_on_load(true);
+    std::vector<ImageData> faces;
+    for (const std::string &face_filepath : face_filepaths)
+    {
+        int width, height, channels;
+        unsigned char* data = stbi_load(face_filepath.c_str(), &width, &height, &channels, 0);
+        if (!data)
+        {
+            std::cerr << "Failed to load " << face_filepath << ": " << stbi_failure_reason() << std::endl;
+            return 1;
+        }
+        ImageData face;
+        face.width = width;
+        face.height = height;
+        face.channels = channels;
+        face.pixels.assign(data, data + static_cast<size_t>(width) * static_cast<size_t>(height) * static_cast<size_t>(channels));
+        stbi_image_free(data);
+        faces.push_back(std::move(face));
+    }
+
+    if (!CubemapFile::write(cubemap_filepath, faces))
+    {
+        return 1;
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Written " << cubemap_filepath << ": 6 faces of " << faces[0].width << "x" << faces[0].height << " with "
+              << faces[0].channels << " channels, " << ((faces[0].pixels.size() * faces.size()) >> 10) << " KB in " << seconds
+              << " s" << std::endl;
+    return 0;
+}
@@ -0,0 +1,35 @@
+#include <iostream>
+#include <string>
+
+#include "../include/mesh_cache.h"
+
+int main(int argc, char** argv)
+/** Offline converter from .obj files to the binary mesh cache format loaded by project_4, with the vertices in the
+default layout of the scene objects.
+Usage: mesh_converter <input.obj> [output.meshcache] */
+{
+    if (argc < 2 || argc > 3)
+    {
+        std::cout << "Usage: " << argv[0] << " <input.obj> [output.meshcache]" << std::endl;
+        return 1;
+    }
+
+    const std::string obj_filepath = argv[1];
+    const std::string cache_filepath = argc == 3 ? argv[2] : MeshCache::cachePathFor(obj_filepath);
+
+    try
+    {
+        if (!MeshCache::build(obj_filepath, cache_filepath, MeshCache::defaultLayout()))
+        {
+            return 1;
+        }
+    }
+    catch (const std::string &error)
+    {
+        std::cerr << "Failed to convert " << obj_filepath << ": " << error << std::endl;
+        return 1;
+    }
+
+    std::cout << "Written " << cache_filepath << std::endl;
+    return 0;
+}
@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../include/orbit_set.h"
+
+namespace
+{
+// the same local transform the planes use
+glm::mat4 localMatrix()
+{
+    glm::mat4 model = glm::mat4(1.0f);
+    model = glm::rotate(model, glm::radians(-180.0f), glm::vec3(0.0, 1.0, 0.0));
+    model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0, 0.0, 0.0));
+    model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));
+    return model;
+}
+
+void computeTransformsGlm(const OrbitSet &orbits, const glm::mat4 &local, float* rows)
+/** The transforms built one orbit at a time with a chain of glm calls, the way the planes were animated before
+OrbitSet, written in the layout of OrbitSet::computeTransforms. */
+{
+    const size_t count = orbits.size();
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::rotate(model, glm::radians(orbits.inclination()[i]), glm::vec3(1.0, 0.0, 0.0));
+        model = glm::rotate(model, glm::radians(orbits.phase()[i]), glm::vec3(0.0, 1.0, 0.0));
+        model = glm::translate(model, glm::vec3(0.0f, 0.0f, -orbits.radius()[i]));
+        model = model * local;
+        for (int row = 0; row < 3; row++)
+        {
+            for (int column = 0; column < 4; column++)
+            {
+                rows[(row * count + i) * 4 + column] = model[column][row];
+            }
+        }
+    }
+}
+
+template<typename Compute>
+double nanosecondsPerOrbit(OrbitSet &orbits, int iterations, Compute compute)
+/** Runs compute once to warm up and then iterations times, advancing the orbits in between like the application does. */
+{
+    compute();
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        orbits.advance(1.0f);
+        compute();
+    }
+    const auto end = std::chrono::steady_clock::now();
+    const double nanoseconds = std::chrono::duration<double, std::nano>(end - start).count();
+    return nanoseconds / (static_cast<double>(iterations) * static_cast<double>(orbits.size()));
+}
+
+float maxDifference(const std::vector<float> &a, const std::vector<float> &b)
+{
+    float difference = 0.0f;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        difference = std::max(difference, std::fabs(a[i] - b[i]));
+    }
+    return difference;
+}
+}
+
+int main(int argc, char** argv)
+/** Microbenchmark of the orbit transform update: the glm chain against the scalar and SIMD kernels of OrbitSet.
+Usage: orbit_benchmark [--orbits N] [--iterations N] */
+{
+    int orbit_count = 10000;
+    int iterations = 1000;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--orbits") == 0 && i + 1 < argc)
+        {
+            orbit_count = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+        {
+            iterations = std::atoi(argv[++i]);
+        }
+        else
+        {
+            orbit_count = 0;
+            break;
+        }
+    }
+
+    if (orbit_count <= 0 || iterations <= 0)
+    {
+        std::cout << "Usage: " << argv[0] << " [--orbits N] [--iterations N]" << std::endl;
+        return 1;
+    }
+
+    // the same distribution as the planes
+    OrbitSet orbits;
+    std::mt19937 random(4);
+    std::uniform_real_distribution<float> radius(4.0f, 9.0f);
+    std::uniform_real_distribution<float> inclination(-70.0f, 70.0f);
+    std::uniform_real_distribution<float> phase(0.0f, 360.0f);
+    std::uniform_real_distribution<float> speed(0.2f, 0.8f);
+    for (int i = 0; i < orbit_count; i++)
+    {
+        orbits.add(radius(random), inclination(random), phase(random), speed(random));
+    }
+
+    const glm::mat4 local = localMatrix();
+    std::vector<float> reference(orbits.size() * 12);
+    std::vector<float> rows(orbits.size() * 12);
+
+    std::cout << orbit_count << " orbits, " << iterations << " iterations, best kernel "
+              << OrbitSet::kernelName(OrbitSet::bestKernel()) << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+
+    const double glm_time = nanosecondsPerOrbit(orbits, iterations, [&]() { computeTransformsGlm(orbits, local, rows.data()); });
+    std::cout << "glm     " << std::setw(8) << glm_time << " ns/orbit" << std::endl;
+
+    for (OrbitKernel kernel : {kOrbitKernelScalar, kOrbitKernelSSE2, kOrbitKernelAVX2})
+    {
+        if (!OrbitSet::isSupported(kernel))
+        {
+            std::cout << std::left << std::setw(8) << OrbitSet::kernelName(kernel) << std::right << "not supported" << std::endl;
+            continue;
+        }
+        const double time = nanosecondsPerOrbit(orbits, iterations, [&]() { orbits.computeTransforms(local, rows.data(), 0.0f, kernel); });
+
+        // differences are measured on the same phases for both, against the glm chain
+        computeTransformsGlm(orbits, local, reference.data());
+        orbits.computeTransforms(local, rows.data(), 0.0f, kernel);
+        std::cout << std::left << std::setw(8) << OrbitSet::kernelName(kernel) << std::right << std::setw(8) << time
+                  << " ns/orbit, " << std::setw(6) << glm_time / time << "x the glm chain, max difference "
+                  << std::scientific << maxDifference(reference, rows) << std::fixed << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../include/ktx2.h"
+#include "../include/texture_codec.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+namespace
+{
+// maximum difference between colour channels for an image to still be treated as grey
+const int kGreyTolerance = 8;
+
+bool parseFormat(const std::string &name, TextureFormat &format)
+{
+    if (name == "bc1") { format = kTextureFormatBC1; return true; }
+    if (name == "bc3") { format = kTextureFormatBC3; return true; }
+    if (name == "bc4") { format = kTextureFormatBC4; return true; }
+    if (name == "bc7") { format = kTextureFormatBC7; return true; }
+    return false;
+}
+
+bool isGrey(const ImageData &image)
+{
+    if (image.channels < 3)
+    {
+        return image.channels == 1;
+    }
+    const size_t texels = static_cast<size_t>(image.width) * static_cast<size_t>(image.height);
+    for (size_t i = 0; i < texels; i++)
+    {
+        const uint8_t* texel = image.pixels.data() + i * static_cast<size_t>(image.channels);
+        if (std::abs(texel[0] - texel[1]) > kGreyTolerance || std::abs(texel[0] - texel[2]) > kGreyTolerance)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool hasAlpha(const ImageData &image)
+{
+    if (image.channels != 4)
+    {
+        return false;
+    }
+    for (size_t i = 3; i < image.pixels.size(); i += 4)
+    {
+        if (image.pixels[i] != 255)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+ImageData toSingleChannel(const ImageData &image)
+{
+    ImageData grey;
+    grey.width = image.width;
+    grey.height = image.height;
+    grey.channels = 1;
+    const size_t texels = static_cast<size_t>(image.width) * static_cast<size_t>(image.height);
+    grey.pixels.resize(texels);
+    for (size_t i = 0; i < texels; i++)
+    {
+        grey.pixels[i] = image.pixels[i * static_cast<size_t>(image.channels)];
+    }
+    return grey;
+}
+}
+
+int main(int argc, char** argv)
+/** Offline compressor from images to KTX2 files with a block-compressed mip chain, loaded by project_4 instead of the images.
+Usage: texture_compressor [--format auto|bc1|bc3|bc4|bc7] <input image> [output.ktx2]
+The automatic format is BC4 for grey images, BC3 for images with alpha and BC1 otherwise. */
+{
+    std::string format_name = "auto";
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+        {
+            format_name = argv[++i];
+        }
+        else
+        {
+            paths.emplace_back(argv[i]);
+        }
+    }
+
+    TextureFormat format = kTextureFormatBC1;
+    if (paths.empty() || paths.size() > 2 || (format_name != "auto" && !parseFormat(format_name, format)))
+    {
+        std::cout << "Usage: " << argv[0] << " [--format auto|bc1|bc3|bc4|bc7] <input image> [output.ktx2]" << std::endl;
+        return 1;
+    }
+
+    const std::string image_filepath = paths[0];
+    const std::string ktx2_filepath = paths.size() == 2 ? paths[1] : Ktx2File::pathFor(image_filepath);
+
+    // OpenGL expects the first row at the bottom, the same flip the application applies to decoded images
+    stbi_set_flip_vertically_on_load(true);
+    int width, height, channels;
+    unsigned char* data = stbi_load(image_filepath.c_str(), &width, &height, &channels, 0);
+    if (!data)
+    {
+        std::cerr << "Failed to load " << image_filepath << ": " << stbi_failure_reason() << std::endl;
+        return 1;
+    }
+    ImageData image;
+    image.width = width;
+    image.height = height;
+    image.channels = channels;
+    image.pixels.assign(data, data + static_cast<size_t>(width) * static_cast<size_t>(height) * static_cast<size_t>(channels));
+    stbi_image_free(data);
+
+    if (format_name == "auto")
+    {
+        format = isGrey(image) ? kTextureFormatBC4 : (hasAlpha(image) ? kTextureFormatBC3 : kTextureFormatBC1);
+    }
+    if (format == kTextureFormatBC4 && image.channels != 1)
+    {
+        image = toSingleChannel(image);
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const std::vector<ImageData> mip_chain = TextureCodec::buildMipChain(image);
+    std::vector<std::vector<uint8_t>> levels;
+    size_t compressed_size = 0;
+    size_t uncompressed_size = 0;
+    for (const ImageData &level : mip_chain)
+    {
+        levels.push_back(TextureCodec::compress(level, format));
+        compressed_size += levels.back().size();
+        uncompressed_size += level.pixels.size();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (!Ktx2File::write(ktx2_filepath, format, width, height, levels))
+    {
+        return 1;
+    }
+
+    const ImageData decoded = TextureCodec::decompress(levels[0].data(), width, height, format);
+    const int compared_channels = format == kTextureFormatBC4 ? 1 : (format == kTextureFormatBC1 ? std::min(3, image.channels) : image.channels);
+    std::cout << "Written " << ktx2_filepath << ": " << TextureCodec::name(format) << ", " << width << "x" << height
+              << ", " << levels.size() << " levels, " << (uncompressed_size >> 10) << " KB -> " << (compressed_size >> 10)
+              << " KB in " << seconds << " s, level 0 PSNR " << TextureCodec::psnr(image, decoded, compared_channels) << " dB" << std::endl;
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../include/virtual_texture_file.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+int main(int argc, char** argv)
+/** Offline tiler from an image to the page pyramid of a virtual texture (.vtex), streamed by project_4 instead of the image.
+Usage: virtual_texture_tiler [--page-size N] [--border N] <input image> [output.vtex] */
+{
+    int page_size = 128;
+    int border = 4;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "--page-size") == 0 && i + 1 < argc)
+        {
+            page_size = std::atoi(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--border") == 0 && i + 1 < argc)
+        {
+            border = std::atoi(argv[++i]);
+        }
+        else
+        {
+            paths.emplace_back(argv[i]);
+        }
+    }
+
+    if (paths.empty() || paths.size() > 2 || page_size <= 0 || border < 0)
+    {
+        std::cout << "Usage: " << argv[0] << " [--page-size N] [--border N] <input image> [output.vtex]" << std::endl;
+        return 1;
+    }
+
+    const std::string image_filepath = paths[0];
+    const std::string vtex_filepath = paths.size() == 2 ? paths[1] : VirtualTextureFile::pathFor(image_filepath);
+
+    // OpenGL expects the first row at the bottom, the same flip the application applies to decoded images
+    stbi_set_flip_vertically_on_load(true);
+    int width, height, channels;
+    unsigned char* data = stbi_load(image_filepath.c_str(), &width, &height, &channels, 0);
+    if (!data)
+    {
+        std::cerr << "Failed to load " << image_filepath << ": " << stbi_failure_reason() << std::endl;
+        return 1;
+    }
+    ImageData image;
+    image.width = width;
+    image.height = height;
+    image.channels = channels;
+    image.pixels.assign(data, data + static_cast<size_t>(width) * static_cast<size_t>(height) * static_cast<size_t>(channels));
+    stbi_image_free(data);
+
+    if (!VirtualTextureFile::write(vtex_filepath, image, page_size, border))
+    {
+        return 1;
+    }
+
+    const VirtualTextureLayout layout(width, height, page_size);
+    std::cout << "Written " << vtex_filepath << ": " << width << "x" << height << ", " << layout.levelCount() << " levels, "
+              << layout.pageCount() << " pages of " << page_size << "x" << page_size << " texels" << std::endl;
+    return 0;
+}